@@ -3,6 +3,7 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/spi.h>
 #include <zephyr/drivers/gpio.h>
+#include <eeg_codec.h>
 
 #define DT_DRV_COMPAT ti_ads1299
 #define ADS1299_CMD_DELAY_US 30
@@ -162,14 +163,14 @@ static void ads1299_readout_work_handler(struct k_work *work)
     spi_transceive(data->spi, data->spi_cfg, &tx_set, &rx_set);
     //gpio_pin_set_dt(&data->cs_gpios, 0);   // CS inactive
 
+    // status word + sign-extended samples, see common/eeg_codec.h
+    int32_t vals[EEG_CHANNELS];
+    eeg_codec_ads_frame(rx_buf, EEG_CHANNELS, vals);
+
     // Accumulate baseline for 500 samples
     if (!baseline_captured) {
         for (int ch = 0; ch < EEG_CHANNELS; ch++) {
-            int32_t val = (rx_buf[3 + 3*ch] << 16) |
-                          (rx_buf[3 + 3*ch + 1] << 8) |
-                          rx_buf[3 + 3*ch + 2];
-            if (val & 0x800000) val |= 0xFF000000; // sign extend
-            baseline_accum[ch] += val;
+            baseline_accum[ch] += vals[ch];
         }
 
         baseline_count++;
@@ -185,12 +186,7 @@ static void ads1299_readout_work_handler(struct k_work *work)
 
     //Stream channel data with baseline removed
     for (int ch = 0; ch < EEG_CHANNELS; ch++) {
-        int32_t val = (rx_buf[3 + 3*ch] << 16) |
-                      (rx_buf[3 + 3*ch + 1] << 8) |
-                      rx_buf[3 + 3*ch + 2];
-        if (val & 0x800000) val |= 0xFF000000; // sign extend
-
-        val -= channel_baseline[ch]; // remove DC offset
+        int32_t val = vals[ch] - channel_baseline[ch]; // remove DC offset
 
         LOG_INF("CH%d: %d", ch+1, val);
     }
@@ -0,0 +1,721 @@
+/*
+ * ANA EEG sticker - emulated ADS1299
+ *
+ * Sits behind the ti,ads1299 node on a zephyr,spi-emul-controller bus so the
+ * driver in main.c runs unchanged on native_sim: commands, RREG/WREG and
+ * RDATAC/RDATA readout are decoded byte by byte as the chip would.
+ *
+ * Timing follows the chip rather than the host. After START the first
+ * conversion is ready after the settling time (4 tDR + 9 tCLK), then one
+ * every tDR on an absolute schedule, each latched into the output register
+ * and signalled by a falling DRDY edge. Each SPI byte is clocked at its own
+ * point on that timeline and the transfer busy-waits its bus time, so a
+ * conversion due during a readout replaces the rest of the frame (overrun),
+ * and one the host never reads is replaced by the next (missed), the way the
+ * board behaves when the SPI is too slow or DRDY is serviced late. native_sim
+ * runs the CPU infinitely fast, only bus time and explicit waits advance.
+ *
+ * The opcodes and register addresses are taken from the datasheet, not from
+ * the driver, so driver mistakes are not mirrored here.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/drivers/spi_emul.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+
+#include <eeg_codec.h>
+
+#include "ads1299_emul.h"
+
+LOG_MODULE_REGISTER(ads1299_emul, LOG_LEVEL_INF);
+
+#define DT_DRV_COMPAT ti_ads1299
+
+/* Opcodes */
+#define ADS_WAKEUP      0x02
+#define ADS_STANDBY     0x04
+#define ADS_RESET       0x06
+#define ADS_START       0x08
+#define ADS_STOP        0x0A
+#define ADS_RDATAC      0x10
+#define ADS_SDATAC      0x11
+#define ADS_RDATA       0x12
+#define ADS_RREG        0x20    // | address, then count - 1
+#define ADS_WREG        0x40
+#define ADS_REG_OP_MASK 0xE0
+#define ADS_REG_ADDR    0x1F
+
+/* Registers */
+#define ADS_ID          0x00
+#define ADS_CONFIG1     0x01
+#define ADS_CONFIG2     0x02
+#define ADS_CONFIG3     0x03
+#define ADS_CH1SET      0x05
+#define ADS_LOFF_SENSP  0x0F
+#define ADS_LOFF_SENSN  0x10
+#define ADS_LOFF_STATP  0x12
+#define ADS_LOFF_STATN  0x13
+#define ADS_GPIO        0x14
+#define ADS_CONFIG4     0x17
+#define ADS_REGS        0x18
+#define ADS_CONFIG1_DR  0x07
+#define ADS_CHNSET_PD   0x80
+#define ADS_CHNSET_GAIN(reg) (((reg) >> 4) & 0x07)
+#define ADS_CONFIG4_LOFF_COMP 0x02
+
+#define ADS_CHANNELS    8
+#define ADS_STATUS_LEN  3
+#define ADS_FRAME_LEN   (ADS_STATUS_LEN + ADS_CHANNELS * EEG_SAMPLE_BYTES)
+#define ADS_RATE_MAX    16000
+#define ADS_FCLK_HZ     2048000
+#define ADS_SETTLE_TCLK 9       // On top of 4 tDR
+#define ADS_FULL_SCALE  0x7FFFFF
+#define ADS_UV_PER_LSB  (4.5e6 / 8388608.0)  // 4.5 V reference, gain 1
+#define ADS_TWO_PI      6.283185307179586
+
+/* Power-on values, ID is an ADS1299 (8 channels) */
+static const uint8_t ads_defaults[ADS_REGS] = {
+	[ADS_ID] = 0x3E,
+	[ADS_CONFIG1] = 0x96,
+	[ADS_CONFIG2] = 0xC0,
+	[ADS_CONFIG3] = 0x60,
+	[ADS_CH1SET ... ADS_CH1SET + ADS_CHANNELS - 1] = 0x61,
+	[ADS_GPIO] = 0x0F,
+};
+
+/* PGA gains by CHnSET GAIN code, 7 is reserved */
+static const uint8_t ads_gains[] = {1, 2, 4, 6, 8, 12, 24, 24};
+
+#if defined(CONFIG_EEG_ADS1299_EMUL_CSV)
+static const char ads_csv[] = {
+#include "ads1299_emul_csv.inc"
+	'\0'
+};
+#endif
+
+/* ID and the lead-off status are not writable */
+static bool ads_reg_writable(uint8_t addr)
+{
+	return (addr != ADS_ID) && (addr != ADS_LOFF_STATP) && (addr != ADS_LOFF_STATN);
+}
+
+struct ads1299_emul_cfg {
+	struct gpio_dt_spec drdy;
+	struct gpio_dt_spec reset;
+};
+
+/* Decoder state of the transfer under way, one per spi_transceive() */
+struct ads1299_emul_xfer {
+	uint8_t op;                     // First opcode, 0 while reading out RDATAC
+	uint8_t addr;
+	uint8_t left;                   // Registers still to read or write
+	uint16_t pos;                   // Bytes clocked so far
+	uint16_t out;                   // Next frame byte for RDATA
+	bool reading;                   // Shifting out a frame
+};
+
+struct ads1299_emul_data {
+	const struct ads1299_emul_cfg *cfg;
+	struct k_timer drdy_timer;
+	struct k_spinlock lock;
+	uint8_t regs[ADS_REGS];
+	uint8_t frame[ADS_FRAME_LEN];   // Output register, latest conversion
+	enum ads1299_emul_source source;
+	uint8_t loff_p;
+	uint8_t loff_n;
+	bool running;                   // Between START and STOP
+	bool rdatac;
+	bool standby;
+	bool in_reset;
+	bool unread;                    // Output register not read out yet
+	bool edge;                      // Conversion latched, DRDY not pulled yet
+	uint32_t period_ns;             // tDR
+	int64_t next_ns;                // Uptime of the next conversion
+	uint32_t conv;                  // Conversions since START
+	uint32_t rng;
+	const char *csv_pos;
+	struct ads1299_emul_stats stats;
+};
+
+static int64_t ads_now_ns(void)
+{
+	return k_ticks_to_ns_floor64(k_uptime_ticks());
+}
+
+static uint16_t ads_rate(const struct ads1299_emul_data *data)
+{
+	return ADS_RATE_MAX >> MIN(data->regs[ADS_CONFIG1] & ADS_CONFIG1_DR, 6);
+}
+
+static void ads_power_on(struct ads1299_emul_data *data)
+{
+	k_timer_stop(&data->drdy_timer);
+	memcpy(data->regs, ads_defaults, sizeof(data->regs));
+	memset(data->frame, 0, sizeof(data->frame));
+	/* The chip comes out of reset in RDATAC, the driver has to SDATAC */
+	data->rdatac = true;
+	data->running = false;
+	data->standby = false;
+	data->unread = false;
+	data->edge = false;
+}
+
+/* RESET is active low on the chip whatever the DT flags say */
+static bool ads_reset_held(struct ads1299_emul_data *data)
+{
+	const struct gpio_dt_spec *reset = &data->cfg->reset;
+	bool held = reset->port && (gpio_emul_output_get(reset->port, reset->pin) == 0);
+
+	if (held && !data->in_reset) {
+		ads_power_on(data);
+	}
+	data->in_reset = held;
+
+	return held;
+}
+
+/* Uniform in [-0.5, 0.5), xorshift32 with a fixed seed so runs repeat */
+static double ads_uniform(struct ads1299_emul_data *data)
+{
+	data->rng ^= data->rng << 13;
+	data->rng ^= data->rng >> 17;
+	data->rng ^= data->rng << 5;
+
+	return (double)data->rng / 4294967296.0 - 0.5;
+}
+
+/* Sum of four uniforms, close enough to Gaussian with unit variance */
+static double ads_noise(struct ads1299_emul_data *data)
+{
+	double sum = 0.0;
+
+	for (uint8_t i = 0; i < 4; i++) {
+		sum += ads_uniform(data);
+	}
+	return sum * sqrt(3.0);
+}
+
+#if defined(CONFIG_EEG_ADS1299_EMUL_CSV)
+/* A number as Dart prints a double, rounded. NULL if there is none */
+static const char *ads_csv_number(const char *p, int32_t *out)
+{
+	double v = 0.0, scale = 1.0;
+	bool neg = false, digits = false;
+	int exp = 0, exp_sign = 1;
+
+	if ((*p == '-') || (*p == '+')) {
+		neg = (*p++ == '-');
+	}
+	for (; (*p >= '0') && (*p <= '9'); p++, digits = true) {
+		v = v * 10.0 + (*p - '0');
+	}
+	if (*p == '.') {
+		for (p++; (*p >= '0') && (*p <= '9'); p++, digits = true) {
+			scale /= 10.0;
+			v += (*p - '0') * scale;
+		}
+	}
+	if (!digits) {
+		return NULL;
+	}
+	if ((*p == 'e') || (*p == 'E')) {
+		p++;
+		if ((*p == '-') || (*p == '+')) {
+			exp_sign = (*p++ == '-') ? -1 : 1;
+		}
+		for (; (*p >= '0') && (*p <= '9'); p++) {
+			exp = MIN(exp * 10 + (*p - '0'), 30);
+		}
+	}
+	for (; exp > 0; exp--) {
+		v = (exp_sign > 0) ? v * 10.0 : v / 10.0;
+	}
+
+	*out = (int32_t)CLAMP(lround(neg ? -v : v), -ADS_FULL_SCALE - 1, ADS_FULL_SCALE);
+	return p;
+}
+
+/*
+ * Next row of timestamp_utc,ch1,ch2,... into x, looping at the end of the
+ * recording. Lines without numbers after the first field (the header) are
+ * skipped, missing channels stay at zero.
+ */
+static void ads_csv_row(struct ads1299_emul_data *data, int32_t *x)
+{
+	for (uint8_t wraps = 0; wraps < 2;) {
+		const char *line = data->csv_pos;
+		const char *p = line;
+		uint8_t n = 0;
+
+		if (!*line) {
+			data->csv_pos = ads_csv;
+			wraps++;
+			continue;
+		}
+
+		while (*p && (*p != '\n')) {
+			p++;
+		}
+		data->csv_pos = *p ? p + 1 : p;
+
+		for (p = line; (p < data->csv_pos) && (*p != ',') && (*p != '\n'); p++) {
+		}
+		while ((n < ADS_CHANNELS) && (*p == ',') && (p = ads_csv_number(p + 1, &x[n]))) {
+			n++;
+		}
+		if (n) {
+			return;
+		}
+	}
+}
+#endif /* CONFIG_EEG_ADS1299_EMUL_CSV */
+
+/* Input of every channel in counts at its PGA gain */
+static void ads_source(struct ads1299_emul_data *data, int32_t *x)
+{
+	const double t = (double)data->conv / ads_rate(data);
+
+	switch (data->source) {
+	case ADS1299_EMUL_SINE:
+		for (uint8_t ch = 0; ch < ADS_CHANNELS; ch++) {
+			const double hz = CONFIG_EEG_ADS1299_EMUL_SINE_DHZ / 10.0 * (ch + 1);
+			const double uv = CONFIG_EEG_ADS1299_EMUL_SINE_UV * sin(ADS_TWO_PI * hz * t) +
+					  CONFIG_EEG_ADS1299_EMUL_NOISE_UV * ads_noise(data);
+			const double counts = uv * ads_gains[ADS_CHNSET_GAIN(data->regs[ADS_CH1SET + ch])] /
+					      ADS_UV_PER_LSB;
+
+			x[ch] = (int32_t)CLAMP(lround(counts), -ADS_FULL_SCALE - 1, ADS_FULL_SCALE);
+		}
+		break;
+#if defined(CONFIG_EEG_ADS1299_EMUL_CSV)
+	case ADS1299_EMUL_CSV:
+		ads_csv_row(data, x);
+		break;
+#endif
+	default:
+		/* Channels offset from each other, wrapping inside the positive range */
+		for (uint8_t ch = 0; ch < ADS_CHANNELS; ch++) {
+			x[ch] = (int32_t)((data->stats.conversions + ((uint32_t)ch << 20)) & ADS_FULL_SCALE);
+		}
+		break;
+	}
+}
+
+static void ads_convert(struct ads1299_emul_data *data)
+{
+	int32_t x[ADS_CHANNELS] = {0};
+	const uint8_t off = data->loff_p | data->loff_n;
+
+	ads_source(data, x);
+
+	for (uint8_t ch = 0; ch < ADS_CHANNELS; ch++) {
+		if (data->regs[ADS_CH1SET + ch] & ADS_CHNSET_PD) {
+			/* A powered down channel reads close to zero */
+			x[ch] = 0;
+		} else if (off & BIT(ch)) {
+			/* A floating input is pulled to the rail */
+			x[ch] = ADS_FULL_SCALE;
+		}
+	}
+
+	/* The comparators only report with lead-off detection on */
+	if (data->regs[ADS_CONFIG4] & ADS_CONFIG4_LOFF_COMP) {
+		data->regs[ADS_LOFF_STATP] = data->loff_p & data->regs[ADS_LOFF_SENSP];
+		data->regs[ADS_LOFF_STATN] = data->loff_n & data->regs[ADS_LOFF_SENSN];
+	} else {
+		data->regs[ADS_LOFF_STATP] = 0;
+		data->regs[ADS_LOFF_STATN] = 0;
+	}
+
+	data->frame[0] = 0xC0 | (data->regs[ADS_LOFF_STATP] >> 4);
+	data->frame[1] = (data->regs[ADS_LOFF_STATP] << 4) | (data->regs[ADS_LOFF_STATN] >> 4);
+	data->frame[2] = (data->regs[ADS_LOFF_STATN] << 4) | (data->regs[ADS_GPIO] >> 4);
+	eeg_codec_pack24(x, &data->frame[ADS_STATUS_LEN], ADS_CHANNELS);
+
+	data->conv++;
+	data->stats.conversions++;
+}
+
+/* Latch every conversion due by t, returns true if there was one */
+static bool ads_convert_until(struct ads1299_emul_data *data, int64_t t)
+{
+	bool any = false;
+
+	while (data->running && (data->next_ns <= t)) {
+		if (data->unread) {
+			data->stats.missed++;
+		}
+		ads_convert(data);
+		data->unread = true;
+		data->edge = true;
+		data->next_ns += data->period_ns;
+		any = true;
+	}
+
+	return any;
+}
+
+static void ads_schedule(struct ads1299_emul_data *data)
+{
+	k_timer_start(&data->drdy_timer, K_TIMEOUT_ABS_TICKS(k_ns_to_ticks_ceil64(data->next_ns)),
+		      K_NO_WAIT);
+}
+
+static void ads_drdy(struct k_timer *timer)
+{
+	struct ads1299_emul_data *data = CONTAINER_OF(timer, struct ads1299_emul_data, drdy_timer);
+	const struct gpio_dt_spec *drdy = &data->cfg->drdy;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+	bool edge;
+
+	if (ads_reset_held(data)) {
+		k_spin_unlock(&data->lock, key);
+		return;
+	}
+
+	/* A readout may already have latched it */
+	ads_convert_until(data, ads_now_ns());
+	edge = data->edge;
+	data->edge = false;
+	if (data->running) {
+		ads_schedule(data);
+	}
+	k_spin_unlock(&data->lock, key);
+
+	/* Unread, DRDY pulses high ahead of the conversion; either way it falls */
+	if (edge) {
+		gpio_emul_input_set(drdy->port, drdy->pin, 1);
+		gpio_emul_input_set(drdy->port, drdy->pin, 0);
+	}
+}
+
+static void ads_start(struct ads1299_emul_data *data)
+{
+	const uint16_t rate = ads_rate(data);
+
+	/* START while running restarts the conversion, CONFIG1 is taken now */
+	data->running = true;
+	data->conv = 0;
+	data->period_ns = NSEC_PER_SEC / rate;
+	data->next_ns = ads_now_ns() + 4 * (int64_t)data->period_ns +
+			(int64_t)ADS_SETTLE_TCLK * NSEC_PER_SEC / ADS_FCLK_HZ;
+	ads_schedule(data);
+	LOG_DBG("Converting at %u SPS", rate);
+}
+
+static void ads_stop(struct ads1299_emul_data *data)
+{
+	if (data->running) {
+		LOG_INF("%u conversions, %u read, %u missed, %u overrun, %u stale",
+			data->stats.conversions, data->stats.reads, data->stats.missed,
+			data->stats.overrun, data->stats.stale);
+	}
+	data->running = false;
+	k_timer_stop(&data->drdy_timer);
+}
+
+static void ads_command(struct ads1299_emul_data *data, uint8_t op)
+{
+	switch (op) {
+	case ADS_WAKEUP:
+		data->standby = false;
+		break;
+	case ADS_STANDBY:
+		data->standby = true;
+		ads_stop(data);
+		break;
+	case ADS_RESET:
+		ads_power_on(data);
+		break;
+	case ADS_START:
+		if (!data->standby) {
+			ads_start(data);
+		}
+		break;
+	case ADS_STOP:
+		ads_stop(data);
+		break;
+	case ADS_RDATAC:
+		data->rdatac = true;
+		break;
+	case ADS_SDATAC:
+		data->rdatac = false;
+		break;
+	default:
+		break;
+	}
+}
+
+/* The first SCLK of a readout takes DRDY high */
+static void ads_readout(struct ads1299_emul_data *data, struct ads1299_emul_xfer *x)
+{
+	x->reading = true;
+	data->stats.reads++;
+	if (!data->unread) {
+		data->stats.stale++;
+	}
+	data->unread = false;
+}
+
+/* One byte each way: returns MISO for MOSI byte mosi */
+static uint8_t ads_byte(struct ads1299_emul_data *data, struct ads1299_emul_xfer *x, uint8_t mosi)
+{
+	const uint16_t pos = x->pos++;
+	uint8_t miso = 0;
+
+	/* In RDATAC every SCLK shifts out the frame, only commands are decoded */
+	if (data->rdatac && !x->op) {
+		if ((pos == 0) && !mosi) {
+			ads_readout(data, x);
+		}
+		miso = (pos < ADS_FRAME_LEN) ? data->frame[pos] : 0;
+		if (mosi && ((mosi & ADS_REG_OP_MASK) == 0)) {
+			ads_command(data, mosi);
+		}
+		return miso;
+	}
+
+	if (pos == 0) {
+		x->op = mosi;
+		x->addr = mosi & ADS_REG_ADDR;
+		if (mosi == ADS_RDATA) {
+			ads_readout(data, x);
+		} else if (((mosi & ADS_REG_OP_MASK) != ADS_RREG) &&
+			   ((mosi & ADS_REG_OP_MASK) != ADS_WREG)) {
+			ads_command(data, mosi);
+		}
+		return 0;
+	}
+
+	switch (x->op & ADS_REG_OP_MASK) {
+	case ADS_RREG:
+	case ADS_WREG:
+		if (pos == 1) {
+			x->left = (mosi & ADS_REG_ADDR) + 1;
+		} else if (x->left && (x->addr < ADS_REGS)) {
+			if ((x->op & ADS_REG_OP_MASK) == ADS_RREG) {
+				miso = data->regs[x->addr];
+			} else if (ads_reg_writable(x->addr)) {
+				data->regs[x->addr] = mosi;
+			}
+			x->addr++;
+			x->left--;
+		}
+		break;
+	default:
+		if (x->op == ADS_RDATA) {
+			miso = (x->out < ADS_FRAME_LEN) ? data->frame[x->out++] : 0;
+		}
+		break;
+	}
+
+	return miso;
+}
+
+static size_t ads_bufs_len(const struct spi_buf_set *bufs)
+{
+	size_t len = 0;
+
+	for (size_t i = 0; bufs && (i < bufs->count); i++) {
+		len += bufs->buffers[i].len;
+	}
+	return len;
+}
+
+/* Byte at offset i of a buffer set, NULL buffers send zeros / drop data */
+static uint8_t *ads_bufs_at(const struct spi_buf_set *bufs, size_t i)
+{
+	for (size_t b = 0; bufs && (b < bufs->count); b++) {
+		if (i < bufs->buffers[b].len) {
+			return bufs->buffers[b].buf ? (uint8_t *)bufs->buffers[b].buf + i : NULL;
+		}
+		i -= bufs->buffers[b].len;
+	}
+	return NULL;
+}
+
+static int ads1299_emul_io(const struct emul *target, const struct spi_config *config,
+			   const struct spi_buf_set *tx_bufs, const struct spi_buf_set *rx_bufs)
+{
+	struct ads1299_emul_data *data = target->data;
+	const size_t len = MAX(ads_bufs_len(tx_bufs), ads_bufs_len(rx_bufs));
+	const uint32_t byte_ns = (IS_ENABLED(CONFIG_EEG_ADS1299_EMUL_SPI_TIMING) &&
+				  config->frequency) ? 8U * NSEC_PER_SEC / config->frequency : 0;
+	const int64_t t0 = ads_now_ns();
+	struct ads1299_emul_xfer x = {0};
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+	const bool held = ads_reset_held(data);
+	bool overrun = false;
+
+	for (size_t i = 0; i < len; i++) {
+		const uint8_t *mosi = ads_bufs_at(tx_bufs, i);
+		uint8_t *miso = ads_bufs_at(rx_bufs, i);
+		uint8_t out = 0;
+
+		if (!held) {
+			/* Conversions due by this byte, the DRDY timer pulls the edge */
+			if (ads_convert_until(data, t0 + (int64_t)i * byte_ns) && x.reading) {
+				overrun = true;
+			}
+			out = ads_byte(data, &x, mosi ? *mosi : 0);
+		}
+		if (miso) {
+			*miso = out;
+		}
+	}
+
+	if (overrun) {
+		data->stats.overrun++;
+	}
+	k_spin_unlock(&data->lock, key);
+
+	if (x.reading) {
+		gpio_emul_input_set(data->cfg->drdy.port, data->cfg->drdy.pin, 1);
+	}
+	if (byte_ns) {
+		k_busy_wait(DIV_ROUND_UP(len * byte_ns, NSEC_PER_USEC));
+	}
+
+	return 0;
+}
+
+static const struct spi_emul_api ads1299_emul_api = {
+	.io = ads1299_emul_io,
+};
+
+int ads1299_emul_set_source(const struct emul *target, enum ads1299_emul_source source)
+{
+	struct ads1299_emul_data *data = target->data;
+	k_spinlock_key_t key;
+
+	if ((source == ADS1299_EMUL_CSV) && !IS_ENABLED(CONFIG_EEG_ADS1299_EMUL_CSV)) {
+		return -ENOTSUP;
+	}
+
+	key = k_spin_lock(&data->lock);
+	data->source = source;
+#if defined(CONFIG_EEG_ADS1299_EMUL_CSV)
+	data->csv_pos = ads_csv;
+#endif
+	k_spin_unlock(&data->lock, key);
+
+	return 0;
+}
+
+void ads1299_emul_lead_off(const struct emul *target, uint8_t p, uint8_t n)
+{
+	struct ads1299_emul_data *data = target->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	data->loff_p = p;
+	data->loff_n = n;
+	k_spin_unlock(&data->lock, key);
+}
+
+void ads1299_emul_stats_get(const struct emul *target, struct ads1299_emul_stats *out)
+{
+	struct ads1299_emul_data *data = target->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	*out = data->stats;
+	k_spin_unlock(&data->lock, key);
+}
+
+static int ads1299_emul_init(const struct emul *target, const struct device *parent)
+{
+	struct ads1299_emul_data *data = target->data;
+
+	data->cfg = target->cfg;
+	data->rng = 0x2545F491;
+	data->loff_p = CONFIG_EEG_ADS1299_EMUL_LEAD_OFF & 0xFF;
+	data->loff_n = CONFIG_EEG_ADS1299_EMUL_LEAD_OFF >> 8;
+	k_timer_init(&data->drdy_timer, ads_drdy, NULL);
+	ads_power_on(data);
+	ads1299_emul_set_source(target, IS_ENABLED(CONFIG_EEG_ADS1299_EMUL_SOURCE_CSV) ?
+					ADS1299_EMUL_CSV :
+				IS_ENABLED(CONFIG_EEG_ADS1299_EMUL_SOURCE_SINE) ?
+					ADS1299_EMUL_SINE : ADS1299_EMUL_COUNTER);
+	LOG_INF("ADS1299 emulated on %s", parent->name);
+
+	return 0;
+}
+
+#define ADS1299_EMUL(inst)                                                                 \
+	static struct ads1299_emul_data ads1299_emul_data_##inst;                          \
+	static const struct ads1299_emul_cfg ads1299_emul_cfg_##inst = {                   \
+		.drdy = GPIO_DT_SPEC_INST_GET(inst, drdy_gpios),                           \
+		.reset = GPIO_DT_SPEC_INST_GET_OR(inst, reset_gpios, {0}),                 \
+	};                                                                                 \
+	EMUL_DT_INST_DEFINE(inst, ads1299_emul_init, &ads1299_emul_data_##inst,            \
+			    &ads1299_emul_cfg_##inst, &ads1299_emul_api, NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(ADS1299_EMUL)
+
+#if defined(CONFIG_SHELL)
+
+static const struct emul *ads_shell_emul(void)
+{
+	return EMUL_DT_GET(DT_DRV_INST(0));
+}
+
+static int cmd_emul_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	struct ads1299_emul_stats st;
+
+	ads1299_emul_stats_get(ads_shell_emul(), &st);
+	shell_print(sh, "conversions %u read %u missed %u overrun %u stale %u", st.conversions,
+		    st.reads, st.missed, st.overrun, st.stale);
+
+	return 0;
+}
+
+static int cmd_emul_source(const struct shell *sh, size_t argc, char **argv)
+{
+	static const char *const names[] = {"counter", "sine", "csv"};
+
+	for (uint8_t s = 0; s < ARRAY_SIZE(names); s++) {
+		if (!strcmp(argv[1], names[s])) {
+			int err = ads1299_emul_set_source(ads_shell_emul(), s);
+
+			if (err) {
+				shell_error(sh, "No recording built in");
+			}
+			return err;
+		}
+	}
+
+	shell_error(sh, "counter, sine or csv");
+	return -EINVAL;
+}
+
+static int cmd_emul_lead_off(const struct shell *sh, size_t argc, char **argv)
+{
+	uint8_t p = strtoul(argv[1], NULL, 0);
+	uint8_t n = (argc > 2) ? strtoul(argv[2], NULL, 0) : p;
+
+	ads1299_emul_lead_off(ads_shell_emul(), p, n);
+	shell_print(sh, "Electrodes off P 0x%02x N 0x%02x", p, n);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_ads_emul,
+	SHELL_CMD(stats, NULL, "Conversions, missed and overrun frames", cmd_emul_stats),
+	SHELL_CMD_ARG(source, NULL, "<counter|sine|csv>", cmd_emul_source, 2, 0),
+	SHELL_CMD_ARG(lead_off, NULL, "<p mask> [n mask]", cmd_emul_lead_off, 2, 1),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(ads_emul, &sub_ads_emul, "Emulated ADS1299", NULL);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,47 @@
+/*
+ * ANA EEG sticker - emulated ADS1299
+ *
+ * Behavioural model of the chip behind the ti,ads1299 node on native_sim
+ * (prj_emul.conf): register file, RDATAC/SDATAC and START/STOP, conversions
+ * at the CONFIG1 data rate after the datasheet settling time, and SPI
+ * transfers that take their bus time, so a host that reads too slowly or
+ * too late loses or corrupts frames as it would on the board. Frames come
+ * from per-channel counters, sines plus noise or a recording saved by the
+ * app; electrodes can be taken off at runtime.
+ *
+ * Get the instance with EMUL_DT_GET(DT_NODELABEL(ads1299)).
+ */
+
+#ifndef ADS1299_EMUL_H_
+#define ADS1299_EMUL_H_
+
+#include <zephyr/types.h>
+#include <zephyr/drivers/emul.h>
+
+enum ads1299_emul_source {
+	ADS1299_EMUL_COUNTER,           // Sample counter, channel n offset by n << 20
+	ADS1299_EMUL_SINE,              // Channel n at n x the base frequency, plus noise
+	ADS1299_EMUL_CSV,               // Embedded EEGRecorder CSV, looped
+};
+
+struct ads1299_emul_stats {
+	uint32_t conversions;
+	uint32_t reads;             // Frames read out, RDATAC or RDATA
+	uint32_t missed;            // Conversions replaced before being read
+	uint32_t overrun;           // Readouts a new conversion cut into, data corrupt
+	uint32_t stale;             // Readouts of a frame already read
+};
+
+/* -ENOTSUP for ADS1299_EMUL_CSV without CONFIG_EEG_ADS1299_EMUL_CSV */
+int ads1299_emul_set_source(const struct emul *target, enum ads1299_emul_source source);
+
+/*
+ * Electrodes off, bit n for channel n + 1 on the P and N inputs. Their
+ * channels rail at positive full scale; the status word and LOFF_STATP/N
+ * only show them once the driver enables the comparators and LOFF_SENSP/N.
+ */
+void ads1299_emul_lead_off(const struct emul *target, uint8_t p, uint8_t n);
+
+void ads1299_emul_stats_get(const struct emul *target, struct ads1299_emul_stats *stats);
+
+#endif /* ADS1299_EMUL_H_ */
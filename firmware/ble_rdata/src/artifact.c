@@ -0,0 +1,192 @@
+/*
+ * ANA EEG sticker - artifact detector
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+
+#include "eeg_stream.h"
+#include "artifact.h"
+
+LOG_MODULE_REGISTER(artifact, LOG_LEVEL_INF);
+
+#define ARTIFACT_RAIL_POS       ((1 << 23) - 1 - EEG_ARTIFACT_RAIL_MARGIN)
+#define ARTIFACT_RAIL_NEG       (-(1 << 23) + EEG_ARTIFACT_RAIL_MARGIN)
+#define ARTIFACT_FLAT_LSB       1
+#define ARTIFACT_GAIN_DEFAULT   24          // CHnSET after reset
+#define ARTIFACT_FULL_SCALE_UV  4500000     // +-VREF / gain spans 2^24 codes
+#define ARTIFACT_FAST_HZ        5.0
+#define ARTIFACT_SLOW_HZ        0.5
+#define ARTIFACT_EMA_BITS       16
+
+struct artifact_chan {
+	bool primed;
+	int32_t prev;
+	int64_t fast;           // Averages, samples << ARTIFACT_EMA_BITS
+	int64_t slow;
+	uint16_t flat_run;
+	uint16_t blink_run;
+	uint32_t step_lsb;
+	uint32_t blink_lsb;
+};
+
+/* Acquisition context only */
+static struct artifact_chan chans[EEG_CHANNELS];
+static int32_t a_fast;                  // Averaging weights, q16
+static int32_t a_slow;
+static uint16_t flat_len;               // Samples
+static uint16_t blink_len;
+static uint8_t art_mask;
+
+static struct eeg_artifact_stats stats;
+
+static uint32_t uv_to_lsb(uint32_t uv, uint8_t gain)
+{
+	return (uint32_t)(((uint64_t)uv * gain << 23) / ARTIFACT_FULL_SCALE_UV);
+}
+
+static int32_t ema_weight(double hz, uint16_t sps)
+{
+	return (int32_t)lround((1.0 - exp(-2.0 * 3.14159265358979323846 * hz / sps)) *
+			       (1 << ARTIFACT_EMA_BITS));
+}
+
+void eeg_artifact_reset(void)
+{
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		chans[ch].primed = false;
+		chans[ch].flat_run = 0;
+		chans[ch].blink_run = 0;
+	}
+}
+
+void eeg_artifact_set_rate(uint16_t sps)
+{
+	a_fast = ema_weight(ARTIFACT_FAST_HZ, sps);
+	a_slow = ema_weight(ARTIFACT_SLOW_HZ, sps);
+	flat_len = MAX((uint32_t)sps * CONFIG_EEG_ARTIFACT_FLAT_MS / 1000, 2);
+	blink_len = MAX((uint32_t)sps * CONFIG_EEG_ARTIFACT_BLINK_MS / 1000, 1);
+	eeg_artifact_reset();
+}
+
+void eeg_artifact_set_gain(uint8_t chan_mask, uint8_t gain)
+{
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		if (chan_mask & BIT(ch)) {
+			chans[ch].step_lsb = uv_to_lsb(CONFIG_EEG_ARTIFACT_STEP_UV, gain);
+			chans[ch].blink_lsb = uv_to_lsb(CONFIG_EEG_ARTIFACT_BLINK_UV, gain);
+			chans[ch].primed = false;
+		}
+	}
+}
+
+static uint8_t artifact_sample(struct artifact_chan *c, int32_t x)
+{
+	uint8_t flags = 0;
+	int64_t xq = (int64_t)x << ARTIFACT_EMA_BITS;
+	int64_t lf;
+
+	if ((x >= ARTIFACT_RAIL_POS) || (x <= ARTIFACT_RAIL_NEG)) {
+		flags |= EEG_PKT_FLAG_SATURATED;
+	}
+
+	if (!c->primed) {
+		c->primed = true;
+		c->prev = x;
+		c->fast = xq;
+		c->slow = xq;
+		return flags;
+	}
+
+	if ((uint32_t)abs(x - c->prev) > c->step_lsb) {
+		flags |= EEG_PKT_FLAG_STEP;
+	}
+
+	if (abs(x - c->prev) <= ARTIFACT_FLAT_LSB) {
+		if (c->flat_run < UINT16_MAX) {
+			c->flat_run++;
+		}
+	} else {
+		c->flat_run = 0;
+	}
+	if (c->flat_run >= flat_len) {
+		flags |= EEG_PKT_FLAG_FLAT;
+	}
+
+	c->fast += ((xq - c->fast) * a_fast) >> ARTIFACT_EMA_BITS;
+	c->slow += ((xq - c->slow) * a_slow) >> ARTIFACT_EMA_BITS;
+	lf = (c->fast - c->slow) >> ARTIFACT_EMA_BITS;
+
+	if ((uint64_t)(lf < 0 ? -lf : lf) > c->blink_lsb) {
+		if (c->blink_run < UINT16_MAX) {
+			c->blink_run++;
+		}
+	} else {
+		c->blink_run = 0;
+	}
+	if (c->blink_run >= blink_len) {
+		flags |= EEG_PKT_FLAG_BLINK;
+	}
+
+	c->prev = x;
+
+	return flags;
+}
+
+uint8_t eeg_artifact_frames(const int32_t *samples, uint8_t chan_mask, uint8_t n_frames,
+			    uint8_t *bad)
+{
+	const uint8_t n_ch = eeg_pkt_channels(chan_mask);
+	const int32_t *p = samples;
+	uint8_t flags = 0;
+
+	*bad = 0;
+	if (chan_mask != art_mask) {
+		art_mask = chan_mask;
+		eeg_artifact_reset();
+	}
+
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		uint8_t ch_flags = 0;
+
+		if (!(chan_mask & BIT(ch))) {
+			continue;
+		}
+
+		for (uint8_t i = 0; i < n_frames; i++) {
+			ch_flags |= artifact_sample(&chans[ch], p[i * n_ch]);
+		}
+
+		if (ch_flags) {
+			*bad |= BIT(ch);
+			flags |= ch_flags;
+		}
+		p++;
+	}
+
+	stats.saturated += !!(flags & EEG_PKT_FLAG_SATURATED);
+	stats.flat += !!(flags & EEG_PKT_FLAG_FLAT);
+	stats.step += !!(flags & EEG_PKT_FLAG_STEP);
+	stats.blink += !!(flags & EEG_PKT_FLAG_BLINK);
+
+	return flags;
+}
+
+void eeg_artifact_stats_get(struct eeg_artifact_stats *out)
+{
+	*out = stats;
+}
+
+static int artifact_init(void)
+{
+	eeg_artifact_set_gain(EEG_CHAN_MASK, ARTIFACT_GAIN_DEFAULT);
+	eeg_artifact_set_rate(eeg_stream_rate());
+
+	return 0;
+}
+
+SYS_INIT(artifact_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,77 @@
+/*
+ * ANA EEG sticker - artifact detector
+ *
+ * Looks at the raw samples of every packet before the pre-filter and sets
+ * artifact flags in its header (EEG_PKT_FLAG_SATURATED, _FLAT, _STEP,
+ * _BLINK) so scoring, on the sticker or in the app, can leave the packet
+ * out, and tells which channels raised them so the sticker's scores can
+ * leave out only those. Per channel it keeps only the previous sample, two exponential
+ * averages and two run lengths, so the cost is constant per sample:
+ *
+ *  - saturated: a sample within EEG_ARTIFACT_RAIL_MARGIN codes of the
+ *    24-bit rails, the input is clipping or the electrode is off
+ *  - flat: successive samples within one code for CONFIG_EEG_ARTIFACT_FLAT_MS
+ *  - step: one sample to the next jumps by more than
+ *    CONFIG_EEG_ARTIFACT_STEP_UV, an electrode pop or motion
+ *  - blink: the 0.5-5 Hz content (difference of two averages) stays above
+ *    CONFIG_EEG_ARTIFACT_BLINK_UV for CONFIG_EEG_ARTIFACT_BLINK_MS
+ *
+ * Thresholds in µV follow the PGA gain of each channel.
+ */
+
+#ifndef ARTIFACT_H_
+#define ARTIFACT_H_
+
+#include <zephyr/types.h>
+
+#define EEG_ARTIFACT_RAIL_MARGIN 16
+
+struct eeg_artifact_stats {
+	uint32_t saturated;     // Packets flagged, per flag
+	uint32_t flat;
+	uint32_t step;
+	uint32_t blink;
+};
+
+#if defined(CONFIG_EEG_ARTIFACT)
+
+/*
+ * Check the raw samples of a completed packet, frame by frame (acquisition
+ * context), returns the EEG_PKT_FLAG_* artifact bits for its header. bad
+ * gets the channels (BIT(ch)) that raised any of them.
+ */
+uint8_t eeg_artifact_frames(const int32_t *samples, uint8_t chan_mask, uint8_t n_frames,
+			    uint8_t *bad);
+
+/* Forget the history, e.g. after a channel mask change */
+void eeg_artifact_reset(void);
+
+/* Retune the averages and run lengths for a new sample rate */
+void eeg_artifact_set_rate(uint16_t sps);
+
+/* PGA gain of the channels in the mask changed */
+void eeg_artifact_set_gain(uint8_t chan_mask, uint8_t gain);
+
+void eeg_artifact_stats_get(struct eeg_artifact_stats *stats);
+
+#else
+
+static inline uint8_t eeg_artifact_frames(const int32_t *samples, uint8_t chan_mask,
+					  uint8_t n_frames, uint8_t *bad)
+{
+	*bad = 0;
+	return 0;
+}
+static inline void eeg_artifact_reset(void)
+{
+}
+static inline void eeg_artifact_set_rate(uint16_t sps)
+{
+}
+static inline void eeg_artifact_set_gain(uint8_t chan_mask, uint8_t gain)
+{
+}
+
+#endif /* CONFIG_EEG_ARTIFACT */
+
+#endif /* ARTIFACT_H_ */
@@ -0,0 +1,272 @@
+/*
+ * ANA EEG sticker - Welch band power engine
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+#if defined(CONFIG_EEG_BANDS_FFT_CMSIS)
+#include <arm_math.h>
+#endif
+
+#include <eeg_fft.h>
+
+#include "eeg_stream.h"
+#include "bands.h"
+
+LOG_MODULE_REGISTER(bands, LOG_LEVEL_INF);
+
+#define FFT_LEN                 CONFIG_EEG_BANDS_FFT_LEN
+#define HOP                     CONFIG_EEG_BANDS_HOP
+#define SEGMENTS                CONFIG_EEG_BANDS_SEGMENTS
+
+/*
+ * One hop more than the window, so the window the thread works on is not
+ * overwritten before the next hop is complete. The thread drops it if more
+ * than HOP samples were written while it ran.
+ */
+#define RING_LEN                (FFT_LEN + HOP)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(FFT_LEN), "FFT length must be a power of two");
+BUILD_ASSERT(HOP <= FFT_LEN, "Hop longer than the window skips samples");
+
+/* Acquisition context, shared with the thread under ring_lock */
+static struct k_spinlock ring_lock;
+static int32_t ring[EEG_CHANNELS][RING_LEN];
+static uint16_t head;
+static uint16_t filled;
+static uint16_t since_hop;
+static uint32_t written;        // Frames stored since boot, wraps
+static uint32_t posted_at;      // written when the last window was posted
+static uint16_t posted_start;
+static uint8_t posted_mask;
+static uint8_t ring_mask;
+
+static K_SEM_DEFINE(bands_wake, 0, 1);
+
+/* Thread only */
+static int32_t fft_buf[2 * FFT_LEN];
+static int32_t window[FFT_LEN];
+static int16_t hann[FFT_LEN];
+static float acc[EEG_CHANNELS][EEG_BANDS_COUNT];
+static uint8_t acc_segments;
+static uint8_t acc_mask;
+static uint16_t band_bins[EEG_BANDS_COUNT + 1];
+static uint16_t bands_rate;
+static uint16_t bands_seq;
+static uint8_t pkt[EEG_PKT_HDR_LEN + EEG_BANDS_HDR_LEN +
+		   EEG_CHANNELS * EEG_BANDS_COUNT * EEG_BANDS_VALUE_LEN];
+
+static struct eeg_bands_stats stats;
+
+#if defined(CONFIG_EEG_BANDS_FFT_CMSIS)
+static arm_cfft_instance_q31 cfft;
+
+static void bands_fft(void)
+{
+	arm_cfft_q31(&cfft, fft_buf, 0, 1);
+}
+#else
+static int32_t twiddles[FFT_LEN];
+
+static void bands_fft(void)
+{
+	eeg_fft_q31(fft_buf, twiddles, FFT_LEN);
+}
+#endif /* CONFIG_EEG_BANDS_FFT_CMSIS */
+
+void eeg_bands_frames(const int32_t *samples, uint8_t chan_mask, uint8_t n_frames)
+{
+	const uint8_t n_ch = eeg_pkt_channels(chan_mask);
+	k_spinlock_key_t key = k_spin_lock(&ring_lock);
+	bool wake = false;
+
+	if (chan_mask != ring_mask) {
+		ring_mask = chan_mask;
+		filled = 0;
+		since_hop = 0;
+	}
+
+	for (uint8_t i = 0; i < n_frames; i++) {
+		const int32_t *p = &samples[i * n_ch];
+
+		for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+			if (chan_mask & BIT(ch)) {
+				ring[ch][head] = *p++;
+			}
+		}
+
+		head = (head + 1) % RING_LEN;
+		written++;
+		filled = MIN(filled + 1, FFT_LEN);
+
+		if ((++since_hop >= HOP) && (filled == FFT_LEN)) {
+			since_hop = 0;
+			posted_at = written;
+			posted_start = (head + RING_LEN - FFT_LEN) % RING_LEN;
+			posted_mask = chan_mask;
+			wake = true;
+		}
+	}
+
+	k_spin_unlock(&ring_lock, key);
+
+	if (wake) {
+		k_sem_give(&bands_wake);
+	}
+}
+
+void eeg_bands_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&ring_lock);
+
+	filled = 0;
+	since_hop = 0;
+	/* Anything in flight is stale now, the thread checks the mask */
+	ring_mask = 0;
+
+	k_spin_unlock(&ring_lock, key);
+}
+
+void eeg_bands_set_rate(uint16_t sps)
+{
+	static const uint8_t edges[] = EEG_BANDS_EDGES_HZ;
+	k_spinlock_key_t key = k_spin_lock(&ring_lock);
+
+	/* First bin at or above each edge */
+	for (uint8_t b = 0; b <= EEG_BANDS_COUNT; b++) {
+		band_bins[b] = MIN(DIV_ROUND_UP((uint32_t)edges[b] * FFT_LEN, sps), FFT_LEN / 2);
+	}
+	bands_rate = sps;
+	filled = 0;
+	since_hop = 0;
+	ring_mask = 0;
+
+	k_spin_unlock(&ring_lock, key);
+
+	if (band_bins[1] - band_bins[0] < 2) {
+		LOG_WRN("%u SPS: bins of %u Hz are too coarse for the delta band", sps,
+			sps / FFT_LEN);
+	}
+}
+
+void eeg_bands_stats_get(struct eeg_bands_stats *out)
+{
+	*out = stats;
+}
+
+static void bands_report(void)
+{
+	uint8_t *p = &pkt[EEG_PKT_HDR_LEN];
+	uint16_t len = eeg_bands_pkt_len(acc_mask);
+
+	eeg_pkt_hdr_init((struct eeg_pkt_hdr *)pkt, EEG_PKT_TYPE_BANDS, bands_seq++,
+			 acc_mask, EEG_BANDS_COUNT);
+	sys_put_le16(bands_rate, &p[0]);
+	sys_put_le16(FFT_LEN, &p[2]);
+	p[4] = acc_segments;
+	p += EEG_BANDS_HDR_LEN;
+
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		if (!(acc_mask & BIT(ch))) {
+			continue;
+		}
+		for (uint8_t b = 0; b < EEG_BANDS_COUNT; b++) {
+			float v = acc[ch][b] / acc_segments;
+			uint32_t raw;
+
+			memcpy(&raw, &v, sizeof(raw));
+			sys_put_le32(raw, p);
+			p += EEG_BANDS_VALUE_LEN;
+		}
+	}
+
+	stats.reports++;
+	if (eeg_stream_send_aux(pkt, len)) {
+		stats.send_failed++;
+	}
+}
+
+static void bands_thread(void)
+{
+#if defined(CONFIG_EEG_BANDS_FFT_CMSIS)
+	arm_cfft_init_q31(&cfft, FFT_LEN);
+#else
+	eeg_fft_twiddles(twiddles, FFT_LEN);
+#endif
+	eeg_fft_hann(hann, FFT_LEN);
+
+	for (;;) {
+		uint32_t at;
+		uint16_t start;
+		uint8_t mask;
+		k_spinlock_key_t key;
+
+		k_sem_take(&bands_wake, K_FOREVER);
+
+		key = k_spin_lock(&ring_lock);
+		at = posted_at;
+		start = posted_start;
+		mask = posted_mask;
+		k_spin_unlock(&ring_lock, key);
+
+		if (mask != acc_mask) {
+			acc_mask = mask;
+			acc_segments = 0;
+			memset(acc, 0, sizeof(acc));
+		}
+
+		for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+			int shift;
+
+			if (!(mask & BIT(ch))) {
+				continue;
+			}
+
+			for (uint16_t i = 0; i < FFT_LEN; i++) {
+				window[i] = ring[ch][(start + i) % RING_LEN];
+			}
+
+			shift = eeg_fft_load(fft_buf, window, hann, FFT_LEN);
+			bands_fft();
+
+			for (uint8_t b = 0; b < EEG_BANDS_COUNT; b++) {
+				acc[ch][b] += eeg_fft_band_power(fft_buf, band_bins[b],
+								 band_bins[b + 1], shift);
+			}
+		}
+
+		/* More than a hop written meanwhile: the window's oldest samples are newer */
+		key = k_spin_lock(&ring_lock);
+		if ((written - at > HOP) || (ring_mask != mask)) {
+			k_spin_unlock(&ring_lock, key);
+			stats.late++;
+			acc_segments = 0;
+			memset(acc, 0, sizeof(acc));
+			continue;
+		}
+		k_spin_unlock(&ring_lock, key);
+
+		stats.segments++;
+		if (++acc_segments == SEGMENTS) {
+			bands_report();
+			acc_segments = 0;
+			memset(acc, 0, sizeof(acc));
+		}
+	}
+}
+
+K_THREAD_DEFINE(bands_thread_id, CONFIG_EEG_BANDS_THREAD_STACK_SIZE, bands_thread,
+		NULL, NULL, NULL, CONFIG_EEG_BANDS_THREAD_PRIO, 0, 0);
+
+static int bands_init(void)
+{
+	eeg_bands_set_rate(eeg_stream_rate());
+
+	return 0;
+}
+
+SYS_INIT(bands_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,50 @@
+/*
+ * ANA EEG sticker - Welch band power engine
+ *
+ * Keeps the last CONFIG_EEG_BANDS_FFT_LEN samples of every channel. Every
+ * CONFIG_EEG_BANDS_HOP frames a thread takes that window, removes its mean,
+ * applies a Hann window and a q31 FFT, and adds up the periodogram over
+ * the five EEG bands. After CONFIG_EEG_BANDS_SEGMENTS windows the average
+ * goes out as one band power packet (EEG_PKT_TYPE_BANDS) on the live link.
+ */
+
+#ifndef BANDS_H_
+#define BANDS_H_
+
+#include <zephyr/types.h>
+
+struct eeg_bands_stats {
+	uint32_t segments;      // Windows transformed
+	uint32_t late;          // Windows overwritten before the thread got to them
+	uint32_t reports;       // Band power packets built
+	uint32_t send_failed;   // Of those, not taken by the BT stack
+};
+
+#if defined(CONFIG_EEG_BANDS)
+
+/* Feed the samples of a completed packet, frame by frame (acquisition context) */
+void eeg_bands_frames(const int32_t *samples, uint8_t chan_mask, uint8_t n_frames);
+
+/* Drop the history, e.g. after a channel mask, rate or mode change */
+void eeg_bands_reset(void);
+
+/* Map the band edges to FFT bins for a new sample rate */
+void eeg_bands_set_rate(uint16_t sps);
+
+void eeg_bands_stats_get(struct eeg_bands_stats *stats);
+
+#else
+
+static inline void eeg_bands_frames(const int32_t *samples, uint8_t chan_mask, uint8_t n_frames)
+{
+}
+static inline void eeg_bands_reset(void)
+{
+}
+static inline void eeg_bands_set_rate(uint16_t sps)
+{
+}
+
+#endif /* CONFIG_EEG_BANDS */
+
+#endif /* BANDS_H_ */
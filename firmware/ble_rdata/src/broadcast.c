@@ -0,0 +1,156 @@
+/*
+ * ANA EEG sticker - connectionless broadcast
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/logging/log.h>
+
+#include "eeg_stream.h"
+#include "eeg_svc.h"
+#include "broadcast.h"
+
+LOG_MODULE_REGISTER(broadcast, LOG_LEVEL_INF);
+
+#define BCAST_INTERVAL_MS       CONFIG_EEG_BCAST_INTERVAL_MS
+#define BCAST_INTERVAL_UNITS    (BCAST_INTERVAL_MS * 1000 / 1250)   // 1.25 ms units
+
+/* Manufacturer data: company ID, train counter, then back-to-back packets */
+#define BCAST_COMPANY_ID        0xFFFF
+#define BCAST_TRAIN_HDR_LEN     3
+#define BCAST_TRAIN_LEN         CONFIG_EEG_BCAST_TRAIN_LEN
+
+BUILD_ASSERT(BCAST_TRAIN_LEN <= 254, "Train must fit one AD structure");
+BUILD_ASSERT(BCAST_TRAIN_LEN >= BCAST_TRAIN_HDR_LEN + EEG_PKT_MAX_LEN,
+	     "Train too short for a single data packet");
+
+static struct bt_le_ext_adv *adv;
+
+/* Filled by acquisition, swapped out once per train */
+static struct k_spinlock fill_lock;
+static uint8_t fill_buf[2][BCAST_TRAIN_LEN];
+static uint8_t fill_idx;
+static uint8_t fill_len = BCAST_TRAIN_HDR_LEN;
+static uint8_t fill_packets;
+
+static struct eeg_bcast_stats stats;
+
+static const struct bt_data ext_ad[] = {
+	BT_DATA(BT_DATA_NAME_COMPLETE, CONFIG_BT_DEVICE_NAME, sizeof(CONFIG_BT_DEVICE_NAME) - 1),
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_EEG_SVC_VAL),
+};
+
+void eeg_bcast_packet(const uint8_t *pkt, uint16_t len)
+{
+	k_spinlock_key_t key = k_spin_lock(&fill_lock);
+
+	if (fill_len + len > BCAST_TRAIN_LEN) {
+		stats.dropped++;
+	} else {
+		memcpy(&fill_buf[fill_idx][fill_len], pkt, len);
+		fill_len += len;
+		fill_packets++;
+	}
+
+	k_spin_unlock(&fill_lock, key);
+}
+
+void eeg_bcast_stats_get(struct eeg_bcast_stats *out)
+{
+	*out = stats;
+}
+
+int eeg_bcast_start(void)
+{
+	int err;
+
+	err = bt_le_ext_adv_create(BT_LE_EXT_ADV_NCONN, NULL, &adv);
+	if (err) {
+		LOG_ERR("Failed to create broadcast set (err %d)", err);
+		return err;
+	}
+
+	err = bt_le_per_adv_set_param(adv, BT_LE_PER_ADV_PARAM(BCAST_INTERVAL_UNITS,
+							       BCAST_INTERVAL_UNITS,
+							       BT_LE_PER_ADV_OPT_NONE));
+	if (err) {
+		LOG_ERR("Failed to set periodic advertising parameters (err %d)", err);
+		return err;
+	}
+
+	err = bt_le_ext_adv_set_data(adv, ext_ad, ARRAY_SIZE(ext_ad), NULL, 0);
+	if (err) {
+		LOG_ERR("Failed to set broadcast advertising data (err %d)", err);
+		return err;
+	}
+
+	err = bt_le_per_adv_start(adv);
+	if (err) {
+		LOG_ERR("Failed to enable periodic advertising (err %d)", err);
+		return err;
+	}
+
+	err = bt_le_ext_adv_start(adv, BT_LE_EXT_ADV_START_DEFAULT);
+	if (err) {
+		LOG_ERR("Failed to start broadcast set (err %d)", err);
+		return err;
+	}
+
+	LOG_INF("EEG broadcast started, %u ms trains", BCAST_INTERVAL_MS);
+
+	return 0;
+}
+
+/* Hands the packets collected since the last train to the controller, which
+ * repeats them in every periodic event until the next update.
+ */
+static void bcast_thread(void)
+{
+	static struct k_timer train_timer;
+	uint8_t train_counter = 0;
+
+	k_timer_init(&train_timer, NULL, NULL);
+	k_timer_start(&train_timer, K_MSEC(BCAST_INTERVAL_MS), K_MSEC(BCAST_INTERVAL_MS));
+
+	for (;;) {
+		k_timer_status_sync(&train_timer);
+
+		if (!adv) {
+			continue;
+		}
+
+		k_spinlock_key_t key = k_spin_lock(&fill_lock);
+
+		uint8_t *train = fill_buf[fill_idx];
+		uint8_t len = fill_len;
+		uint8_t packets = fill_packets;
+
+		fill_idx ^= 1;
+		fill_len = BCAST_TRAIN_HDR_LEN;
+		fill_packets = 0;
+
+		k_spin_unlock(&fill_lock, key);
+
+		if (!packets) {
+			continue;
+		}
+
+		train[0] = BCAST_COMPANY_ID & 0xFF;
+		train[1] = BCAST_COMPANY_ID >> 8;
+		train[2] = train_counter++;
+
+		struct bt_data ad = BT_DATA(BT_DATA_MANUFACTURER_DATA, train, len);
+
+		if (bt_le_per_adv_set_data(adv, &ad, 1)) {
+			stats.dropped += packets;
+			continue;
+		}
+
+		stats.trains++;
+		stats.packets += packets;
+	}
+}
+
+K_THREAD_DEFINE(bcast_thread_id, CONFIG_EEG_BCAST_THREAD_STACK_SIZE, bcast_thread,
+		NULL, NULL, NULL, CONFIG_EEG_BCAST_THREAD_PRIO, 0, 0);
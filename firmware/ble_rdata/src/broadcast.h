@@ -0,0 +1,42 @@
+/*
+ * ANA EEG sticker - connectionless broadcast
+ *
+ * Carries data packets in a periodic advertising train so any number of
+ * scanners can sync to the stream without connecting.
+ */
+
+#ifndef BROADCAST_H_
+#define BROADCAST_H_
+
+#include <zephyr/types.h>
+
+struct eeg_bcast_stats {
+	uint32_t trains;          // Periodic advertising data updates
+	uint32_t packets;         // Packets carried in those trains
+	uint32_t dropped;         // Packets that did not fit before the next train
+};
+
+#if defined(CONFIG_EEG_BROADCAST)
+
+int eeg_bcast_start(void);
+
+/* Queue a data packet for the next train (acquisition context) */
+void eeg_bcast_packet(const uint8_t *pkt, uint16_t len);
+
+void eeg_bcast_stats_get(struct eeg_bcast_stats *stats);
+
+#else
+
+static inline int eeg_bcast_start(void)
+{
+	return 0;
+}
+static inline void eeg_bcast_packet(const uint8_t *pkt, uint16_t len) {}
+static inline void eeg_bcast_stats_get(struct eeg_bcast_stats *stats)
+{
+	*stats = (struct eeg_bcast_stats){0};
+}
+
+#endif /* CONFIG_EEG_BROADCAST */
+
+#endif /* BROADCAST_H_ */
@@ -0,0 +1,153 @@
+/*
+ * ANA EEG sticker - clock synchronization with the central
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+#include "eeg_stream.h"
+#include "eeg_svc.h"
+#include "clock_sync.h"
+
+LOG_MODULE_REGISTER(clock_sync, LOG_LEVEL_INF);
+
+struct sync_req {
+	struct bt_conn *conn;
+	uint8_t id;
+	int64_t t1;
+	int64_t prev_t4;
+	int64_t t2;
+};
+
+/* Exchange answered last, completed by the t4 in the next request */
+struct sync_sent {
+	bool valid;
+	uint8_t id;
+	int64_t t1;
+	int64_t t2;
+	int64_t t3;
+};
+
+static struct k_spinlock lock;
+static struct sync_req pending;         // Protected by lock
+static struct eeg_clock est;            // Protected by lock
+static struct sync_sent last;           // Work item only
+
+static void sync_work_handler(struct k_work *work);
+static K_WORK_DEFINE(sync_work, sync_work_handler);
+
+int64_t eeg_clock_sync_now(void)
+{
+	return (int64_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+void eeg_clock_sync_request(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	int64_t t2 = eeg_clock_sync_now();
+	k_spinlock_key_t key;
+
+	if (len != EEG_CLOCK_REQ_LEN) {
+		LOG_WRN("Malformed clock request (len %u)", len);
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+
+	/* Only the newest request is answered, a stale one would skew the sample */
+	if (pending.conn) {
+		bt_conn_unref(pending.conn);
+	}
+	pending = (struct sync_req){
+		.conn = bt_conn_ref(conn),
+		.id = data[0],
+		.t1 = (int64_t)eeg_clock_get_le64(&data[1]),
+		.prev_t4 = (int64_t)eeg_clock_get_le64(&data[9]),
+		.t2 = t2,
+	};
+
+	k_spin_unlock(&lock, key);
+
+	/* Reply from the system workqueue, notifying from BT RX could block */
+	k_work_submit(&sync_work);
+}
+
+static void sync_work_handler(struct k_work *work)
+{
+	struct eeg_stream_anchor anchor;
+	uint8_t rsp[EEG_CLOCK_RESP_LEN];
+	struct sync_req req;
+	k_spinlock_key_t key;
+	uint32_t age;
+	int64_t t3;
+	int err;
+
+	key = k_spin_lock(&lock);
+	req = pending;
+	pending.conn = NULL;
+
+	if (req.conn && last.valid && req.prev_t4 &&
+	    (req.id == (uint8_t)(last.id + 1))) {
+		eeg_clock_exchange(&est, last.t1, last.t2, last.t3, req.prev_t4);
+	}
+
+	k_spin_unlock(&lock, key);
+
+	if (!req.conn) {
+		return;
+	}
+
+	eeg_stream_anchor_get(&anchor);
+	age = EEG_CLOCK_NO_ANCHOR;
+	if (anchor.valid && (req.t2 - anchor.t_us < EEG_CLOCK_NO_ANCHOR)) {
+		age = (uint32_t)(req.t2 - anchor.t_us);
+	}
+
+	rsp[0] = req.id;
+	eeg_clock_put_le64(&rsp[1], (uint64_t)req.t2);
+	sys_put_le16(anchor.seq, &rsp[11]);
+	sys_put_le32(age, &rsp[13]);
+
+	t3 = eeg_clock_sync_now();
+	sys_put_le16((uint16_t)MIN(t3 - req.t2, UINT16_MAX), &rsp[9]);
+
+	err = eeg_svc_clock_send(req.conn, rsp, sizeof(rsp));
+	bt_conn_unref(req.conn);
+
+	if (err) {
+		LOG_WRN("Clock response not sent (err %d)", err);
+		last.valid = false;
+		return;
+	}
+
+	last = (struct sync_sent){
+		.valid = true,
+		.id = req.id,
+		.t1 = req.t1,
+		.t2 = req.t2,
+		.t3 = req.t2 + MIN(t3 - req.t2, UINT16_MAX),
+	};
+
+	LOG_DBG("Clock offset %lld us, drift %d ppb, delay %lld us",
+		est.offset_us, (int)(est.drift * 1e9), est.delay_us);
+}
+
+void eeg_clock_sync_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	eeg_clock_init(&est);
+	last.valid = false;
+
+	k_spin_unlock(&lock, key);
+}
+
+void eeg_clock_sync_get(struct eeg_clock *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = est;
+
+	k_spin_unlock(&lock, key);
+}
@@ -0,0 +1,28 @@
+/*
+ * ANA EEG sticker - clock synchronization with the central
+ *
+ * Answers the NTP-style requests on the clock characteristic (see
+ * eeg_clock.h) and keeps its own offset/drift estimate from the t4 the
+ * central reports back, so the firmware knows the central's time too.
+ */
+
+#ifndef CLOCK_SYNC_H_
+#define CLOCK_SYNC_H_
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
+#include <eeg_clock.h>
+
+/* Sticker time base of the exchange, microseconds since boot */
+int64_t eeg_clock_sync_now(void);
+
+/* Write to the clock characteristic (BT RX context) */
+void eeg_clock_sync_request(struct bt_conn *conn, const uint8_t *data, uint16_t len);
+
+/* Forget the estimate, the next central has another clock */
+void eeg_clock_sync_reset(void);
+
+/* Copy of the current estimate, check est->valid */
+void eeg_clock_sync_get(struct eeg_clock *est);
+
+#endif /* CLOCK_SYNC_H_ */
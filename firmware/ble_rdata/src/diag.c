@@ -0,0 +1,477 @@
+/*
+ * ANA EEG sticker - runtime diagnostics
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/logging/log.h>
+
+#include "eeg_stream.h"
+#include "eeg_state.h"
+#include "eeg_svc.h"
+#include "diag.h"
+#include "latency.h"
+#include "power.h"
+
+LOG_MODULE_REGISTER(diag, LOG_LEVEL_INF);
+
+#define DIAG_PERIOD             K_SECONDS(1)
+#define DIAG_MAX_THREADS        CONFIG_EEG_DIAG_MAX_THREADS
+#define DIAG_LAT_STAGES         (IS_ENABLED(CONFIG_EEG_LATENCY) ? EEG_LAT_STAGES : 0)
+#define DIAG_SNAP_LEN           (5 * EEG_DIAG_SECTION_MAX + \
+				 DIAG_MAX_THREADS * EEG_DIAG_SECTION_MAX + \
+				 ARRAY_SIZE(pools) * EEG_DIAG_SECTION_MAX + \
+				 DIAG_LAT_STAGES * EEG_DIAG_SECTION_MAX)
+
+struct diag_pool_src {
+	uint8_t id;
+	void (*get)(struct eeg_diag_pool *pool);
+};
+
+static const struct diag_pool_src pools[] = {
+	{EEG_DIAG_POOL_UART, eeg_uart_pool_get},
+#if defined(CONFIG_EEG_LOG)
+	{EEG_DIAG_POOL_LOG, eeg_log_pool_get},
+#endif
+	{EEG_DIAG_POOL_CTRL, eeg_ctrl_pool_get},
+	{EEG_DIAG_POOL_RETX, eeg_retx_pool_get},
+};
+
+/* Previous sample of everything turned into a rate, work queue only */
+struct diag_thread {
+	const struct k_thread *thread;
+	uint64_t cycles;
+	uint16_t stack_used;    // As of the last stack scan
+	bool seen;
+};
+
+static struct diag_thread threads[DIAG_MAX_THREADS];
+static uint16_t peaks[ARRAY_SIZE(pools)];
+static uint32_t last_cycle;
+static uint32_t last_packets;
+static uint32_t last_bytes;
+
+static uint8_t build_buf[DIAG_SNAP_LEN];
+static uint16_t build_len;
+static uint32_t window_cycles;
+static uint32_t idle_cycles;
+static bool scan_stacks;
+
+/* Latest finished snapshot */
+static K_MUTEX_DEFINE(snap_lock);
+static uint8_t snap[DIAG_SNAP_LEN];
+static uint16_t snap_len;
+
+static struct k_spinlock conn_lock;
+static struct bt_conn *diag_conn;
+static atomic_t subscribed;
+static atomic_t restarted;      // First snapshot after connecting, baseline only
+static atomic_t scan_requested; // Read since the last snapshot
+
+static void diag_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(diag_work, diag_work_handler);
+
+static uint8_t *section(uint8_t id, uint8_t len)
+{
+	uint8_t *p = &build_buf[build_len];
+
+	if (build_len + 2 + len > sizeof(build_buf)) {
+		return NULL;
+	}
+
+	p[0] = id;
+	p[1] = len;
+	build_len += 2 + len;
+
+	return &p[2];
+}
+
+static uint16_t permille(uint64_t part, uint32_t whole)
+{
+	return whole ? (uint16_t)MIN(part * 1000U / whole, 1000U) : 0;
+}
+
+static void thread_cb(const struct k_thread *cthread, void *user_data)
+{
+	struct k_thread *thread = (struct k_thread *)cthread;
+	k_thread_runtime_stats_t rt;
+	struct diag_thread *slot = NULL;
+	const char *name = k_thread_name_get(thread);
+	size_t name_len;
+	uint64_t delta;
+	uint8_t *p;
+
+	for (int i = 0; i < DIAG_MAX_THREADS; i++) {
+		if (threads[i].thread == thread) {
+			slot = &threads[i];
+			break;
+		}
+		if (!slot && !threads[i].thread) {
+			slot = &threads[i];
+		}
+	}
+	if (!slot) {
+		return;
+	}
+
+	if (slot->thread != thread) {
+		slot->thread = thread;
+		slot->cycles = 0;
+		slot->stack_used = 0;
+	}
+	slot->seen = true;
+
+	k_thread_runtime_stats_get(thread, &rt);
+	delta = rt.execution_cycles - slot->cycles;
+	slot->cycles = rt.execution_cycles;
+
+	if (name && !strcmp(name, "idle")) {
+		idle_cycles += delta;
+	}
+
+	/* Scanning for the high-water mark reads the whole stack */
+	if (scan_stacks) {
+		size_t unused = 0;
+
+		k_thread_stack_space_get(thread, &unused);
+		slot->stack_used = thread->stack_info.size - unused;
+	}
+
+	name_len = name ? MIN(strlen(name), EEG_DIAG_THREAD_NAME) : 0;
+	p = section(EEG_DIAG_THREAD, EEG_DIAG_THREAD_LEN + name_len);
+	if (!p) {
+		return;
+	}
+
+	sys_put_le16(permille(delta, window_cycles), &p[0]);
+	sys_put_le16(slot->stack_used, &p[2]);
+	sys_put_le16(thread->stack_info.size, &p[4]);
+	if (name_len) {
+		memcpy(&p[6], name, name_len);
+	}
+}
+
+static void add_threads(void)
+{
+	for (int i = 0; i < DIAG_MAX_THREADS; i++) {
+		threads[i].seen = false;
+	}
+
+	/* Not the locked variant, scanning stacks takes a while */
+	k_thread_foreach_unlocked(thread_cb, NULL);
+
+	/* Free the slots of threads that have exited */
+	for (int i = 0; i < DIAG_MAX_THREADS; i++) {
+		if (!threads[i].seen) {
+			threads[i].thread = NULL;
+		}
+	}
+}
+
+static void add_link(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+	uint8_t *p;
+
+	if (!conn || bt_conn_get_info(conn, &info)) {
+		return;
+	}
+
+	p = section(EEG_DIAG_LINK, EEG_DIAG_LINK_LEN);
+	if (!p) {
+		return;
+	}
+
+	sys_put_le16(info.le.interval, &p[0]);
+	sys_put_le16(info.le.latency, &p[2]);
+	sys_put_le16(info.le.timeout, &p[4]);
+	sys_put_le16(bt_gatt_get_mtu(conn), &p[6]);
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+	p[8] = info.le.phy->tx_phy;
+	p[9] = info.le.phy->rx_phy;
+#else
+	p[8] = 0;
+	p[9] = 0;
+#endif
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+	sys_put_le16(info.le.data_len->tx_max_len, &p[10]);
+#else
+	sys_put_le16(0, &p[10]);
+#endif
+}
+
+static void add_rates(void)
+{
+	struct eeg_stream_stats st;
+	uint32_t packets;
+	uint32_t bytes;
+	uint8_t *p;
+
+	eeg_stream_stats_get(&st);
+
+	/* Rates over the window, scaled to one second */
+	packets = (uint32_t)((uint64_t)(st.packets - last_packets) *
+			     sys_clock_hw_cycles_per_sec() / MAX(window_cycles, 1U));
+	bytes = (uint32_t)((uint64_t)(st.bytes - last_bytes) *
+			   sys_clock_hw_cycles_per_sec() / MAX(window_cycles, 1U));
+	last_packets = st.packets;
+	last_bytes = st.bytes;
+
+	p = section(EEG_DIAG_RATES, EEG_DIAG_RATES_LEN);
+	if (!p) {
+		return;
+	}
+
+	sys_put_le16(MIN(packets * EEG_FRAMES_PER_PACKET, UINT16_MAX), &p[0]);
+	sys_put_le16(MIN(packets, UINT16_MAX), &p[2]);
+	sys_put_le32(bytes, &p[4]);
+	sys_put_le32(st.notify_failed, &p[8]);
+	sys_put_le32(st.tx_done, &p[12]);
+}
+
+static void add_pools(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(pools); i++) {
+		struct eeg_diag_pool pool = {0};
+		uint8_t *p;
+
+		pools[i].get(&pool);
+		peaks[i] = MAX(peaks[i], MAX(pool.peak, pool.used));
+
+		p = section(EEG_DIAG_POOL, EEG_DIAG_POOL_LEN);
+		if (!p) {
+			return;
+		}
+
+		p[0] = pools[i].id;
+		sys_put_le16(pool.used, &p[1]);
+		sys_put_le16(peaks[i], &p[3]);
+		sys_put_le16(pool.total, &p[5]);
+		sys_put_le32(pool.failed, &p[7]);
+	}
+}
+
+static void add_latency(void)
+{
+#if defined(CONFIG_EEG_LATENCY)
+	for (uint8_t st = 0; st < EEG_LAT_STAGES; st++) {
+		struct eeg_ctrl_latency lat;
+		uint8_t *p;
+
+		eeg_lat_get(st, &lat);
+		if (!lat.count) {
+			continue;
+		}
+
+		p = section(EEG_DIAG_LATENCY, EEG_DIAG_LATENCY_LEN);
+		if (!p) {
+			return;
+		}
+
+		p[0] = st;
+		memcpy(&p[1], &lat.count, sizeof(lat.count));
+		p[5] = eeg_lat_percentile(st, 50);
+		p[6] = eeg_lat_percentile(st, 90);
+		p[7] = eeg_lat_percentile(st, 99);
+		memcpy(&p[8], &lat.max_us, sizeof(lat.max_us));
+	}
+#endif
+}
+
+static void add_power(void)
+{
+#if defined(CONFIG_EEG_PM)
+	static struct eeg_pm_stats last;
+	struct eeg_pm_stats st;
+	uint32_t samples;
+	uint16_t spi;
+	uint8_t *p;
+
+	eeg_pm_stats_get(&st);
+	samples = st.samples - last.samples;
+	spi = permille(st.spi_cycles - last.spi_cycles, window_cycles);
+
+	p = section(EEG_DIAG_POWER, EEG_DIAG_POWER_LEN);
+	if (p) {
+		sys_put_le16(MIN(k_cyc_to_us_floor32((uint32_t)((st.active_cycles -
+						      last.active_cycles) / MAX(samples, 1U))),
+				 UINT16_MAX), &p[0]);
+		sys_put_le16(MIN(k_cyc_to_us_floor32(st.active_max_cycles), UINT16_MAX), &p[2]);
+		sys_put_le16(spi, &p[4]);
+		sys_put_le32(eeg_pm_current_ua(1000U - permille(idle_cycles, window_cycles), spi),
+			     &p[6]);
+	}
+	last = st;
+#endif
+}
+
+static void add_system(uint8_t *p)
+{
+	struct eeg_state_stats st;
+
+	eeg_state_stats_get(&st);
+
+	sys_put_le32((uint32_t)(k_uptime_get() / MSEC_PER_SEC), &p[0]);
+	p[4] = eeg_state_get();
+	sys_put_le16(1000U - permille(idle_cycles, window_cycles), &p[5]);
+	sys_put_le32(st.drdy_overruns, &p[7]);
+	sys_put_le32(st.wakeups, &p[11]);
+}
+
+/* Send whole sections, as many per notification as the MTU allows */
+static void diag_push(struct bt_conn *conn)
+{
+	uint16_t max = bt_gatt_get_mtu(conn) - 3;
+	uint16_t start = 0;
+	uint16_t pos = 0;
+
+	while (pos < snap_len) {
+		uint16_t len = 2 + snap[pos + 1];
+
+		if ((pos + len - start > max) && (pos > start)) {
+			if (eeg_svc_diag_send(conn, &snap[start], pos - start)) {
+				return;
+			}
+			start = pos;
+		}
+		pos += len;
+	}
+
+	if (pos > start) {
+		eeg_svc_diag_send(conn, &snap[start], pos - start);
+	}
+}
+
+/* Runs only while a central is connected, nobody can read the result otherwise */
+static void diag_work_handler(struct k_work *work)
+{
+	uint32_t now = k_cycle_get_32();
+	struct bt_conn *conn = NULL;
+	k_spinlock_key_t key;
+	bool baseline;
+	uint8_t *sys;
+
+	key = k_spin_lock(&conn_lock);
+	if (diag_conn) {
+		conn = bt_conn_ref(diag_conn);
+	}
+	k_spin_unlock(&conn_lock, key);
+
+	if (!conn) {
+		return;
+	}
+
+	/*
+	 * The first pass after connecting only restarts the rates, whose last
+	 * sample is from before the disconnection. Stacks are scanned for a
+	 * subscriber, or for the snapshot after a read.
+	 */
+	baseline = atomic_clear(&restarted);
+	scan_stacks = !baseline && (atomic_get(&subscribed) || atomic_clear(&scan_requested));
+
+	window_cycles = now - last_cycle;
+	last_cycle = now;
+	idle_cycles = 0;
+	build_len = 0;
+
+	/* System goes first but needs the idle time found with the threads */
+	sys = section(EEG_DIAG_SYSTEM, EEG_DIAG_SYSTEM_LEN);
+	add_link(conn);
+	add_rates();
+	add_pools();
+	add_threads();
+	add_latency();
+	add_power();
+	add_system(sys);
+
+	/* A new central gets nothing older than its connection */
+	k_mutex_lock(&snap_lock, K_FOREVER);
+	if (baseline) {
+		snap_len = 0;
+	} else {
+		memcpy(snap, build_buf, build_len);
+		snap_len = build_len;
+		if (atomic_get(&subscribed)) {
+			diag_push(conn);
+		}
+	}
+	k_mutex_unlock(&snap_lock);
+
+	bt_conn_unref(conn);
+
+	k_work_reschedule(&diag_work, DIAG_PERIOD);
+}
+
+uint16_t eeg_diag_get(uint8_t *buf, uint16_t size)
+{
+	uint16_t len;
+
+	k_mutex_lock(&snap_lock, K_FOREVER);
+	len = MIN(snap_len, size);
+	memcpy(buf, snap, len);
+	k_mutex_unlock(&snap_lock);
+
+	atomic_set(&scan_requested, 1);
+
+	return len;
+}
+
+void eeg_diag_subscribed(bool on)
+{
+	atomic_set(&subscribed, on);
+}
+
+static void diag_connected(struct bt_conn *conn, uint8_t err)
+{
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+	bool start = false;
+
+	if (!err && !diag_conn) {
+		diag_conn = bt_conn_ref(conn);
+		start = true;
+	}
+
+	k_spin_unlock(&conn_lock, key);
+
+	if (start) {
+		atomic_set(&restarted, 1);
+		atomic_set(&scan_requested, 1);
+		k_work_reschedule(&diag_work, K_NO_WAIT);
+	}
+}
+
+static void diag_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+	bool stop = false;
+
+	if (diag_conn == conn) {
+		bt_conn_unref(diag_conn);
+		diag_conn = NULL;
+		stop = true;
+	}
+
+	k_spin_unlock(&conn_lock, key);
+
+	atomic_set(&subscribed, 0);
+
+	if (stop) {
+		k_work_cancel_delayable(&diag_work);
+	}
+}
+
+static void diag_le_param_updated(struct bt_conn *conn, uint16_t interval,
+				  uint16_t latency, uint16_t timeout)
+{
+	LOG_INF("Connection interval %u us, latency %u, timeout %u ms",
+		interval * 1250U, latency, timeout * 10U);
+}
+
+BT_CONN_CB_DEFINE(diag_conn_callbacks) = {
+	.connected = diag_connected,
+	.disconnected = diag_disconnected,
+	.le_param_updated = diag_le_param_updated,
+};
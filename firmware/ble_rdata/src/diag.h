@@ -0,0 +1,50 @@
+/*
+ * ANA EEG sticker - runtime diagnostics
+ *
+ * Once a second while a central is connected the sticker takes a snapshot of
+ * its threads, buffer pools, link and rates (sections described in
+ * eeg_packet.h); with nothing connected it takes none. The central reads it
+ * from the diagnostics characteristic, or subscribes and gets it pushed.
+ * Thread stacks are only scanned for a subscriber or after a read, so a read
+ * returns the stack use found for the previous one.
+ */
+
+#ifndef DIAG_H_
+#define DIAG_H_
+
+#include <zephyr/types.h>
+
+/* Occupancy of one buffer pool or queue, filled in by the module owning it */
+struct eeg_diag_pool {
+	uint16_t used;
+	uint16_t peak;          // 0 if the pool does not track it
+	uint16_t total;
+	uint32_t failed;        // Allocations or puts that found it full
+};
+
+void eeg_uart_pool_get(struct eeg_diag_pool *pool);
+void eeg_log_pool_get(struct eeg_diag_pool *pool);
+void eeg_ctrl_pool_get(struct eeg_diag_pool *pool);
+void eeg_retx_pool_get(struct eeg_diag_pool *pool);
+
+#if defined(CONFIG_EEG_DIAG)
+
+/* Copy of the latest snapshot, returns its length, 0 before the first one */
+uint16_t eeg_diag_get(uint8_t *buf, uint16_t size);
+
+/* Central (un)subscribed to the diagnostics characteristic */
+void eeg_diag_subscribed(bool on);
+
+#else
+
+static inline uint16_t eeg_diag_get(uint8_t *buf, uint16_t size)
+{
+	return 0;
+}
+static inline void eeg_diag_subscribed(bool on)
+{
+}
+
+#endif /* CONFIG_EEG_DIAG */
+
+#endif /* DIAG_H_ */
@@ -0,0 +1,172 @@
+/*
+ * ANA EEG sticker - command/control plane
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "eeg_svc.h"
+#include "retx.h"
+#include "eeg_ctrl.h"
+#include "eeg_state.h"
+#include "diag.h"
+
+LOG_MODULE_REGISTER(eeg_ctrl, LOG_LEVEL_INF);
+
+#define CTRL_RESP_MAX   (EEG_CTRL_TLV_HDR_LEN + 1 + \
+			 MAX(sizeof(struct eeg_ctrl_counters), sizeof(struct eeg_ctrl_latency)))
+
+K_MSGQ_DEFINE(ctrl_q, sizeof(struct eeg_ctrl_cmd), CONFIG_EEG_CTRL_QUEUE, 4);
+
+static struct eeg_ctrl_stats stats;
+
+/* Expected value length per command, -1 for types that are not commands */
+static int ctrl_value_len(uint8_t type)
+{
+	switch (type) {
+	case EEG_CTRL_START:
+	case EEG_CTRL_STOP:
+	case EEG_CTRL_COUNTERS:
+	case EEG_CTRL_LOW_POWER:
+		return 0;
+	case EEG_CTRL_SET_CHANS:
+	case EEG_CTRL_SET_MODE:
+		return 1;
+	case EEG_CTRL_SET_RATE:
+	case EEG_CTRL_SET_GAIN:
+		return 2;
+	case EEG_CTRL_SET_SPATIAL:
+		return EEG_CTRL_SPATIAL_LEN;
+	case EEG_CTRL_SET_FEEDBACK:
+		return EEG_CTRL_FEEDBACK_LEN;
+	case EEG_CTRL_LATENCY:
+		return IS_ENABLED(CONFIG_EEG_LATENCY) ? 2 : -1;
+	default:
+		return -1;
+	}
+}
+
+static void ctrl_queue(const struct eeg_ctrl_cmd *cmd)
+{
+	if (k_msgq_put(&ctrl_q, cmd, K_NO_WAIT)) {
+		LOG_WRN("Command 0x%02x dropped, queue full", cmd->type);
+		stats.dropped++;
+		return;
+	}
+
+	stats.received++;
+	eeg_state_post(EEG_EVT_CTRL);
+}
+
+/* Every TLV must be known and complete, otherwise it is not ours */
+static bool ctrl_is_tlv_stream(const uint8_t *data, uint16_t len)
+{
+	uint16_t pos = 0;
+
+	while (pos < len) {
+		if ((len - pos < EEG_CTRL_TLV_HDR_LEN) ||
+		    (data[pos + 1] > len - pos - EEG_CTRL_TLV_HDR_LEN)) {
+			return false;
+		}
+
+		if ((data[pos] != EEG_CTRL_NACK) && (ctrl_value_len(data[pos]) < 0)) {
+			return false;
+		}
+
+		pos += EEG_CTRL_TLV_HDR_LEN + data[pos + 1];
+	}
+
+	return len > 0;
+}
+
+bool eeg_ctrl_received(const uint8_t *data, uint16_t len)
+{
+	struct eeg_ctrl_cmd cmd;
+
+	if ((len == 1) && ((data[0] == EEG_CTRL_LEGACY_START) ||
+			   (data[0] == EEG_CTRL_LEGACY_STOP))) {
+		cmd = (struct eeg_ctrl_cmd){
+			.type = (data[0] == EEG_CTRL_LEGACY_START) ?
+				EEG_CTRL_START : EEG_CTRL_STOP,
+			.legacy = true,
+		};
+		ctrl_queue(&cmd);
+		return true;
+	}
+
+	if (!ctrl_is_tlv_stream(data, len)) {
+		return false;
+	}
+
+	for (uint16_t pos = 0; pos < len; pos += EEG_CTRL_TLV_HDR_LEN + data[pos + 1]) {
+		const uint8_t *value = &data[pos + EEG_CTRL_TLV_HDR_LEN];
+		uint8_t vlen = data[pos + 1];
+
+		if (data[pos] == EEG_CTRL_NACK) {
+			eeg_retx_nack(value, vlen);
+			continue;
+		}
+
+		cmd = (struct eeg_ctrl_cmd){
+			.type = data[pos],
+			.len = vlen,
+		};
+
+		if (vlen != ctrl_value_len(cmd.type)) {
+			cmd.status = EEG_CTRL_STATUS_LEN;
+			cmd.len = 0;
+		} else {
+			memcpy(cmd.value, value, vlen);
+		}
+
+		ctrl_queue(&cmd);
+	}
+
+	return true;
+}
+
+int eeg_ctrl_get(struct eeg_ctrl_cmd *cmd, k_timeout_t timeout)
+{
+	return k_msgq_get(&ctrl_q, cmd, timeout);
+}
+
+void eeg_ctrl_respond(const struct eeg_ctrl_cmd *cmd, uint8_t status,
+		      const void *payload, uint8_t len)
+{
+	uint8_t buf[CTRL_RESP_MAX];
+	int err;
+
+	if (cmd->legacy) {
+		return;
+	}
+
+	if (len > sizeof(buf) - EEG_CTRL_TLV_HDR_LEN - 1) {
+		len = 0;
+		status = EEG_CTRL_STATUS_VALUE;
+	}
+
+	buf[0] = cmd->type;
+	buf[1] = 1 + len;
+	buf[2] = status;
+	if (len) {
+		memcpy(&buf[3], payload, len);
+	}
+
+	err = eeg_svc_resp_send(buf, EEG_CTRL_TLV_HDR_LEN + 1 + len);
+	if (err && (err != -EACCES)) {
+		LOG_WRN("Response to 0x%02x not sent (err %d)", cmd->type, err);
+		stats.resp_failed++;
+	}
+}
+
+void eeg_ctrl_stats_get(struct eeg_ctrl_stats *out)
+{
+	*out = stats;
+}
+
+void eeg_ctrl_pool_get(struct eeg_diag_pool *pool)
+{
+	pool->used = k_msgq_num_used_get(&ctrl_q);
+	pool->total = CONFIG_EEG_CTRL_QUEUE;
+	pool->failed = stats.dropped;
+}
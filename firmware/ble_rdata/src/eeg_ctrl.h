@@ -0,0 +1,45 @@
+/*
+ * ANA EEG sticker - command/control plane
+ *
+ * Commands arrive as TLVs on the NUS RX characteristic (see eeg_packet.h).
+ * They are parsed in the BT RX context into fixed size entries of a message
+ * queue, executed by the acquisition thread and answered on the response
+ * characteristic of the EEG service.
+ */
+
+#ifndef EEG_CTRL_H_
+#define EEG_CTRL_H_
+
+#include <zephyr/kernel.h>
+#include <eeg_packet.h>
+
+struct eeg_ctrl_cmd {
+	uint8_t type;
+	uint8_t status;         // EEG_CTRL_STATUS_OK or a parse error to report
+	uint8_t len;
+	bool legacy;            // Bare start/stop byte, not acknowledged
+	uint8_t value[EEG_CTRL_VALUE_MAX];
+};
+
+struct eeg_ctrl_stats {
+	uint32_t received;      // Commands queued
+	uint32_t dropped;       // Commands lost because the queue was full
+	uint32_t resp_failed;   // Responses the BT stack refused
+};
+
+/*
+ * Consume a write to the RX characteristic (BT RX context). Returns false if
+ * the write is not a control message, it then belongs to the UART bridge.
+ */
+bool eeg_ctrl_received(const uint8_t *data, uint16_t len);
+
+/* Fetch the next command for execution (acquisition context) */
+int eeg_ctrl_get(struct eeg_ctrl_cmd *cmd, k_timeout_t timeout);
+
+/* Answer an executed command, payload may be NULL */
+void eeg_ctrl_respond(const struct eeg_ctrl_cmd *cmd, uint8_t status,
+		      const void *payload, uint8_t len);
+
+void eeg_ctrl_stats_get(struct eeg_ctrl_stats *stats);
+
+#endif /* EEG_CTRL_H_ */
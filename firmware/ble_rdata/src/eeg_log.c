@@ -0,0 +1,393 @@
+/*
+ * ANA EEG sticker - offline flash log
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/logging/log.h>
+
+#include <eeg_delta.h>
+
+#include "eeg_stream.h"
+#include "eeg_svc.h"
+#include "eeg_log.h"
+#include "eeg_state.h"
+#include "diag.h"
+
+LOG_MODULE_REGISTER(eeg_log, LOG_LEVEL_INF);
+
+#define LOG_PARTITION_ID        FIXED_PARTITION_ID(eeg_log_partition)
+#define LOG_FCB_MAGIC           0x414E4131  // "ANA1"
+#define LOG_BLOCK_SIZE          CONFIG_EEG_LOG_BLOCK_SIZE
+#define LOG_INFLIGHT            CONFIG_EEG_LOG_DRAIN_INFLIGHT
+#define LOG_MTU_RETRY_DELAY     K_MSEC(1000)
+
+/* Flags shared between the BT callbacks and the log thread */
+#define LOG_FLAG_RESET          0
+
+/* Room for the flash write alignment padding after the block */
+struct log_block {
+	void *fifo_reserved;
+	uint16_t len;
+	uint8_t data[LOG_BLOCK_SIZE + 8];
+};
+
+K_MEM_SLAB_DEFINE_STATIC(log_slab, sizeof(struct log_block), CONFIG_EEG_LOG_BLOCK_BUFS, 4);
+static K_FIFO_DEFINE(log_fifo);
+static K_SEM_DEFINE(log_wake, 0, 1);
+static K_SEM_DEFINE(drain_credits, LOG_INFLIGHT, LOG_INFLIGHT);
+
+static struct fcb log_fcb;
+static struct flash_sector log_sectors[CONFIG_EEG_LOG_MAX_SECTORS];
+static struct eeg_log_stats stats;
+static atomic_t log_flags;
+
+/* Acquisition context only */
+static struct log_block *open_blk;
+static struct eeg_delta_enc enc;
+
+/* Log thread only */
+static struct fcb_entry drain_loc;      // Last block handed to the BT stack
+static bool drain_pending;
+static uint8_t drain_buf[LOG_BLOCK_SIZE + 8];
+
+/* Shared with BT callbacks, protected by drain_lock */
+static struct k_spinlock drain_lock;
+static struct bt_conn *drain_conn;
+static struct fcb_entry acked_loc;      // Last block the stack confirmed as sent
+static struct fcb_entry inflight[LOG_INFLIGHT];
+static uint8_t inflight_head;
+static uint8_t inflight_tail;
+static uintptr_t drain_gen;
+
+void eeg_log_packet(const uint8_t *pkt, uint16_t len)
+{
+	const struct eeg_pkt_hdr *hdr = (const struct eeg_pkt_hdr *)pkt;
+	size_t frame_len = eeg_pkt_frame_len(hdr->chan_mask);
+
+	if (len < eeg_pkt_len(hdr->chan_mask, hdr->n_frames)) {
+		return;
+	}
+
+	if (open_blk &&
+	    ((hdr->chan_mask != ((struct eeg_pkt_hdr *)open_blk->data)->chan_mask) ||
+	     !eeg_delta_enc_room(&enc, hdr->n_frames))) {
+		eeg_log_close();
+	}
+
+	if (!open_blk) {
+		if (k_mem_slab_alloc(&log_slab, (void **)&open_blk, K_NO_WAIT)) {
+			open_blk = NULL;
+			stats.packets_dropped++;
+			return;
+		}
+
+		eeg_delta_enc_init(&enc, open_blk->data, LOG_BLOCK_SIZE,
+				   eeg_pkt_seq(hdr), hdr->chan_mask);
+	}
+
+	for (uint8_t f = 0; f < hdr->n_frames; f++) {
+		eeg_delta_enc_frame(&enc, &pkt[EEG_PKT_HDR_LEN + f * frame_len]);
+	}
+}
+
+void eeg_log_close(void)
+{
+	if (!open_blk) {
+		return;
+	}
+
+	if (eeg_delta_enc_frames(&enc)) {
+		open_blk->len = enc.len;
+		k_fifo_put(&log_fifo, open_blk);
+		k_sem_give(&log_wake);
+	} else {
+		k_mem_slab_free(&log_slab, open_blk);
+	}
+
+	open_blk = NULL;
+}
+
+void eeg_log_connected(struct bt_conn *conn)
+{
+	k_spinlock_key_t key = k_spin_lock(&drain_lock);
+
+	drain_conn = bt_conn_ref(conn);
+
+	k_spin_unlock(&drain_lock, key);
+
+	k_sem_give(&log_wake);
+}
+
+void eeg_log_disconnected(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&drain_lock);
+
+	if (drain_conn) {
+		bt_conn_unref(drain_conn);
+		drain_conn = NULL;
+	}
+
+	k_spin_unlock(&drain_lock, key);
+
+	/* Anything not yet confirmed is sent again on the next connection */
+	atomic_set_bit(&log_flags, LOG_FLAG_RESET);
+	k_sem_give(&log_wake);
+}
+
+void eeg_log_kick(void)
+{
+	k_sem_give(&log_wake);
+}
+
+void eeg_log_stats_get(struct eeg_log_stats *out)
+{
+	*out = stats;
+}
+
+void eeg_log_pool_get(struct eeg_diag_pool *pool)
+{
+	pool->used = k_mem_slab_num_used_get(&log_slab);
+#if defined(CONFIG_MEM_SLAB_TRACE_MAX_UTILIZATION)
+	pool->peak = k_mem_slab_max_used_get(&log_slab);
+#endif
+	pool->total = CONFIG_EEG_LOG_BLOCK_BUFS;
+	pool->failed = stats.packets_dropped;
+}
+
+static void drain_sent(struct bt_conn *conn, void *user_data)
+{
+	k_spinlock_key_t key = k_spin_lock(&drain_lock);
+
+	/* Completions from a previous connection no longer count */
+	if ((uintptr_t)user_data == drain_gen) {
+		acked_loc = inflight[inflight_tail];
+		inflight_tail = (inflight_tail + 1) % LOG_INFLIGHT;
+		stats.blocks_drained++;
+	}
+
+	k_spin_unlock(&drain_lock, key);
+
+	k_sem_give(&drain_credits);
+	k_sem_give(&log_wake);
+}
+
+static void drain_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&drain_lock);
+
+	drain_gen++;
+	drain_loc = acked_loc;
+	inflight_head = 0;
+	inflight_tail = 0;
+
+	k_spin_unlock(&drain_lock, key);
+
+	k_sem_reset(&drain_credits);
+	for (int i = 0; i < LOG_INFLIGHT; i++) {
+		k_sem_give(&drain_credits);
+	}
+
+	drain_pending = !fcb_is_empty(&log_fcb);
+}
+
+/* Make room by dropping the oldest sector, moving the drain cursors off it */
+static int log_reclaim(void)
+{
+	struct flash_sector *oldest = log_fcb.f_oldest;
+	k_spinlock_key_t key;
+	int err;
+
+	err = fcb_rotate(&log_fcb);
+	if (err) {
+		return err;
+	}
+
+	key = k_spin_lock(&drain_lock);
+
+	if (!acked_loc.fe_sector || acked_loc.fe_sector == oldest) {
+		stats.sectors_overwritten++;
+		acked_loc = (struct fcb_entry){0};
+	}
+	if (!drain_loc.fe_sector || drain_loc.fe_sector == oldest) {
+		drain_loc = (struct fcb_entry){0};
+	}
+
+	k_spin_unlock(&drain_lock, key);
+
+	return 0;
+}
+
+static void log_write(struct log_block *blk)
+{
+	uint16_t len = ROUND_UP(blk->len, MAX(log_fcb.f_align, 1));
+	struct fcb_entry loc;
+	int err;
+
+	memset(&blk->data[blk->len], 0, len - blk->len);
+
+	err = fcb_append(&log_fcb, len, &loc);
+	if (err == -ENOSPC) {
+		err = log_reclaim();
+		if (!err) {
+			err = fcb_append(&log_fcb, len, &loc);
+		}
+	}
+
+	if (!err) {
+		err = flash_area_write(log_fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc),
+				       blk->data, len);
+	}
+
+	if (!err) {
+		err = fcb_append_finish(&log_fcb, &loc);
+	}
+
+	if (err) {
+		LOG_WRN("Log write failed (err %d)", err);
+		stats.write_errors++;
+		return;
+	}
+
+	stats.blocks_written++;
+	drain_pending = true;
+}
+
+static void drain_one(void)
+{
+	struct fcb_entry loc = drain_loc;
+	struct bt_conn *conn = NULL;
+	k_spinlock_key_t key;
+	uintptr_t gen;
+	int err;
+
+	if (fcb_getnext(&log_fcb, &loc)) {
+		drain_pending = false;
+		k_sem_give(&drain_credits);
+		return;
+	}
+
+	if ((loc.fe_data_len > sizeof(drain_buf)) ||
+	    flash_area_read(log_fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), drain_buf,
+			    loc.fe_data_len)) {
+		LOG_WRN("Skipping unreadable log block");
+		drain_loc = loc;
+		k_sem_give(&drain_credits);
+		return;
+	}
+
+	key = k_spin_lock(&drain_lock);
+
+	if (drain_conn) {
+		conn = bt_conn_ref(drain_conn);
+	}
+	inflight[inflight_head] = loc;
+	gen = drain_gen;
+
+	k_spin_unlock(&drain_lock, key);
+
+	if (!conn) {
+		k_sem_give(&drain_credits);
+		return;
+	}
+
+	err = eeg_svc_bulk_send(conn, drain_buf, loc.fe_data_len, drain_sent,
+				(void *)gen);
+	bt_conn_unref(conn);
+
+	if (err) {
+		k_sem_give(&drain_credits);
+
+		if (err == -EMSGSIZE) {
+			LOG_WRN("ATT MTU too small for log blocks, waiting for MTU exchange");
+			k_sleep(LOG_MTU_RETRY_DELAY);
+		} else {
+			k_sleep(K_MSEC(CONFIG_EEG_RETX_BACKOFF_MS));
+		}
+		return;
+	}
+
+	inflight_head = (inflight_head + 1) % LOG_INFLIGHT;
+	drain_loc = loc;
+}
+
+static int log_init(void)
+{
+	uint32_t cnt = ARRAY_SIZE(log_sectors);
+	const struct flash_area *fa;
+	int err;
+
+	err = flash_area_get_sectors(LOG_PARTITION_ID, &cnt, log_sectors);
+	if (err) {
+		LOG_ERR("Cannot get log partition layout (err %d)", err);
+		return err;
+	}
+
+	log_fcb.f_magic = LOG_FCB_MAGIC;
+	log_fcb.f_version = EEG_PKT_VERSION;
+	log_fcb.f_sector_cnt = cnt;
+	log_fcb.f_scratch_cnt = 0;
+	log_fcb.f_sectors = log_sectors;
+
+	err = fcb_init(LOG_PARTITION_ID, &log_fcb);
+	if (err) {
+		/* Foreign or corrupted content, start from a clean partition */
+		LOG_WRN("Log partition unusable (err %d), erasing", err);
+
+		err = flash_area_open(LOG_PARTITION_ID, &fa);
+		if (!err) {
+			err = flash_area_erase(fa, 0, fa->fa_size);
+			flash_area_close(fa);
+		}
+		if (!err) {
+			err = fcb_init(LOG_PARTITION_ID, &log_fcb);
+		}
+		if (err) {
+			LOG_ERR("Cannot init log (err %d)", err);
+			return err;
+		}
+	}
+
+	/* The drain position is not persisted, a reboot re-sends the whole log */
+	drain_pending = !fcb_is_empty(&log_fcb);
+	LOG_INF("Log ready, %u sectors, %s", cnt, drain_pending ? "backlog pending" : "empty");
+
+	return 0;
+}
+
+static void log_thread(void)
+{
+	struct log_block *blk;
+
+	if (log_init()) {
+		return;
+	}
+
+	for (;;) {
+		if (atomic_test_and_clear_bit(&log_flags, LOG_FLAG_RESET)) {
+			drain_reset();
+		}
+
+		/* Persist finished blocks first, they only exist in RAM */
+		while ((blk = k_fifo_get(&log_fifo, K_NO_WAIT)) != NULL) {
+			log_write(blk);
+			k_mem_slab_free(&log_slab, blk);
+		}
+
+		eeg_state_draining(drain_pending && drain_conn);
+
+		if (drain_pending && drain_conn && eeg_svc_bulk_enabled()) {
+			if (!k_sem_take(&drain_credits, K_MSEC(100))) {
+				drain_one();
+			}
+			continue;
+		}
+
+		k_sem_take(&log_wake, K_FOREVER);
+	}
+}
+
+K_THREAD_DEFINE(eeg_log_thread_id, CONFIG_EEG_LOG_THREAD_STACK_SIZE, log_thread,
+		NULL, NULL, NULL, CONFIG_EEG_LOG_THREAD_PRIO, 0, 0);
@@ -0,0 +1,55 @@
+/*
+ * ANA EEG sticker - offline flash log
+ *
+ * While no central is connected, data packets are delta-compressed into
+ * blocks (see eeg_delta.h) and appended to a flash circular buffer, unless
+ * the live mode leaves out raw data (EEG_MODE_RAW off). Once a
+ * central subscribes to the bulk characteristic the backlog is drained there,
+ * alongside the live stream.
+ */
+
+#ifndef EEG_LOG_H_
+#define EEG_LOG_H_
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
+
+struct eeg_log_stats {
+	uint32_t blocks_written;
+	uint32_t blocks_drained;
+	uint32_t sectors_overwritten; // Undrained sectors lost to rotation
+	uint32_t packets_dropped;     // No free block buffer while disconnected
+	uint32_t write_errors;
+};
+
+#if defined(CONFIG_EEG_LOG)
+
+/* Add one live data packet to the open block (acquisition context) */
+void eeg_log_packet(const uint8_t *pkt, uint16_t len);
+
+/* Close the open block so it gets persisted (acquisition context) */
+void eeg_log_close(void);
+
+void eeg_log_connected(struct bt_conn *conn);
+void eeg_log_disconnected(void);
+
+/* Wake the log thread, e.g. after the central subscribed */
+void eeg_log_kick(void);
+
+void eeg_log_stats_get(struct eeg_log_stats *stats);
+
+#else
+
+static inline void eeg_log_packet(const uint8_t *pkt, uint16_t len) {}
+static inline void eeg_log_close(void) {}
+static inline void eeg_log_connected(struct bt_conn *conn) {}
+static inline void eeg_log_disconnected(void) {}
+static inline void eeg_log_kick(void) {}
+static inline void eeg_log_stats_get(struct eeg_log_stats *stats)
+{
+	*stats = (struct eeg_log_stats){0};
+}
+
+#endif /* CONFIG_EEG_LOG */
+
+#endif /* EEG_LOG_H_ */
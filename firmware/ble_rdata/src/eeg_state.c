@@ -0,0 +1,129 @@
+/*
+ * ANA EEG sticker - sticker state machine
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/logging/log.h>
+
+#include "eeg_state.h"
+
+LOG_MODULE_REGISTER(eeg_state, LOG_LEVEL_INF);
+
+static K_EVENT_DEFINE(events);
+
+static struct k_spinlock lock;
+static bool advertising;
+static bool connected;
+static bool streaming;
+static bool draining;
+static enum eeg_state state = EEG_STATE_IDLE;
+static int64_t entered_ticks;
+static struct eeg_state_stats stats = {
+	.entries[EEG_STATE_IDLE] = 1,
+};
+
+static const char *const names[EEG_STATE_COUNT] = {
+	[EEG_STATE_IDLE] = "idle",
+	[EEG_STATE_ADVERTISING] = "advertising",
+	[EEG_STATE_CONNECTED] = "connected",
+	[EEG_STATE_STREAMING] = "streaming",
+	[EEG_STATE_DRAINING] = "draining",
+};
+
+void eeg_state_post(uint32_t ev)
+{
+	uint32_t prev = k_event_post(&events, ev);
+
+	/* An unconsumed DRDY means a sample was overwritten in the ADS1299 */
+	if (ev & prev & EEG_EVT_DRDY) {
+		stats.drdy_overruns++;
+	}
+}
+
+uint32_t eeg_state_wait(uint32_t ev, k_timeout_t timeout)
+{
+	uint32_t got;
+
+	if (!k_event_wait(&events, ev, false, timeout)) {
+		return 0;
+	}
+
+	/*
+	 * Take the events with the same operation that clears them: anything
+	 * posted after the wait returned is handled now, anything posted after
+	 * the clear stays set for the next wait.
+	 */
+	got = k_event_clear(&events, ev) & ev;
+	stats.wakeups++;
+
+	return got;
+}
+
+static enum eeg_state derive(void)
+{
+	if (streaming) {
+		return EEG_STATE_STREAMING;
+	}
+	if (connected) {
+		return draining ? EEG_STATE_DRAINING : EEG_STATE_CONNECTED;
+	}
+
+	return advertising ? EEG_STATE_ADVERTISING : EEG_STATE_IDLE;
+}
+
+/* Called with lock held */
+static void update(void)
+{
+	enum eeg_state next = derive();
+	int64_t now = k_uptime_ticks();
+	enum eeg_state prev = state;
+
+	if (next == state) {
+		return;
+	}
+
+	stats.time_us[state] += k_ticks_to_us_floor64(now - entered_ticks);
+	stats.entries[next]++;
+	stats.transitions++;
+	entered_ticks = now;
+	state = next;
+
+	LOG_INF("%s -> %s", names[prev], names[next]);
+}
+
+#define STATE_SETTER(name)                                      \
+	void eeg_state_##name(bool on)                          \
+	{                                                       \
+		k_spinlock_key_t key = k_spin_lock(&lock);      \
+								\
+		name = on;                                      \
+		update();                                       \
+								\
+		k_spin_unlock(&lock, key);                      \
+	}
+
+STATE_SETTER(advertising)
+STATE_SETTER(connected)
+STATE_SETTER(streaming)
+STATE_SETTER(draining)
+
+enum eeg_state eeg_state_get(void)
+{
+	return state;
+}
+
+const char *eeg_state_name(enum eeg_state s)
+{
+	return (s < EEG_STATE_COUNT) ? names[s] : "?";
+}
+
+void eeg_state_stats_get(struct eeg_state_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = stats;
+	out->time_us[state] += k_ticks_to_us_floor64(k_uptime_ticks() - entered_ticks);
+
+	k_spin_unlock(&lock, key);
+}
@@ -0,0 +1,64 @@
+/*
+ * ANA EEG sticker - sticker state machine
+ *
+ * The connection callbacks, the control channel, the offline log and the
+ * acquisition loop report what they are doing here; the sticker state is
+ * derived from that:
+ *
+ *   IDLE        Bluetooth not up yet
+ *   ADVERTISING no central, not sampling
+ *   CONNECTED   central connected, not sampling, nothing to drain
+ *   STREAMING   sampling, to the central or to the offline log
+ *   DRAINING    central connected, not sampling, offline log backlog going out
+ *
+ * Wake-ups of the acquisition loop go through one k_event, so it sleeps
+ * (and the CPU idles) until there is something to do.
+ */
+
+#ifndef EEG_STATE_H_
+#define EEG_STATE_H_
+
+#include <zephyr/kernel.h>
+
+enum eeg_state {
+	EEG_STATE_IDLE,
+	EEG_STATE_ADVERTISING,
+	EEG_STATE_CONNECTED,
+	EEG_STATE_STREAMING,
+	EEG_STATE_DRAINING,
+	EEG_STATE_COUNT,
+};
+
+/* Events waking the acquisition loop */
+#define EEG_EVT_CONNECTED       BIT(0)
+#define EEG_EVT_DISCONNECTED    BIT(1)
+#define EEG_EVT_CTRL            BIT(2)  // Control command queued
+#define EEG_EVT_DRDY            BIT(3)  // ADS1299 sample ready
+#define EEG_EVT_ALL             (EEG_EVT_CONNECTED | EEG_EVT_DISCONNECTED | \
+				 EEG_EVT_CTRL | EEG_EVT_DRDY)
+
+struct eeg_state_stats {
+	uint32_t entries[EEG_STATE_COUNT];      // Times each state was entered
+	uint64_t time_us[EEG_STATE_COUNT];      // Time spent in each state
+	uint32_t transitions;
+	uint32_t drdy_overruns;                 // DRDY while the previous one was pending
+	uint32_t wakeups;                       // Acquisition loop wake-ups
+};
+
+void eeg_state_post(uint32_t events);
+
+/* Wait for any of events, return and clear the ones that are set */
+uint32_t eeg_state_wait(uint32_t events, k_timeout_t timeout);
+
+void eeg_state_advertising(bool on);
+void eeg_state_connected(bool on);
+void eeg_state_streaming(bool on);
+void eeg_state_draining(bool on);
+
+enum eeg_state eeg_state_get(void);
+const char *eeg_state_name(enum eeg_state state);
+
+/* Residency includes the time spent so far in the current state */
+void eeg_state_stats_get(struct eeg_state_stats *stats);
+
+#endif /* EEG_STATE_H_ */
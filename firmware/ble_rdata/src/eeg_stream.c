@@ -0,0 +1,467 @@
+/*
+ * ANA EEG sticker - packetizer
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/logging/log.h>
+
+#include <bluetooth/services/nus.h>
+
+#include <eeg_codec.h>
+
+#include "eeg_stream.h"
+#include "retx.h"
+#include "eeg_log.h"
+#include "broadcast.h"
+#include "eeg_ctrl.h"
+#include "iso.h"
+#include "latency.h"
+#include "filter.h"
+#include "bands.h"
+#include "scores.h"
+#include "artifact.h"
+#include "spatial.h"
+#include "feedback.h"
+
+LOG_MODULE_REGISTER(eeg_stream, LOG_LEVEL_INF);
+
+/* Something looks at the samples of each packet, decode them once for all */
+#define STREAM_DECODE           (IS_ENABLED(CONFIG_EEG_ARTIFACT) || IS_ENABLED(CONFIG_EEG_SPATIAL) || \
+				 IS_ENABLED(CONFIG_EEG_FILTER) || IS_ENABLED(CONFIG_EEG_BANDS) ||     \
+				 IS_ENABLED(CONFIG_EEG_SCORES))
+
+/* Acquisition context only, pkt is the retx slot being filled */
+static uint8_t *pkt;
+static uint8_t n_frames;
+static uint16_t seq;
+static uint8_t chan_mask = EEG_CHAN_MASK;
+static uint16_t rate = EEG_DEFAULT_RATE;
+static uint8_t mode = EEG_MODE_RAW;
+static const struct bt_gatt_attr *live_attr;
+static int32_t samples[EEG_FRAMES_PER_PACKET * EEG_CHANNELS];
+static uint32_t first_drdy;
+static uint32_t first_read;
+static uint32_t frame_drdy;
+
+/*
+ * Live notifications in flight, indexed by sequence number. The BT stack
+ * holds far fewer TX buffers than this, so a slot is never reused early.
+ */
+#define LIVE_INFLIGHT 32
+
+static struct live_pkt {
+	uint32_t cyc;           // k_cycle_get_32() when handed over
+#if defined(CONFIG_EEG_LATENCY)
+	uint32_t drdy;          // eeg_lat_now() stamps
+	uint32_t queued;
+#endif
+} inflight[LIVE_INFLIGHT];
+
+static struct k_spinlock conn_lock;
+static struct bt_conn *live_conn;
+static struct eeg_stream_stats stats;
+
+static struct k_spinlock anchor_lock;
+static struct eeg_stream_anchor anchor;
+
+void eeg_stream_tx_done(uint32_t stamp, uint16_t packets)
+{
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - stamp);
+
+	stats.tx_done += packets;
+	stats.latency_sum_us += (uint64_t)us * packets;
+	stats.latency_max_us = MAX(stats.latency_max_us, us);
+}
+
+/* Runs in the BT stack once the controller has sent the packet */
+static void live_sent(struct bt_conn *conn, void *user_data)
+{
+	const struct live_pkt *lp = &inflight[(uintptr_t)user_data % LIVE_INFLIGHT];
+
+#if defined(CONFIG_EEG_LATENCY)
+	uint32_t now = eeg_lat_now();
+
+	eeg_lat_record(EEG_LAT_TX, lp->queued, now);
+	eeg_lat_record(EEG_LAT_TOTAL, lp->drdy, now);
+#endif
+	eeg_stream_tx_done(lp->cyc, 1);
+}
+
+/*
+ * Same as bt_nus_send() but with a completion callback to time the packet.
+ * The packet is notified from its retx slot, the ATT PDU is the only copy.
+ */
+static int live_send(struct bt_conn *conn, const uint8_t *buf, uint16_t len,
+		     uint16_t pkt_seq)
+{
+	struct bt_gatt_notify_params params = {
+		.data = buf,
+		.len = len,
+		.func = live_sent,
+		.user_data = (void *)(uintptr_t)pkt_seq,
+	};
+
+	if (!live_attr) {
+		live_attr = bt_gatt_find_by_uuid(NULL, 0, BT_UUID_NUS_TX);
+	}
+	params.attr = live_attr;
+
+	inflight[pkt_seq % LIVE_INFLIGHT].cyc = k_cycle_get_32();
+
+	return bt_gatt_notify_cb(conn, &params);
+}
+
+int eeg_stream_send_aux_cb(const uint8_t *buf, uint16_t len, bt_gatt_complete_func_t func,
+			   void *user_data)
+{
+	struct bt_gatt_notify_params params = {
+		.data = buf,
+		.len = len,
+		.func = func,
+		.user_data = user_data,
+	};
+	struct bt_conn *conn = NULL;
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+	int err;
+
+	if (live_conn) {
+		conn = bt_conn_ref(live_conn);
+	}
+	k_spin_unlock(&conn_lock, key);
+
+	if (!conn) {
+		return -ENOTCONN;
+	}
+
+	if (!live_attr) {
+		live_attr = bt_gatt_find_by_uuid(NULL, 0, BT_UUID_NUS_TX);
+	}
+	params.attr = live_attr;
+	err = bt_gatt_notify_cb(conn, &params);
+	bt_conn_unref(conn);
+
+	return err;
+}
+
+int eeg_stream_send_aux(const uint8_t *buf, uint16_t len)
+{
+	return eeg_stream_send_aux_cb(buf, len, NULL, NULL);
+}
+
+uint8_t *eeg_stream_frame_buf(void)
+{
+	if (!pkt) {
+		pkt = eeg_retx_claim(seq);
+	}
+
+	return &pkt[EEG_PKT_HDR_LEN + n_frames * eeg_pkt_frame_len(chan_mask)];
+}
+
+bool eeg_stream_frame(const uint8_t *frame)
+{
+	uint8_t *dst = eeg_stream_frame_buf();
+
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		if (chan_mask & BIT(ch)) {
+			memcpy(dst, &frame[ch * EEG_SAMPLE_BYTES], EEG_SAMPLE_BYTES);
+			dst += EEG_SAMPLE_BYTES;
+		}
+	}
+
+	return eeg_stream_frame_done();
+}
+
+void eeg_stream_frame_time(uint32_t drdy)
+{
+	eeg_lat_record(EEG_LAT_DRDY_SPI, drdy, eeg_lat_now());
+
+	frame_drdy = drdy;
+	if (n_frames == 0) {
+		first_drdy = drdy;
+	}
+}
+
+bool eeg_stream_frame_done(void)
+{
+	struct bt_conn *conn = NULL;
+	k_spinlock_key_t key;
+	uint32_t now = eeg_lat_now();
+	uint16_t pkt_seq;
+	uint8_t artifacts;
+	uint8_t bad;
+	uint8_t spatial;
+	uint8_t out_mask = chan_mask;
+	uint8_t *buf;
+	uint16_t len;
+	int err;
+
+	if (n_frames == 0) {
+		first_read = now;
+	}
+
+	/* Frame by frame, the packet would add up to EEG_FRAMES_PER_PACKET of delay */
+	if (mode & EEG_MODE_FEEDBACK) {
+		eeg_feedback_frame(&pkt[EEG_PKT_HDR_LEN + n_frames * eeg_pkt_frame_len(chan_mask)],
+				   chan_mask, seq, n_frames, frame_drdy ? frame_drdy : now);
+	}
+	frame_drdy = 0;
+
+	if (++n_frames < EEG_FRAMES_PER_PACKET) {
+		return false;
+	}
+
+	eeg_lat_record(EEG_LAT_BATCH, first_read, now);
+
+	buf = pkt;
+	pkt = NULL;
+	if (STREAM_DECODE) {
+		eeg_codec_unpack24(&buf[EEG_PKT_HDR_LEN], samples,
+				   n_frames * eeg_pkt_channels(chan_mask));
+	}
+	artifacts = eeg_artifact_frames(samples, chan_mask, n_frames, &bad);
+	/* From here on the channels are the derivations, if any */
+	spatial = eeg_spatial_frames(samples, &out_mask, n_frames);
+	bad = eeg_spatial_derived(bad);
+	len = eeg_pkt_len(out_mask, n_frames);
+	eeg_filter_frames(samples, out_mask, n_frames);
+	if (spatial || IS_ENABLED(CONFIG_EEG_FILTER)) {
+		eeg_codec_pack24(samples, &buf[EEG_PKT_HDR_LEN],
+				 n_frames * eeg_pkt_channels(out_mask));
+	}
+	eeg_pkt_hdr_init((struct eeg_pkt_hdr *)buf, EEG_PKT_TYPE_DATA, seq,
+			 out_mask, n_frames);
+	((struct eeg_pkt_hdr *)buf)->flags |= artifacts | spatial;
+	if (IS_ENABLED(CONFIG_EEG_FILTER)) {
+		((struct eeg_pkt_hdr *)buf)->flags |= EEG_PKT_FLAG_FILTERED;
+	}
+	if (mode & EEG_MODE_BANDS) {
+		eeg_bands_frames(samples, out_mask, n_frames);
+	}
+	if (mode & EEG_MODE_SCORES) {
+		eeg_scores_frames(samples, out_mask, n_frames, seq, bad);
+	}
+	n_frames = 0;
+	stats.packets++;
+
+	/* Lets the central map sequence numbers to its clock, see eeg_clock.h */
+	key = k_spin_lock(&anchor_lock);
+	anchor.valid = true;
+	anchor.seq = pkt_seq = seq++;
+	anchor.t_us = (int64_t)k_ticks_to_us_floor64(k_uptime_ticks());
+	k_spin_unlock(&anchor_lock, key);
+
+	/* The slot keeps it for NACKs, everything below reads it in place */
+	eeg_retx_commit(pkt_seq, len);
+	eeg_bcast_packet(buf, len);
+
+	key = k_spin_lock(&conn_lock);
+	if (live_conn) {
+		conn = bt_conn_ref(live_conn);
+	}
+	k_spin_unlock(&conn_lock, key);
+
+	/* Features only: the raw stream is not wanted later either, scores keep their own backlog */
+	if (!conn) {
+		if (mode & EEG_MODE_RAW) {
+			eeg_log_packet(buf, len);
+		}
+		return true;
+	}
+
+	/* Anything logged while disconnected can go to flash now */
+	eeg_log_close();
+
+	/* Features only: the packet stays available for NACKs and the log */
+	if (!(mode & EEG_MODE_RAW)) {
+		bt_conn_unref(conn);
+		return true;
+	}
+
+	/* A CIS takes over from notifications while it is up */
+	if (eeg_iso_packet(buf, len)) {
+		bt_conn_unref(conn);
+		eeg_lat_record(EEG_LAT_QUEUE, now, eeg_lat_now());
+		stats.bytes += len;
+		return true;
+	}
+
+#if defined(CONFIG_EEG_LATENCY)
+	inflight[pkt_seq % LIVE_INFLIGHT].drdy = first_drdy;
+	inflight[pkt_seq % LIVE_INFLIGHT].queued = eeg_lat_now();
+#endif
+	err = live_send(conn, buf, len, pkt_seq);
+	bt_conn_unref(conn);
+
+	if (err) {
+		LOG_DBG("Live packet %u not sent (err %d)", pkt_seq, err);
+		stats.notify_failed++;
+	} else {
+		eeg_lat_record(EEG_LAT_QUEUE, now, eeg_lat_now());
+		stats.bytes += len;
+	}
+
+	return true;
+}
+
+bool eeg_stream_boundary(void)
+{
+	return n_frames == 0;
+}
+
+uint8_t eeg_stream_mask(void)
+{
+	return chan_mask;
+}
+
+uint8_t eeg_stream_set_mask(uint8_t mask)
+{
+	bool applied;
+	uint8_t status;
+
+	__ASSERT_NO_MSG(n_frames == 0);
+	status = eeg_spatial_set_mask(mask, &applied);
+	if (status != EEG_CTRL_STATUS_OK) {
+		return status;
+	}
+
+	chan_mask = mask;
+	eeg_filter_reset();
+	eeg_bands_reset();
+	eeg_scores_reset();
+	eeg_artifact_reset();
+	eeg_feedback_reset();
+
+	return EEG_CTRL_STATUS_OK;
+}
+
+void eeg_stream_set_rate(uint16_t sps)
+{
+	__ASSERT_NO_MSG(n_frames == 0);
+	if (sps == rate) {
+		return;
+	}
+
+	rate = sps;
+	eeg_filter_set_rate(sps);
+	eeg_bands_set_rate(sps);
+	eeg_scores_set_rate(sps);
+	eeg_artifact_set_rate(sps);
+	eeg_feedback_set_rate(sps);
+}
+
+uint8_t eeg_stream_set_mode(uint8_t new_mode)
+{
+	uint8_t supported = EEG_MODE_RAW;
+
+	__ASSERT_NO_MSG(n_frames == 0);
+	if (IS_ENABLED(CONFIG_EEG_BANDS)) {
+		supported |= EEG_MODE_BANDS;
+	}
+	if (IS_ENABLED(CONFIG_EEG_SCORES)) {
+		supported |= EEG_MODE_SCORES;
+	}
+	if (IS_ENABLED(CONFIG_EEG_FEEDBACK)) {
+		supported |= EEG_MODE_FEEDBACK;
+	}
+	if (!new_mode || (new_mode & ~supported)) {
+		return EEG_CTRL_STATUS_VALUE;
+	}
+
+	if ((new_mode & EEG_MODE_BANDS) && !(mode & EEG_MODE_BANDS)) {
+		eeg_bands_reset();
+	}
+	if ((new_mode & EEG_MODE_SCORES) && !(mode & EEG_MODE_SCORES)) {
+		eeg_scores_reset();
+	}
+	if ((new_mode & EEG_MODE_FEEDBACK) && !(mode & EEG_MODE_FEEDBACK)) {
+		eeg_feedback_reset();
+	}
+	mode = new_mode;
+
+	return EEG_CTRL_STATUS_OK;
+}
+
+uint8_t eeg_stream_set_spatial(const uint8_t *value)
+{
+	bool applied;
+	uint8_t status;
+
+	__ASSERT_NO_MSG(n_frames == 0);
+	status = eeg_spatial_set_row(value, &applied);
+	if (applied) {
+		eeg_filter_reset();
+		eeg_bands_reset();
+		eeg_scores_reset();
+	}
+
+	return status;
+}
+
+uint16_t eeg_stream_rate(void)
+{
+	return rate;
+}
+
+void eeg_stream_connected(struct bt_conn *conn)
+{
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+
+	live_conn = bt_conn_ref(conn);
+
+	k_spin_unlock(&conn_lock, key);
+}
+
+void eeg_stream_disconnected(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+
+	if (live_conn) {
+		bt_conn_unref(live_conn);
+		live_conn = NULL;
+	}
+
+	k_spin_unlock(&conn_lock, key);
+}
+
+void eeg_stream_stats_get(struct eeg_stream_stats *out)
+{
+	*out = stats;
+}
+
+void eeg_stream_anchor_get(struct eeg_stream_anchor *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&anchor_lock);
+
+	*out = anchor;
+
+	k_spin_unlock(&anchor_lock, key);
+}
+
+void eeg_stream_counters(struct eeg_ctrl_counters *cnt)
+{
+	struct eeg_retx_stats retx;
+	struct eeg_log_stats log;
+	struct eeg_ctrl_stats ctrl;
+
+	eeg_retx_stats_get(&retx);
+	eeg_log_stats_get(&log);
+	eeg_ctrl_stats_get(&ctrl);
+
+	cnt->packets = sys_cpu_to_le32(stats.packets);
+	cnt->notify_failed = sys_cpu_to_le32(stats.notify_failed);
+	cnt->retx_requested = sys_cpu_to_le32(retx.requested);
+	cnt->retx_sent = sys_cpu_to_le32(retx.sent);
+	cnt->retx_expired = sys_cpu_to_le32(retx.expired);
+	cnt->log_written = sys_cpu_to_le32(log.blocks_written);
+	cnt->log_drained = sys_cpu_to_le32(log.blocks_drained);
+	cnt->log_dropped = sys_cpu_to_le32(log.packets_dropped);
+	cnt->ctrl_dropped = sys_cpu_to_le32(ctrl.dropped);
+	cnt->bytes = sys_cpu_to_le32(stats.bytes);
+	cnt->tx_done = sys_cpu_to_le32(stats.tx_done);
+	cnt->latency_avg_us = sys_cpu_to_le32(stats.tx_done ?
+					      (uint32_t)(stats.latency_sum_us / stats.tx_done) : 0);
+	cnt->latency_max_us = sys_cpu_to_le32(stats.latency_max_us);
+}
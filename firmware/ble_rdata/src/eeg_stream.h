@@ -0,0 +1,123 @@
+/*
+ * ANA EEG sticker - stream parameters and packetizer
+ *
+ * Every frame source (the ADS1299, the load generator) hands raw frames to
+ * eeg_stream_frame(), which builds the data packets and fans them out to the
+ * live link, the retransmit ring, the broadcast train and the offline log.
+ */
+
+#ifndef EEG_STREAM_H_
+#define EEG_STREAM_H_
+
+#include <zephyr/types.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <eeg_packet.h>
+
+#define EEG_CHANNELS            CONFIG_EEG_CHANNELS
+#define EEG_CHAN_MASK           ((uint8_t)BIT_MASK(EEG_CHANNELS))
+#define EEG_FRAME_LEN           (EEG_CHANNELS * EEG_SAMPLE_BYTES)
+#define EEG_FRAMES_PER_PACKET   CONFIG_EEG_FRAMES_PER_PACKET
+#define EEG_PKT_MAX_LEN         (EEG_PKT_HDR_LEN + EEG_FRAMES_PER_PACKET * EEG_FRAME_LEN)
+#define EEG_DEFAULT_RATE        250   // ADS1299 CONFIG1 after reset
+
+struct eeg_stream_stats {
+	uint32_t packets;           // Data packets produced
+	uint32_t bytes;             // Live packet bytes accepted by the BT stack
+	uint32_t notify_failed;     // Live packets the BT stack refused
+	uint32_t tx_done;           // Live packets confirmed sent
+	uint32_t latency_max_us;    // Packet handed over to TX done
+	uint64_t latency_sum_us;
+};
+
+/* Newest data packet and the uptime (us) it was complete at */
+struct eeg_stream_anchor {
+	bool valid;
+	uint16_t seq;
+	int64_t t_us;
+};
+
+/*
+ * Append one frame of EEG_CHANNELS 24-bit big-endian samples (acquisition
+ * context). Returns true when this completed and sent a packet.
+ */
+bool eeg_stream_frame(const uint8_t *frame);
+
+/*
+ * Zero-copy variant: write the samples of the channels in the mask straight
+ * to eeg_stream_frame_buf() (e.g. by DMA), then call eeg_stream_frame_done(),
+ * which returns like eeg_stream_frame().
+ */
+uint8_t *eeg_stream_frame_buf(void);
+bool eeg_stream_frame_done(void);
+
+/*
+ * Sources with a data ready interrupt report its eeg_lat_now() stamp right
+ * after reading a frame, before eeg_stream_frame_done().
+ */
+void eeg_stream_frame_time(uint32_t drdy);
+
+/* Channels currently put into packets */
+uint8_t eeg_stream_mask(void);
+
+/*
+ * Frame rate of the source, kept by the packetizer for the stages that
+ * process samples (filters, features). Only changes on a packet boundary.
+ */
+void eeg_stream_set_rate(uint16_t sps);
+uint16_t eeg_stream_rate(void);
+
+/*
+ * Live outputs, a combination of EEG_MODE_* bits. Returns an
+ * EEG_CTRL_STATUS_* code, EEG_MODE_BANDS needs CONFIG_EEG_BANDS,
+ * EEG_MODE_SCORES CONFIG_EEG_SCORES and EEG_MODE_FEEDBACK
+ * CONFIG_EEG_FEEDBACK. Without EEG_MODE_RAW data packets are still produced
+ * for NACKs, the broadcast and the log, only not notified.
+ */
+uint8_t eeg_stream_set_mode(uint8_t mode);
+
+/*
+ * One EEG_CTRL_SET_SPATIAL row (between packets); the pre-filter and the
+ * features restart when a new matrix takes effect. Returns an
+ * EEG_CTRL_STATUS_* code, EEG_CTRL_STATUS_VALUE without CONFIG_EEG_SPATIAL.
+ */
+uint8_t eeg_stream_set_spatial(const uint8_t *value);
+
+/*
+ * Notify a packet other than a data packet (band powers, scores) on the live
+ * characteristic, without TX tracking. Returns 0 or a negative errno.
+ */
+int eeg_stream_send_aux(const uint8_t *buf, uint16_t len);
+
+/* Same, func runs in the BT stack once the controller has sent the packet */
+int eeg_stream_send_aux_cb(const uint8_t *buf, uint16_t len, bt_gatt_complete_func_t func,
+			   void *user_data);
+
+/* No packet is half filled, stream settings may change */
+bool eeg_stream_boundary(void);
+
+/*
+ * Channels put into packets, only change on a packet boundary. Returns
+ * EEG_CTRL_STATUS_VALUE, mask unchanged, if the spatial filter's matrix
+ * needs an electrode left out.
+ */
+uint8_t eeg_stream_set_mask(uint8_t chan_mask);
+
+void eeg_stream_connected(struct bt_conn *conn);
+void eeg_stream_disconnected(void);
+
+void eeg_stream_stats_get(struct eeg_stream_stats *stats);
+
+/*
+ * Live transports report packets the controller has sent, stamp is the
+ * k_cycle_get_32() value when the (oldest) packet was handed over.
+ */
+void eeg_stream_tx_done(uint32_t stamp, uint16_t packets);
+
+void eeg_stream_anchor_get(struct eeg_stream_anchor *anchor);
+
+/* Fill the EEG_CTRL_COUNTERS response from all modules */
+void eeg_stream_counters(struct eeg_ctrl_counters *cnt);
+
+#endif /* EEG_STREAM_H_ */
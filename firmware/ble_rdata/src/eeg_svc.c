@@ -0,0 +1,144 @@
+/*
+ * ANA EEG sticker - EEG GATT service
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/logging/log.h>
+
+#include "eeg_svc.h"
+#include "eeg_log.h"
+#include "clock_sync.h"
+#include "diag.h"
+
+LOG_MODULE_REGISTER(eeg_svc, LOG_LEVEL_INF);
+
+static struct bt_uuid_128 eeg_svc_uuid = BT_UUID_INIT_128(BT_UUID_EEG_SVC_VAL);
+static struct bt_uuid_128 eeg_bulk_uuid = BT_UUID_INIT_128(BT_UUID_EEG_BULK_VAL);
+static struct bt_uuid_128 eeg_resp_uuid = BT_UUID_INIT_128(BT_UUID_EEG_RESP_VAL);
+static struct bt_uuid_128 eeg_clock_uuid = BT_UUID_INIT_128(BT_UUID_EEG_CLOCK_VAL);
+static struct bt_uuid_128 eeg_diag_uuid = BT_UUID_INIT_128(BT_UUID_EEG_DIAG_VAL);
+
+static bool bulk_notify_enabled;
+static bool resp_notify_enabled;
+
+static void bulk_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	bulk_notify_enabled = (value == BT_GATT_CCC_NOTIFY);
+	LOG_INF("Bulk notifications %s", bulk_notify_enabled ? "enabled" : "disabled");
+
+	eeg_log_kick();
+}
+
+static void resp_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	resp_notify_enabled = (value == BT_GATT_CCC_NOTIFY);
+}
+
+static ssize_t clock_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			   const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	eeg_clock_sync_request(conn, buf, len);
+
+	return len;
+}
+
+static void diag_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	eeg_diag_subscribed(value == BT_GATT_CCC_NOTIFY);
+}
+
+#if defined(CONFIG_EEG_DIAG)
+#define DIAG_READ_LEN CONFIG_EEG_DIAG_READ_LEN
+#else
+#define DIAG_READ_LEN 1
+#endif
+
+/* BT RX thread only; a long read is served from the copy taken at offset 0 */
+static uint8_t diag_read_buf[DIAG_READ_LEN];
+static uint16_t diag_read_len;
+
+static ssize_t diag_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			 void *buf, uint16_t len, uint16_t offset)
+{
+	if (!offset) {
+		diag_read_len = eeg_diag_get(diag_read_buf, sizeof(diag_read_buf));
+	}
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, diag_read_buf,
+				 diag_read_len);
+}
+
+BT_GATT_SERVICE_DEFINE(eeg_svc,
+	BT_GATT_PRIMARY_SERVICE(&eeg_svc_uuid),
+	BT_GATT_CHARACTERISTIC(&eeg_bulk_uuid.uuid,
+			       BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE,
+			       NULL, NULL, NULL),
+	BT_GATT_CCC(bulk_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&eeg_resp_uuid.uuid,
+			       BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE,
+			       NULL, NULL, NULL),
+	BT_GATT_CCC(resp_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&eeg_clock_uuid.uuid,
+			       BT_GATT_CHRC_WRITE_WITHOUT_RESP | BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_WRITE,
+			       NULL, clock_write, NULL),
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(&eeg_diag_uuid.uuid,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_READ,
+			       diag_read, NULL, NULL),
+	BT_GATT_CCC(diag_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+);
+
+bool eeg_svc_bulk_enabled(void)
+{
+	return bulk_notify_enabled;
+}
+
+int eeg_svc_bulk_send(struct bt_conn *conn, const uint8_t *data, uint16_t len,
+		      bt_gatt_complete_func_t cb, void *user_data)
+{
+	struct bt_gatt_notify_params params = {
+		.attr = &eeg_svc.attrs[1],
+		.data = data,
+		.len = len,
+		.func = cb,
+		.user_data = user_data,
+	};
+
+	if (!bulk_notify_enabled) {
+		return -EACCES;
+	}
+
+	if (len > bt_gatt_get_mtu(conn) - 3) {
+		return -EMSGSIZE;
+	}
+
+	return bt_gatt_notify_cb(conn, &params);
+}
+
+int eeg_svc_resp_send(const uint8_t *data, uint16_t len)
+{
+	if (!resp_notify_enabled) {
+		return -EACCES;
+	}
+
+	return bt_gatt_notify(NULL, &eeg_svc.attrs[4], data, len);
+}
+
+int eeg_svc_clock_send(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	return bt_gatt_notify(conn, &eeg_svc.attrs[7], data, len);
+}
+
+int eeg_svc_diag_send(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	return bt_gatt_notify(conn, &eeg_svc.attrs[10], data, len);
+}
@@ -0,0 +1,41 @@
+/*
+ * ANA EEG sticker - EEG GATT service
+ *
+ * Companion to NUS for traffic that must not share the live TX characteristic.
+ */
+
+#ifndef EEG_SVC_H_
+#define EEG_SVC_H_
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#define BT_UUID_EEG_SVC_VAL \
+	BT_UUID_128_ENCODE(0xe1a00001, 0x5ee5, 0x4c0d, 0x9a0e, 0x0a0e0e6ef00d)
+#define BT_UUID_EEG_BULK_VAL \
+	BT_UUID_128_ENCODE(0xe1a00002, 0x5ee5, 0x4c0d, 0x9a0e, 0x0a0e0e6ef00d)
+#define BT_UUID_EEG_RESP_VAL \
+	BT_UUID_128_ENCODE(0xe1a00003, 0x5ee5, 0x4c0d, 0x9a0e, 0x0a0e0e6ef00d)
+#define BT_UUID_EEG_CLOCK_VAL \
+	BT_UUID_128_ENCODE(0xe1a00004, 0x5ee5, 0x4c0d, 0x9a0e, 0x0a0e0e6ef00d)
+#define BT_UUID_EEG_DIAG_VAL \
+	BT_UUID_128_ENCODE(0xe1a00005, 0x5ee5, 0x4c0d, 0x9a0e, 0x0a0e0e6ef00d)
+
+/* Central has enabled notifications on the bulk characteristic */
+bool eeg_svc_bulk_enabled(void);
+
+/* Notify one block on the bulk characteristic, cb runs once it is sent */
+int eeg_svc_bulk_send(struct bt_conn *conn, const uint8_t *data, uint16_t len,
+		      bt_gatt_complete_func_t cb, void *user_data);
+
+/* Notify a control response TLV to every subscribed central */
+int eeg_svc_resp_send(const uint8_t *data, uint16_t len);
+
+/* Notify a clock sync response to the central that asked */
+int eeg_svc_clock_send(struct bt_conn *conn, const uint8_t *data, uint16_t len);
+
+/* Notify part of a diagnostics snapshot */
+int eeg_svc_diag_send(struct bt_conn *conn, const uint8_t *data, uint16_t len);
+
+#endif /* EEG_SVC_H_ */
@@ -0,0 +1,208 @@
+/*
+ * ANA EEG sticker - neurofeedback trackers
+ */
+
+#include <math.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+#include <eeg_codec.h>
+#include <eeg_goertzel.h>
+
+#include "eeg_stream.h"
+#include "latency.h"
+#include "feedback.h"
+
+LOG_MODULE_REGISTER(feedback, LOG_LEVEL_INF);
+
+#define FEEDBACK_WINDOW_MAX     CONFIG_EEG_FEEDBACK_WINDOW_MAX
+#define FEEDBACK_WINDOW_MIN_MS  20
+#define FEEDBACK_WINDOW_MAX_MS  2000
+#define FEEDBACK_PERIOD_MAX_MS  1000
+#define FEEDBACK_PKT_MAX_LEN    (EEG_PKT_HDR_LEN + EEG_FEEDBACK_HDR_LEN + \
+				 2 * EEG_FEEDBACK_TARGETS_MAX +           \
+				 EEG_CHANNELS * EEG_FEEDBACK_TARGETS_MAX * EEG_FEEDBACK_VALUE_LEN)
+
+BUILD_ASSERT(EEG_FEEDBACK_TARGETS_MAX <= EEG_GOERTZEL_TARGETS_MAX, "Too many targets");
+BUILD_ASSERT(EEG_CHANNELS <= EEG_GOERTZEL_CHANNELS_MAX, "Too many channels");
+
+/* Acquisition context only */
+static uint16_t targets[EEG_FEEDBACK_TARGETS_MAX] = {
+	CONFIG_EEG_FEEDBACK_TARGET1_DHZ,
+	CONFIG_EEG_FEEDBACK_TARGET2_DHZ,
+	CONFIG_EEG_FEEDBACK_TARGET3_DHZ,
+	CONFIG_EEG_FEEDBACK_TARGET4_DHZ,
+};
+static uint8_t n_targets;               // Set and below Nyquist
+static uint16_t window_ms = CONFIG_EEG_FEEDBACK_WINDOW_MS;
+static uint16_t period_ms = CONFIG_EEG_FEEDBACK_PERIOD_MS;
+static uint16_t fb_rate = EEG_DEFAULT_RATE;
+static uint8_t fb_mask;
+static uint32_t period_len;             // Frames between packets
+static uint32_t period_frames;
+static struct eeg_goertzel trk;
+static int32_t ring[FEEDBACK_WINDOW_MAX * EEG_CHANNELS];
+static uint8_t pkt[FEEDBACK_PKT_MAX_LEN];
+static uint16_t fb_seq;
+
+static struct eeg_feedback_stats stats;
+
+void eeg_feedback_reset(void)
+{
+	uint32_t len = (uint32_t)fb_rate * window_ms / 1000;
+
+	/* Targets in order, the first one unset or at Nyquist ends the list */
+	n_targets = 0;
+	while ((n_targets < EEG_FEEDBACK_TARGETS_MAX) && targets[n_targets] &&
+	       (targets[n_targets] < fb_rate * 5U)) {
+		n_targets++;
+	}
+
+	eeg_goertzel_init(&trk, ring, CLAMP(len, 2, FEEDBACK_WINDOW_MAX),
+			  eeg_pkt_channels(fb_mask), fb_rate, targets, n_targets);
+	period_len = MAX((uint32_t)fb_rate * period_ms / 1000, 1);
+	period_frames = 0;
+}
+
+void eeg_feedback_set_rate(uint16_t sps)
+{
+	fb_rate = sps;
+	eeg_feedback_reset();
+}
+
+/* Runs in the BT stack once the controller has sent the packet */
+static void feedback_sent(struct bt_conn *conn, void *user_data)
+{
+	uint32_t drdy = (uint32_t)(uintptr_t)user_data;
+	uint32_t now = eeg_lat_now();
+	uint32_t us;
+
+	stats.sent++;
+
+	/* Not stamped without CONFIG_EEG_LATENCY */
+	if (!drdy) {
+		return;
+	}
+
+	eeg_lat_record(EEG_LAT_FEEDBACK, drdy, now);
+	us = eeg_lat_to_us(now - drdy);
+	stats.max_us = MAX(stats.max_us, us);
+	if (us > CONFIG_EEG_FEEDBACK_BUDGET_MS * USEC_PER_MSEC) {
+		stats.over_budget++;
+		LOG_WRN_ONCE("Feedback sent %u us after DRDY, budget %u ms", us,
+			     CONFIG_EEG_FEEDBACK_BUDGET_MS);
+	}
+}
+
+static void feedback_send(uint16_t pkt_seq, uint8_t frame_no, uint32_t drdy)
+{
+	const uint16_t len = eeg_feedback_pkt_len(fb_mask, n_targets);
+	uint8_t *p = &pkt[EEG_PKT_HDR_LEN];
+	int err;
+
+	eeg_pkt_hdr_init((struct eeg_pkt_hdr *)pkt, EEG_PKT_TYPE_FEEDBACK, fb_seq++, fb_mask,
+			 n_targets);
+	sys_put_le16(pkt_seq, &p[0]);
+	p[2] = frame_no;
+	sys_put_le16(fb_rate, &p[3]);
+	sys_put_le16(trk.len, &p[5]);
+	p += EEG_FEEDBACK_HDR_LEN;
+
+	for (uint8_t t = 0; t < n_targets; t++) {
+		sys_put_le16(targets[t], p);
+		p += 2;
+	}
+
+	for (uint8_t ch = 0; ch < trk.n_ch; ch++) {
+		for (uint8_t t = 0; t < n_targets; t++) {
+			long amp = lroundf(eeg_goertzel_amp(&trk, ch, t));
+
+			sys_put_le16((uint16_t)MIN(amp, UINT16_MAX), p);
+			p += EEG_FEEDBACK_VALUE_LEN;
+		}
+	}
+
+	stats.packets++;
+
+	/* Nothing is kept for later, old feedback is no use */
+	err = eeg_stream_send_aux_cb(pkt, len, feedback_sent, (void *)(uintptr_t)drdy);
+	if (err && (err != -ENOTCONN)) {
+		LOG_DBG("Feedback %u not sent (err %d)", fb_seq - 1, err);
+		stats.refused++;
+	}
+}
+
+void eeg_feedback_frame(const uint8_t *frame, uint8_t chan_mask, uint16_t pkt_seq,
+			uint8_t frame_no, uint32_t drdy)
+{
+	int32_t x[EEG_CHANNELS];
+
+	if (chan_mask != fb_mask) {
+		fb_mask = chan_mask;
+		eeg_feedback_reset();
+	}
+
+	if (!n_targets) {
+		return;
+	}
+
+	eeg_codec_unpack24(frame, x, trk.n_ch);
+	eeg_goertzel_frame(&trk, x);
+
+	if ((++period_frames < period_len) || !eeg_goertzel_full(&trk)) {
+		return;
+	}
+
+	period_frames = 0;
+	feedback_send(pkt_seq, frame_no, drdy);
+}
+
+uint8_t eeg_feedback_set(const uint8_t *value)
+{
+	uint16_t hz[EEG_FEEDBACK_TARGETS_MAX];
+	uint16_t win = sys_get_le16(&value[2 * EEG_FEEDBACK_TARGETS_MAX]);
+	uint16_t per = sys_get_le16(&value[2 * EEG_FEEDBACK_TARGETS_MAX + 2]);
+	uint8_t n = 0;
+
+	for (uint8_t t = 0; t < EEG_FEEDBACK_TARGETS_MAX; t++) {
+		hz[t] = sys_get_le16(&value[2 * t]);
+		if (!hz[t]) {
+			continue;
+		}
+		/* Used ones first, all below Nyquist */
+		if ((n != t) || (hz[t] >= fb_rate * 5U)) {
+			return EEG_CTRL_STATUS_VALUE;
+		}
+		n++;
+	}
+
+	if (!n || (win < FEEDBACK_WINDOW_MIN_MS) || (win > FEEDBACK_WINDOW_MAX_MS) ||
+	    !per || (per > FEEDBACK_PERIOD_MAX_MS)) {
+		return EEG_CTRL_STATUS_VALUE;
+	}
+
+	memcpy(targets, hz, sizeof(targets));
+	window_ms = win;
+	period_ms = per;
+	eeg_feedback_reset();
+	LOG_INF("%u targets, %u ms window (%u samples), every %u ms", n_targets, win, trk.len, per);
+
+	return EEG_CTRL_STATUS_OK;
+}
+
+void eeg_feedback_stats_get(struct eeg_feedback_stats *out)
+{
+	*out = stats;
+}
+
+static int feedback_init(void)
+{
+	eeg_feedback_set_rate(eeg_stream_rate());
+
+	return 0;
+}
+
+SYS_INIT(feedback_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,73 @@
+/*
+ * ANA EEG sticker - neurofeedback trackers
+ *
+ * Closed-loop neurofeedback needs band amplitudes within a fraction of a
+ * second, not per minute: sliding Goertzel trackers (eeg_goertzel.h) follow
+ * up to EEG_FEEDBACK_TARGETS_MAX target frequencies on every channel, sample
+ * by sample, and every CONFIG_EEG_FEEDBACK_PERIOD_MS their amplitudes go out
+ * as an EEG_PKT_TYPE_FEEDBACK packet while the stream mode includes
+ * EEG_MODE_FEEDBACK. Targets, window and period are set at build time or
+ * with EEG_CTRL_SET_FEEDBACK.
+ *
+ * The trackers take every frame as it is read, ahead of the packetizer, the
+ * spatial filter and the pre-filter, which work on whole packets. DRDY of
+ * the newest frame to the feedback packet sent is timed as EEG_LAT_FEEDBACK
+ * and checked against CONFIG_EEG_FEEDBACK_BUDGET_MS; the trackers' own lag,
+ * half the window, comes on top.
+ */
+
+#ifndef FEEDBACK_H_
+#define FEEDBACK_H_
+
+#include <zephyr/types.h>
+
+#include <eeg_packet.h>
+
+struct eeg_feedback_stats {
+	uint32_t packets;       // Feedback packets produced
+	uint32_t refused;       // Not taken by the BT stack while connected
+	uint32_t sent;          // Reported sent by the controller
+	uint32_t over_budget;   // Sent later than CONFIG_EEG_FEEDBACK_BUDGET_MS after DRDY
+	uint32_t max_us;        // DRDY to sent
+};
+
+#if defined(CONFIG_EEG_FEEDBACK)
+
+/*
+ * One frame of the channels in chan_mask as read, the frame_no-th of data
+ * packet pkt_seq, drdy its eeg_lat_now() stamp (acquisition context).
+ */
+void eeg_feedback_frame(const uint8_t *frame, uint8_t chan_mask, uint16_t pkt_seq,
+			uint8_t frame_no, uint32_t drdy);
+
+/* Empty the windows, e.g. after a channel mask or mode change */
+void eeg_feedback_reset(void);
+
+/* Retune the trackers for a new sample rate, empties the windows */
+void eeg_feedback_set_rate(uint16_t sps);
+
+/* EEG_CTRL_SET_FEEDBACK, between packets. Returns an EEG_CTRL_STATUS_* code */
+uint8_t eeg_feedback_set(const uint8_t *value);
+
+void eeg_feedback_stats_get(struct eeg_feedback_stats *stats);
+
+#else
+
+static inline void eeg_feedback_frame(const uint8_t *frame, uint8_t chan_mask,
+				      uint16_t pkt_seq, uint8_t frame_no, uint32_t drdy)
+{
+}
+static inline void eeg_feedback_reset(void)
+{
+}
+static inline void eeg_feedback_set_rate(uint16_t sps)
+{
+}
+static inline uint8_t eeg_feedback_set(const uint8_t *value)
+{
+	return EEG_CTRL_STATUS_VALUE;
+}
+
+#endif /* CONFIG_EEG_FEEDBACK */
+
+#endif /* FEEDBACK_H_ */
@@ -0,0 +1,168 @@
+/*
+ * ANA EEG sticker - pre-filter cascade
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+
+#if defined(CONFIG_EEG_FILTER_IMPL_CMSIS)
+#include <arm_math.h>
+#endif
+
+#include <eeg_biquad.h>
+#if defined(CONFIG_EEG_FILTER_MAINS_ADAPTIVE)
+#include <eeg_mains.h>
+#endif
+
+#include "eeg_stream.h"
+#include "filter.h"
+
+LOG_MODULE_REGISTER(filter, LOG_LEVEL_INF);
+
+#if defined(CONFIG_EEG_FILTER_MAINS_NOTCH)
+#define FILTER_NOTCH            (CONFIG_EEG_FILTER_NOTCH_HZ > 0)
+#else
+#define FILTER_NOTCH            0
+#endif
+#define FILTER_STAGES           (2 + FILTER_NOTCH)
+#define FILTER_Q_BUTTERWORTH    0.7071      // As the app, not 1/sqrt(2)
+#define FILTER_Q_NOTCH          30.0
+
+/* 24-bit samples enter one bit below q31 full scale, room for overshoot */
+#define FILTER_SHIFT            7
+#define FILTER_SAMPLE_MAX       ((1 << 23) - 1)
+#define FILTER_SAMPLE_MIN       (-(1 << 23))
+
+#define FILTER_MAINS_DETECT_MS  2000
+
+/* Acquisition context only */
+static int32_t coeffs[FILTER_STAGES * EEG_BIQUAD_COEFFS];
+static int64_t state[EEG_CHANNELS][FILTER_STAGES * EEG_BIQUAD_STATE];
+static int32_t block[EEG_FRAMES_PER_PACKET];
+
+#if defined(CONFIG_EEG_FILTER_MAINS_ADAPTIVE)
+static struct eeg_mains mains[EEG_CHANNELS];
+static uint16_t rate;
+
+/* Restarts adaptation but keeps what each channel has locked to */
+static void mains_reset(uint8_t ch)
+{
+	uint16_t hz = CONFIG_EEG_FILTER_MAINS_HZ;
+
+	eeg_mains_init(&mains[ch], rate, hz ? hz : eeg_mains_hz(&mains[ch]),
+		       CONFIG_EEG_FILTER_MAINS_HARMONICS, CONFIG_EEG_FILTER_MAINS_TAU_MS,
+		       FILTER_MAINS_DETECT_MS);
+}
+
+static void mains_run(uint8_t ch, uint8_t n)
+{
+	eeg_mains_run(&mains[ch], block, block, n);
+}
+#else
+static inline void mains_reset(uint8_t ch)
+{
+}
+
+static inline void mains_run(uint8_t ch, uint8_t n)
+{
+}
+#endif /* CONFIG_EEG_FILTER_MAINS_ADAPTIVE */
+
+#if defined(CONFIG_EEG_FILTER_IMPL_CMSIS)
+BUILD_ASSERT(sizeof(q63_t) == sizeof(int64_t));
+
+static arm_biquad_cas_df1_32x64_ins_q31 cas[EEG_CHANNELS];
+
+void eeg_filter_reset(void)
+{
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		arm_biquad_cas_df1_32x64_init_q31(&cas[ch], FILTER_STAGES, coeffs,
+						  state[ch], EEG_BIQUAD_POST_SHIFT);
+		mains_reset(ch);
+	}
+}
+
+static void filter_run(uint8_t ch, uint8_t n)
+{
+	arm_biquad_cas_df1_32x64_q31(&cas[ch], block, block, n);
+}
+#else
+static struct eeg_biquad_cas cas[EEG_CHANNELS];
+
+void eeg_filter_reset(void)
+{
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		eeg_biquad_init(&cas[ch], FILTER_STAGES, coeffs, state[ch]);
+		mains_reset(ch);
+	}
+}
+
+static void filter_run(uint8_t ch, uint8_t n)
+{
+	eeg_biquad_run(&cas[ch], block, block, n);
+}
+#endif /* CONFIG_EEG_FILTER_IMPL_CMSIS */
+
+void eeg_filter_set_rate(uint16_t sps)
+{
+	eeg_biquad_design(&coeffs[0], EEG_BIQUAD_HIGHPASS, sps,
+			  CONFIG_EEG_FILTER_HIGHPASS_HZ, FILTER_Q_BUTTERWORTH);
+	eeg_biquad_design(&coeffs[EEG_BIQUAD_COEFFS], EEG_BIQUAD_LOWPASS, sps,
+			  CONFIG_EEG_FILTER_LOWPASS_HZ, FILTER_Q_BUTTERWORTH);
+#if FILTER_NOTCH
+	eeg_biquad_design(&coeffs[2 * EEG_BIQUAD_COEFFS], EEG_BIQUAD_NOTCH, sps,
+			  CONFIG_EEG_FILTER_NOTCH_HZ, FILTER_Q_NOTCH);
+#endif
+
+#if defined(CONFIG_EEG_FILTER_MAINS_ADAPTIVE)
+	rate = sps;
+#endif
+
+	eeg_filter_reset();
+
+#if defined(CONFIG_EEG_FILTER_MAINS_ADAPTIVE)
+	LOG_INF("%u-%u Hz, adaptive mains %u Hz (0 = detect) at %u SPS",
+		CONFIG_EEG_FILTER_HIGHPASS_HZ, CONFIG_EEG_FILTER_LOWPASS_HZ,
+		eeg_mains_hz(&mains[0]), sps);
+#else
+	LOG_INF("%u-%u Hz, notch %u Hz at %u SPS", CONFIG_EEG_FILTER_HIGHPASS_HZ,
+		CONFIG_EEG_FILTER_LOWPASS_HZ, CONFIG_EEG_FILTER_NOTCH_HZ, sps);
+#endif
+}
+
+void eeg_filter_frames(int32_t *samples, uint8_t chan_mask, uint8_t n_frames)
+{
+	const uint8_t n_ch = eeg_pkt_channels(chan_mask);
+	int32_t *p = samples;
+
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		if (!(chan_mask & BIT(ch))) {
+			continue;
+		}
+
+		for (uint8_t i = 0; i < n_frames; i++) {
+			block[i] = (int32_t)((uint32_t)p[i * n_ch] << FILTER_SHIFT);
+		}
+
+		filter_run(ch, n_frames);
+		mains_run(ch, n_frames);
+
+		for (uint8_t i = 0; i < n_frames; i++) {
+			int32_t y = ((block[i] >> (FILTER_SHIFT - 1)) + 1) >> 1;
+
+			p[i * n_ch] = CLAMP(y, FILTER_SAMPLE_MIN, FILTER_SAMPLE_MAX);
+		}
+
+		p++;
+	}
+}
+
+static int filter_init(void)
+{
+	eeg_filter_set_rate(eeg_stream_rate());
+
+	return 0;
+}
+
+SYS_INIT(filter_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,50 @@
+/*
+ * ANA EEG sticker - pre-filter cascade
+ *
+ * The same 1 Hz high-pass, 45 Hz low-pass and 50 Hz notch (Q 30) the app runs
+ * before its band analysis, as q31 biquads (eeg_biquad.h) applied to every
+ * completed packet in place. Filtered packets carry EEG_PKT_FLAG_FILTERED.
+ *
+ * Against the app's double precision cascade on the same input the output
+ * stays within 2 LSB (24-bit codes) up to 1 kSPS for inputs up to full
+ * scale (host/filter_check.c). Above that the q31 pole resolution near
+ * z = 1 shifts the 1 Hz corner slightly; the difference grows to about 6e-4
+ * of full scale at 16 kSPS, in the settling after a large DC step.
+ *
+ * With CONFIG_EEG_FILTER_MAINS_ADAPTIVE the notch is replaced by the
+ * adaptive canceller of eeg_mains.h after the cascade: 50/60 Hz detected per
+ * channel, harmonics below Nyquist removed too. The output then no longer
+ * matches the app's notch sample for sample.
+ */
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <zephyr/types.h>
+
+#if defined(CONFIG_EEG_FILTER)
+
+/* Redesign for a new sample rate, clears the filter state */
+void eeg_filter_set_rate(uint16_t sps);
+
+/* Restart every channel from rest, e.g. after the channel mask changed */
+void eeg_filter_reset(void);
+
+/* Filter the samples of a packet in place, frame by frame */
+void eeg_filter_frames(int32_t *samples, uint8_t chan_mask, uint8_t n_frames);
+
+#else
+
+static inline void eeg_filter_set_rate(uint16_t sps)
+{
+}
+static inline void eeg_filter_reset(void)
+{
+}
+static inline void eeg_filter_frames(int32_t *samples, uint8_t chan_mask, uint8_t n_frames)
+{
+}
+
+#endif /* CONFIG_EEG_FILTER */
+
+#endif /* FILTER_H_ */
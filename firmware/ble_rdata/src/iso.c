@@ -0,0 +1,236 @@
+/*
+ * ANA EEG sticker - connected isochronous stream transport
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/logging/log.h>
+
+#include "eeg_stream.h"
+#include "iso.h"
+
+LOG_MODULE_REGISTER(iso, LOG_LEVEL_INF);
+
+#define ISO_SDU_LEN             CONFIG_EEG_ISO_SDU_LEN
+#define ISO_TX_BUFS             CONFIG_EEG_ISO_TX_BUFS
+
+BUILD_ASSERT(ISO_SDU_LEN >= EEG_PKT_MAX_LEN, "SDU too short for a single data packet");
+
+NET_BUF_POOL_FIXED_DEFINE(iso_tx_pool, ISO_TX_BUFS, BT_ISO_SDU_BUF_SIZE(ISO_SDU_LEN),
+			  CONFIG_BT_CONN_TX_USER_DATA_SIZE, NULL);
+
+/* Filled by acquisition, swapped out once per SDU interval */
+static struct k_spinlock fill_lock;
+static uint8_t fill_buf[2][ISO_SDU_LEN];
+static uint8_t fill_idx;
+static uint16_t fill_len;
+static uint16_t fill_packets;
+static uint32_t fill_stamp;             // Cycle count of the oldest packet
+
+/* Oldest packet stamp and packet count of each SDU in flight, in order */
+static uint32_t inflight_stamp[ISO_TX_BUFS];
+static uint16_t inflight_packets[ISO_TX_BUFS];
+static uint8_t inflight_head;
+static uint8_t inflight_tail;
+
+static atomic_t iso_up;
+static K_SEM_DEFINE(iso_up_sem, 0, 1);
+static struct k_timer sdu_timer;
+static uint32_t sdu_interval_us;
+static struct eeg_iso_stats stats;
+
+static void iso_connected(struct bt_iso_chan *chan)
+{
+	struct bt_iso_info info;
+
+	if (bt_iso_chan_get_info(chan, &info)) {
+		LOG_ERR("Cannot read CIS parameters");
+		return;
+	}
+
+	/* One SDU per ISO interval, given in 1.25 ms units */
+	sdu_interval_us = info.iso_interval * 1250U;
+	inflight_head = 0;
+	inflight_tail = 0;
+
+	LOG_INF("CIS connected, %u us interval, %u us transport latency",
+		sdu_interval_us, info.unicast.peripheral.latency);
+
+	atomic_set(&iso_up, 1);
+	k_sem_give(&iso_up_sem);
+}
+
+static void iso_disconnected(struct bt_iso_chan *chan, uint8_t reason)
+{
+	LOG_INF("CIS disconnected (reason 0x%02x), back to GATT", reason);
+
+	atomic_set(&iso_up, 0);
+	k_timer_stop(&sdu_timer);
+}
+
+static void iso_sent(struct bt_iso_chan *chan)
+{
+	stats.sent++;
+
+	if (inflight_tail != inflight_head) {
+		eeg_stream_tx_done(inflight_stamp[inflight_tail], inflight_packets[inflight_tail]);
+		inflight_tail = (inflight_tail + 1) % ISO_TX_BUFS;
+	}
+}
+
+static struct bt_iso_chan_ops iso_ops = {
+	.connected = iso_connected,
+	.disconnected = iso_disconnected,
+	.sent = iso_sent,
+};
+
+static struct bt_iso_chan_io_qos iso_tx_qos = {
+	.sdu = ISO_SDU_LEN,
+	.rtn = CONFIG_EEG_ISO_RTN,
+	.phy = BT_GAP_LE_PHY_2M,
+};
+
+static struct bt_iso_chan_qos iso_qos = {
+	.tx = &iso_tx_qos,
+};
+
+static struct bt_iso_chan iso_chan = {
+	.ops = &iso_ops,
+	.qos = &iso_qos,
+};
+
+static int iso_accept(const struct bt_iso_accept_info *info, struct bt_iso_chan **chan)
+{
+	if (iso_chan.iso) {
+		LOG_WRN("CIS already in use");
+		return -ENOMEM;
+	}
+
+	*chan = &iso_chan;
+
+	return 0;
+}
+
+static struct bt_iso_server iso_server = {
+#if defined(CONFIG_BT_SMP)
+	.sec_level = BT_SECURITY_L1,
+#endif
+	.accept = iso_accept,
+};
+
+int eeg_iso_init(void)
+{
+	int err = bt_iso_server_register(&iso_server);
+
+	if (err) {
+		LOG_ERR("ISO server not registered (err %d), GATT only", err);
+	}
+
+	return err;
+}
+
+bool eeg_iso_packet(const uint8_t *pkt, uint16_t len)
+{
+	k_spinlock_key_t key;
+
+	if (!atomic_get(&iso_up)) {
+		return false;
+	}
+
+	key = k_spin_lock(&fill_lock);
+
+	if (fill_len + len > ISO_SDU_LEN) {
+		stats.dropped++;
+	} else {
+		if (!fill_packets) {
+			fill_stamp = k_cycle_get_32();
+		}
+		memcpy(&fill_buf[fill_idx][fill_len], pkt, len);
+		fill_len += len;
+		fill_packets++;
+	}
+
+	k_spin_unlock(&fill_lock, key);
+
+	return true;
+}
+
+void eeg_iso_stats_get(struct eeg_iso_stats *out)
+{
+	*out = stats;
+}
+
+static void iso_send(const uint8_t *sdu, uint16_t len, uint16_t packets,
+		     uint32_t stamp, uint16_t seq_num)
+{
+	struct net_buf *buf;
+	uint8_t next = (inflight_head + 1) % ISO_TX_BUFS;
+	int err;
+
+	buf = net_buf_alloc(&iso_tx_pool, K_NO_WAIT);
+	if (!buf || (next == inflight_tail)) {
+		if (buf) {
+			net_buf_unref(buf);
+		}
+		stats.dropped += packets;
+		return;
+	}
+
+	net_buf_reserve(buf, BT_ISO_CHAN_SEND_RESERVE);
+	net_buf_add_mem(buf, sdu, len);
+
+	inflight_stamp[inflight_head] = stamp;
+	inflight_packets[inflight_head] = packets;
+	inflight_head = next;
+
+	err = bt_iso_chan_send(&iso_chan, buf, seq_num);
+	if (err < 0) {
+		LOG_DBG("SDU %u not sent (err %d)", seq_num, err);
+		inflight_head = (inflight_head + ISO_TX_BUFS - 1) % ISO_TX_BUFS;
+		net_buf_unref(buf);
+		stats.dropped += packets;
+		return;
+	}
+
+	stats.sdus++;
+	stats.packets += packets;
+}
+
+/* Sends the packets collected during the previous interval, one SDU each */
+static void iso_thread(void)
+{
+	uint16_t seq_num = 0;
+
+	k_timer_init(&sdu_timer, NULL, NULL);
+
+	for (;;) {
+		k_sem_take(&iso_up_sem, K_FOREVER);
+		k_timer_start(&sdu_timer, K_USEC(sdu_interval_us), K_USEC(sdu_interval_us));
+
+		/* Returns 0 once the timer is stopped on disconnect */
+		while (k_timer_status_sync(&sdu_timer)) {
+			k_spinlock_key_t key = k_spin_lock(&fill_lock);
+
+			uint8_t *sdu = fill_buf[fill_idx];
+			uint16_t len = fill_len;
+			uint16_t packets = fill_packets;
+			uint32_t stamp = fill_stamp;
+
+			fill_idx ^= 1;
+			fill_len = 0;
+			fill_packets = 0;
+
+			k_spin_unlock(&fill_lock, key);
+
+			/* The sequence number tracks the interval, sent or not */
+			if (packets) {
+				iso_send(sdu, len, packets, stamp, seq_num);
+			}
+			seq_num++;
+		}
+	}
+}
+
+K_THREAD_DEFINE(iso_thread_id, CONFIG_EEG_ISO_THREAD_STACK_SIZE, iso_thread,
+		NULL, NULL, NULL, CONFIG_EEG_ISO_THREAD_PRIO, 0, 0);
@@ -0,0 +1,51 @@
+/*
+ * ANA EEG sticker - connected isochronous stream transport
+ *
+ * When the central sets up a CIS, data packets are carried in its SDUs
+ * instead of GATT notifications, one SDU per interval holding the packets
+ * completed since the previous one. Without a CIS (or without ISO support
+ * in the controller) everything stays on GATT.
+ */
+
+#ifndef ISO_H_
+#define ISO_H_
+
+#include <zephyr/types.h>
+
+struct eeg_iso_stats {
+	uint32_t sdus;          // SDUs handed to the controller
+	uint32_t packets;       // Data packets carried in them
+	uint32_t dropped;       // Packets that did not fit or found no buffer
+	uint32_t sent;          // SDUs the controller reported done
+};
+
+#if defined(CONFIG_EEG_ISO)
+
+int eeg_iso_init(void);
+
+/*
+ * Queue a data packet for the next SDU (acquisition context). Returns false
+ * if no CIS is up, the packet then goes over GATT.
+ */
+bool eeg_iso_packet(const uint8_t *pkt, uint16_t len);
+
+void eeg_iso_stats_get(struct eeg_iso_stats *stats);
+
+#else
+
+static inline int eeg_iso_init(void)
+{
+	return 0;
+}
+static inline bool eeg_iso_packet(const uint8_t *pkt, uint16_t len)
+{
+	return false;
+}
+static inline void eeg_iso_stats_get(struct eeg_iso_stats *stats)
+{
+	*stats = (struct eeg_iso_stats){0};
+}
+
+#endif /* CONFIG_EEG_ISO */
+
+#endif /* ISO_H_ */
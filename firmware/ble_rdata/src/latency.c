@@ -0,0 +1,208 @@
+/*
+ * ANA EEG sticker - pipeline latency histograms
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+
+#include "eeg_ctrl.h"
+#include "latency.h"
+
+LOG_MODULE_REGISTER(latency, LOG_LEVEL_INF);
+
+struct lat_hist {
+	uint32_t bins[EEG_LAT_BINS];
+	uint32_t count;
+	uint32_t max_us;
+};
+
+static struct k_spinlock lock;
+static struct lat_hist hist[EEG_LAT_STAGES];
+static bool running;
+
+static const char *const stage_names[EEG_LAT_STAGES] = {
+	[EEG_LAT_DRDY_SPI] = "drdy-spi",
+	[EEG_LAT_BATCH] = "batch",
+	[EEG_LAT_QUEUE] = "queue",
+	[EEG_LAT_TX] = "tx",
+	[EEG_LAT_TOTAL] = "total",
+	[EEG_LAT_FEEDBACK] = "feedback",
+};
+
+uint32_t eeg_lat_to_us(uint32_t cycles)
+{
+#if defined(CONFIG_TIMING_FUNCTIONS)
+	return (uint32_t)(timing_cycles_to_ns(cycles) / NSEC_PER_USEC);
+#else
+	return k_cyc_to_us_floor32(cycles);
+#endif
+}
+
+void eeg_lat_record(uint8_t stage, uint32_t from, uint32_t to)
+{
+	uint32_t us;
+	uint8_t bin;
+	k_spinlock_key_t key;
+
+	/* A timer stopped in between would give a meaningless delta */
+	if (!from || !running || (stage >= EEG_LAT_STAGES)) {
+		return;
+	}
+
+	us = eeg_lat_to_us(to - from);
+	bin = us ? MIN(32 - __builtin_clz(us), EEG_LAT_BINS - 1) : 0;
+
+	key = k_spin_lock(&lock);
+	hist[stage].bins[bin]++;
+	hist[stage].count++;
+	hist[stage].max_us = MAX(hist[stage].max_us, us);
+	k_spin_unlock(&lock, key);
+}
+
+void eeg_lat_get(uint8_t stage, struct eeg_ctrl_latency *lat)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	lat->count = sys_cpu_to_le32(hist[stage].count);
+	lat->max_us = sys_cpu_to_le32(hist[stage].max_us);
+	for (int i = 0; i < EEG_LAT_BINS; i++) {
+		lat->bins[i] = sys_cpu_to_le16(MIN(hist[stage].bins[i], UINT16_MAX));
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+uint8_t eeg_lat_percentile(uint8_t stage, uint8_t pct)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	uint64_t target = ((uint64_t)hist[stage].count * pct + 99) / 100;
+	uint64_t seen = 0;
+	uint8_t bin = 0;
+
+	for (; bin < EEG_LAT_BINS - 1; bin++) {
+		seen += hist[stage].bins[bin];
+		if (seen >= target) {
+			break;
+		}
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return bin;
+}
+
+void eeg_lat_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	memset(hist, 0, sizeof(hist));
+
+	k_spin_unlock(&lock, key);
+}
+
+void eeg_lat_command(const struct eeg_ctrl_cmd *cmd)
+{
+	struct eeg_ctrl_latency lat;
+
+	if (cmd->value[0] >= EEG_LAT_STAGES) {
+		eeg_ctrl_respond(cmd, EEG_CTRL_STATUS_VALUE, NULL, 0);
+		return;
+	}
+
+	eeg_lat_get(cmd->value[0], &lat);
+	if (cmd->value[1]) {
+		eeg_lat_reset();
+	}
+
+	eeg_ctrl_respond(cmd, EEG_CTRL_STATUS_OK, &lat, sizeof(lat));
+}
+
+void eeg_lat_run(bool on)
+{
+	if (on == running) {
+		return;
+	}
+
+	running = on;
+#if defined(CONFIG_TIMING_FUNCTIONS)
+	if (on) {
+		timing_start();
+	} else {
+		timing_stop();
+	}
+#endif
+}
+
+bool eeg_lat_running(void)
+{
+	return running && IS_ENABLED(CONFIG_TIMING_FUNCTIONS);
+}
+
+static int lat_init(void)
+{
+#if defined(CONFIG_TIMING_FUNCTIONS)
+	timing_init();
+#endif
+
+	return 0;
+}
+
+SYS_INIT(lat_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#if defined(CONFIG_SHELL)
+
+/* Upper bound of a bin in us, the last one is open */
+static uint32_t bin_limit(uint8_t bin)
+{
+	return BIT(bin);
+}
+
+static int cmd_latency_show(const struct shell *sh, size_t argc, char **argv)
+{
+	for (uint8_t st = 0; st < EEG_LAT_STAGES; st++) {
+		struct lat_hist h;
+		k_spinlock_key_t key = k_spin_lock(&lock);
+
+		h = hist[st];
+		k_spin_unlock(&lock, key);
+
+		shell_print(sh, "%-9s n=%u p50<%u p90<%u p99<%u max=%u us", stage_names[st],
+			    h.count, bin_limit(eeg_lat_percentile(st, 50)),
+			    bin_limit(eeg_lat_percentile(st, 90)),
+			    bin_limit(eeg_lat_percentile(st, 99)), h.max_us);
+
+		for (uint8_t bin = 0; bin < EEG_LAT_BINS; bin++) {
+			if (h.bins[bin]) {
+				shell_print(sh, "  <%7u us %u", bin_limit(bin), h.bins[bin]);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int cmd_latency_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	eeg_lat_reset();
+	shell_print(sh, "Latency histograms cleared");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_latency,
+	SHELL_CMD(reset, NULL, "Clear all histograms", cmd_latency_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_eeg,
+	SHELL_CMD(latency, &sub_latency, "Per-stage latency histograms", cmd_latency_show),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(eeg, &sub_eeg, "ANA EEG sticker", NULL);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,86 @@
+/*
+ * ANA EEG sticker - pipeline latency histograms
+ *
+ * The acquisition path and the live link take timestamps at DRDY, SPI done,
+ * packet complete, notification queued and TX done, the feedback trackers at
+ * DRDY and feedback sent; every stage delta goes into a log2 histogram
+ * (EEG_LAT_* in eeg_packet.h). The histograms can be dumped and reset with
+ * the LATENCY command, the shell ("eeg latency") and show up as percentiles
+ * in the diagnostics snapshot.
+ *
+ * With CONFIG_TIMING_FUNCTIONS the stamps come from a hardware timer that
+ * keeps the high frequency clock requested, so it only runs while the
+ * sticker streams (eeg_lat_run()); stages are not recorded otherwise.
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/timing/timing.h>
+#include <eeg_packet.h>
+
+struct eeg_ctrl_cmd;
+
+#if defined(CONFIG_EEG_LATENCY)
+
+/* Timestamp, cycle counter ticks; 0 is never returned */
+static inline uint32_t eeg_lat_now(void)
+{
+#if defined(CONFIG_TIMING_FUNCTIONS)
+	return (uint32_t)timing_counter_get() | 1U;
+#else
+	return k_cycle_get_32() | 1U;
+#endif
+}
+
+/* Microseconds in a difference of two eeg_lat_now() stamps */
+uint32_t eeg_lat_to_us(uint32_t cycles);
+
+/* Add to to - from to the stage, ignored if from is 0 (not stamped) */
+void eeg_lat_record(uint8_t stage, uint32_t from, uint32_t to);
+
+/* Histogram of one stage, little endian as sent on the response */
+void eeg_lat_get(uint8_t stage, struct eeg_ctrl_latency *lat);
+
+/* Bin below which pct percent of the stage's deltas fall */
+uint8_t eeg_lat_percentile(uint8_t stage, uint8_t pct);
+
+void eeg_lat_reset(void);
+
+/* Execute and answer EEG_CTRL_LATENCY */
+void eeg_lat_command(const struct eeg_ctrl_cmd *cmd);
+
+/* Streaming started or stopped: start or stop the timestamp timer */
+void eeg_lat_run(bool on);
+
+/* Timestamp timer running, for the current model */
+bool eeg_lat_running(void);
+
+#else
+
+static inline uint32_t eeg_lat_now(void)
+{
+	return 0;
+}
+static inline uint32_t eeg_lat_to_us(uint32_t cycles)
+{
+	return 0;
+}
+static inline void eeg_lat_record(uint8_t stage, uint32_t from, uint32_t to)
+{
+}
+static inline void eeg_lat_command(const struct eeg_ctrl_cmd *cmd)
+{
+}
+static inline void eeg_lat_run(bool on)
+{
+}
+static inline bool eeg_lat_running(void)
+{
+	return false;
+}
+
+#endif /* CONFIG_EEG_LATENCY */
+
+#endif /* LATENCY_H_ */
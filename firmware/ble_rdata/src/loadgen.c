@@ -0,0 +1,279 @@
+/*
+ * ANA EEG sticker - load generator
+ */
+
+#include <math.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+#include <eeg_codec.h>
+
+#include "eeg_stream.h"
+#include "eeg_ctrl.h"
+#include "eeg_log.h"
+#include "loadgen.h"
+#include "eeg_state.h"
+#include "latency.h"
+#include "artifact.h"
+#include "feedback.h"
+
+LOG_MODULE_REGISTER(loadgen, LOG_LEVEL_INF);
+
+#define LOADGEN_RATE_MAX        16000
+#define LOADGEN_GAIN_REF        24      // Gain at which the amplitude applies
+#define LOADGEN_SINE_HZ         10.0f   // Channel n runs at n x this
+#define LOADGEN_TWO_PI          6.28318531f
+
+struct loadgen {
+	bool running;
+	uint16_t rate;
+	uint8_t gain[EEG_CHANNELS];
+	int64_t t0;                     // Ticks at frame 0
+	uint64_t frame_no;              // Frames due since t0 that were handled
+	float phase[EEG_CHANNELS];
+	float chirp_t;                  // Seconds into the current sweep
+	int64_t report_ms;              // Uptime of the last report
+	struct eeg_stream_stats report; // Stream stats at the last report
+};
+
+static struct loadgen lg = {
+	.running = IS_ENABLED(CONFIG_EEG_AUTOSTART),
+	.rate = CONFIG_EEG_LOADGEN_RATE,
+};
+static struct eeg_loadgen_stats stats;
+
+static void loadgen_restart(void)
+{
+	lg.t0 = k_uptime_ticks();
+	lg.frame_no = 0;
+	lg.report_ms = k_uptime_get();
+	eeg_stream_stats_get(&lg.report);
+}
+
+static int32_t loadgen_sample(uint8_t ch, float amp)
+{
+#if defined(CONFIG_EEG_LOADGEN_COUNTER)
+	ARG_UNUSED(amp);
+	/* Channels offset from each other, wrapping inside the positive range */
+	return (int32_t)((stats.frames + ((uint32_t)ch << 20)) & 0x7FFFFF);
+#else
+#if defined(CONFIG_EEG_LOADGEN_SINE)
+	float hz = LOADGEN_SINE_HZ * (ch + 1);
+#else
+	/* Linear sweep from 1 Hz to Nyquist, the same on every channel */
+	float hz = 1.0f + (lg.rate / 2.0f - 1.0f) * lg.chirp_t / CONFIG_EEG_LOADGEN_CHIRP_S;
+#endif
+	int32_t val = (int32_t)(amp * sinf(lg.phase[ch]));
+
+	lg.phase[ch] += LOADGEN_TWO_PI * hz / lg.rate;
+	if (lg.phase[ch] >= LOADGEN_TWO_PI) {
+		lg.phase[ch] -= LOADGEN_TWO_PI;
+	}
+
+	return val;
+#endif
+}
+
+static void loadgen_frame(void)
+{
+	uint8_t frame[EEG_FRAME_LEN];
+	int32_t samples[EEG_CHANNELS];
+
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		float amp = (float)CONFIG_EEG_LOADGEN_AMPLITUDE * lg.gain[ch] / LOADGEN_GAIN_REF;
+
+		samples[ch] = loadgen_sample(ch, amp);
+	}
+	eeg_codec_pack24(samples, frame, EEG_CHANNELS);
+
+	if (IS_ENABLED(CONFIG_EEG_LOADGEN_CHIRP)) {
+		lg.chirp_t += 1.0f / lg.rate;
+		if (lg.chirp_t >= CONFIG_EEG_LOADGEN_CHIRP_S) {
+			lg.chirp_t = 0.0f;
+		}
+	}
+
+	stats.frames++;
+	eeg_stream_frame(frame);
+}
+
+static uint8_t loadgen_set_gain(const uint8_t *value)
+{
+	static const uint8_t gains[] = {1, 2, 4, 6, 8, 12, 24};
+	uint8_t mask = value[0];
+
+	if (!mask || (mask & ~EEG_CHAN_MASK)) {
+		return EEG_CTRL_STATUS_VALUE;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(gains); i++) {
+		if (gains[i] == value[1]) {
+			for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+				if (mask & BIT(ch)) {
+					lg.gain[ch] = value[1];
+				}
+			}
+			eeg_artifact_set_gain(mask, value[1]);
+			return EEG_CTRL_STATUS_OK;
+		}
+	}
+
+	return EEG_CTRL_STATUS_VALUE;
+}
+
+/* Same commands as the ADS1299 path, any rate up to 16 kSPS is accepted */
+static void loadgen_control(const struct eeg_ctrl_cmd *cmd)
+{
+	struct eeg_ctrl_counters cnt;
+	uint8_t status = cmd->status;
+	uint16_t rate;
+
+	if (status != EEG_CTRL_STATUS_OK) {
+		eeg_ctrl_respond(cmd, status, NULL, 0);
+		return;
+	}
+
+	switch (cmd->type) {
+	case EEG_CTRL_START:
+		if (!lg.running) {
+			lg.running = true;
+			loadgen_restart();
+		}
+		break;
+	case EEG_CTRL_STOP:
+	case EEG_CTRL_LOW_POWER:
+		lg.running = false;
+		eeg_log_close();
+		break;
+	case EEG_CTRL_SET_RATE:
+		rate = sys_get_le16(cmd->value);
+		if (!rate || (rate > LOADGEN_RATE_MAX)) {
+			status = EEG_CTRL_STATUS_VALUE;
+			break;
+		}
+		lg.rate = rate;
+		eeg_stream_set_rate(rate);
+		loadgen_restart();
+		break;
+	case EEG_CTRL_SET_CHANS:
+		if (!cmd->value[0] || (cmd->value[0] & ~EEG_CHAN_MASK)) {
+			status = EEG_CTRL_STATUS_VALUE;
+			break;
+		}
+		status = eeg_stream_set_mask(cmd->value[0]);
+		break;
+	case EEG_CTRL_SET_GAIN:
+		status = loadgen_set_gain(cmd->value);
+		break;
+	case EEG_CTRL_COUNTERS:
+		eeg_stream_counters(&cnt);
+		eeg_ctrl_respond(cmd, EEG_CTRL_STATUS_OK, &cnt, sizeof(cnt));
+		return;
+	case EEG_CTRL_LATENCY:
+		eeg_lat_command(cmd);
+		return;
+	case EEG_CTRL_SET_MODE:
+		status = eeg_stream_set_mode(cmd->value[0]);
+		break;
+	case EEG_CTRL_SET_SPATIAL:
+		status = eeg_stream_set_spatial(cmd->value);
+		break;
+	case EEG_CTRL_SET_FEEDBACK:
+		status = eeg_feedback_set(cmd->value);
+		break;
+	default:
+		status = EEG_CTRL_STATUS_VALUE;
+		break;
+	}
+
+	LOG_INF("Command 0x%02x: status %u, %s at %u frames/s", cmd->type, status,
+		lg.running ? "running" : "stopped", lg.rate);
+	eeg_ctrl_respond(cmd, status, NULL, 0);
+}
+
+static void loadgen_report(void)
+{
+	struct eeg_stream_stats now;
+	int64_t ms = k_uptime_get() - lg.report_ms;
+	uint32_t done;
+
+	if (ms < CONFIG_EEG_LOADGEN_REPORT_MS) {
+		return;
+	}
+
+	eeg_stream_stats_get(&now);
+	done = now.tx_done - lg.report.tx_done;
+
+	LOG_INF("%u notif/s, %u B/s, %u refused, %u late, latency avg %u us max %u us",
+		(uint32_t)(done * 1000 / ms),
+		(uint32_t)((uint64_t)(now.bytes - lg.report.bytes) * 1000 / ms),
+		now.notify_failed - lg.report.notify_failed, stats.late,
+		done ? (uint32_t)((now.latency_sum_us - lg.report.latency_sum_us) / done) : 0,
+		now.latency_max_us);
+
+	lg.report = now;
+	lg.report_ms += ms;
+}
+
+void eeg_loadgen_run(void)
+{
+	struct eeg_ctrl_cmd cmd;
+
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		lg.gain[ch] = LOADGEN_GAIN_REF;
+	}
+
+	LOG_INF("Load generator, %u channels at %u frames/s", EEG_CHANNELS, lg.rate);
+	eeg_stream_set_rate(lg.rate);
+	loadgen_restart();
+
+	for (;;) {
+		uint64_t due;
+
+		/* Commands are only applied on packet boundaries, idle waits for one */
+		while (eeg_stream_boundary() &&
+		       !eeg_ctrl_get(&cmd, lg.running ? K_NO_WAIT : K_FOREVER)) {
+			loadgen_control(&cmd);
+		}
+		eeg_state_streaming(lg.running);
+		eeg_lat_run(lg.running);
+
+		if (!lg.running) {
+			continue;
+		}
+
+		loadgen_report();
+
+		due = (uint64_t)(k_uptime_ticks() - lg.t0) * lg.rate / CONFIG_SYS_CLOCK_TICKS_PER_SEC;
+
+		/* More than a second behind: the link is saturated, skip ahead */
+		if (due - lg.frame_no > lg.rate) {
+			stats.late += (uint32_t)(due - lg.frame_no);
+			lg.frame_no = due;
+		}
+
+		/* Catch up, but stop at each packet boundary to look for commands */
+		while (lg.frame_no < due) {
+			lg.frame_no++;
+			loadgen_frame();
+			if (eeg_stream_boundary()) {
+				break;
+			}
+		}
+
+		if (lg.frame_no >= due) {
+			/* Sleep until the next packet can be completed */
+			uint64_t next = lg.frame_no +
+					(eeg_stream_boundary() ? EEG_FRAMES_PER_PACKET : 1);
+
+			k_sleep(K_TIMEOUT_ABS_TICKS(lg.t0 + next * CONFIG_SYS_CLOCK_TICKS_PER_SEC / lg.rate));
+		}
+	}
+}
+
+void eeg_loadgen_stats_get(struct eeg_loadgen_stats *out)
+{
+	*out = stats;
+}
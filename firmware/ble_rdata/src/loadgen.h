@@ -0,0 +1,36 @@
+/*
+ * ANA EEG sticker - load generator
+ *
+ * Replaces the ADS1299 with synthetic frames (counters, sine waves or a chirp)
+ * pushed through the real packetizer at a configurable rate, to measure what
+ * the link sustains without electrodes on a head. Runs on native_sim and
+ * nrf52_bsim as well as on the boards.
+ */
+
+#ifndef LOADGEN_H_
+#define LOADGEN_H_
+
+#include <zephyr/types.h>
+
+struct eeg_loadgen_stats {
+	uint32_t frames;        // Frames generated
+	uint32_t late;          // Frames skipped because the stream fell behind
+};
+
+#if defined(CONFIG_EEG_LOADGEN)
+
+/* Generate frames and execute control commands, never returns */
+void eeg_loadgen_run(void);
+
+void eeg_loadgen_stats_get(struct eeg_loadgen_stats *stats);
+
+#else
+
+static inline void eeg_loadgen_stats_get(struct eeg_loadgen_stats *stats)
+{
+	*stats = (struct eeg_loadgen_stats){0};
+}
+
+#endif /* CONFIG_EEG_LOADGEN */
+
+#endif /* LOADGEN_H_ */
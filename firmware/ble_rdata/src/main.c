@@ -35,6 +35,23 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/spi.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "eeg_stream.h"
+#include "retx.h"
+#include "eeg_log.h"
+#include "broadcast.h"
+#include "eeg_ctrl.h"
+#include "loadgen.h"
+#include "clock_sync.h"
+#include "iso.h"
+#include "eeg_state.h"
+#include "diag.h"
+#include "latency.h"
+#include "power.h"
+#include "artifact.h"
+#include "feedback.h"
+
 #define LOG_MODULE_NAME peripheral_uart
 LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 
@@ -99,6 +116,12 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 #define MISC1      0x15 // Miscellaneous settings 1
 #define MISC2      0x16 // Miscellaneous settings 2
 
+/* Register fields */
+#define CONFIG1_DR_MASK  0x07 // Output data rate
+#define CHNSET_PD        0x80 // Channel power-down
+#define CHNSET_GAIN_MASK 0x70 // PGA gain
+#define CHNSET_GAIN_POS  4
+
 /* -------------------------------------------------------------------------- */
 /* Driver Data Structure                                                      */
 /* -------------------------------------------------------------------------- */
@@ -111,6 +134,13 @@ struct ads1299_data {
     struct gpio_callback drdy_cb;               //drdy callback
     struct k_work drdy_work;                    //drdy work queue
 };
+
+/* Acquisition state, owned by the acquisition (main) thread */
+struct ads1299_acq {
+    bool streaming;
+    bool standby;
+};
+
 static K_SEM_DEFINE(ble_init_ok, 0, 1);
 
 static struct bt_conn *current_conn;
@@ -128,6 +158,37 @@ struct uart_data_t {
 static K_FIFO_DEFINE(fifo_uart_tx_data);
 static K_FIFO_DEFINE(fifo_uart_rx_data);
 
+/* UART payload buffers, fixed at link time instead of coming from the heap */
+K_MEM_SLAB_DEFINE_STATIC(uart_slab, sizeof(struct uart_data_t), CONFIG_BT_NUS_UART_BUFFER_COUNT, 4);
+static atomic_t uart_buf_failed;
+
+static struct uart_data_t *uart_buf_alloc(void)
+{
+	struct uart_data_t *buf;
+
+	if (k_mem_slab_alloc(&uart_slab, (void **)&buf, K_NO_WAIT)) {
+		atomic_inc(&uart_buf_failed);
+		return NULL;
+	}
+
+	return buf;
+}
+
+static void uart_buf_free(struct uart_data_t *buf)
+{
+	k_mem_slab_free(&uart_slab, buf);
+}
+
+void eeg_uart_pool_get(struct eeg_diag_pool *pool)
+{
+	pool->used = k_mem_slab_num_used_get(&uart_slab);
+#if defined(CONFIG_MEM_SLAB_TRACE_MAX_UTILIZATION)
+	pool->peak = k_mem_slab_max_used_get(&uart_slab);
+#endif
+	pool->total = CONFIG_BT_NUS_UART_BUFFER_COUNT;
+	pool->failed = atomic_get(&uart_buf_failed);
+}
+
 static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
 	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
@@ -170,7 +231,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 					   data[0]);
 		}
 
-		k_free(buf);
+		uart_buf_free(buf);
 
 		buf = k_fifo_get(&fifo_uart_tx_data, K_NO_WAIT);
 		if (!buf) {
@@ -204,7 +265,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		LOG_DBG("UART_RX_DISABLED");
 		disable_req = false;
 
-		buf = k_malloc(sizeof(*buf));
+		buf = uart_buf_alloc();
 		if (buf) {
 			buf->len = 0;
 		} else {
@@ -220,7 +281,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 
 	case UART_RX_BUF_REQUEST:
 		LOG_DBG("UART_RX_BUF_REQUEST");
-		buf = k_malloc(sizeof(*buf));
+		buf = uart_buf_alloc();
 		if (buf) {
 			buf->len = 0;
 			uart_rx_buf_rsp(uart, buf->data, sizeof(buf->data));
@@ -238,7 +299,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		if (buf->len > 0) {
 			k_fifo_put(&fifo_uart_rx_data, buf);
 		} else {
-			k_free(buf);
+			uart_buf_free(buf);
 		}
 
 		break;
@@ -267,7 +328,7 @@ static void uart_work_handler(struct k_work *item)
 {
 	struct uart_data_t *buf;
 
-	buf = k_malloc(sizeof(*buf));
+	buf = uart_buf_alloc();
 	if (buf) {
 		buf->len = 0;
 	} else {
@@ -306,7 +367,7 @@ static int uart_init(void)
 		}
 	}
 
-	rx = k_malloc(sizeof(*rx));
+	rx = uart_buf_alloc();
 	if (rx) {
 		rx->len = 0;
 	} else {
@@ -324,7 +385,7 @@ static int uart_init(void)
 
 	err = uart_callback_set(uart, uart_cb, NULL);
 	if (err) {
-		k_free(rx);
+		uart_buf_free(rx);
 		LOG_ERR("Cannot initialize UART callback");
 		return err;
 	}
@@ -352,29 +413,29 @@ static int uart_init(void)
 		}
 	}
 
-	tx = k_malloc(sizeof(*tx));
+	tx = uart_buf_alloc();
 
 	if (tx) {
 		pos = snprintf(tx->data, sizeof(tx->data),
 			       "Starting Nordic UART service example\r\n");
 
 		if ((pos < 0) || (pos >= sizeof(tx->data))) {
-			k_free(rx);
-			k_free(tx);
+			uart_buf_free(rx);
+			uart_buf_free(tx);
 			LOG_ERR("snprintf returned %d", pos);
 			return -ENOMEM;
 		}
 
 		tx->len = pos;
 	} else {
-		k_free(rx);
+		uart_buf_free(rx);
 		return -ENOMEM;
 	}
 
 	err = uart_tx(uart, tx->data, tx->len, SYS_FOREVER_MS);
 	if (err) {
-		k_free(rx);
-		k_free(tx);
+		uart_buf_free(rx);
+		uart_buf_free(tx);
 		LOG_ERR("Cannot display welcome message (err: %d)", err);
 		return err;
 	}
@@ -383,7 +444,7 @@ static int uart_init(void)
 	if (err) {
 		LOG_ERR("Cannot enable uart reception (err: %d)", err);
 		/* Free the rx buffer only because the tx buffer will be handled in the callback */
-		k_free(rx);
+		uart_buf_free(rx);
 	}
 
 	return err;
@@ -402,6 +463,10 @@ static void connected(struct bt_conn *conn, uint8_t err)
 	LOG_INF("Connected %s", addr);
 
 	current_conn = bt_conn_ref(conn);
+	eeg_stream_connected(conn);
+	eeg_log_connected(conn);
+	eeg_state_connected(true);
+	eeg_state_post(EEG_EVT_CONNECTED);
 
 	dk_set_led_on(CON_STATUS_LED);
 }
@@ -424,6 +489,13 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 		current_conn = NULL;
 		dk_set_led_off(CON_STATUS_LED);
 	}
+
+	eeg_stream_disconnected();
+	eeg_clock_sync_reset();
+	eeg_retx_flush();
+	eeg_log_disconnected();
+	eeg_state_connected(false);
+	eeg_state_post(EEG_EVT_DISCONNECTED);
 }
 
 #ifdef CONFIG_BT_NUS_SECURITY_ENABLED
@@ -529,8 +601,13 @@ static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
 
 	LOG_INF("Received data from: %s", addr);
 
+	/* Control messages are consumed here, anything else goes to UART */
+	if (eeg_ctrl_received(data, len)) {
+		return;
+	}
+
 	for (uint16_t pos = 0; pos != len;) {
-		struct uart_data_t *tx = k_malloc(sizeof(*tx));
+		struct uart_data_t *tx = uart_buf_alloc();
 
 		if (!tx) {
 			LOG_WRN("Not able to allocate UART send data buffer");
@@ -643,6 +720,19 @@ void ads1299_power_up(const struct device *dev){
     LOG_INF("ADS1299 Powered up");
 }
 
+//One SPI transfer, rx may be NULL; the SPIM is only resumed while it runs
+static int ads1299_spi(const struct ads1299_data *data, const struct spi_buf_set *tx,
+                       const struct spi_buf_set *rx){
+    int ret = eeg_pm_spi_get(data->spi);
+
+    if (ret < 0) {
+        return ret;
+    }
+    ret = spi_transceive(data->spi, data->spi_cfg, tx, rx);
+    eeg_pm_spi_put(data->spi);
+    return ret;
+}
+
 //SPI read/write register
 uint8_t ads1299_rreg(const struct device *dev, uint8_t address){
     const struct ads1299_data *data = dev->data;
@@ -661,7 +751,7 @@ uint8_t ads1299_rreg(const struct device *dev, uint8_t address){
     struct spi_buf_set rx_set = { .buffers = &rx, .count = 1 };
     
     gpio_pin_set_dt(&data->cs_gpios, 1);
-    int ret = spi_transceive(data->spi, data->spi_cfg, &tx_set, &rx_set);
+    int ret = ads1299_spi(data, &tx_set, &rx_set);
     
     if (ret < 0) {
         LOG_ERR("Failed to read register: 0x%02X", ret);
@@ -686,7 +776,7 @@ void ads1299_wrreg(const struct device *dev, uint8_t address, uint8_t value){
 
     // Send WREG command + data
     gpio_pin_set_dt(&data->cs_gpios, 1);
-    int ret = spi_write(data->spi, data->spi_cfg, &tx_set);
+    int ret = ads1299_spi(data, &tx_set, NULL);
     if (ret < 0) {
         LOG_ERR("Failed to write register: 0x%02X", ret);
     }
@@ -707,47 +797,258 @@ void ads1299_recognise(const struct device *dev){
     }
 }
 
+void ads1299_send_command(const struct device *dev, uint8_t cmd);
+
+/* Data rates indexed by the CONFIG1 DR code */
+static const uint16_t ads1299_rates[] = {16000, 8000, 4000, 2000, 1000, 500, 250};
+/* PGA gains indexed by the CHnSET GAIN code */
+static const uint8_t ads1299_gains[] = {1, 2, 4, 6, 8, 12, 24};
+
+//Read-modify-write a register and read it back, registers are only writable after SDATAC
+static int ads1299_update_reg(const struct device *dev, uint8_t address, uint8_t mask, uint8_t value){
+    uint8_t reg = (ads1299_rreg(dev, address) & ~mask) | (value & mask);
+
+    ads1299_wrreg(dev, address, reg);
+
+    return (ads1299_rreg(dev, address) == reg) ? 0 : -EIO;
+}
+
+static void ads1299_stream_start(const struct device *dev, struct ads1299_acq *acq){
+    if (acq->standby) {
+        ads1299_send_command(dev, _WAKEUP);
+        acq->standby = false;
+    }
+    ads1299_send_command(dev, _START);
+    ads1299_send_command(dev, _RDATAC);
+    acq->streaming = true;
+    eeg_state_streaming(true);
+    eeg_lat_run(true);
+    LOG_INF("Streaming of ADS Data started");
+}
+
+static void ads1299_stream_stop(const struct device *dev, struct ads1299_acq *acq){
+    ads1299_send_command(dev, _SDATAC);
+    ads1299_send_command(dev, _STOP);
+    acq->streaming = false;
+    eeg_state_streaming(false);
+    eeg_lat_run(false);
+    //persist whatever was logged so far
+    eeg_log_close();
+    LOG_INF("Streaming of ADS Data stopped");
+}
+
+static uint8_t ads1299_set_rate(const struct device *dev, const uint8_t *value){
+    uint16_t sps = sys_get_le16(value);
+
+    for (uint8_t dr = 0; dr < ARRAY_SIZE(ads1299_rates); dr++) {
+        if (ads1299_rates[dr] == sps) {
+            if (ads1299_update_reg(dev, CONFIG1, CONFIG1_DR_MASK, dr)) {
+                return EEG_CTRL_STATUS_IO;
+            }
+            eeg_stream_set_rate(sps);
+            return EEG_CTRL_STATUS_OK;
+        }
+    }
+    return EEG_CTRL_STATUS_VALUE;
+}
+
+static uint8_t ads1299_set_chans(const struct device *dev, uint8_t mask){
+    uint8_t old = eeg_stream_mask();
+    uint8_t status;
+
+    if (!mask || (mask & ~EEG_CHAN_MASK)) {
+        return EEG_CTRL_STATUS_VALUE;
+    }
+
+    //the spatial filter may refuse a mask that drops one of its electrodes
+    status = eeg_stream_set_mask(mask);
+    if (status != EEG_CTRL_STATUS_OK) {
+        return status;
+    }
+
+    //power down the channels that are not sent
+    for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+        if (ads1299_update_reg(dev, CH1SET + ch, CHNSET_PD, (mask & BIT(ch)) ? 0 : CHNSET_PD)) {
+            eeg_stream_set_mask(old);
+            return EEG_CTRL_STATUS_IO;
+        }
+    }
+    return EEG_CTRL_STATUS_OK;
+}
+
+static uint8_t ads1299_set_gain(const struct device *dev, const uint8_t *value){
+    uint8_t mask = value[0];
+
+    if (!mask || (mask & ~EEG_CHAN_MASK)) {
+        return EEG_CTRL_STATUS_VALUE;
+    }
+
+    for (uint8_t code = 0; code < ARRAY_SIZE(ads1299_gains); code++) {
+        if (ads1299_gains[code] != value[1]) {
+            continue;
+        }
+        for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+            if ((mask & BIT(ch)) &&
+                ads1299_update_reg(dev, CH1SET + ch, CHNSET_GAIN_MASK, code << CHNSET_GAIN_POS)) {
+                return EEG_CTRL_STATUS_IO;
+            }
+        }
+        eeg_artifact_set_gain(mask, value[1]);
+        return EEG_CTRL_STATUS_OK;
+    }
+    return EEG_CTRL_STATUS_VALUE;
+}
+
+//Execute one command from the control plane, only called between packets
+static void ads1299_control(const struct device *dev, struct ads1299_acq *acq,
+                            const struct eeg_ctrl_cmd *cmd){
+    struct eeg_ctrl_counters cnt;
+    uint8_t status = cmd->status;
+    bool was_streaming = acq->streaming;
+
+    if (status != EEG_CTRL_STATUS_OK) {
+        eeg_ctrl_respond(cmd, status, NULL, 0);
+        return;
+    }
+
+    switch (cmd->type) {
+    case EEG_CTRL_START:
+        if (!acq->streaming) {
+            ads1299_stream_start(dev, acq);
+        }
+        break;
+    case EEG_CTRL_STOP:
+        if (acq->streaming) {
+            ads1299_stream_stop(dev, acq);
+        }
+        break;
+    case EEG_CTRL_LOW_POWER:
+        if (acq->streaming) {
+            ads1299_stream_stop(dev, acq);
+        }
+        if (!acq->standby) {
+            ads1299_send_command(dev, _STANDBY);
+            acq->standby = true;
+        }
+        break;
+    case EEG_CTRL_COUNTERS:
+        eeg_stream_counters(&cnt);
+        eeg_ctrl_respond(cmd, EEG_CTRL_STATUS_OK, &cnt, sizeof(cnt));
+        return;
+    case EEG_CTRL_LATENCY:
+        eeg_lat_command(cmd);
+        return;
+    case EEG_CTRL_SET_MODE:
+        status = eeg_stream_set_mode(cmd->value[0]);
+        break;
+    case EEG_CTRL_SET_SPATIAL:
+        status = eeg_stream_set_spatial(cmd->value);
+        break;
+    case EEG_CTRL_SET_FEEDBACK:
+        status = eeg_feedback_set(cmd->value);
+        break;
+    case EEG_CTRL_SET_RATE:
+    case EEG_CTRL_SET_CHANS:
+    case EEG_CTRL_SET_GAIN:
+        if (acq->standby) {
+            status = EEG_CTRL_STATUS_BUSY;
+            break;
+        }
+        //registers can only be written outside RDATAC
+        if (was_streaming) {
+            ads1299_stream_stop(dev, acq);
+        }
+        if (cmd->type == EEG_CTRL_SET_RATE) {
+            status = ads1299_set_rate(dev, cmd->value);
+        } else if (cmd->type == EEG_CTRL_SET_CHANS) {
+            status = ads1299_set_chans(dev, cmd->value[0]);
+        } else {
+            status = ads1299_set_gain(dev, cmd->value);
+        }
+        if (was_streaming) {
+            ads1299_stream_start(dev, acq);
+        }
+        break;
+    default:
+        status = EEG_CTRL_STATUS_VALUE;
+        break;
+    }
+
+    eeg_ctrl_respond(cmd, status, NULL, 0);
+}
+
+//Scatter one RDATAC frame: the status bytes and unsent channels are discarded,
+//the rest lands in the packet being built so no copy is needed afterwards
+static uint32_t ads1299_frame_bufs(uint8_t mask, uint8_t *dst, struct spi_buf *bufs){
+    uint32_t n = 0;
+
+    bufs[n++] = (struct spi_buf){ .buf = NULL, .len = 3 };
+    for (uint8_t ch = 0; ch < 8; ch++) {
+        bool keep = mask & BIT(ch);
+
+        if ((bufs[n - 1].buf != NULL) == keep) {
+            bufs[n - 1].len += 3;
+        } else {
+            bufs[n++] = (struct spi_buf){ .buf = keep ? dst : NULL, .len = 3 };
+        }
+        if (keep) {
+            dst += 3;
+        }
+    }
+    return n;
+}
+
+//eeg_lat_now() at the last DRDY edge, read after the event that follows it
+static volatile uint32_t drdy_stamp;
+
 void ads1299_rdatac(const struct device *dev){
 	const struct ads1299_data *data = dev->data;
 
-	//setup buffers
+	//setup buffers, rx goes straight into the packet
 	uint8_t tx_buf[27] = {0};
-	uint8_t rx_buf[27] = {0};
+	struct spi_buf rx_bufs[9];
 	struct spi_buf tx = { .buf = tx_buf, .len = sizeof(tx_buf) };
-    struct spi_buf rx = { .buf = rx_buf, .len = sizeof(rx_buf) };
 
     struct spi_buf_set tx_set = { .buffers = &tx, .count = 1 };
-    struct spi_buf_set rx_set = { .buffers = &rx, .count = 1 };
-    
-	while(1){
-		if(gpio_pin_get_dt(&data->drdy_gpio) != 1){
-			gpio_pin_set_dt(&data->cs_gpios, 1);
-			  int ret = spi_transceive(data->spi, data->spi_cfg, &tx_set, &rx_set);
-			if (ret < 0) {
-        		printk("Failed to write to collect data: 0x%02X", ret);
-    		}
-			gpio_pin_set_dt(&data->cs_gpios, 0);
-			uint8_t ble_buf[12];
-    		for (int ch = 0; ch < 4; ch++) {
-				int32_t val = 	(rx_buf[3 + 3*ch] << 16) |
-								(rx_buf[3 + 3*ch + 1] << 8) |
-								rx_buf[3 + 3*ch + 2];
-				if (val & 0x800000) val |= 0xFF000000;
-					ble_buf[ch*3]   = rx_buf[3 + 3*ch];
-					ble_buf[ch*3+1] = rx_buf[3 + 3*ch + 1];
-					ble_buf[ch*3+2] = rx_buf[3 + 3*ch + 2];
-					
-    		}
-
-			if (current_conn) {
-				int err = bt_nus_send(current_conn, ble_buf, sizeof(ble_buf));
-				if (err) printk("bt_nus_send error: %d\n", err);
-				k_sleep(K_MSEC(1));
-			}
-			k_sleep(K_USEC(50));
+    struct spi_buf_set rx_set = { .buffers = rx_bufs, .count = 0 };
+
+	struct ads1299_acq acq = {0};
+	struct eeg_ctrl_cmd cmd;
+
+	//an idle sticker neither samples nor transmits until asked to
+	if (IS_ENABLED(CONFIG_EEG_AUTOSTART)) {
+		ads1299_stream_start(dev, &acq);
+	}
+
+	for (;;) {
+		//sleep until DRDY, a command or a connection change; idle never sees DRDY
+		uint32_t ev = eeg_state_wait(EEG_EVT_ALL, K_FOREVER);
+		uint32_t wake = k_cycle_get_32();
+
+		//commands are only applied on packet boundaries
+		while (eeg_stream_boundary() && !eeg_ctrl_get(&cmd, K_NO_WAIT)) {
+			ads1299_control(dev, &acq, &cmd);
+		}
+
+		if (!(ev & EEG_EVT_DRDY) || !acq.streaming) {
+			continue;
+		}
+
+		rx_set.count = ads1299_frame_bufs(eeg_stream_mask(), eeg_stream_frame_buf(), rx_bufs);
+
+		gpio_pin_set_dt(&data->cs_gpios, 1);
+		int ret = ads1299_spi(data, &tx_set, &rx_set);
+		if (ret < 0) {
+			printk("Failed to write to collect data: 0x%02X", ret);
+		}
+		gpio_pin_set_dt(&data->cs_gpios, 0);
+
+		eeg_stream_frame_time(drdy_stamp);
+		eeg_stream_frame_done();
+		eeg_pm_sample(wake);
 	}
 }
-}
+
 //send commands
 void ads1299_send_command(const struct device *dev, uint8_t cmd){
     const struct ads1299_data *data = dev->data;
@@ -763,7 +1064,7 @@ void ads1299_send_command(const struct device *dev, uint8_t cmd){
     
     
     gpio_pin_set_dt(&data->cs_gpios, 1);
-    int ret = spi_write(data->spi, data->spi_cfg, &tx_set);
+    int ret = ads1299_spi(data, &tx_set, NULL);
     if (ret < 0 ){
         LOG_INF("Command send failed");
     }
@@ -779,6 +1080,12 @@ void ads1299_send_command(const struct device *dev, uint8_t cmd){
     LOG_INF("Command sent sucesfully");
 }
 
+//DRDY falls once per sample, the acquisition loop picks it up
+static void ads1299_drdy_isr(const struct device *port, struct gpio_callback *cb, uint32_t pins){
+    drdy_stamp = eeg_lat_now();
+    eeg_state_post(EEG_EVT_DRDY);
+}
+
 /* ADS1299 device initialization */
 static int ads1299_init(const struct device *dev){
     struct ads1299_data *data = dev->data;
@@ -787,6 +1094,8 @@ static int ads1299_init(const struct device *dev){
         LOG_ERR("SPI bus not ready");
         return -ENODEV;
     }
+    //no SPIM clock or pins between transfers; only a warning if unsupported
+    eeg_pm_spi_enable(data->spi);
 
     if(!device_is_ready(data->drdy_gpio.port)) {
         LOG_ERR("DRDY GPIO not ready");
@@ -794,6 +1103,10 @@ static int ads1299_init(const struct device *dev){
     }
 
     gpio_pin_configure_dt(&data->drdy_gpio, GPIO_INPUT); //configure as input
+    gpio_init_callback(&data->drdy_cb, ads1299_drdy_isr, BIT(data->drdy_gpio.pin));
+    gpio_add_callback(data->drdy_gpio.port, &data->drdy_cb);
+    //DRDY is active high in DT, data is ready on the falling edge
+    gpio_pin_interrupt_configure_dt(&data->drdy_gpio, GPIO_INT_EDGE_TO_INACTIVE);
 
     if(!device_is_ready(data->reset_gpio.port)){
         LOG_ERR("RESET GPIO not ready");
@@ -890,6 +1203,9 @@ int main(void)
 		return 0;
 	}
 
+	/* Not fatal, the stream then stays on GATT */
+	eeg_iso_init();
+
 	err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd,
 			      ARRAY_SIZE(sd));
 	if (err) {
@@ -897,6 +1213,16 @@ int main(void)
 		return 0;
 	}
 
+	eeg_state_advertising(true);
+
+	err = eeg_bcast_start();
+	if (err) {
+		LOG_ERR("Broadcast failed to start (err %d)", err);
+	}
+
+#if defined(CONFIG_EEG_LOADGEN)
+	eeg_loadgen_run();
+#else
 	LOG_INF("Starting ADS1299 test");
         const struct device *dev = DEVICE_DT_GET_ONE(ti_ads1299);
         if(!device_is_ready(dev)){
@@ -906,13 +1232,8 @@ int main(void)
 
        ads1299_recognise(dev);
 
-       ads1299_send_command(dev, _START);
-       LOG_INF("Streaming of ADS Data started");
-       ads1299_send_command(dev, _RDATAC);
-
 		ads1299_rdatac(dev);
-
-	
+#endif /* CONFIG_EEG_LOADGEN */
 }
 
 void ble_write_thread(void)
@@ -948,7 +1269,7 @@ void ble_write_thread(void)
 			plen = MIN(sizeof(nus_data.data), buf->len - loc);
 		}
 
-		k_free(buf);
+		uart_buf_free(buf);
 	}
 }
 
@@ -0,0 +1,103 @@
+/*
+ * ANA EEG sticker - power-managed acquisition
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/logging/log.h>
+
+#include "latency.h"
+#include "power.h"
+
+LOG_MODULE_REGISTER(power, LOG_LEVEL_INF);
+
+static struct k_spinlock lock;
+static struct eeg_pm_stats stats;
+static uint32_t spi_since;
+static bool spi_managed;
+
+int eeg_pm_spi_enable(const struct device *spi)
+{
+	int err = pm_device_runtime_enable(spi);
+
+	if (err) {
+		LOG_WRN("SPI runtime PM not available (err %d), SPIM stays on", err);
+		return err;
+	}
+
+	spi_managed = true;
+	LOG_INF("SPIM suspended between transfers");
+
+	return 0;
+}
+
+int eeg_pm_spi_get(const struct device *spi)
+{
+	int err;
+
+	if (!spi_managed) {
+		return 0;
+	}
+
+	err = pm_device_runtime_get(spi);
+	if (err) {
+		LOG_ERR("SPI resume failed (err %d)", err);
+		return err;
+	}
+
+	spi_since = k_cycle_get_32();
+
+	return 0;
+}
+
+void eeg_pm_spi_put(const struct device *spi)
+{
+	uint32_t on;
+	k_spinlock_key_t key;
+
+	if (!spi_managed) {
+		return;
+	}
+
+	on = k_cycle_get_32() - spi_since;
+	pm_device_runtime_put(spi);
+
+	key = k_spin_lock(&lock);
+	stats.spi_cycles += on;
+	stats.spi_resumes++;
+	k_spin_unlock(&lock, key);
+}
+
+void eeg_pm_sample(uint32_t wake)
+{
+	uint32_t active = k_cycle_get_32() - wake;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	stats.samples++;
+	stats.active_cycles += active;
+	stats.active_max_cycles = MAX(stats.active_max_cycles, active);
+
+	k_spin_unlock(&lock, key);
+}
+
+void eeg_pm_stats_get(struct eeg_pm_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = stats;
+	stats.active_max_cycles = 0;
+
+	k_spin_unlock(&lock, key);
+}
+
+uint32_t eeg_pm_current_ua(uint16_t cpu_permille, uint16_t spi_permille)
+{
+	uint32_t cpu = MIN(cpu_permille, 1000U);
+
+	return ((uint32_t)CONFIG_EEG_PM_ACTIVE_UA * cpu +
+		(uint32_t)CONFIG_EEG_PM_IDLE_UA * (1000U - cpu) +
+		(uint32_t)CONFIG_EEG_PM_SPI_UA * MIN(spi_permille, 1000U)) / 1000U +
+	       (eeg_lat_running() ? CONFIG_EEG_PM_TIMER_UA : 0U);
+}
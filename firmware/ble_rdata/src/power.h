@@ -0,0 +1,68 @@
+/*
+ * ANA EEG sticker - power-managed acquisition
+ *
+ * Between two DRDY edges the acquisition thread sleeps on its k_event and
+ * the kernel, being tickless, idles the CPU in System ON until the next
+ * interrupt. With CONFIG_EEG_PM the SPIM is additionally suspended (pins in
+ * their pinctrl sleep state) whenever no transfer is running, through PM
+ * device runtime. The module also keeps the duty cycle: how long the CPU
+ * stays awake per sample and how long the SPIM is resumed, from which a
+ * current estimate is derived (CONFIG_EEG_PM_*_UA), including the latency
+ * timer while it runs.
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+
+struct eeg_pm_stats {
+	uint32_t samples;           // Frames read
+	uint64_t active_cycles;     // DRDY wake-up to back to sleep, all samples
+	uint32_t active_max_cycles;
+	uint64_t spi_cycles;        // SPIM resumed
+	uint32_t spi_resumes;
+};
+
+#if defined(CONFIG_EEG_PM)
+
+/* Put the SPIM under PM device runtime, it is suspended until first used */
+int eeg_pm_spi_enable(const struct device *spi);
+
+/* Resume the SPIM around a transfer */
+int eeg_pm_spi_get(const struct device *spi);
+void eeg_pm_spi_put(const struct device *spi);
+
+/* One frame handled, wake is the k_cycle_get_32() value at wake-up */
+void eeg_pm_sample(uint32_t wake);
+
+/* active_max_cycles restarts from 0 after every call */
+void eeg_pm_stats_get(struct eeg_pm_stats *stats);
+
+/*
+ * Modelled average current in uA for a CPU load and SPIM on-time in 1/1000,
+ * plus the latency timer if it is running now
+ */
+uint32_t eeg_pm_current_ua(uint16_t cpu_permille, uint16_t spi_permille);
+
+#else
+
+static inline int eeg_pm_spi_enable(const struct device *spi)
+{
+	return 0;
+}
+static inline int eeg_pm_spi_get(const struct device *spi)
+{
+	return 0;
+}
+static inline void eeg_pm_spi_put(const struct device *spi)
+{
+}
+static inline void eeg_pm_sample(uint32_t wake)
+{
+}
+
+#endif /* CONFIG_EEG_PM */
+
+#endif /* POWER_H_ */
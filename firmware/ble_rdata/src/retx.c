@@ -0,0 +1,171 @@
+/*
+ * ANA EEG sticker - retransmit buffer
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+#include <bluetooth/services/nus.h>
+
+#include "eeg_stream.h"
+#include "retx.h"
+#include "diag.h"
+
+LOG_MODULE_REGISTER(retx, LOG_LEVEL_INF);
+
+#define RETX_DEPTH CONFIG_EEG_RETX_DEPTH
+
+BUILD_ASSERT(IS_POWER_OF_TWO(RETX_DEPTH), "EEG_RETX_DEPTH must be a power of two");
+
+struct retx_slot {
+	uint16_t seq;
+	uint16_t len;           // 0 = slot empty or being built
+	uint8_t data[EEG_PKT_MAX_LEN];
+};
+
+struct retx_range {
+	uint16_t start;
+	uint16_t count;
+};
+
+static struct retx_slot ring[RETX_DEPTH];
+static struct k_spinlock ring_lock;
+static struct eeg_retx_stats stats;
+
+K_MSGQ_DEFINE(retx_req_q, sizeof(struct retx_range), CONFIG_EEG_RETX_REQ_QUEUE, 4);
+
+uint8_t *eeg_retx_claim(uint16_t seq)
+{
+	struct retx_slot *slot = &ring[seq & (RETX_DEPTH - 1)];
+	k_spinlock_key_t key = k_spin_lock(&ring_lock);
+
+	slot->len = 0;
+
+	k_spin_unlock(&ring_lock, key);
+
+	return slot->data;
+}
+
+void eeg_retx_commit(uint16_t seq, uint16_t len)
+{
+	struct retx_slot *slot = &ring[seq & (RETX_DEPTH - 1)];
+	k_spinlock_key_t key = k_spin_lock(&ring_lock);
+
+	slot->seq = seq;
+	slot->len = len;
+
+	k_spin_unlock(&ring_lock, key);
+}
+
+/* Copy a packet out of the ring, false if it has already been overwritten */
+static bool retx_fetch(uint16_t seq, uint8_t *buf, uint16_t *len)
+{
+	const struct retx_slot *slot = &ring[seq & (RETX_DEPTH - 1)];
+	bool found = false;
+
+	k_spinlock_key_t key = k_spin_lock(&ring_lock);
+
+	if (slot->len && slot->seq == seq) {
+		memcpy(buf, slot->data, slot->len);
+		*len = slot->len;
+		found = true;
+	}
+
+	k_spin_unlock(&ring_lock, key);
+
+	return found;
+}
+
+int eeg_retx_nack(const uint8_t *value, uint16_t len)
+{
+	if ((len == 0) || (len % EEG_CTRL_NACK_RANGE_LEN)) {
+		LOG_WRN("Malformed NACK (len %u)", len);
+		return -EINVAL;
+	}
+
+	for (uint16_t pos = 0; pos < len; pos += EEG_CTRL_NACK_RANGE_LEN) {
+		struct retx_range range = {
+			.start = sys_get_le16(&value[pos]),
+			.count = MIN(sys_get_le16(&value[pos + 2]), RETX_DEPTH),
+		};
+
+		if (range.count == 0) {
+			continue;
+		}
+
+		/* BT RX context, never block here */
+		if (k_msgq_put(&retx_req_q, &range, K_NO_WAIT)) {
+			stats.req_dropped++;
+			return -ENOBUFS;
+		}
+
+		stats.requested += range.count;
+	}
+
+	return 0;
+}
+
+void eeg_retx_flush(void)
+{
+	k_msgq_purge(&retx_req_q);
+}
+
+void eeg_retx_stats_get(struct eeg_retx_stats *out)
+{
+	*out = stats;
+}
+
+void eeg_retx_pool_get(struct eeg_diag_pool *pool)
+{
+	pool->used = k_msgq_num_used_get(&retx_req_q);
+	pool->total = CONFIG_EEG_RETX_REQ_QUEUE;
+	pool->failed = stats.req_dropped;
+}
+
+/* Runs below the live acquisition path so retransmissions only ever use the
+ * link capacity left over by live data.
+ */
+static void retx_thread(void)
+{
+	/* Up to 774 bytes (8 channels x 32 frames), kept off the thread stack */
+	static uint8_t buf[EEG_PKT_MAX_LEN];
+	struct retx_range range;
+
+	for (;;) {
+		k_msgq_get(&retx_req_q, &range, K_FOREVER);
+
+		for (uint16_t i = 0; i < range.count;) {
+			uint16_t seq = range.start + i;
+			uint16_t len;
+			int err;
+
+			if (!retx_fetch(seq, buf, &len)) {
+				stats.expired++;
+				i++;
+				continue;
+			}
+
+			((struct eeg_pkt_hdr *)buf)->flags |= EEG_PKT_FLAG_RETX;
+
+			err = bt_nus_send(NULL, buf, len);
+			if (err == -ENOTCONN) {
+				eeg_retx_flush();
+				break;
+			} else if (err) {
+				/* Link is saturated by live data, back off and retry */
+				stats.send_failed++;
+				k_sleep(K_MSEC(CONFIG_EEG_RETX_BACKOFF_MS));
+				continue;
+			}
+
+			stats.sent++;
+			i++;
+			k_yield();
+		}
+	}
+}
+
+K_THREAD_DEFINE(retx_thread_id, CONFIG_EEG_RETX_THREAD_STACK_SIZE, retx_thread,
+		NULL, NULL, NULL, CONFIG_EEG_RETX_THREAD_PRIO, 0, 0);
@@ -0,0 +1,42 @@
+/*
+ * ANA EEG sticker - retransmit buffer
+ *
+ * Keeps the most recent data packets in a RAM ring indexed by sequence number
+ * so the central can ask for the ones it missed (EEG_CTRL_NACK).
+ *
+ * The ring is also the packet buffer pool: the packetizer builds each packet
+ * (and the ADS1299 SPI transfer writes its samples) straight into the slot it
+ * will be kept in, so a packet is never copied before the BT stack takes it.
+ */
+
+#ifndef RETX_H_
+#define RETX_H_
+
+#include <zephyr/types.h>
+
+struct eeg_retx_stats {
+	uint32_t requested;     // Packets asked for by the central
+	uint32_t sent;          // Packets retransmitted
+	uint32_t expired;       // Requested packets no longer in the ring
+	uint32_t send_failed;   // bt_nus_send errors while retransmitting
+	uint32_t req_dropped;   // NACK ranges dropped because the queue was full
+};
+
+/*
+ * Slot to build packet seq in (acquisition context). Whatever the slot held
+ * is no longer retransmitted, and packet seq is not either until committed.
+ */
+uint8_t *eeg_retx_claim(uint16_t seq);
+
+/* Packet seq is complete in its slot */
+void eeg_retx_commit(uint16_t seq, uint16_t len);
+
+/* Parse the value of an EEG_CTRL_NACK TLV and queue the ranges (BT RX context) */
+int eeg_retx_nack(const uint8_t *value, uint16_t len);
+
+/* Drop queued requests, e.g. when the central goes away */
+void eeg_retx_flush(void);
+
+void eeg_retx_stats_get(struct eeg_retx_stats *stats);
+
+#endif /* RETX_H_ */
@@ -0,0 +1,453 @@
+/*
+ * ANA EEG sticker - focus and stress scores
+ */
+
+#include <math.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+#if defined(CONFIG_EEG_FILTER_IMPL_CMSIS)
+#include <arm_math.h>
+#endif
+
+#include <eeg_biquad.h>
+
+#include "eeg_stream.h"
+#include "scores.h"
+
+LOG_MODULE_REGISTER(scores, LOG_LEVEL_INF);
+
+#define SCORES_BLOCKS           (CONFIG_EEG_SCORES_WINDOW_S / CONFIG_EEG_SCORES_PERIOD_S)
+#define SCORES_FLUSH_RETRY_MS   50
+
+BUILD_ASSERT(CONFIG_EEG_SCORES_WINDOW_S % CONFIG_EEG_SCORES_PERIOD_S == 0,
+	     "The window must be a whole number of periods");
+
+/* Pre-filtered samples, the band-passes peak at a gain of up to 2.5 */
+#define SCORES_SHIFT            5
+
+/* Without CONFIG_EEG_FILTER: the app's pre-filter, scaled as filter.c */
+#define SCORES_PRE_STAGES       3
+#define SCORES_PRE_SHIFT        7
+#define SCORES_PRE_HIGHPASS_HZ  1.0
+#define SCORES_PRE_LOWPASS_HZ   45.0
+#define SCORES_PRE_NOTCH_HZ     50.0
+#define SCORES_Q_BUTTERWORTH    0.7071      // As the app, not 1/sqrt(2)
+#define SCORES_Q_NOTCH          30.0
+#define SCORES_SAMPLE_MAX       ((1 << 23) - 1)
+#define SCORES_SAMPLE_MIN       (-(1 << 23))
+
+/* Thresholds of MinuteAnalyzer.analyze() */
+#define SCORES_TBR_MID          2.5f
+#define SCORES_TBR_SCALE        0.5f
+#define SCORES_ALPHA_CALM       0.25f
+#define SCORES_ALPHA_WEIGHT     1.2f
+#define SCORES_BETA_CALM        0.25f
+#define SCORES_EPS              1e-12f
+
+/* Centre and bandwidth (Hz) of the app's band-passes, Q = centre / bandwidth */
+static const struct {
+	double f0;
+	double bw;
+} bands[EEG_BANDS_COUNT] = {
+	[EEG_BAND_DELTA] = {2.5, 3.0},
+	[EEG_BAND_THETA] = {6.0, 4.0},
+	[EEG_BAND_ALPHA] = {10.0, 4.0},
+	[EEG_BAND_BETA] = {21.0, 18.0},
+	[EEG_BAND_GAMMA] = {37.5, 15.0},
+};
+
+/* Acquisition context only */
+static int32_t coeffs[EEG_BANDS_COUNT][EEG_BIQUAD_COEFFS];
+static int64_t state[EEG_CHANNELS][EEG_BANDS_COUNT][EEG_BIQUAD_STATE];
+static int32_t block[EEG_FRAMES_PER_PACKET];
+static int32_t out[EEG_FRAMES_PER_PACKET];
+static uint16_t scores_rate = EEG_DEFAULT_RATE;
+static uint8_t scores_mask;
+static uint32_t blk_len;                // Frames per period
+static uint32_t blk_frames;             // Frames with at least one clean channel
+static uint32_t blk_clean[EEG_CHANNELS];
+static uint64_t blk_sum[EEG_CHANNELS][EEG_BANDS_COUNT];
+static uint64_t ring_sum[SCORES_BLOCKS][EEG_CHANNELS][EEG_BANDS_COUNT];
+static uint32_t ring_frames[SCORES_BLOCKS];
+static uint32_t ring_clean[SCORES_BLOCKS][EEG_CHANNELS];
+static uint8_t ring_head;
+
+/* Last closed window, handed to the work item */
+static struct k_spinlock snap_lock;
+static struct {
+	uint64_t sum[EEG_CHANNELS][EEG_BANDS_COUNT];
+	uint32_t clean[EEG_CHANNELS];   // Frames in the sums, per channel
+	uint32_t frames;
+	uint16_t rate;
+	uint16_t seq;
+	uint8_t mask;
+} snap;
+
+/* System work queue only */
+static uint8_t backlog[CONFIG_EEG_SCORES_BACKLOG][EEG_SCORES_PKT_LEN];
+static uint16_t backlog_head;
+static uint16_t backlog_count;
+static uint16_t scores_seq;
+
+static struct eeg_scores_stats stats;
+
+static void scores_work_handler(struct k_work *work);
+static void flush_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(scores_work, scores_work_handler);
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_work_handler);
+
+#if defined(CONFIG_EEG_FILTER)
+/* The stream's samples are pre-filtered already */
+static void pre_design(uint16_t sps)
+{
+}
+
+static void pre_init(uint8_t ch)
+{
+}
+
+static void pre_load(uint8_t ch, const int32_t *p, uint8_t n_ch, uint8_t n)
+{
+	for (uint8_t i = 0; i < n; i++) {
+		block[i] = (int32_t)((uint32_t)p[i * n_ch] << SCORES_SHIFT);
+	}
+}
+#else
+static int32_t pre_coeffs[SCORES_PRE_STAGES * EEG_BIQUAD_COEFFS];
+static int64_t pre_state[EEG_CHANNELS][SCORES_PRE_STAGES * EEG_BIQUAD_STATE];
+static struct eeg_biquad_cas pre[EEG_CHANNELS];
+
+static void pre_design(uint16_t sps)
+{
+	eeg_biquad_design(&pre_coeffs[0], EEG_BIQUAD_HIGHPASS, sps, SCORES_PRE_HIGHPASS_HZ,
+			  SCORES_Q_BUTTERWORTH);
+	eeg_biquad_design(&pre_coeffs[EEG_BIQUAD_COEFFS], EEG_BIQUAD_LOWPASS, sps,
+			  SCORES_PRE_LOWPASS_HZ, SCORES_Q_BUTTERWORTH);
+	eeg_biquad_design(&pre_coeffs[2 * EEG_BIQUAD_COEFFS], EEG_BIQUAD_NOTCH, sps,
+			  SCORES_PRE_NOTCH_HZ, SCORES_Q_NOTCH);
+}
+
+static void pre_init(uint8_t ch)
+{
+	eeg_biquad_init(&pre[ch], SCORES_PRE_STAGES, pre_coeffs, pre_state[ch]);
+}
+
+/* Through the pre-filter and back to 24 bits, as filter.c would send it */
+static void pre_load(uint8_t ch, const int32_t *p, uint8_t n_ch, uint8_t n)
+{
+	for (uint8_t i = 0; i < n; i++) {
+		block[i] = (int32_t)((uint32_t)p[i * n_ch] << SCORES_PRE_SHIFT);
+	}
+
+	eeg_biquad_run(&pre[ch], block, block, n);
+
+	for (uint8_t i = 0; i < n; i++) {
+		int32_t y = ((block[i] >> (SCORES_PRE_SHIFT - 1)) + 1) >> 1;
+
+		y = CLAMP(y, SCORES_SAMPLE_MIN, SCORES_SAMPLE_MAX);
+		block[i] = (int32_t)((uint32_t)y << SCORES_SHIFT);
+	}
+}
+#endif /* CONFIG_EEG_FILTER */
+
+#if defined(CONFIG_EEG_FILTER_IMPL_CMSIS)
+static arm_biquad_cas_df1_32x64_ins_q31 cas[EEG_CHANNELS][EEG_BANDS_COUNT];
+
+static void band_init(uint8_t ch, uint8_t b)
+{
+	arm_biquad_cas_df1_32x64_init_q31(&cas[ch][b], 1, coeffs[b], state[ch][b],
+					  EEG_BIQUAD_POST_SHIFT);
+}
+
+static void band_run(uint8_t ch, uint8_t b, uint8_t n)
+{
+	arm_biquad_cas_df1_32x64_q31(&cas[ch][b], block, out, n);
+}
+#else
+static struct eeg_biquad_cas cas[EEG_CHANNELS][EEG_BANDS_COUNT];
+
+static void band_init(uint8_t ch, uint8_t b)
+{
+	eeg_biquad_init(&cas[ch][b], 1, coeffs[b], state[ch][b]);
+}
+
+static void band_run(uint8_t ch, uint8_t b, uint8_t n)
+{
+	eeg_biquad_run(&cas[ch][b], block, out, n);
+}
+#endif /* CONFIG_EEG_FILTER_IMPL_CMSIS */
+
+static uint64_t add_sat(uint64_t a, uint64_t b)
+{
+	return (a > UINT64_MAX - b) ? UINT64_MAX : a + b;
+}
+
+void eeg_scores_reset(void)
+{
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		pre_init(ch);
+		for (uint8_t b = 0; b < EEG_BANDS_COUNT; b++) {
+			band_init(ch, b);
+		}
+	}
+
+	blk_frames = 0;
+	memset(blk_clean, 0, sizeof(blk_clean));
+	memset(blk_sum, 0, sizeof(blk_sum));
+	memset(ring_frames, 0, sizeof(ring_frames));
+	ring_head = 0;
+}
+
+void eeg_scores_set_rate(uint16_t sps)
+{
+	for (uint8_t b = 0; b < EEG_BANDS_COUNT; b++) {
+		eeg_biquad_design(coeffs[b], EEG_BIQUAD_BANDPASS, sps, bands[b].f0,
+				  bands[b].f0 / bands[b].bw);
+	}
+	pre_design(sps);
+
+	scores_rate = sps;
+	blk_len = (uint32_t)sps * CONFIG_EEG_SCORES_PERIOD_S;
+	eeg_scores_reset();
+}
+
+/* Period complete: move it into the window and publish the window */
+static void scores_close_block(uint16_t pkt_seq)
+{
+	k_spinlock_key_t key;
+
+	memcpy(ring_sum[ring_head], blk_sum, sizeof(blk_sum));
+	memcpy(ring_clean[ring_head], blk_clean, sizeof(blk_clean));
+	ring_frames[ring_head] = blk_frames;
+	ring_head = (ring_head + 1) % SCORES_BLOCKS;
+	blk_frames = 0;
+	memset(blk_clean, 0, sizeof(blk_clean));
+	memset(blk_sum, 0, sizeof(blk_sum));
+
+	key = k_spin_lock(&snap_lock);
+
+	memset(snap.sum, 0, sizeof(snap.sum));
+	memset(snap.clean, 0, sizeof(snap.clean));
+	snap.frames = 0;
+	for (uint8_t i = 0; i < SCORES_BLOCKS; i++) {
+		if (!ring_frames[i]) {
+			continue;
+		}
+		snap.frames += ring_frames[i];
+		for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+			snap.clean[ch] += ring_clean[i][ch];
+			for (uint8_t b = 0; b < EEG_BANDS_COUNT; b++) {
+				snap.sum[ch][b] = add_sat(snap.sum[ch][b], ring_sum[i][ch][b]);
+			}
+		}
+	}
+	snap.rate = scores_rate;
+	snap.seq = pkt_seq;
+	snap.mask = scores_mask;
+
+	k_spin_unlock(&snap_lock, key);
+
+	k_work_submit(&scores_work);
+}
+
+void eeg_scores_frames(const int32_t *samples, uint8_t chan_mask, uint8_t n_frames,
+		       uint16_t pkt_seq, uint8_t bad)
+{
+	const uint8_t n_ch = eeg_pkt_channels(chan_mask);
+	const int32_t *p = samples;
+
+	if (chan_mask != scores_mask) {
+		scores_mask = chan_mask;
+		eeg_scores_reset();
+	}
+
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		if (!(chan_mask & BIT(ch))) {
+			continue;
+		}
+
+		pre_load(ch, p, n_ch, n_frames);
+
+		for (uint8_t b = 0; b < EEG_BANDS_COUNT; b++) {
+			uint64_t sq = 0;
+
+			band_run(ch, b, n_frames);
+			if (bad & BIT(ch)) {
+				continue;
+			}
+			for (uint8_t i = 0; i < n_frames; i++) {
+				int32_t y = out[i] >> SCORES_SHIFT;
+
+				sq += (uint64_t)((int64_t)y * y);
+			}
+			blk_sum[ch][b] = add_sat(blk_sum[ch][b], sq);
+		}
+
+		if (bad & BIT(ch)) {
+			stats.excluded++;
+		} else {
+			blk_clean[ch] += n_frames;
+		}
+		p++;
+	}
+
+	/* No channel left, the window does not move on */
+	if (!(chan_mask & ~bad)) {
+		stats.skipped++;
+		return;
+	}
+
+	blk_frames += n_frames;
+	if (blk_frames >= blk_len) {
+		scores_close_block(pkt_seq);
+	}
+}
+
+static float median(float *v, uint8_t n)
+{
+	/* Insertion sort, at most EEG_CHANNELS values */
+	for (uint8_t i = 1; i < n; i++) {
+		float x = v[i];
+		int8_t j = i - 1;
+
+		for (; (j >= 0) && (v[j] > x); j--) {
+			v[j + 1] = v[j];
+		}
+		v[j + 1] = x;
+	}
+
+	return (n % 2) ? v[n / 2] : 0.5f * (v[n / 2 - 1] + v[n / 2]);
+}
+
+static uint16_t unit_u16(float v)
+{
+	return (uint16_t)lroundf(CLAMP(v, 0.0f, 1.0f) * UINT16_MAX);
+}
+
+static void flush_work_handler(struct k_work *work)
+{
+	while (backlog_count) {
+		uint16_t tail = (backlog_head + CONFIG_EEG_SCORES_BACKLOG - backlog_count) %
+				CONFIG_EEG_SCORES_BACKLOG;
+		int err = eeg_stream_send_aux(backlog[tail], EEG_SCORES_PKT_LEN);
+
+		if (err == -ENOMEM) {
+			/* TX buffers full, the rest of the backlog follows shortly */
+			k_work_schedule(&flush_work, K_MSEC(SCORES_FLUSH_RETRY_MS));
+			return;
+		}
+		if (err) {
+			return;
+		}
+
+		backlog_count--;
+		stats.sent++;
+	}
+}
+
+static void scores_work_handler(struct k_work *work)
+{
+	float tbr[EEG_CHANNELS], rel_alpha[EEG_CHANNELS], rel_beta[EEG_CHANNELS];
+	uint64_t sum[EEG_CHANNELS][EEG_BANDS_COUNT];
+	uint32_t clean[EEG_CHANNELS];
+	uint32_t frames;
+	uint16_t rate, data_seq;
+	uint8_t mask, scored = 0, n = 0;
+	float tbr_med, alpha_med, beta_med, focus, stress;
+	uint8_t *pkt, *p;
+	k_spinlock_key_t key = k_spin_lock(&snap_lock);
+
+	memcpy(sum, snap.sum, sizeof(sum));
+	memcpy(clean, snap.clean, sizeof(clean));
+	frames = snap.frames;
+	rate = snap.rate;
+	data_seq = snap.seq;
+	mask = snap.mask;
+
+	k_spin_unlock(&snap_lock, key);
+
+	if (!frames || !mask) {
+		return;
+	}
+
+	for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+		float rms[EEG_BANDS_COUNT];
+		float tot = SCORES_EPS;
+
+		if (!(mask & BIT(ch)) || !clean[ch]) {
+			continue;
+		}
+
+		for (uint8_t b = 0; b < EEG_BANDS_COUNT; b++) {
+			rms[b] = sqrtf((float)sum[ch][b] / clean[ch]);
+			tot += rms[b];
+		}
+
+		tbr[n] = rms[EEG_BAND_THETA] / (rms[EEG_BAND_BETA] + SCORES_EPS);
+		rel_alpha[n] = rms[EEG_BAND_ALPHA] / tot;
+		rel_beta[n] = rms[EEG_BAND_BETA] / tot;
+		scored |= BIT(ch);
+		n++;
+	}
+
+	if (!n) {
+		return;
+	}
+
+	tbr_med = median(tbr, n);
+	alpha_med = median(rel_alpha, n);
+	beta_med = median(rel_beta, n);
+
+	focus = 1.0f / (1.0f + expf(-(SCORES_TBR_MID - tbr_med) / SCORES_TBR_SCALE));
+	stress = MAX(0.0f, SCORES_ALPHA_CALM - alpha_med) * SCORES_ALPHA_WEIGHT +
+		 MAX(0.0f, beta_med - SCORES_BETA_CALM);
+
+	if (backlog_count == CONFIG_EEG_SCORES_BACKLOG) {
+		/* Oldest record goes */
+		backlog_count--;
+		stats.dropped++;
+	}
+	pkt = backlog[backlog_head];
+	backlog_head = (backlog_head + 1) % CONFIG_EEG_SCORES_BACKLOG;
+	backlog_count++;
+
+	eeg_pkt_hdr_init((struct eeg_pkt_hdr *)pkt, EEG_PKT_TYPE_SCORES, scores_seq++, scored, 1);
+	p = &pkt[EEG_PKT_HDR_LEN];
+	sys_put_le16(data_seq, &p[0]);
+	sys_put_le16(frames / rate, &p[2]);
+	p[4] = CONFIG_EEG_SCORES_PERIOD_S;
+	sys_put_le16(unit_u16(focus), &p[5]);
+	sys_put_le16(unit_u16(stress), &p[7]);
+	sys_put_le16((uint16_t)lroundf(MIN(tbr_med, 65.535f) * 1000.0f), &p[9]);
+	sys_put_le16(unit_u16(alpha_med), &p[11]);
+	sys_put_le16(unit_u16(beta_med), &p[13]);
+	stats.scores++;
+
+	LOG_DBG("Focus %d/1000, stress %d/1000 over %u s", (int)(focus * 1000),
+		(int)(MIN(stress, 1.0f) * 1000), frames / rate);
+
+	/* A pending retry sends this one too */
+	if (!k_work_delayable_is_pending(&flush_work)) {
+		flush_work_handler(NULL);
+	}
+}
+
+void eeg_scores_stats_get(struct eeg_scores_stats *out)
+{
+	*out = stats;
+}
+
+static int scores_init(void)
+{
+	eeg_scores_set_rate(eeg_stream_rate());
+
+	return 0;
+}
+
+SYS_INIT(scores_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
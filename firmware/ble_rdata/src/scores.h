@@ -0,0 +1,71 @@
+/*
+ * ANA EEG sticker - focus and stress scores
+ *
+ * The app's MinuteAnalyzer (flutter_app/lib/eeg/analyzer_dart.dart) on the
+ * sticker: the pre-filtered samples of every channel go through the same
+ * five band-pass biquads (q31, eeg_biquad.h) and the squares of their output
+ * are summed per CONFIG_EEG_SCORES_PERIOD_S block. Every block the last
+ * CONFIG_EEG_SCORES_WINDOW_S seconds of sums give the band RMS amplitudes,
+ * from which a work item derives the theta/beta focus score and the alpha
+ * suppression / beta elevation stress score, median across channels.
+ * Channels with artifacts in a packet (artifact.c) are left out of the sums
+ * for that packet only, so one electrode off does not stop the scores; a
+ * channel without clean data in the window is left out of the median.
+ *
+ * The samples are those CONFIG_EEG_FILTER put in the packet; without it the
+ * scores run the app's pre-filter (1 Hz high-pass, 45 Hz low-pass, 50 Hz
+ * notch, as filter.c) on their own copy and leave the packet raw.
+ *
+ * Scores are notified as EEG_PKT_TYPE_SCORES packets while the stream mode
+ * includes EEG_MODE_SCORES. Scores computed while no central is connected
+ * are kept (CONFIG_EEG_SCORES_BACKLOG) and sent first once one is.
+ */
+
+#ifndef SCORES_H_
+#define SCORES_H_
+
+#include <zephyr/types.h>
+
+struct eeg_scores_stats {
+	uint32_t scores;        // Score records produced
+	uint32_t sent;          // Notified
+	uint32_t dropped;       // Backlog overflowed before they could be sent
+	uint32_t skipped;       // Packets left out, artifacts on every channel
+	uint32_t excluded;      // Channels left out of a packet for artifacts
+};
+
+#if defined(CONFIG_EEG_SCORES)
+
+/*
+ * Feed the samples of a completed data packet, pre-filtered or not, frame by
+ * frame, with sequence number pkt_seq (acquisition context). The channels in
+ * bad (BIT(ch)) had artifacts: their band filters keep running but the
+ * packet is left out of their window.
+ */
+void eeg_scores_frames(const int32_t *samples, uint8_t chan_mask, uint8_t n_frames,
+		       uint16_t pkt_seq, uint8_t bad);
+
+/* Start a new window, e.g. after a channel mask or mode change */
+void eeg_scores_reset(void);
+
+/* Redesign the band filters for a new sample rate, starts a new window */
+void eeg_scores_set_rate(uint16_t sps);
+
+void eeg_scores_stats_get(struct eeg_scores_stats *stats);
+
+#else
+
+static inline void eeg_scores_frames(const int32_t *samples, uint8_t chan_mask,
+				     uint8_t n_frames, uint16_t pkt_seq, uint8_t bad)
+{
+}
+static inline void eeg_scores_reset(void)
+{
+}
+static inline void eeg_scores_set_rate(uint16_t sps)
+{
+}
+
+#endif /* CONFIG_EEG_SCORES */
+
+#endif /* SCORES_H_ */
@@ -0,0 +1,235 @@
+/*
+ * ANA EEG sticker - spatial filter
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <eeg_spatial.h>
+
+#include "eeg_stream.h"
+#include "spatial.h"
+
+LOG_MODULE_REGISTER(spatial, LOG_LEVEL_INF);
+
+#define SPATIAL_SAMPLE_MAX      ((1 << 23) - 1)
+#define SPATIAL_SAMPLE_MIN      (-(1 << 23))
+
+enum spatial_kind {
+	SPATIAL_CUSTOM,
+	SPATIAL_CAR,
+	SPATIAL_BIPOLAR,
+};
+
+/* Acquisition context only */
+static int16_t matrix[EEG_CHANNELS * EEG_SPATIAL_COLS];
+static uint8_t rows;                    // 0 = off
+static enum spatial_kind kind;
+static uint8_t sampled = EEG_CHAN_MASK; // Electrodes in the packets
+static int16_t staged[EEG_CHANNELS * EEG_SPATIAL_COLS];
+static uint8_t staged_rows;
+static uint8_t staged_have;             // Bit r set = row r received
+static int32_t electrodes[EEG_FRAMES_PER_PACKET * EEG_CHANNELS];
+
+static struct eeg_spatial_stats stats;
+
+uint8_t eeg_spatial_frames(int32_t *samples, uint8_t *chan_mask, uint8_t n_frames)
+{
+	const int32_t *p = samples;
+
+	if (!rows) {
+		return 0;
+	}
+
+	/* Electrodes by position in the matrix, the ones not sampled read 0 */
+	for (uint8_t i = 0; i < n_frames; i++) {
+		for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+			if (*chan_mask & BIT(ch)) {
+				electrodes[i * EEG_CHANNELS + ch] = *p++;
+			} else {
+				electrodes[i * EEG_CHANNELS + ch] = 0;
+			}
+		}
+	}
+
+	eeg_spatial_apply(matrix, rows, EEG_CHANNELS, electrodes, samples, n_frames);
+
+	for (uint16_t i = 0; i < n_frames * rows; i++) {
+		if ((samples[i] > SPATIAL_SAMPLE_MAX) || (samples[i] < SPATIAL_SAMPLE_MIN)) {
+			stats.clipped++;
+			samples[i] = CLAMP(samples[i], SPATIAL_SAMPLE_MIN, SPATIAL_SAMPLE_MAX);
+		}
+	}
+
+	stats.packets++;
+	*chan_mask = BIT_MASK(rows);
+
+	return EEG_PKT_FLAG_SPATIAL;
+}
+
+/* Preset over the n electrodes of mask: built on the first n columns, then spread out */
+static uint8_t spatial_preset(int16_t *m, enum spatial_kind k, uint8_t mask)
+{
+	const uint8_t n = eeg_pkt_channels(mask);
+	uint8_t n_rows = (k == SPATIAL_CAR) ? eeg_spatial_car(m, n) : eeg_spatial_bipolar(m, n);
+
+	for (uint8_t r = 0; r < n_rows; r++) {
+		int16_t *row = &m[r * EEG_SPATIAL_COLS];
+		int8_t c = n - 1;
+
+		/* Downwards, an electrode's column is never left of its source */
+		for (int8_t ch = EEG_CHANNELS - 1; ch >= 0; ch--) {
+			row[ch] = (mask & BIT(ch)) ? row[c--] : 0;
+		}
+	}
+
+	return n_rows;
+}
+
+/* Some row of m uses an electrode outside mask */
+static bool spatial_uses_other(const int16_t *m, uint8_t n_rows, uint8_t mask)
+{
+	for (uint8_t r = 0; r < n_rows; r++) {
+		for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+			if (!(mask & BIT(ch)) && m[r * EEG_SPATIAL_COLS + ch]) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+uint8_t eeg_spatial_derived(uint8_t electrodes)
+{
+	uint8_t out = 0;
+
+	if (!rows) {
+		return electrodes;
+	}
+
+	for (uint8_t r = 0; r < rows; r++) {
+		for (uint8_t ch = 0; ch < EEG_CHANNELS; ch++) {
+			if ((electrodes & BIT(ch)) && matrix[r * EEG_SPATIAL_COLS + ch]) {
+				out |= BIT(r);
+				break;
+			}
+		}
+	}
+
+	return out;
+}
+
+uint8_t eeg_spatial_set_row(const uint8_t *value, bool *applied)
+{
+	const uint8_t n = value[0];
+	const uint8_t r = value[1];
+
+	*applied = false;
+
+	if ((n > EEG_CHANNELS) || (n && (r >= n))) {
+		return EEG_CTRL_STATUS_VALUE;
+	}
+
+	if (!n) {
+		*applied = (rows != 0);
+		rows = 0;
+		staged_have = 0;
+		LOG_INF("Off");
+		return EEG_CTRL_STATUS_OK;
+	}
+
+	/* A new row count starts a new matrix */
+	if (n != staged_rows) {
+		staged_rows = n;
+		staged_have = 0;
+	}
+
+	/* Coefficients for electrodes this build does not sample are dropped */
+	for (uint8_t c = 0; c < EEG_CHANNELS; c++) {
+		staged[r * EEG_SPATIAL_COLS + c] = (int16_t)sys_get_le16(&value[2 + 2 * c]);
+	}
+	staged_have |= BIT(r);
+
+	if (staged_have != BIT_MASK(n)) {
+		return EEG_CTRL_STATUS_OK;
+	}
+
+	staged_have = 0;
+	if (spatial_uses_other(staged, n, sampled)) {
+		LOG_WRN("Matrix uses electrodes not sampled (mask 0x%02x)", sampled);
+		return EEG_CTRL_STATUS_VALUE;
+	}
+
+	memcpy(matrix, staged, sizeof(matrix));
+	rows = n;
+	kind = SPATIAL_CUSTOM;
+	stats.matrices++;
+	*applied = true;
+	LOG_INF("%u derivations of %u channels", rows, eeg_pkt_channels(sampled));
+
+	return EEG_CTRL_STATUS_OK;
+}
+
+uint8_t eeg_spatial_set_mask(uint8_t chan_mask, bool *applied)
+{
+	static int16_t m[EEG_CHANNELS * EEG_SPATIAL_COLS];
+	uint8_t n_rows;
+
+	*applied = false;
+
+	if (!rows) {
+		sampled = chan_mask;
+		return EEG_CTRL_STATUS_OK;
+	}
+
+	if (kind == SPATIAL_CUSTOM) {
+		if (spatial_uses_other(matrix, rows, chan_mask)) {
+			LOG_WRN("Mask 0x%02x leaves out electrodes of the matrix", chan_mask);
+			return EEG_CTRL_STATUS_VALUE;
+		}
+		sampled = chan_mask;
+		return EEG_CTRL_STATUS_OK;
+	}
+
+	n_rows = spatial_preset(m, kind, chan_mask);
+	if (!n_rows) {
+		LOG_WRN("Mask 0x%02x: too few electrodes for the montage", chan_mask);
+		return EEG_CTRL_STATUS_VALUE;
+	}
+
+	memcpy(matrix, m, (size_t)n_rows * EEG_SPATIAL_COLS * sizeof(*m));
+	rows = n_rows;
+	sampled = chan_mask;
+	stats.matrices++;
+	*applied = true;
+	LOG_INF("%u derivations of %u channels", rows, eeg_pkt_channels(chan_mask));
+
+	return EEG_CTRL_STATUS_OK;
+}
+
+void eeg_spatial_stats_get(struct eeg_spatial_stats *out)
+{
+	*out = stats;
+}
+
+static int spatial_init(void)
+{
+#if defined(CONFIG_EEG_SPATIAL_DEFAULT_CAR)
+	kind = SPATIAL_CAR;
+	rows = spatial_preset(matrix, kind, sampled);
+#elif defined(CONFIG_EEG_SPATIAL_DEFAULT_BIPOLAR)
+	kind = SPATIAL_BIPOLAR;
+	rows = spatial_preset(matrix, kind, sampled);
+#endif
+
+	if (rows) {
+		LOG_INF("%u derivations of %u channels", rows, EEG_CHANNELS);
+	}
+
+	return 0;
+}
+
+SYS_INIT(spatial_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,89 @@
+/*
+ * ANA EEG sticker - spatial filter
+ *
+ * Re-references every completed packet on the sticker with a small matrix
+ * (eeg_spatial.h): common average reference, bipolar derivations or any
+ * custom montage such as a Laplacian, set at build time
+ * (CONFIG_EEG_SPATIAL_DEFAULT_*) or from the central with
+ * EEG_CTRL_SET_SPATIAL. The packet then carries one channel per matrix row,
+ * which may be fewer than the electrodes sampled, and EEG_PKT_FLAG_SPATIAL.
+ *
+ * Runs after the artifact detector, which judges the electrodes, and before
+ * the pre-filter and the features, which then see the derivations.
+ *
+ * The presets follow the electrodes sampled: after EEG_CTRL_SET_CHANS the
+ * average or the chain is rebuilt over the new channel mask. A custom matrix
+ * may only use electrodes that are sampled; such a matrix, or a channel mask
+ * that leaves out an electrode the matrix uses, is refused.
+ */
+
+#ifndef SPATIAL_H_
+#define SPATIAL_H_
+
+#include <zephyr/types.h>
+
+#include <eeg_packet.h>
+
+struct eeg_spatial_stats {
+	uint32_t packets;       // Packets re-referenced
+	uint32_t clipped;       // Derived samples clamped to 24 bits
+	uint32_t matrices;      // Matrices taken into use
+};
+
+#if defined(CONFIG_EEG_SPATIAL)
+
+/*
+ * Rewrite the samples of a completed packet in place, frame by frame
+ * (acquisition context). chan_mask is the packet's electrode mask on entry
+ * and its derivation mask on return; returns EEG_PKT_FLAG_SPATIAL if the
+ * filter is on.
+ */
+uint8_t eeg_spatial_frames(int32_t *samples, uint8_t *chan_mask, uint8_t n_frames);
+
+/*
+ * Derivations (BIT(row)) that use any of the electrodes in the mask, e.g.
+ * the ones with artifacts; the electrodes themselves with the filter off.
+ */
+uint8_t eeg_spatial_derived(uint8_t electrodes);
+
+/*
+ * One EEG_CTRL_SET_SPATIAL row, between packets. Sets applied when the
+ * matrix in use changed. Returns an EEG_CTRL_STATUS_* code.
+ */
+uint8_t eeg_spatial_set_row(const uint8_t *value, bool *applied);
+
+/*
+ * The electrodes sampled change to chan_mask, between packets: a preset is
+ * rebuilt over them (applied set), a custom matrix checked against them.
+ * Returns EEG_CTRL_STATUS_VALUE, and keeps everything, if the matrix in use
+ * cannot work on that mask.
+ */
+uint8_t eeg_spatial_set_mask(uint8_t chan_mask, bool *applied);
+
+void eeg_spatial_stats_get(struct eeg_spatial_stats *stats);
+
+#else
+
+static inline uint8_t eeg_spatial_frames(int32_t *samples, uint8_t *chan_mask,
+					 uint8_t n_frames)
+{
+	return 0;
+}
+static inline uint8_t eeg_spatial_derived(uint8_t electrodes)
+{
+	return electrodes;
+}
+static inline uint8_t eeg_spatial_set_row(const uint8_t *value, bool *applied)
+{
+	*applied = false;
+	return EEG_CTRL_STATUS_VALUE;
+}
+static inline uint8_t eeg_spatial_set_mask(uint8_t chan_mask, bool *applied)
+{
+	*applied = false;
+	return EEG_CTRL_STATUS_OK;
+}
+
+#endif /* CONFIG_EEG_SPATIAL */
+
+#endif /* SPATIAL_H_ */
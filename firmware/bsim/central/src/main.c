@@ -0,0 +1,800 @@
+/*
+ * ANA EEG sticker - BabbleSim measuring central
+ *
+ * Connects to the sticker (ble_rdata built with FILE_SUFFIX=sim) in the
+ * simulated 2.4 GHz medium with the connection interval, PHY and SDU
+ * settings given on the command line, subscribes to the live stream and
+ * decodes every data packet. The sticker's clock is followed with the
+ * exchange on the clock characteristic (eeg_clock.h), so each packet's
+ * completion on the sticker - DRDY of its newest frame - lands on this
+ * device's clock and the receive latency can be measured.
+ *
+ * After a warm-up the stream is measured for a fixed time and the results go
+ * to stdout as "RESULT <section> {json}" lines: link settings in effect,
+ * throughput, sequence gaps, inter-arrival times and the latency
+ * distribution. run.sh collects them into a JSON lines file.
+ *
+ * Test arguments (after -argstest), all optional:
+ *   interval_us=N   connection interval, multiple of 1250 (7500)
+ *   phy=1M|2M|s2|s8 PHY both ways, s2/s8 coded (2M)
+ *   rate=N          SPS set on the sticker with EEG_CTRL_SET_RATE (as built)
+ *   warmup_s=N      before measuring, the clock fit needs a few exchanges (5)
+ *   duration_s=N    measured time (20)
+ *   iso             carry the stream on a CIS (CONFIG_BT_ISO_CENTRAL)
+ *   sdu_us=N        CIS SDU interval (10000)
+ *   latency_ms=N    CIS maximum transport latency (10)
+ *   rtn=N           CIS retransmissions (2)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/bluetooth/iso.h>
+#include <bluetooth/services/nus.h>
+
+#include "bs_types.h"
+#include "bs_tracing.h"
+#include "bstests.h"
+
+#include <eeg_packet.h>
+#include <eeg_clock.h>
+#include <eeg_svc.h>
+
+#define STICKER_NAME            "ANA_STICKER"
+#define STEP_TIMEOUT            K_SECONDS(10)
+#define CLOCK_PERIOD            K_SECONDS(1)
+
+#define HIST_BIN_US             50
+#define HIST_BINS               2000      // Last bin takes everything above
+
+extern enum bst_result_t bst_result;
+
+#define FAIL(...)                                          \
+	do {                                               \
+		bst_result = Failed;                       \
+		bs_trace_error_time_line(__VA_ARGS__);     \
+	} while (0)
+
+#define PASS(...)                                          \
+	do {                                               \
+		bst_result = Passed;                       \
+		bs_trace_info_time(1, __VA_ARGS__);        \
+	} while (0)
+
+struct args {
+	uint32_t interval_us;
+	const char *phy;
+	uint16_t rate;
+	uint32_t warmup_s;
+	uint32_t duration_s;
+	bool iso;
+	uint32_t sdu_us;
+	uint16_t latency_ms;
+	uint8_t rtn;
+};
+
+static struct args args = {
+	.interval_us = 7500,
+	.phy = "2M",
+	.warmup_s = 5,
+	.duration_s = 20,
+	.sdu_us = 10000,
+	.latency_ms = 10,
+	.rtn = 2,
+};
+
+/* Microsecond histogram with running moments */
+struct hist {
+	uint32_t n;
+	int64_t min;
+	int64_t max;
+	double sum;
+	double sum_sq;
+	uint32_t bins[HIST_BINS];
+};
+
+struct meas {
+	bool on;
+	int64_t t_start;
+	int64_t t_end;
+
+	uint32_t packets;
+	uint32_t bytes;
+	uint32_t samples;
+	uint32_t lost;          // Sequence numbers skipped
+	uint32_t late;          // Sequence number not newer than the last one
+	uint32_t retx;
+	uint32_t bad;           // Not a data packet of this format version
+	uint32_t sdus;
+	uint32_t sdus_lost;     // CIS SDUs the controller flagged invalid or lost
+
+	bool have_seq;
+	uint16_t last_seq;
+	int64_t last_rx;
+
+	struct hist gap;        // Inter-arrival time
+	struct hist latency;    // Packet complete on the sticker to received here
+};
+
+static struct meas meas;
+
+static struct bt_conn *conn;
+static K_SEM_DEFINE(sem_connected, 0, 1);
+static K_SEM_DEFINE(sem_phy, 0, 1);
+static K_SEM_DEFINE(sem_mtu, 0, 1);
+static K_SEM_DEFINE(sem_discovered, 0, 1);
+static K_SEM_DEFINE(sem_iso, 0, 1);
+
+static uint16_t tx_handle;              // NUS TX, live stream
+static uint16_t rx_handle;              // NUS RX, control TLVs
+static uint16_t clock_handle;
+static uint32_t conn_interval_us;
+static uint8_t conn_phy;
+
+/* Clock exchange, BT RX context */
+static struct eeg_clock clk;
+static uint8_t clk_id;
+static int64_t clk_t1;
+static int64_t clk_t4;
+static uint32_t clk_exchanges;
+
+static int64_t now_us(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static void hist_add(struct hist *h, int64_t us)
+{
+	int64_t bin = us / HIST_BIN_US;
+
+	h->min = h->n ? MIN(h->min, us) : us;
+	h->max = h->n ? MAX(h->max, us) : us;
+	h->n++;
+	h->sum += (double)us;
+	h->sum_sq += (double)us * (double)us;
+	h->bins[CLAMP(bin, 0, HIST_BINS - 1)]++;
+}
+
+/* Upper edge of the bin holding the pct-th percentile */
+static int64_t hist_pct(const struct hist *h, uint32_t pct)
+{
+	uint64_t want = ((uint64_t)h->n * pct + 99) / 100;
+	uint64_t seen = 0;
+
+	for (uint32_t i = 0; i < HIST_BINS; i++) {
+		seen += h->bins[i];
+		if (seen >= want) {
+			return (i == HIST_BINS - 1) ? h->max : (int64_t)(i + 1) * HIST_BIN_US;
+		}
+	}
+
+	return h->max;
+}
+
+static void hist_print(const char *name, const struct hist *h)
+{
+	double mean = h->n ? h->sum / h->n : 0;
+	double var = h->n ? h->sum_sq / h->n - mean * mean : 0;
+
+	printk("RESULT %s {\"n\":%u,\"min\":%lld,\"mean\":%lld,\"std\":%lld,"
+	       "\"p50\":%lld,\"p95\":%lld,\"p99\":%lld,\"max\":%lld}\n",
+	       name, h->n, (long long)(h->n ? h->min : 0), (long long)mean,
+	       (long long)sqrt(MAX(var, 0)), (long long)hist_pct(h, 50),
+	       (long long)hist_pct(h, 95), (long long)hist_pct(h, 99),
+	       (long long)(h->n ? h->max : 0));
+}
+
+/* One live data packet received at rx (BT RX context) */
+static void meas_packet(const uint8_t *data, uint16_t len, int64_t rx)
+{
+	const struct eeg_pkt_hdr *hdr = (const struct eeg_pkt_hdr *)data;
+	uint16_t seq;
+
+	if (!meas.on) {
+		return;
+	}
+
+	if ((len < EEG_PKT_HDR_LEN) || (eeg_pkt_version(hdr) != EEG_PKT_VERSION) ||
+	    (eeg_pkt_type(hdr) != EEG_PKT_TYPE_DATA) ||
+	    (len != eeg_pkt_len(hdr->chan_mask, hdr->n_frames))) {
+		meas.bad++;
+		return;
+	}
+
+	seq = eeg_pkt_seq(hdr);
+	meas.packets++;
+	meas.bytes += len;
+	meas.samples += eeg_pkt_channels(hdr->chan_mask) * hdr->n_frames;
+
+	/* Nothing is NACKed, but a retransmission says little about timing */
+	if (hdr->flags & EEG_PKT_FLAG_RETX) {
+		meas.retx++;
+		return;
+	}
+
+	if (meas.have_seq) {
+		int16_t d = eeg_seq_diff(meas.last_seq, seq);
+
+		if (d <= 0) {
+			meas.late++;
+			return;
+		}
+		meas.lost += d - 1;
+		hist_add(&meas.gap, rx - meas.last_rx);
+	}
+
+	meas.have_seq = true;
+	meas.last_seq = seq;
+	meas.last_rx = rx;
+
+	hist_add(&meas.latency,
+		 rx - eeg_clock_to_central(&clk, eeg_clock_packet_time(&clk, seq)));
+}
+
+static uint8_t live_notify(struct bt_conn *c, struct bt_gatt_subscribe_params *params,
+			   const void *data, uint16_t len)
+{
+	if (data) {
+		meas_packet(data, len, now_us());
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static void clock_request(void)
+{
+	uint8_t req[EEG_CLOCK_REQ_LEN];
+	int err;
+
+	req[0] = ++clk_id;
+	clk_t1 = now_us();
+	eeg_clock_put_le64(&req[1], clk_t1);
+	eeg_clock_put_le64(&req[9], clk_t4);
+
+	err = bt_gatt_write_without_response(conn, clock_handle, req, sizeof(req), false);
+	if (err) {
+		printk("Clock request not sent (err %d)\n", err);
+	}
+}
+
+static uint8_t clock_notify(struct bt_conn *c, struct bt_gatt_subscribe_params *params,
+			    const void *data, uint16_t len)
+{
+	const uint8_t *p = data;
+	int64_t t4 = now_us();
+	int64_t t2;
+	uint32_t age;
+
+	if (!data) {
+		return BT_GATT_ITER_CONTINUE;
+	}
+
+	/* A response to an older request would pair with the wrong t1 */
+	if ((len != EEG_CLOCK_RESP_LEN) || (p[0] != clk_id)) {
+		return BT_GATT_ITER_CONTINUE;
+	}
+
+	t2 = (int64_t)eeg_clock_get_le64(&p[1]);
+	eeg_clock_exchange(&clk, clk_t1, t2, t2 + sys_get_le16(&p[9]), t4);
+	clk_t4 = t4;
+	clk_exchanges++;
+
+	age = sys_get_le32(&p[13]);
+	if (age != EEG_CLOCK_NO_ANCHOR) {
+		eeg_clock_anchor(&clk, sys_get_le16(&p[11]), t2 - age);
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static struct bt_gatt_subscribe_params live_sub = {
+	.notify = live_notify,
+	.value = BT_GATT_CCC_NOTIFY,
+};
+
+static struct bt_gatt_subscribe_params clock_sub = {
+	.notify = clock_notify,
+	.value = BT_GATT_CCC_NOTIFY,
+};
+
+#if defined(CONFIG_BT_ISO_CENTRAL)
+
+static struct bt_iso_cig *cig;
+
+/* Each SDU holds the data packets completed in one interval, back to back */
+static void iso_recv(struct bt_iso_chan *chan, const struct bt_iso_recv_info *info,
+		     struct net_buf *buf)
+{
+	int64_t rx = now_us();
+	const uint8_t *p = buf->data;
+	uint16_t left = buf->len;
+
+	if (!meas.on) {
+		return;
+	}
+
+	if (!(info->flags & BT_ISO_FLAGS_VALID)) {
+		meas.sdus_lost++;
+		return;
+	}
+
+	meas.sdus++;
+
+	while (left >= EEG_PKT_HDR_LEN) {
+		const struct eeg_pkt_hdr *hdr = (const struct eeg_pkt_hdr *)p;
+		size_t len = eeg_pkt_len(hdr->chan_mask, hdr->n_frames);
+
+		if (len > left) {
+			meas.bad++;
+			return;
+		}
+		meas_packet(p, len, rx);
+		p += len;
+		left -= len;
+	}
+}
+
+static void iso_connected(struct bt_iso_chan *chan)
+{
+	printk("CIS connected\n");
+	k_sem_give(&sem_iso);
+}
+
+static void iso_disconnected(struct bt_iso_chan *chan, uint8_t reason)
+{
+	printk("CIS disconnected (reason 0x%02x)\n", reason);
+}
+
+static struct bt_iso_chan_ops iso_ops = {
+	.recv = iso_recv,
+	.connected = iso_connected,
+	.disconnected = iso_disconnected,
+};
+
+static struct bt_iso_chan_io_qos iso_rx_qos = {
+	.sdu = CONFIG_BT_ISO_RX_MTU,
+};
+
+static struct bt_iso_chan_qos iso_qos = {
+	.rx = &iso_rx_qos,
+};
+
+static struct bt_iso_chan iso_chan = {
+	.ops = &iso_ops,
+	.qos = &iso_qos,
+};
+
+static int iso_start(uint8_t phy)
+{
+	struct bt_iso_chan *chans[] = { &iso_chan };
+	struct bt_iso_cig_param param = {
+		.cis_channels = chans,
+		.num_cis = ARRAY_SIZE(chans),
+		.sca = BT_GAP_SCA_UNKNOWN,
+		.packing = BT_ISO_PACKING_SEQUENTIAL,
+		.framing = BT_ISO_FRAMING_UNFRAMED,
+		.c_to_p_latency = args.latency_ms,
+		.p_to_c_latency = args.latency_ms,
+		.c_to_p_interval = args.sdu_us,
+		.p_to_c_interval = args.sdu_us,
+	};
+	struct bt_iso_connect_param connect = {
+		.acl = conn,
+		.iso_chan = &iso_chan,
+	};
+	int err;
+
+	iso_rx_qos.phy = phy;
+	iso_rx_qos.rtn = args.rtn;
+
+	err = bt_iso_cig_create(&param, &cig);
+	if (err) {
+		return err;
+	}
+
+	err = bt_iso_chan_connect(&connect, 1);
+	if (err) {
+		return err;
+	}
+
+	return k_sem_take(&sem_iso, STEP_TIMEOUT);
+}
+
+#else
+
+static int iso_start(uint8_t phy)
+{
+	return -ENOTSUP;
+}
+
+#endif /* CONFIG_BT_ISO_CENTRAL */
+
+static bool ad_name(struct bt_data *data, void *user_data)
+{
+	bool *found = user_data;
+
+	if (((data->type == BT_DATA_NAME_COMPLETE) || (data->type == BT_DATA_NAME_SHORTENED)) &&
+	    (data->data_len == strlen(STICKER_NAME)) &&
+	    !memcmp(data->data, STICKER_NAME, data->data_len)) {
+		*found = true;
+		return false;
+	}
+
+	return true;
+}
+
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+			 struct net_buf_simple *ad)
+{
+	struct bt_le_conn_param *param =
+		BT_LE_CONN_PARAM(args.interval_us / 1250, args.interval_us / 1250, 0, 400);
+	bool found = false;
+	int err;
+
+	if (conn) {
+		return;
+	}
+
+	bt_data_parse(ad, ad_name, &found);
+	if (!found || bt_le_scan_stop()) {
+		return;
+	}
+
+	err = bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, param, &conn);
+	if (err) {
+		FAIL("Connection not created (err %d)\n", err);
+	}
+}
+
+static void connected(struct bt_conn *c, uint8_t err)
+{
+	struct bt_conn_info info;
+
+	if (err) {
+		FAIL("Connection failed (err 0x%02x)\n", err);
+		return;
+	}
+
+	bt_conn_get_info(c, &info);
+	conn_interval_us = info.le.interval * 1250U;
+	conn_phy = info.le.phy->rx_phy;
+	k_sem_give(&sem_connected);
+}
+
+static void disconnected(struct bt_conn *c, uint8_t reason)
+{
+	if (meas.on) {
+		FAIL("Disconnected while measuring (reason 0x%02x)\n", reason);
+	}
+}
+
+/* The run is for the interval on the command line, keep it */
+static bool le_param_req(struct bt_conn *c, struct bt_le_conn_param *param)
+{
+	return false;
+}
+
+static void le_param_updated(struct bt_conn *c, uint16_t interval, uint16_t latency,
+			     uint16_t timeout)
+{
+	conn_interval_us = interval * 1250U;
+}
+
+static void le_phy_updated(struct bt_conn *c, struct bt_conn_le_phy_info *param)
+{
+	conn_phy = param->rx_phy;
+	k_sem_give(&sem_phy);
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_req = le_param_req,
+	.le_param_updated = le_param_updated,
+	.le_phy_updated = le_phy_updated,
+};
+
+static void mtu_exchanged(struct bt_conn *c, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+	if (err) {
+		printk("MTU exchange failed (err %u)\n", err);
+	}
+	k_sem_give(&sem_mtu);
+}
+
+static uint8_t discover_func(struct bt_conn *c, const struct bt_gatt_attr *attr,
+			     struct bt_gatt_discover_params *params)
+{
+	static const struct bt_uuid_128 clock_uuid = BT_UUID_INIT_128(BT_UUID_EEG_CLOCK_VAL);
+	const struct bt_gatt_chrc *chrc;
+
+	if (!attr) {
+		k_sem_give(&sem_discovered);
+		return BT_GATT_ITER_STOP;
+	}
+
+	chrc = attr->user_data;
+	if (!bt_uuid_cmp(chrc->uuid, BT_UUID_NUS_TX)) {
+		tx_handle = chrc->value_handle;
+	} else if (!bt_uuid_cmp(chrc->uuid, BT_UUID_NUS_RX)) {
+		rx_handle = chrc->value_handle;
+	} else if (!bt_uuid_cmp(chrc->uuid, &clock_uuid.uuid)) {
+		clock_handle = chrc->value_handle;
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static int phy_parse(const char *name, struct bt_conn_le_phy_param *param)
+{
+	static const struct {
+		const char *name;
+		uint8_t phy;
+		uint16_t options;
+	} phys[] = {
+		{ "1M", BT_GAP_LE_PHY_1M, BT_CONN_LE_PHY_OPT_NONE },
+		{ "2M", BT_GAP_LE_PHY_2M, BT_CONN_LE_PHY_OPT_NONE },
+		{ "s2", BT_GAP_LE_PHY_CODED, BT_CONN_LE_PHY_OPT_CODED_S2 },
+		{ "s8", BT_GAP_LE_PHY_CODED, BT_CONN_LE_PHY_OPT_CODED_S8 },
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(phys); i++) {
+		if (!strcmp(name, phys[i].name)) {
+			param->options = phys[i].options;
+			param->pref_tx_phy = phys[i].phy;
+			param->pref_rx_phy = phys[i].phy;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static int set_rate(uint16_t rate)
+{
+	uint8_t tlv[EEG_CTRL_TLV_HDR_LEN + 2] = { EEG_CTRL_SET_RATE, 2 };
+
+	sys_put_le16(rate, &tlv[EEG_CTRL_TLV_HDR_LEN]);
+
+	return bt_gatt_write_without_response(conn, rx_handle, tlv, sizeof(tlv), false);
+}
+
+static int subscribe(struct bt_gatt_subscribe_params *sub, uint16_t value_handle)
+{
+	/* Both characteristics have their CCC right after the value */
+	sub->value_handle = value_handle;
+	sub->ccc_handle = value_handle + 1;
+
+	return bt_gatt_subscribe(conn, sub);
+}
+
+/*
+ * The console flushes long lines in pieces, so the result goes out as short
+ * "RESULT <section> {...}" lines that run.sh joins into one object.
+ */
+static void result_print(void)
+{
+	static const char *const phy_names[] = {
+		[BT_GAP_LE_PHY_1M] = "1M", [BT_GAP_LE_PHY_2M] = "2M", [BT_GAP_LE_PHY_CODED] = "coded",
+	};
+	int64_t t = meas.t_end - meas.t_start;
+	uint32_t expected = meas.packets - meas.retx - meas.late + meas.lost;
+
+	printk("RESULT link {\"transport\":\"%s\",\"interval_us\":%u,\"phy\":\"%s\","
+	       "\"mtu\":%u,\"sdu_us\":%u,\"sdus\":%u,\"sdus_lost\":%u}\n",
+	       args.iso ? "cis" : "gatt", conn_interval_us,
+	       ((conn_phy < ARRAY_SIZE(phy_names)) && phy_names[conn_phy]) ? phy_names[conn_phy] :
+									        "?",
+	       bt_gatt_get_mtu(conn), args.iso ? args.sdu_us : 0, meas.sdus, meas.sdus_lost);
+	printk("RESULT stream {\"duration_us\":%lld,\"packets\":%u,\"bytes\":%u,"
+	       "\"samples\":%u,\"bytes_per_s\":%lld,\"samples_per_s\":%lld}\n",
+	       (long long)t, meas.packets, meas.bytes, meas.samples,
+	       (long long)meas.bytes * USEC_PER_SEC / t, (long long)meas.samples * USEC_PER_SEC / t);
+	printk("RESULT loss {\"lost\":%u,\"loss_ppm\":%llu,\"late\":%u,\"retx\":%u,"
+	       "\"bad\":%u}\n",
+	       meas.lost, expected ? (unsigned long long)meas.lost * 1000000U / expected : 0,
+	       meas.late, meas.retx, meas.bad);
+	hist_print("interarrival_us", &meas.gap);
+	hist_print("latency_us", &meas.latency);
+	printk("RESULT clock {\"exchanges\":%u,\"delay_us\":%lld,\"drift_ppb\":%lld}\n",
+	       clk_exchanges, (long long)clk.delay_us, (long long)(clk.drift * 1e9));
+	printk("RESULT end {}\n");
+}
+
+static void test_main(void)
+{
+	struct bt_conn_le_phy_param phy;
+	struct bt_gatt_exchange_params mtu = { .func = mtu_exchanged };
+	struct bt_gatt_discover_params disc = {
+		.func = discover_func,
+		.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE,
+		.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE,
+		.type = BT_GATT_DISCOVER_CHARACTERISTIC,
+	};
+	int64_t t_warm;
+	int err;
+
+	if (phy_parse(args.phy, &phy) || (args.interval_us % 1250) || !args.duration_s) {
+		FAIL("Bad test arguments\n");
+		return;
+	}
+
+	eeg_clock_init(&clk);
+
+	err = bt_enable(NULL);
+	if (err) {
+		FAIL("Bluetooth init failed (err %d)\n", err);
+		return;
+	}
+
+	/* The name may be in the scan response */
+	err = bt_le_scan_start(BT_LE_SCAN_ACTIVE, device_found);
+	if (err || k_sem_take(&sem_connected, STEP_TIMEOUT)) {
+		FAIL("No connection to %s (err %d)\n", STICKER_NAME, err);
+		return;
+	}
+
+	/* Dual-mode controllers may already be there, then no update event comes */
+	if (phy.pref_rx_phy != conn_phy) {
+		err = bt_conn_le_phy_update(conn, &phy);
+		if (err || k_sem_take(&sem_phy, STEP_TIMEOUT) || (conn_phy != phy.pref_rx_phy)) {
+			FAIL("PHY %s not set (err %d)\n", args.phy, err);
+			return;
+		}
+	}
+
+	err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+	if (err) {
+		printk("Data length update not started (err %d)\n", err);
+	}
+
+	err = bt_gatt_exchange_mtu(conn, &mtu);
+	if (err || k_sem_take(&sem_mtu, STEP_TIMEOUT)) {
+		FAIL("MTU exchange failed (err %d)\n", err);
+		return;
+	}
+
+	err = bt_gatt_discover(conn, &disc);
+	if (err || k_sem_take(&sem_discovered, STEP_TIMEOUT) || !tx_handle || !rx_handle ||
+	    !clock_handle) {
+		FAIL("Sticker characteristics not found (err %d)\n", err);
+		return;
+	}
+
+	err = subscribe(&clock_sub, clock_handle);
+	if (!err) {
+		err = subscribe(&live_sub, tx_handle);
+	}
+	if (!err && args.rate) {
+		err = set_rate(args.rate);
+	}
+	if (err) {
+		FAIL("Stream not started (err %d)\n", err);
+		return;
+	}
+
+	if (args.iso) {
+		err = iso_start(phy.pref_rx_phy);
+		if (err) {
+			FAIL("CIS not set up (err %d)\n", err);
+			return;
+		}
+	}
+
+	/* Latency needs an offset fit and two anchors a packet period apart */
+	t_warm = now_us() + (int64_t)args.warmup_s * USEC_PER_SEC;
+	while ((now_us() < t_warm) || !clk.valid || (clk.period_us <= 0)) {
+		clock_request();
+		k_sleep(CLOCK_PERIOD);
+		if (now_us() > t_warm + 10 * USEC_PER_SEC) {
+			FAIL("Clock not synchronized, %u exchanges\n", clk_exchanges);
+			return;
+		}
+	}
+
+	meas.t_start = now_us();
+	meas.on = true;
+
+	for (uint32_t s = 0; s < args.duration_s; s++) {
+		clock_request();
+		k_sleep(CLOCK_PERIOD);
+	}
+
+	meas.on = false;
+	meas.t_end = now_us();
+
+	result_print();
+
+	if (!meas.latency.n) {
+		FAIL("No data packets received\n");
+		return;
+	}
+
+	PASS("Measured %u packets\n", meas.packets);
+}
+
+static void test_args(int argc, char *argv[])
+{
+	for (int i = 0; i < argc; i++) {
+		char *val = strchr(argv[i], '=');
+
+		if (!strcmp(argv[i], "iso")) {
+			args.iso = true;
+			continue;
+		}
+		if (!val) {
+			bs_trace_error_line("Unknown argument %s\n", argv[i]);
+		}
+		*val++ = '\0';
+
+		if (!strcmp(argv[i], "interval_us")) {
+			args.interval_us = strtoul(val, NULL, 0);
+		} else if (!strcmp(argv[i], "phy")) {
+			args.phy = val;
+		} else if (!strcmp(argv[i], "rate")) {
+			args.rate = strtoul(val, NULL, 0);
+		} else if (!strcmp(argv[i], "warmup_s")) {
+			args.warmup_s = strtoul(val, NULL, 0);
+		} else if (!strcmp(argv[i], "duration_s")) {
+			args.duration_s = strtoul(val, NULL, 0);
+		} else if (!strcmp(argv[i], "sdu_us")) {
+			args.sdu_us = strtoul(val, NULL, 0);
+		} else if (!strcmp(argv[i], "latency_ms")) {
+			args.latency_ms = strtoul(val, NULL, 0);
+		} else if (!strcmp(argv[i], "rtn")) {
+			args.rtn = strtoul(val, NULL, 0);
+		} else {
+			bs_trace_error_line("Unknown argument %s\n", argv[i]);
+		}
+	}
+}
+
+/* Fails the run if the measurement has not finished by then */
+static void test_init(void)
+{
+	bst_ticker_set_next_tick_absolute((bs_time_t)(args.warmup_s + args.duration_s + 30) *
+					  USEC_PER_SEC);
+	bst_result = In_progress;
+}
+
+static void test_tick(bs_time_t hw_device_time)
+{
+	if (bst_result != Passed) {
+		FAIL("Measurement not finished after %u s\n", args.warmup_s + args.duration_s + 30);
+	}
+}
+
+static const struct bst_test_instance test_central[] = {
+	{
+		.test_id = "central",
+		.test_descr = "Measure the sticker's live stream",
+		.test_args_f = test_args,
+		.test_post_init_f = test_init,
+		.test_tick_f = test_tick,
+		.test_main_f = test_main,
+	},
+	BSTEST_END_MARKER
+};
+
+static struct bst_test_list *test_central_install(struct bst_test_list *tests)
+{
+	return bst_add_tests(tests, test_central);
+}
+
+bst_test_install_t test_installers[] = { test_central_install, NULL };
+
+int main(void)
+{
+	bst_main();
+
+	return 0;
+}
@@ -0,0 +1,95 @@
+#!/usr/bin/env bash
+#
+# Copyright (c) 2025 ANA
+#
+# Builds the BabbleSim images for run.sh and installs them in
+# ${BSIM_OUT_PATH}/bin:
+#
+#   bs_nrf52_bsim_eeg_sticker_mtu<N>  ble_rdata, FILE_SUFFIX=sim (load generator)
+#   bs_nrf52_bsim_eeg_central_mtu<N>  central/, offering ATT MTU N
+#   bs_nrf5340bsim_eeg_sticker_iso    the same with prj_iso.conf, CIS peripheral
+#   bs_nrf5340bsim_eeg_central_iso    central/ with prj_iso.conf, CIS central
+#
+# The sticker packs as many CONFIG_EEG_CHANNELS frames into a data packet as
+# fit one notification at that MTU, so each MTU is its own pair of images.
+#
+# Needs a west workspace (ZEPHYR_BASE) and BabbleSim (BSIM_OUT_PATH,
+# BSIM_COMPONENTS_PATH). Environment:
+#   MTUS       ATT MTUs to build, 66..247       (66 127 247)
+#   CHANNELS   CONFIG_EEG_CHANNELS of the sticker (4)
+#   ISO        0 to skip the nRF5340 CIS images (1)
+#   BUILD_DIR  west build directories           (build_bsim)
+#
+
+set -eu
+
+: "${ZEPHYR_BASE:?ZEPHYR_BASE is not set}"
+: "${BSIM_OUT_PATH:?BSIM_OUT_PATH is not set}"
+: "${BSIM_COMPONENTS_PATH:?BSIM_COMPONENTS_PATH is not set}"
+
+MTUS=${MTUS:-"66 127 247"}
+CHANNELS=${CHANNELS:-4}
+ISO=${ISO:-1}
+
+here=$(cd "$(dirname "$0")" && pwd)
+sticker=$(cd "${here}/../ble_rdata" && pwd)
+central=${here}/central
+build=${BUILD_DIR:-${here}/build_bsim}
+bin=${BSIM_OUT_PATH}/bin
+
+mkdir -p "${bin}"
+
+# build <board> <dir> <app> <exe> [--sysbuild] -- <cmake args>
+build() {
+	local board=$1 dir=$2 app=$3 exe=$4
+	local out
+
+	shift 4
+	west build -p always -b "${board}" -d "${build}/${dir}" "${app}" "$@"
+
+	# Sysbuild puts the app image in a directory named after the app, on
+	# nrf5340bsim its executable carries both cores
+	out=${build}/${dir}/zephyr/zephyr.exe
+	if [ ! -f "${out}" ]; then
+		out=${build}/${dir}/$(basename "${app}")/zephyr/zephyr.exe
+	fi
+	cp "${out}" "${bin}/${exe}"
+	echo "Installed ${bin}/${exe}"
+}
+
+for mtu in ${MTUS}; do
+	# The central's L2CAP RX MTU is its ACL RX buffer minus the L2CAP header
+	if [ "${mtu}" -lt 66 ] || [ "${mtu}" -gt 247 ]; then
+		echo "MTU ${mtu} outside 66..247" >&2
+		exit 1
+	fi
+
+	# Notification payload is MTU - 3, the packet header takes 6
+	fpp=$(( (mtu - 3 - 6) / (CHANNELS * 3) ))
+	fpp=$(( fpp > 32 ? 32 : fpp ))
+
+	build nrf52_bsim "sticker_mtu${mtu}" "${sticker}" \
+		"bs_nrf52_bsim_eeg_sticker_mtu${mtu}" --no-sysbuild -- \
+		-DFILE_SUFFIX=sim \
+		-DCONFIG_EEG_CHANNELS="${CHANNELS}" \
+		-DCONFIG_EEG_FRAMES_PER_PACKET="${fpp}"
+
+	build nrf52_bsim "central_mtu${mtu}" "${central}" \
+		"bs_nrf52_bsim_eeg_central_mtu${mtu}" --no-sysbuild -- \
+		-DCONFIG_BT_BUF_ACL_RX_SIZE=$(( mtu + 4 )) \
+		-DCONFIG_BT_L2CAP_TX_MTU="${mtu}"
+done
+
+if [ "${ISO}" != "0" ]; then
+	build nrf5340bsim/nrf5340/cpuapp sticker_iso "${sticker}" \
+		bs_nrf5340bsim_eeg_sticker_iso --sysbuild -- \
+		-Dble_rdata_FILE_SUFFIX=sim \
+		-Dble_rdata_EXTRA_CONF_FILE=prj_iso.conf \
+		-Dble_rdata_CONFIG_EEG_CHANNELS="${CHANNELS}" \
+		-Dipc_radio_EXTRA_CONF_FILE="${sticker}/sysbuild/ipc_radio/iso.conf"
+
+	build nrf5340bsim/nrf5340/cpuapp central_iso "${central}" \
+		bs_nrf5340bsim_eeg_central_iso --sysbuild -- \
+		-Dcentral_EXTRA_CONF_FILE=prj_iso.conf \
+		-Dipc_radio_EXTRA_CONF_FILE="${central}/sysbuild/ipc_radio/iso.conf"
+fi
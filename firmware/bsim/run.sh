@@ -0,0 +1,137 @@
+#!/usr/bin/env bash
+#
+# Copyright (c) 2025 ANA
+#
+# Runs the sticker against the measuring central in BabbleSim over a matrix
+# of connection intervals, PHYs and ATT MTUs, then the CIS runs over SDU
+# intervals, headless, and appends one JSON object per run to OUT:
+#
+#   {"run":{"board":"nrf52_bsim","interval_us":7500,"phy":"2M","mtu":247,...},
+#    "link":{...},"stream":{...},"loss":{...},"interarrival_us":{...},
+#    "latency_us":{...},"clock":{...}}
+#
+# "run" is what was asked for, "link" what the stack settled on; latency is
+# from the sticker completing a packet (DRDY of its newest frame) to the
+# central receiving it, on the central's clock. A run that fails is written
+# as {"run":{...},"failed":true} and makes the script exit with 1.
+#
+# Build the images first with compile.sh. Environment:
+#   OUT            results file                       (results.jsonl)
+#   INTERVALS      connection intervals, us           (7500 15000 30000)
+#   PHYS           1M 2M s2 s8                        (1M 2M s8)
+#   MTUS           as built by compile.sh             (66 127 247)
+#   RATE           SPS set on the sticker, 0 = as built (250)
+#   WARMUP         s before measuring                 (5)
+#   DURATION       s measured                         (20)
+#   ISO            0 to skip the CIS runs             (1)
+#   SDU_INTERVALS  CIS SDU intervals, us              (5000 10000 20000)
+#   ISO_LATENCY    CIS maximum transport latency, ms  (10)
+#   ISO_RTN        CIS retransmissions                (2)
+#   LOGS           device logs                        (a new temp directory)
+#
+
+set -u
+
+: "${BSIM_OUT_PATH:?BSIM_OUT_PATH is not set}"
+
+OUT=$(realpath -m "${OUT:-results.jsonl}")
+INTERVALS=${INTERVALS:-"7500 15000 30000"}
+PHYS=${PHYS:-"1M 2M s8"}
+MTUS=${MTUS:-"66 127 247"}
+RATE=${RATE:-250}
+WARMUP=${WARMUP:-5}
+DURATION=${DURATION:-20}
+ISO=${ISO:-1}
+SDU_INTERVALS=${SDU_INTERVALS:-"5000 10000 20000"}
+ISO_LATENCY=${ISO_LATENCY:-10}
+ISO_RTN=${ISO_RTN:-2}
+LOGS=$(realpath -m "${LOGS:-$(mktemp -d -t eeg_bsim.XXXXXX)}")
+
+bin=${BSIM_OUT_PATH}/bin
+# The central gives up 30 s after the measurement should have ended
+sim_length=$(( (WARMUP + DURATION + 40) * 1000000 ))
+runs=0
+failed=0
+
+mkdir -p "${LOGS}"
+
+# Join the central's "RESULT <section> {...}" lines, nothing without the end marker
+results() {
+	awk '
+		/RESULT [a-z_]+ \{/ {
+			sub(/.*RESULT /, "")
+			name = $1
+			sub(/^[a-z_]+ /, "")
+			if (name == "end") {
+				done = 1
+				next
+			}
+			out = out "," "\"" name "\":" $0
+		}
+		END {
+			if (done) {
+				print out
+			}
+		}' "$1"
+}
+
+# run <board> <variant> <run json> <central test args...>
+run() {
+	local board=$1 variant=$2 desc=$3
+	local id="eeg_$$_${runs}"
+	local log="${LOGS}/${id}"
+	local central_pid res status
+
+	shift 3
+	runs=$(( runs + 1 ))
+	echo "Run ${runs}: ${desc}"
+
+	(
+		cd "${bin}" || exit 1
+		"./bs_${board}_eeg_sticker_${variant}" -s="${id}" -d=0 \
+			>"${log}.sticker.log" 2>&1 &
+		"./bs_${board}_eeg_central_${variant}" -s="${id}" -d=1 -testid=central \
+			-argstest "$@" >"${log}.central.log" 2>&1 &
+		central_pid=$!
+		./bs_2G4_phy_v1 -s="${id}" -D=2 -sim_length="${sim_length}" \
+			>"${log}.phy.log" 2>&1
+		wait "${central_pid}"
+	)
+	status=$?
+
+	res=$(results "${log}.central.log")
+	if [ "${status}" -ne 0 ] || [ -z "${res}" ]; then
+		echo "  failed, see ${log}.*.log"
+		echo "{\"run\":${desc},\"failed\":true}" >>"${OUT}"
+		failed=$(( failed + 1 ))
+		return
+	fi
+
+	echo "{\"run\":${desc}${res}}" >>"${OUT}"
+}
+
+common="rate=${RATE} warmup_s=${WARMUP} duration_s=${DURATION}"
+[ "${RATE}" != "0" ] || common="warmup_s=${WARMUP} duration_s=${DURATION}"
+
+for mtu in ${MTUS}; do
+	for interval in ${INTERVALS}; do
+		for phy in ${PHYS}; do
+			run nrf52_bsim "mtu${mtu}" \
+				"{\"board\":\"nrf52_bsim\",\"transport\":\"gatt\",\"interval_us\":${interval},\"phy\":\"${phy}\",\"mtu\":${mtu},\"rate\":${RATE},\"duration_s\":${DURATION}}" \
+				interval_us="${interval}" phy="${phy}" ${common}
+		done
+	done
+done
+
+if [ "${ISO}" != "0" ]; then
+	for sdu in ${SDU_INTERVALS}; do
+		run nrf5340bsim iso \
+			"{\"board\":\"nrf5340bsim\",\"transport\":\"cis\",\"interval_us\":30000,\"phy\":\"2M\",\"sdu_us\":${sdu},\"latency_ms\":${ISO_LATENCY},\"rtn\":${ISO_RTN},\"rate\":${RATE},\"duration_s\":${DURATION}}" \
+			iso interval_us=30000 phy=2M sdu_us="${sdu}" latency_ms="${ISO_LATENCY}" \
+			rtn="${ISO_RTN}" ${common}
+	done
+fi
+
+echo "${runs} runs, ${failed} failed, results in ${OUT}, logs in ${LOGS}"
+
+[ "${failed}" -eq 0 ]
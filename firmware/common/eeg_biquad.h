@@ -0,0 +1,174 @@
+/*
+ * ANA EEG sticker - q31 biquad cascade
+ *
+ * Direct form I with 32-bit data and coefficients and 64-bit output state,
+ * bit-exact with CMSIS-DSP arm_biquad_cas_df1_32x64_q31() and using the same
+ * coefficient ({b0, b1, b2, -a1, -a2} per stage, scaled by 2^-post_shift)
+ * and state ({x[n-1], x[n-2], y[n-1], y[n-2]} per stage) layout, so either
+ * implementation can run on the same instance.
+ *
+ * The designs are the RBJ cookbook ones used by the app's _Biquad
+ * (flutter_app/lib/eeg/analyzer_dart.dart), computed in double. The 1 Hz
+ * high-pass, 45 Hz low-pass and 50 Hz notch cascade of filter.c, run on
+ * 24-bit samples shifted up by 7 bits, stays within 2 LSB (24-bit codes) of
+ * the app's double precision cascade from 250 to 1000 SPS for inputs up to
+ * full scale; host/filter_check.c fails when it does not. At higher rates
+ * the q31 poles near z = 1 move the 1 Hz corner and the error grows.
+ *
+ * Header-only and free of Zephyr includes so the host can run the same
+ * filters.
+ */
+
+#ifndef EEG_BIQUAD_H_
+#define EEG_BIQUAD_H_
+
+#include <math.h>
+#include "eeg_packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EEG_BIQUAD_COEFFS       5     // Per stage
+#define EEG_BIQUAD_STATE        4     // Per stage
+#define EEG_BIQUAD_POST_SHIFT   1     // Coefficients up to |2| fit in q31 / 2
+
+#define EEG_BIQUAD_PI           3.14159265358979323846
+
+struct eeg_biquad_cas {
+	uint8_t n_stages;
+	uint8_t post_shift;
+	const int32_t *coeffs;
+	int64_t *state;
+};
+
+static inline void eeg_biquad_init(struct eeg_biquad_cas *cas, uint8_t n_stages,
+				   const int32_t *coeffs, int64_t *state)
+{
+	cas->n_stages = n_stages;
+	cas->post_shift = EEG_BIQUAD_POST_SHIFT;
+	cas->coeffs = coeffs;
+	cas->state = state;
+	memset(state, 0, (size_t)n_stages * EEG_BIQUAD_STATE * sizeof(*state));
+}
+
+/* y (q63) times a (q31), the upper 64 bits of the 96-bit product */
+static inline int64_t eeg_biquad_mul32x64(int64_t y, int32_t a)
+{
+	return (((int64_t)(y & 0xFFFFFFFF) * a) >> 32) + (y >> 32) * a;
+}
+
+static inline void eeg_biquad_run(const struct eeg_biquad_cas *cas,
+				  const int32_t *src, int32_t *dst, size_t n)
+{
+	const int32_t *c = cas->coeffs;
+	int64_t *st = cas->state;
+	const int shift = cas->post_shift + 1;
+
+	for (uint8_t s = 0; s < cas->n_stages; s++) {
+		int32_t x1 = (int32_t)st[0], x2 = (int32_t)st[1];
+		int64_t y1 = st[2], y2 = st[3];
+
+		for (size_t i = 0; i < n; i++) {
+			int32_t x = src[i];
+			int64_t acc = (int64_t)x * c[0] + (int64_t)x1 * c[1] + (int64_t)x2 * c[2];
+
+			acc += eeg_biquad_mul32x64(y1, c[3]);
+			acc += eeg_biquad_mul32x64(y2, c[4]);
+
+			x2 = x1;
+			x1 = x;
+			y2 = y1;
+			y1 = (int64_t)((uint64_t)acc << shift);
+
+			dst[i] = (int32_t)(y1 >> 32);
+		}
+
+		st[0] = x1;
+		st[1] = x2;
+		st[2] = y1;
+		st[3] = y2;
+
+		/* Later stages run in place on the output */
+		src = dst;
+		c += EEG_BIQUAD_COEFFS;
+		st += EEG_BIQUAD_STATE;
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* Designs                                                                    */
+/* -------------------------------------------------------------------------- */
+
+enum eeg_biquad_type {
+	EEG_BIQUAD_LOWPASS,
+	EEG_BIQUAD_HIGHPASS,
+	EEG_BIQUAD_BANDPASS,    // Constant skirt gain (peak gain q), q = f0 / bandwidth
+	EEG_BIQUAD_NOTCH,
+};
+
+static inline int32_t eeg_biquad_q31(double v)
+{
+	double q = round(v * (double)(1U << (31 - EEG_BIQUAD_POST_SHIFT)));
+
+	if (q >= 2147483647.0) {
+		return INT32_MAX;
+	}
+	if (q <= -2147483648.0) {
+		return INT32_MIN;
+	}
+
+	return (int32_t)q;
+}
+
+/*
+ * Fill the 5 coefficients of one stage. b1 absorbs the rounding so that the
+ * DC gain is exact (0 or 1) after quantization: for a 1 Hz high-pass at
+ * 16 kSPS the poles are so close to z = 1 that a one LSB error in the sum of
+ * the b coefficients would otherwise leak a large part of the electrode
+ * offset through.
+ */
+static inline void eeg_biquad_design(int32_t *c, enum eeg_biquad_type type,
+				     double fs, double f0, double q)
+{
+	const int64_t one = (int64_t)1 << (31 - EEG_BIQUAD_POST_SHIFT);
+	const double w0 = 2.0 * EEG_BIQUAD_PI * f0 / fs;
+	const double cw = cos(w0);
+	const double sw = sin(w0);
+	const double alpha = sw / (2.0 * q);
+	const double a0 = 1.0 + alpha;
+	int64_t dc_gain = 1;
+	double b0;
+
+	c[3] = eeg_biquad_q31(2.0 * cw / a0);
+	c[4] = eeg_biquad_q31(-(1.0 - alpha) / a0);
+
+	switch (type) {
+	case EEG_BIQUAD_LOWPASS:
+		b0 = (1.0 - cw) / 2.0;
+		break;
+	case EEG_BIQUAD_HIGHPASS:
+		b0 = (1.0 + cw) / 2.0;
+		dc_gain = 0;
+		break;
+	case EEG_BIQUAD_BANDPASS:
+		c[0] = eeg_biquad_q31(sw / 2.0 / a0);
+		c[1] = 0;
+		c[2] = -c[0];
+		return;
+	case EEG_BIQUAD_NOTCH:
+	default:
+		b0 = 1.0;
+		break;
+	}
+
+	c[0] = eeg_biquad_q31(b0 / a0);
+	c[2] = c[0];
+	c[1] = (int32_t)(dc_gain * (one - c[3] - c[4]) - 2 * (int64_t)c[0]);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEG_BIQUAD_H_ */
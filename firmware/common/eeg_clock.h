@@ -0,0 +1,202 @@
+/*
+ * ANA EEG sticker - clock synchronization
+ *
+ * NTP-style exchange on the clock characteristic between the central's
+ * monotonic clock and the sticker's uptime clock (both in microseconds):
+ *
+ *  request  (central -> sticker, write without response)
+ *    byte 0     : exchange id, incremented by the central per request
+ *    byte 1..8  : t1, central time the request was sent (u64 LE)
+ *    byte 9..16 : t4 of the previous exchange, central time its response
+ *                 arrived (u64 LE), 0 if there was none
+ *
+ *  response (sticker -> central, notification)
+ *    byte 0      : exchange id of the request
+ *    byte 1..8   : t2, sticker time the request arrived (u64 LE)
+ *    byte 9..10  : t3 - t2, sticker time spent before replying (u16 LE)
+ *    byte 11..12 : anchor, sequence number of the newest data packet (u16 LE)
+ *    byte 13..16 : t2 - sticker time that packet was complete (u32 LE),
+ *                  EEG_CLOCK_NO_ANCHOR if no packet was produced yet
+ *
+ * Each exchange gives one offset/delay sample. Both sides feed them to the
+ * estimator below, which fits offset and drift over the low-delay samples of
+ * a sliding window. Anchors map packet sequence numbers to sticker time, so
+ * a receiver can put every sample on its own clock.
+ *
+ * Header-only and free of Zephyr includes like eeg_packet.h.
+ */
+
+#ifndef EEG_CLOCK_H_
+#define EEG_CLOCK_H_
+
+#include <stdbool.h>
+#include "eeg_packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EEG_CLOCK_REQ_LEN       17
+#define EEG_CLOCK_RESP_LEN      17
+#define EEG_CLOCK_NO_ANCHOR     0xFFFFFFFFu
+
+#define EEG_CLOCK_WINDOW        16        // Exchanges kept for the fit
+#define EEG_CLOCK_DELAY_SLACK   2000      // us above the best delay still used
+#define EEG_CLOCK_MIN_SPAN      10000000  // us of samples needed to fit drift
+
+struct eeg_clock_sample {
+	int64_t t_us;           // Sticker time of the exchange midpoint
+	int64_t offset_us;      // Sticker minus central time
+	int64_t delay_us;       // Round trip minus sticker processing
+};
+
+struct eeg_clock {
+	struct eeg_clock_sample win[EEG_CLOCK_WINDOW];
+	uint8_t n;
+	uint8_t head;
+
+	/* Fit: offset(t) = offset_us + drift * (t - ref_us) */
+	bool valid;
+	int64_t ref_us;
+	int64_t offset_us;
+	double drift;           // Sticker seconds gained per second
+	int64_t delay_us;       // Best round trip in the window
+
+	/* Newest packet anchor and the packet period measured between anchors */
+	bool anchored;
+	uint16_t anchor_seq;
+	int64_t anchor_us;
+	double period_us;
+};
+
+static inline uint64_t eeg_clock_get_le64(const uint8_t *p)
+{
+	uint64_t v = 0;
+
+	for (int i = 7; i >= 0; i--) {
+		v = (v << 8) | p[i];
+	}
+
+	return v;
+}
+
+static inline void eeg_clock_put_le64(uint8_t *p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++) {
+		p[i] = (uint8_t)(v >> (8 * i));
+	}
+}
+
+static inline void eeg_clock_init(struct eeg_clock *c)
+{
+	memset(c, 0, sizeof(*c));
+}
+
+static inline void eeg_clock_fit(struct eeg_clock *c)
+{
+	int64_t best = INT64_MAX;
+	int64_t limit;
+	int64_t t_min = INT64_MAX, t_max = INT64_MIN;
+	double t_sum = 0, o_sum = 0, tt = 0, to = 0;
+	uint8_t used = 0;
+
+	for (uint8_t i = 0; i < c->n; i++) {
+		if (c->win[i].delay_us < best) {
+			best = c->win[i].delay_us;
+		}
+	}
+
+	/* Long round trips waited for a later connection event, skip them */
+	limit = best + EEG_CLOCK_DELAY_SLACK;
+
+	for (uint8_t i = 0; i < c->n; i++) {
+		if (c->win[i].delay_us <= limit) {
+			t_sum += (double)c->win[i].t_us;
+			o_sum += (double)c->win[i].offset_us;
+			t_min = (c->win[i].t_us < t_min) ? c->win[i].t_us : t_min;
+			t_max = (c->win[i].t_us > t_max) ? c->win[i].t_us : t_max;
+			used++;
+		}
+	}
+
+	c->ref_us = (int64_t)(t_sum / used);
+	c->offset_us = (int64_t)(o_sum / used);
+	c->delay_us = best;
+	c->valid = true;
+
+	if (t_max - t_min < EEG_CLOCK_MIN_SPAN) {
+		return;
+	}
+
+	for (uint8_t i = 0; i < c->n; i++) {
+		if (c->win[i].delay_us <= limit) {
+			double dt = (double)(c->win[i].t_us - c->ref_us);
+
+			tt += dt * dt;
+			to += dt * (double)(c->win[i].offset_us - c->offset_us);
+		}
+	}
+
+	c->drift = to / tt;
+}
+
+/* Add one completed exchange, times in microseconds on their own clocks */
+static inline void eeg_clock_exchange(struct eeg_clock *c, int64_t t1, int64_t t2,
+				      int64_t t3, int64_t t4)
+{
+	struct eeg_clock_sample *s = &c->win[c->head];
+
+	s->t_us = t2 + (t3 - t2) / 2;
+	s->offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+	s->delay_us = (t4 - t1) - (t3 - t2);
+	if (s->delay_us < 0) {
+		s->delay_us = 0;
+	}
+
+	c->head = (c->head + 1) % EEG_CLOCK_WINDOW;
+	if (c->n < EEG_CLOCK_WINDOW) {
+		c->n++;
+	}
+
+	eeg_clock_fit(c);
+}
+
+static inline int64_t eeg_clock_offset_at(const struct eeg_clock *c, int64_t sticker_us)
+{
+	return c->offset_us + (int64_t)(c->drift * (double)(sticker_us - c->ref_us));
+}
+
+/* Sticker time to central time, only meaningful once c->valid */
+static inline int64_t eeg_clock_to_central(const struct eeg_clock *c, int64_t sticker_us)
+{
+	return sticker_us - eeg_clock_offset_at(c, sticker_us);
+}
+
+/* Record that packet seq was complete at sticker time t_us */
+static inline void eeg_clock_anchor(struct eeg_clock *c, uint16_t seq, int64_t t_us)
+{
+	if (c->anchored) {
+		int16_t d = eeg_seq_diff(c->anchor_seq, seq);
+
+		if (d > 0) {
+			c->period_us = (double)(t_us - c->anchor_us) / d;
+		}
+	}
+
+	c->anchored = true;
+	c->anchor_seq = seq;
+	c->anchor_us = t_us;
+}
+
+/* Sticker time packet seq was complete, extrapolated from the newest anchor */
+static inline int64_t eeg_clock_packet_time(const struct eeg_clock *c, uint16_t seq)
+{
+	return c->anchor_us +
+	       (int64_t)(eeg_seq_diff(c->anchor_seq, seq) * c->period_us);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEG_CLOCK_H_ */
@@ -0,0 +1,302 @@
+/*
+ * ANA EEG sticker - sample and frame codec
+ *
+ * One place for turning the ADS1299's 24-bit big-endian two's complement
+ * samples into int32 and back, for whole runs of samples: an RDATAC frame,
+ * the payload of a data packet, a log block (eeg_delta.h). The fastest
+ * implementation the compiler targets is picked at compile time:
+ *
+ *  - avx2    8 samples per step, 12-byte halves moved into lanes, shuffled
+ *  - ssse3   4 samples per step with PSHUFB (every SSE4 CPU has it)
+ *  - neon    16 samples per step with VLD3 / VST3 de-interleaving
+ *  - arm     Cortex-M3/M4/M33: one unaligned word load, REV, ASR per sample
+ *  - scalar  everything else, and the reference the others must match
+ *
+ * Unpackers never read past src + 3 n, packers never write past dst + 3 n.
+ * Define EEG_CODEC_SCALAR to force the portable code. firmware/host/
+ * codec_bench.c checks every compiled in implementation against the scalar
+ * one and reports samples/s.
+ *
+ * Header-only and free of Zephyr includes so the host can decode the same
+ * packets.
+ */
+
+#ifndef EEG_CODEC_H_
+#define EEG_CODEC_H_
+
+#include "eeg_packet.h"
+#include "eeg_delta.h"
+
+#if !defined(EEG_CODEC_SCALAR)
+#if defined(__AVX2__)
+#define EEG_CODEC_HAVE_AVX2     1
+#endif
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#define EEG_CODEC_HAVE_SSSE3    1
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define EEG_CODEC_HAVE_NEON     1
+#elif defined(__ARM_FEATURE_UNALIGNED) && (__ARM_ARCH >= 7)
+#define EEG_CODEC_HAVE_ARM      1
+#endif
+#endif /* !EEG_CODEC_SCALAR */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(EEG_CODEC_HAVE_AVX2)
+#define EEG_CODEC_IMPL          "avx2"
+#elif defined(EEG_CODEC_HAVE_SSSE3)
+#define EEG_CODEC_IMPL          "ssse3"
+#elif defined(EEG_CODEC_HAVE_NEON)
+#define EEG_CODEC_IMPL          "neon"
+#elif defined(EEG_CODEC_HAVE_ARM)
+#define EEG_CODEC_IMPL          "arm"
+#else
+#define EEG_CODEC_IMPL          "scalar"
+#endif
+
+#define EEG_ADS_STATUS_BYTES    3
+#define EEG_ADS_STATUS_SYNC     0xC   // Top nibble of every status word
+
+/* -------------------------------------------------------------------------- */
+/* Scalar                                                                     */
+/* -------------------------------------------------------------------------- */
+
+static inline void eeg_codec_unpack24_scalar(const uint8_t *src, int32_t *dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		dst[i] = eeg_sample_get(&src[3 * i]);
+	}
+}
+
+/* Values outside 24 bits keep their low 24 bits, clamp before if needed */
+static inline void eeg_codec_pack24_scalar(const int32_t *src, uint8_t *dst, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		eeg_sample_put(&dst[3 * i], src[i]);
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* x86                                                                        */
+/* -------------------------------------------------------------------------- */
+
+#if defined(EEG_CODEC_HAVE_SSSE3)
+/* Bytes of 4 samples into the top 3 bytes of each lane, big to little endian */
+#define EEG_CODEC_X86_UNPACK    _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, \
+					      -1, 8, 7, 6, -1, 11, 10, 9)
+#define EEG_CODEC_X86_PACK      _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, \
+					      8, 14, 13, 12, -1, -1, -1, -1)
+
+static inline void eeg_codec_unpack24_ssse3(const uint8_t *src, int32_t *dst, size_t n)
+{
+	const __m128i shuf = EEG_CODEC_X86_UNPACK;
+	size_t i = 0;
+
+	/* 16-byte loads, stop while they still end inside src */
+	for (; i + 6 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&src[3 * i]);
+
+		v = _mm_srai_epi32(_mm_shuffle_epi8(v, shuf), 8);
+		_mm_storeu_si128((__m128i *)&dst[i], v);
+	}
+
+	eeg_codec_unpack24_scalar(&src[3 * i], &dst[i], n - i);
+}
+
+static inline void eeg_codec_pack24_ssse3(const int32_t *src, uint8_t *dst, size_t n)
+{
+	const __m128i shuf = EEG_CODEC_X86_PACK;
+	size_t i = 0;
+
+	/* 16-byte stores of which 12 are samples, the rest is overwritten next */
+	for (; i + 6 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&src[i]);
+
+		_mm_storeu_si128((__m128i *)&dst[3 * i], _mm_shuffle_epi8(v, shuf));
+	}
+
+	eeg_codec_pack24_scalar(&src[i], &dst[3 * i], n - i);
+}
+#endif /* EEG_CODEC_HAVE_SSSE3 */
+
+#if defined(EEG_CODEC_HAVE_AVX2)
+static inline void eeg_codec_unpack24_avx2(const uint8_t *src, int32_t *dst, size_t n)
+{
+	const __m256i shuf = _mm256_broadcastsi128_si256(EEG_CODEC_X86_UNPACK);
+	/* One 32-byte load, bytes 12-23 moved up to start the high lane */
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+	size_t i = 0;
+
+	for (; i + 11 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&src[3 * i]);
+
+		v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, lanes), shuf);
+		_mm256_storeu_si256((__m256i *)&dst[i], _mm256_srai_epi32(v, 8));
+	}
+
+	eeg_codec_unpack24_ssse3(&src[3 * i], &dst[i], n - i);
+}
+#endif /* EEG_CODEC_HAVE_AVX2 */
+
+/* -------------------------------------------------------------------------- */
+/* Arm                                                                        */
+/* -------------------------------------------------------------------------- */
+
+#if defined(EEG_CODEC_HAVE_NEON)
+static inline void eeg_codec_unpack24_neon(const uint8_t *src, int32_t *dst, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x3_t b = vld3q_u8(&src[3 * i]);
+		/* Top byte signed, the low two as an unsigned 16-bit half */
+		int16x8_t hi_l = vmovl_s8(vreinterpret_s8_u8(vget_low_u8(b.val[0])));
+		int16x8_t hi_h = vmovl_s8(vreinterpret_s8_u8(vget_high_u8(b.val[0])));
+		uint16x8_t lo_l = vorrq_u16(vshll_n_u8(vget_low_u8(b.val[1]), 8),
+					    vmovl_u8(vget_low_u8(b.val[2])));
+		uint16x8_t lo_h = vorrq_u16(vshll_n_u8(vget_high_u8(b.val[1]), 8),
+					    vmovl_u8(vget_high_u8(b.val[2])));
+
+		vst1q_s32(&dst[i], vreinterpretq_s32_u32(vorrq_u32(
+			vreinterpretq_u32_s32(vshll_n_s16(vget_low_s16(hi_l), 16)),
+			vmovl_u16(vget_low_u16(lo_l)))));
+		vst1q_s32(&dst[i + 4], vreinterpretq_s32_u32(vorrq_u32(
+			vreinterpretq_u32_s32(vshll_n_s16(vget_high_s16(hi_l), 16)),
+			vmovl_u16(vget_high_u16(lo_l)))));
+		vst1q_s32(&dst[i + 8], vreinterpretq_s32_u32(vorrq_u32(
+			vreinterpretq_u32_s32(vshll_n_s16(vget_low_s16(hi_h), 16)),
+			vmovl_u16(vget_low_u16(lo_h)))));
+		vst1q_s32(&dst[i + 12], vreinterpretq_s32_u32(vorrq_u32(
+			vreinterpretq_u32_s32(vshll_n_s16(vget_high_s16(hi_h), 16)),
+			vmovl_u16(vget_high_u16(lo_h)))));
+	}
+
+	eeg_codec_unpack24_scalar(&src[3 * i], &dst[i], n - i);
+}
+
+static inline void eeg_codec_pack24_neon(const int32_t *src, uint8_t *dst, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		uint32x4_t a = vreinterpretq_u32_s32(vld1q_s32(&src[i]));
+		uint32x4_t b = vreinterpretq_u32_s32(vld1q_s32(&src[i + 4]));
+		uint8x8x3_t out;
+
+		out.val[0] = vmovn_u16(vcombine_u16(vmovn_u32(vshrq_n_u32(a, 16)),
+						    vmovn_u32(vshrq_n_u32(b, 16))));
+		out.val[1] = vmovn_u16(vcombine_u16(vmovn_u32(vshrq_n_u32(a, 8)),
+						    vmovn_u32(vshrq_n_u32(b, 8))));
+		out.val[2] = vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b)));
+		vst3_u8(&dst[3 * i], out);
+	}
+
+	eeg_codec_pack24_scalar(&src[i], &dst[3 * i], n - i);
+}
+#endif /* EEG_CODEC_HAVE_NEON */
+
+#if defined(EEG_CODEC_HAVE_ARM)
+static inline void eeg_codec_unpack24_arm(const uint8_t *src, int32_t *dst, size_t n)
+{
+	size_t i = 0;
+
+	/* The word load takes one byte of the next sample, ASR drops it */
+	for (; i + 1 < n; i++) {
+		uint32_t w;
+
+		memcpy(&w, &src[3 * i], sizeof(w));
+		dst[i] = (int32_t)__builtin_bswap32(w) >> 8;
+	}
+
+	eeg_codec_unpack24_scalar(&src[3 * i], &dst[i], n - i);
+}
+#endif /* EEG_CODEC_HAVE_ARM */
+
+/* -------------------------------------------------------------------------- */
+/* Best available                                                             */
+/* -------------------------------------------------------------------------- */
+
+/* n 24-bit big-endian samples at src to int32 */
+static inline void eeg_codec_unpack24(const uint8_t *src, int32_t *dst, size_t n)
+{
+#if defined(EEG_CODEC_HAVE_AVX2)
+	eeg_codec_unpack24_avx2(src, dst, n);
+#elif defined(EEG_CODEC_HAVE_SSSE3)
+	eeg_codec_unpack24_ssse3(src, dst, n);
+#elif defined(EEG_CODEC_HAVE_NEON)
+	eeg_codec_unpack24_neon(src, dst, n);
+#elif defined(EEG_CODEC_HAVE_ARM)
+	eeg_codec_unpack24_arm(src, dst, n);
+#else
+	eeg_codec_unpack24_scalar(src, dst, n);
+#endif
+}
+
+/* n int32 samples to 24-bit big-endian at dst */
+static inline void eeg_codec_pack24(const int32_t *src, uint8_t *dst, size_t n)
+{
+#if defined(EEG_CODEC_HAVE_SSSE3)
+	eeg_codec_pack24_ssse3(src, dst, n);
+#elif defined(EEG_CODEC_HAVE_NEON)
+	eeg_codec_pack24_neon(src, dst, n);
+#else
+	eeg_codec_pack24_scalar(src, dst, n);
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/* ADS1299 frames and packets                                                 */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * One RDATAC frame as clocked out: the 24-bit status word, then n_ch
+ * samples. Returns the status word; (status >> 20) == EEG_ADS_STATUS_SYNC
+ * for a frame read in step.
+ */
+static inline uint32_t eeg_codec_ads_frame(const uint8_t *frame, uint8_t n_ch, int32_t *samples)
+{
+	eeg_codec_unpack24(&frame[EEG_ADS_STATUS_BYTES], samples, n_ch);
+
+	return ((uint32_t)frame[0] << 16) | ((uint32_t)frame[1] << 8) | frame[2];
+}
+
+/*
+ * Decode a data packet or a log block into out[frame * n_ch + ch], n_ch the
+ * channels in its mask. Returns the number of frames, or -1 if it is
+ * malformed, of another type or out is too small.
+ */
+static inline int eeg_codec_pkt_decode(const uint8_t *pkt, size_t len,
+				       int32_t *out, size_t out_len)
+{
+	const struct eeg_pkt_hdr *hdr = (const struct eeg_pkt_hdr *)pkt;
+	size_t n;
+
+	if ((len < EEG_PKT_HDR_LEN) || (eeg_pkt_version(hdr) != EEG_PKT_VERSION)) {
+		return -1;
+	}
+
+	if (eeg_pkt_type(hdr) == EEG_PKT_TYPE_DELTA) {
+		return eeg_delta_decode(pkt, len, out, out_len);
+	}
+
+	n = (size_t)hdr->n_frames * eeg_pkt_channels(hdr->chan_mask);
+	if ((eeg_pkt_type(hdr) != EEG_PKT_TYPE_DATA) || (n > out_len) ||
+	    (len < eeg_pkt_len(hdr->chan_mask, hdr->n_frames))) {
+		return -1;
+	}
+
+	eeg_codec_unpack24(&pkt[EEG_PKT_HDR_LEN], out, n);
+
+	return hdr->n_frames;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEG_CODEC_H_ */
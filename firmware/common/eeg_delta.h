@@ -0,0 +1,140 @@
+/*
+ * ANA EEG sticker - delta-compressed sample blocks
+ *
+ * Used for the offline flash log and the bulk download characteristic. A block
+ * has the same 6-byte header as a data packet (type EEG_PKT_TYPE_DELTA) and
+ * carries whole packets worth of frames. Each sample is stored as the
+ * zigzag/varint coded difference to the previous sample of the same channel
+ * (the first frame is coded against zero), so quiet EEG costs 1-2 bytes per
+ * sample instead of 3.
+ *
+ * Header-only and free of Zephyr includes so the host can decode the same
+ * blocks.
+ */
+
+#ifndef EEG_DELTA_H_
+#define EEG_DELTA_H_
+
+#include <stdbool.h>
+#include "eeg_packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Worst case size of one coded sample: a 25-bit zigzag value in 7-bit groups */
+#define EEG_DELTA_SAMPLE_MAX    4
+
+struct eeg_delta_enc {
+	uint8_t *buf;
+	size_t cap;
+	size_t len;
+	uint8_t n_ch;
+	int32_t prev[EEG_MAX_CHANNELS];
+};
+
+static inline size_t eeg_delta_varint_put(uint8_t *p, uint32_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (uint8_t)v;
+
+	return n;
+}
+
+static inline void eeg_delta_enc_init(struct eeg_delta_enc *enc, uint8_t *buf,
+				      size_t cap, uint16_t seq, uint8_t chan_mask)
+{
+	enc->buf = buf;
+	enc->cap = cap;
+	enc->len = EEG_PKT_HDR_LEN;
+	enc->n_ch = eeg_pkt_channels(chan_mask);
+	memset(enc->prev, 0, sizeof(enc->prev));
+
+	eeg_pkt_hdr_init((struct eeg_pkt_hdr *)buf, EEG_PKT_TYPE_DELTA, seq,
+			 chan_mask, 0);
+}
+
+/* True if n_frames more frames are guaranteed to fit */
+static inline bool eeg_delta_enc_room(const struct eeg_delta_enc *enc,
+				      uint8_t n_frames)
+{
+	const struct eeg_pkt_hdr *hdr = (const struct eeg_pkt_hdr *)enc->buf;
+
+	return (hdr->n_frames + n_frames <= UINT8_MAX) &&
+	       (enc->len + (size_t)n_frames * enc->n_ch * EEG_DELTA_SAMPLE_MAX <= enc->cap);
+}
+
+/* Append one frame of 24-bit big-endian samples, caller checks room first */
+static inline void eeg_delta_enc_frame(struct eeg_delta_enc *enc, const uint8_t *frame)
+{
+	struct eeg_pkt_hdr *hdr = (struct eeg_pkt_hdr *)enc->buf;
+
+	for (uint8_t ch = 0; ch < enc->n_ch; ch++) {
+		int32_t val = eeg_sample_get(&frame[ch * EEG_SAMPLE_BYTES]);
+		int32_t d = val - enc->prev[ch];
+		uint32_t zz = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+
+		enc->len += eeg_delta_varint_put(&enc->buf[enc->len], zz);
+		enc->prev[ch] = val;
+	}
+
+	hdr->n_frames++;
+}
+
+static inline uint8_t eeg_delta_enc_frames(const struct eeg_delta_enc *enc)
+{
+	return ((const struct eeg_pkt_hdr *)enc->buf)->n_frames;
+}
+
+/*
+ * Decode a block into out[frame * n_ch + ch]. Returns the number of frames
+ * decoded, or -1 if the block is malformed or out is too small.
+ */
+static inline int eeg_delta_decode(const uint8_t *blk, size_t len,
+				   int32_t *out, size_t out_len)
+{
+	const struct eeg_pkt_hdr *hdr = (const struct eeg_pkt_hdr *)blk;
+	int32_t prev[EEG_MAX_CHANNELS] = {0};
+	size_t pos = EEG_PKT_HDR_LEN;
+	uint8_t n_ch;
+
+	if ((len < EEG_PKT_HDR_LEN) || (eeg_pkt_type(hdr) != EEG_PKT_TYPE_DELTA)) {
+		return -1;
+	}
+
+	n_ch = eeg_pkt_channels(hdr->chan_mask);
+	if ((size_t)hdr->n_frames * n_ch > out_len) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < (size_t)hdr->n_frames * n_ch; i++) {
+		uint32_t zz = 0;
+		uint8_t shift = 0;
+		uint8_t b;
+
+		do {
+			if ((pos >= len) || (shift > 28)) {
+				return -1;
+			}
+			b = blk[pos++];
+			zz |= (uint32_t)(b & 0x7F) << shift;
+			shift += 7;
+		} while (b & 0x80);
+
+		prev[i % n_ch] += (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+		out[i] = prev[i % n_ch];
+	}
+
+	return hdr->n_frames;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEG_DELTA_H_ */
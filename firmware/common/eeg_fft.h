@@ -0,0 +1,167 @@
+/*
+ * ANA EEG sticker - q31 FFT and Welch band power
+ *
+ * Radix-2 decimation in time complex FFT on interleaved q31 (re, im) data,
+ * halving every stage so the output is the DFT scaled by 1/n, the same
+ * scaling as CMSIS-DSP arm_cfft_q31(). Plus the pieces of a Welch estimate:
+ * a periodic Hann window and the sum of the one-sided periodogram over a
+ * range of bins, in LSB^2 of the input samples.
+ *
+ * Header-only and free of Zephyr includes so the host can compute the same
+ * features.
+ */
+
+#ifndef EEG_FFT_H_
+#define EEG_FFT_H_
+
+#include <math.h>
+#include "eeg_packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EEG_FFT_PI              3.14159265358979323846
+
+/* Twiddles: n / 2 interleaved (cos, -sin) pairs, q31 */
+static inline void eeg_fft_twiddles(int32_t *tw, uint16_t n)
+{
+	for (uint16_t k = 0; k < n / 2; k++) {
+		double a = 2.0 * EEG_FFT_PI * k / n;
+
+		tw[2 * k] = (int32_t)fmin(round(cos(a) * 2147483648.0), 2147483647.0);
+		tw[2 * k + 1] = (int32_t)fmin(round(-sin(a) * 2147483648.0), 2147483647.0);
+	}
+}
+
+/* Periodic Hann window, q15; its sum of squares is 3n/8 */
+static inline void eeg_fft_hann(int16_t *w, uint16_t n)
+{
+	for (uint16_t i = 0; i < n; i++) {
+		w[i] = (int16_t)fmin(round(0.5 * (1.0 - cos(2.0 * EEG_FFT_PI * i / n)) * 32768.0),
+				     32767.0);
+	}
+}
+
+static inline int32_t eeg_fft_mul(int32_t a, int32_t b)
+{
+	return (int32_t)(((int64_t)a * b) >> 31);
+}
+
+/* In place, buf holds n complex values, n a power of two */
+static inline void eeg_fft_q31(int32_t *buf, const int32_t *tw, uint16_t n)
+{
+	/* Bit reversed order */
+	for (uint16_t i = 1, j = 0; i < n; i++) {
+		uint16_t bit = n >> 1;
+
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j |= bit;
+
+		if (i < j) {
+			int32_t re = buf[2 * i], im = buf[2 * i + 1];
+
+			buf[2 * i] = buf[2 * j];
+			buf[2 * i + 1] = buf[2 * j + 1];
+			buf[2 * j] = re;
+			buf[2 * j + 1] = im;
+		}
+	}
+
+	for (uint16_t len = 2; len <= n; len <<= 1) {
+		const uint16_t half = len / 2;
+		const uint16_t step = n / len;
+
+		for (uint16_t i = 0; i < n; i += len) {
+			for (uint16_t k = 0; k < half; k++) {
+				int32_t *a = &buf[2 * (i + k)];
+				int32_t *b = &buf[2 * (i + k + half)];
+				int32_t wr = tw[2 * k * step], wi = tw[2 * k * step + 1];
+				int32_t tr = eeg_fft_mul(b[0], wr) - eeg_fft_mul(b[1], wi);
+				int32_t ti = eeg_fft_mul(b[0], wi) + eeg_fft_mul(b[1], wr);
+				int32_t ar = a[0] >> 1, ai = a[1] >> 1;
+
+				tr >>= 1;
+				ti >>= 1;
+				a[0] = ar + tr;
+				a[1] = ai + ti;
+				b[0] = ar - tr;
+				b[1] = ai - ti;
+			}
+		}
+	}
+}
+
+/*
+ * Load n samples (24-bit values as int32) into buf as complex values with
+ * the mean removed, Hann windowed and scaled up to use the q31 range.
+ * Returns that scale as a left shift, -1 if the segment is flat.
+ */
+static inline int eeg_fft_load(int32_t *buf, const int32_t *x, const int16_t *w, uint16_t n)
+{
+	int64_t sum = 0;
+	int32_t mean;
+	uint32_t peak = 0;
+	int shift = 0;
+
+	for (uint16_t i = 0; i < n; i++) {
+		sum += x[i];
+	}
+	mean = (int32_t)(sum / n);
+
+	for (uint16_t i = 0; i < n; i++) {
+		int32_t v = (int32_t)(((int64_t)(x[i] - mean) * w[i]) >> 15);
+
+		buf[2 * i] = v;
+		buf[2 * i + 1] = 0;
+		peak |= (uint32_t)(v < 0 ? -v : v);
+	}
+
+	if (!peak) {
+		return -1;
+	}
+
+	/* Top bit of the peak at bit 29, room for the first butterflies */
+	while (!(peak & 0x20000000)) {
+		peak <<= 1;
+		shift++;
+	}
+
+	for (uint16_t i = 0; i < n; i++) {
+		buf[2 * i] = (int32_t)((uint32_t)buf[2 * i] << shift);
+	}
+
+	return shift;
+}
+
+/*
+ * Power of bins [k_lo, k_hi) of a Hann windowed segment transformed by
+ * eeg_fft_q31() after eeg_fft_load() returned shift, in LSB^2 of the input:
+ * the one-sided periodogram 2 |X|^2 / (n sum(w^2)) with the 1/n FFT scaling
+ * and the load shift undone, which makes it 16 / 3 sum |Y|^2 / 4^shift.
+ */
+static inline float eeg_fft_band_power(const int32_t *buf, uint16_t k_lo, uint16_t k_hi,
+				       int shift)
+{
+	uint64_t acc = 0;
+
+	if (shift < 0) {
+		return 0.0f;
+	}
+
+	for (uint16_t k = k_lo; k < k_hi; k++) {
+		int64_t re = buf[2 * k], im = buf[2 * k + 1];
+
+		acc += (uint64_t)(re * re) + (uint64_t)(im * im);
+	}
+
+	return ldexpf((float)acc * (16.0f / 3.0f), -2 * shift);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEG_FFT_H_ */
@@ -0,0 +1,156 @@
+/*
+ * ANA EEG sticker - sliding Goertzel trackers
+ *
+ * Amplitude of a few target frequencies over the last N samples of every
+ * channel, updated every sample: the sliding DFT form of the Goertzel filter,
+ * at any frequency rather than only at the bins of N. Each sample is
+ * demodulated with a q15 phasor from a phase accumulator (eeg_mains_sin())
+ * and added to a running sum; the sample leaving the window is demodulated
+ * again with the phasor it went in with, N steps back, and taken out:
+ *
+ *   S(n) = S(n-1) + x(n) e^(-jwn) - x(n-N) e^(-jw(n-N)),   A(n) = 2 |S(n)| / N
+ *
+ * The sums are exact integers, so unlike the recursive Goertzel resonator,
+ * whose poles sit on the unit circle, nothing drifts however long it runs.
+ * A one-pole DC blocker in front keeps electrode offsets out of the sums,
+ * the rectangular window would leak them into every target. The window is
+ * about fs / N Hz wide and the amplitude lags the input by N / 2 samples.
+ *
+ * Header-only and free of Zephyr includes, the sine comes from eeg_mains.h.
+ */
+
+#ifndef EEG_GOERTZEL_H_
+#define EEG_GOERTZEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include "eeg_mains.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EEG_GOERTZEL_TARGETS_MAX  4
+#define EEG_GOERTZEL_CHANNELS_MAX 8
+#define EEG_GOERTZEL_DC_FRAC      8     // Fraction bits of the DC blocker state
+#define EEG_GOERTZEL_DC_MIN       3     // fs >> shift, DC blocker corner 0.5-1 Hz
+
+struct eeg_goertzel_chan {
+	int32_t dc_x;                   // Previous input
+	int64_t dc_y;                   // Previous output, DC_FRAC fraction bits
+	int64_t sum[EEG_GOERTZEL_TARGETS_MAX][2];  // cos, sin; input x q15
+};
+
+struct eeg_goertzel {
+	int32_t *ring;                  // len x n_ch blocked samples, frame-major
+	uint16_t len;                   // N
+	uint16_t pos;                   // Oldest frame, replaced next
+	uint16_t fill;                  // Frames in the window, up to len
+	uint8_t n_ch;
+	uint8_t n_tgt;
+	uint8_t dc_shift;
+	struct {
+		uint32_t phase;         // Of the next sample, 2^32 per cycle
+		uint32_t step;
+		uint32_t lag;           // len x step
+	} tgt[EEG_GOERTZEL_TARGETS_MAX];
+	struct eeg_goertzel_chan chan[EEG_GOERTZEL_CHANNELS_MAX];
+};
+
+/*
+ * ring must hold len x n_ch samples. hz_x10 lists n_tgt target frequencies
+ * in 1/10 Hz, all below fs / 2.
+ */
+static inline void eeg_goertzel_init(struct eeg_goertzel *g, int32_t *ring, uint16_t len,
+				     uint8_t n_ch, uint16_t fs, const uint16_t *hz_x10,
+				     uint8_t n_tgt)
+{
+	*g = (struct eeg_goertzel){
+		.ring = ring,
+		.len = len,
+		.n_ch = n_ch,
+		.n_tgt = n_tgt,
+	};
+
+	memset(ring, 0, (size_t)len * n_ch * sizeof(*ring));
+
+	/* Corner fs / (2 pi 2^shift) */
+	while ((fs >> (g->dc_shift + 1)) >= EEG_GOERTZEL_DC_MIN) {
+		g->dc_shift++;
+	}
+
+	for (uint8_t t = 0; t < n_tgt; t++) {
+		g->tgt[t].step = eeg_mains_step(((uint32_t)hz_x10[t] << 8) / 10, fs);
+		g->tgt[t].lag = g->tgt[t].step * len;
+	}
+}
+
+static inline int32_t eeg_goertzel_dc_block(struct eeg_goertzel *g, struct eeg_goertzel_chan *c,
+					    int32_t x)
+{
+	c->dc_y += ((int64_t)(x - c->dc_x) << EEG_GOERTZEL_DC_FRAC) - (c->dc_y >> g->dc_shift);
+	c->dc_x = x;
+
+	return (int32_t)(c->dc_y >> EEG_GOERTZEL_DC_FRAC);
+}
+
+/* One frame of n_ch samples */
+static inline void eeg_goertzel_frame(struct eeg_goertzel *g, const int32_t *x)
+{
+	int32_t *slot = &g->ring[(size_t)g->pos * g->n_ch];
+	int32_t in[EEG_GOERTZEL_CHANNELS_MAX];
+	int32_t out[EEG_GOERTZEL_CHANNELS_MAX];
+
+	for (uint8_t ch = 0; ch < g->n_ch; ch++) {
+		in[ch] = eeg_goertzel_dc_block(g, &g->chan[ch], x[ch]);
+		out[ch] = slot[ch];
+		slot[ch] = in[ch];
+	}
+
+	/* The phasors are the same for every channel */
+	for (uint8_t t = 0; t < g->n_tgt; t++) {
+		const uint32_t ph = g->tgt[t].phase;
+		const uint32_t ph_out = ph - g->tgt[t].lag;
+		const int64_t c_in = eeg_mains_sin(ph + (1U << 30));
+		const int64_t s_in = eeg_mains_sin(ph);
+		const int64_t c_out = eeg_mains_sin(ph_out + (1U << 30));
+		const int64_t s_out = eeg_mains_sin(ph_out);
+
+		for (uint8_t ch = 0; ch < g->n_ch; ch++) {
+			int64_t *sum = g->chan[ch].sum[t];
+
+			sum[0] += in[ch] * c_in - out[ch] * c_out;
+			sum[1] += in[ch] * s_in - out[ch] * s_out;
+		}
+
+		g->tgt[t].phase = ph + g->tgt[t].step;
+	}
+
+	g->pos = (g->pos + 1 == g->len) ? 0 : g->pos + 1;
+	if (g->fill < g->len) {
+		g->fill++;
+	}
+}
+
+static inline int eeg_goertzel_full(const struct eeg_goertzel *g)
+{
+	return g->fill == g->len;
+}
+
+/* Peak amplitude of target t on channel ch over the window, input units */
+static inline float eeg_goertzel_amp(const struct eeg_goertzel *g, uint8_t ch, uint8_t t)
+{
+	const float c = (float)g->chan[ch].sum[t][0];
+	const float s = (float)g->chan[ch].sum[t][1];
+
+	return 2.0f * sqrtf(c * c + s * s) / ((float)g->len * 32767.0f);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEG_GOERTZEL_H_ */
@@ -0,0 +1,257 @@
+/*
+ * ANA EEG sticker - adaptive mains canceller
+ *
+ * LMS adaptive noise canceller with internal reference oscillators: for
+ * the mains fundamental and each harmonic below Nyquist a sine and a cosine
+ * weight model the interference, their sum is subtracted from the input and
+ * the residual adapts the weights (Widrow's two-weight notch, repeated per
+ * harmonic). The notch is about 1 / (pi tau) Hz wide for an adaptation time
+ * constant tau and follows amplitude and phase changes within tau.
+ *
+ * Until it locks the canceller runs 50 Hz and 60 Hz banks side by side and
+ * after detect_ms keeps the one whose fundamental is clearly stronger, so
+ * the same build works in both mains regions. Once locked it also tracks the
+ * mains frequency from the rotation of the fundamental's weights, the
+ * harmonics follow as exact multiples.
+ *
+ * Fixed point throughout: q15 references from a phase accumulator and a
+ * polynomial sine, q31 step size, weights with 16 fraction bits. Inputs are
+ * int32 with |x| < 2^30 (24-bit codes shifted left by up to 7).
+ *
+ * Header-only and free of Zephyr includes so the host can run the same
+ * canceller (firmware/host/mains_bench.c).
+ */
+
+#ifndef EEG_MAINS_H_
+#define EEG_MAINS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EEG_MAINS_HARMONICS_MAX 4
+#define EEG_MAINS_BANKS         2     // 50 Hz, 60 Hz
+#define EEG_MAINS_WEIGHT_FRAC   16
+
+#define EEG_MAINS_LOCK_RATIO    4     // Power ratio of the fundamentals to decide
+#define EEG_MAINS_TRACK_DIV     4     // Frequency updates per second
+#define EEG_MAINS_TRACK_MAX_HZ  1     // Furthest the tracker moves from nominal
+
+struct eeg_mains_bank {
+	uint16_t hz;
+	uint8_t n_harm;                 // Fundamental included, 0 = bank off
+	uint32_t phase;                 // Fundamental, 2^32 per cycle
+	uint32_t step;
+	uint32_t step_nominal;
+	int64_t w[EEG_MAINS_HARMONICS_MAX][2];  // sin, cos, input << 16
+};
+
+struct eeg_mains {
+	struct eeg_mains_bank bank[EEG_MAINS_BANKS];
+	int32_t mu;                     // Step size, q31
+	uint32_t detect_len;            // Samples per detection round
+	uint32_t count;                 // Samples into the round / tracking interval
+	uint32_t track_len;
+	int64_t track_prev[2];          // Fundamental weights at the last update
+	uint16_t hz;                    // Locked to, 0 while detecting
+};
+
+/* sin(2 pi phase / 2^32) in q15, 7th order minimax polynomial, error below 1e-6 before rounding */
+static inline int32_t eeg_mains_sin(uint32_t phase)
+{
+	/* Fold into [-pi/2, pi/2] as z in q30 */
+	int64_t z = (int32_t)phase;
+	int64_t z2, r;
+
+	if (z > (1LL << 30)) {
+		z = (1LL << 31) - z;
+	} else if (z < -(1LL << 30)) {
+		z = -(1LL << 31) - z;
+	}
+
+	z2 = (z * z) >> 30;
+	r = -4652608;                   // -0.0043330790
+	r = 85291952 + ((r * z2) >> 30);       // 0.0794343204
+	r = -693522156 + ((r * z2) >> 30);     // -0.6458928396
+	r = 1686624004 + ((r * z2) >> 30);     // 1.5707910101
+	r = (r * z) >> 30;
+
+	r = (r + (1 << 14)) >> 15;
+	return (int32_t)(r > 32767 ? 32767 : (r < -32767 ? -32767 : r));
+}
+
+static inline uint32_t eeg_mains_step(uint32_t hz_q8, uint16_t fs)
+{
+	return (uint32_t)((((uint64_t)hz_q8 << 32) / fs + (1 << 7)) >> 8);
+}
+
+static inline void eeg_mains_bank_init(struct eeg_mains_bank *b, uint16_t hz,
+				       uint16_t fs, uint8_t harmonics)
+{
+	*b = (struct eeg_mains_bank){ .hz = hz };
+
+	/* Harmonics at or above Nyquist would alias onto the EEG, skip them */
+	while ((b->n_harm < harmonics) && (b->n_harm < EEG_MAINS_HARMONICS_MAX) &&
+	       (2U * hz * (b->n_harm + 1U) < fs)) {
+		b->n_harm++;
+	}
+	b->step = b->step_nominal = eeg_mains_step((uint32_t)hz << 8, fs);
+}
+
+/*
+ * hz 50 or 60 fixes the mains frequency, 0 detects it. tau_ms sets the
+ * adaptation time constant (and the notch width), detect_ms the length of
+ * one detection round.
+ */
+static inline void eeg_mains_init(struct eeg_mains *m, uint16_t fs, uint16_t hz,
+				  uint8_t harmonics, uint16_t tau_ms, uint16_t detect_ms)
+{
+	static const uint16_t mains_hz[EEG_MAINS_BANKS] = {50, 60};
+	/* Each weight converges with a time constant of 2 / mu samples */
+	const uint64_t mu = ((uint64_t)2000 << 31) / ((uint64_t)tau_ms * fs);
+
+	for (uint8_t i = 0; i < EEG_MAINS_BANKS; i++) {
+		eeg_mains_bank_init(&m->bank[i], mains_hz[i], fs,
+				    (!hz || hz == mains_hz[i]) ? harmonics : 0);
+	}
+
+	m->mu = (mu > INT32_MAX) ? INT32_MAX : (int32_t)mu;
+	m->detect_len = (uint32_t)fs * detect_ms / 1000;
+	m->track_len = fs / EEG_MAINS_TRACK_DIV;
+	m->count = 0;
+	m->track_prev[0] = 0;
+	m->track_prev[1] = 0;
+	m->hz = hz;
+}
+
+static inline uint16_t eeg_mains_hz(const struct eeg_mains *m)
+{
+	return m->hz;
+}
+
+static inline int64_t eeg_mains_fund_power(const struct eeg_mains_bank *b)
+{
+	int64_t s = b->w[0][0] >> EEG_MAINS_WEIGHT_FRAC;
+	int64_t c = b->w[0][1] >> EEG_MAINS_WEIGHT_FRAC;
+
+	return s * s + c * c;
+}
+
+/* End of a detection round: keep the clearly stronger bank or go again */
+static inline void eeg_mains_detect(struct eeg_mains *m)
+{
+	int64_t p50 = eeg_mains_fund_power(&m->bank[0]);
+	int64_t p60 = eeg_mains_fund_power(&m->bank[1]);
+	struct eeg_mains_bank *keep, *drop;
+
+	if (p50 > EEG_MAINS_LOCK_RATIO * p60) {
+		keep = &m->bank[0];
+		drop = &m->bank[1];
+	} else if (p60 > EEG_MAINS_LOCK_RATIO * p50) {
+		keep = &m->bank[1];
+		drop = &m->bank[0];
+	} else {
+		return;
+	}
+
+	drop->n_harm = 0;
+	m->hz = keep->hz;
+}
+
+/*
+ * Frequency tracking: with the mains delta Hz off the oscillator, the
+ * fundamental's weight phasor (cos, sin) turns by -2 pi delta per second.
+ * Half the measured turn per interval is taken out of the step.
+ */
+static inline void eeg_mains_track(struct eeg_mains *m, struct eeg_mains_bank *b)
+{
+	const int64_t s = b->w[0][0] >> EEG_MAINS_WEIGHT_FRAC;
+	const int64_t c = b->w[0][1] >> EEG_MAINS_WEIGHT_FRAC;
+	const int64_t ps = m->track_prev[0];
+	const int64_t pc = m->track_prev[1];
+	const int64_t dot = (pc * c + ps * s) >> 16;
+	const int64_t cross = (pc * s - ps * c) >> 16;
+	const int64_t span = (int64_t)b->step_nominal * EEG_MAINS_TRACK_MAX_HZ / b->hz;
+	int64_t dphi_q16, step;
+
+	m->track_prev[0] = s;
+	m->track_prev[1] = c;
+
+	/* Too weak to measure, or the first interval */
+	if (dot <= 0) {
+		return;
+	}
+
+	/* Small angle, radians q16 */
+	dphi_q16 = (cross << 16) / dot;
+
+	/* Radians per interval to step units: 2^32 / (2 pi) / 2^16 / track_len */
+	step = (int64_t)b->step - (dphi_q16 * 10430 / (int64_t)m->track_len) / 2;
+
+	if (step > (int64_t)b->step_nominal + span) {
+		step = (int64_t)b->step_nominal + span;
+	} else if (step < (int64_t)b->step_nominal - span) {
+		step = (int64_t)b->step_nominal - span;
+	}
+	b->step = (uint32_t)step;
+}
+
+static inline void eeg_mains_run(struct eeg_mains *m, const int32_t *src, int32_t *dst,
+				 size_t n)
+{
+	int32_t ref[EEG_MAINS_BANKS][EEG_MAINS_HARMONICS_MAX][2];
+
+	for (size_t i = 0; i < n; i++) {
+		int64_t est = 0;
+		int64_t e, g;
+
+		for (uint8_t k = 0; k < EEG_MAINS_BANKS; k++) {
+			struct eeg_mains_bank *b = &m->bank[k];
+
+			for (uint8_t h = 0; h < b->n_harm; h++) {
+				uint32_t ph = b->phase * (h + 1U);
+
+				ref[k][h][0] = eeg_mains_sin(ph);
+				ref[k][h][1] = eeg_mains_sin(ph + 0x40000000U);
+				est += ((b->w[h][0] >> EEG_MAINS_WEIGHT_FRAC) * ref[k][h][0] +
+					(b->w[h][1] >> EEG_MAINS_WEIGHT_FRAC) * ref[k][h][1]) >> 15;
+			}
+			b->phase += b->step;
+		}
+
+		e = (int64_t)src[i] - est;
+		e = e > INT32_MAX ? INT32_MAX : (e < INT32_MIN ? INT32_MIN : e);
+		dst[i] = (int32_t)e;
+
+		/* mu e in weight units, then times each reference */
+		g = (e * m->mu) >> (31 - EEG_MAINS_WEIGHT_FRAC);
+		for (uint8_t k = 0; k < EEG_MAINS_BANKS; k++) {
+			struct eeg_mains_bank *b = &m->bank[k];
+
+			for (uint8_t h = 0; h < b->n_harm; h++) {
+				b->w[h][0] += (g * ref[k][h][0]) >> 15;
+				b->w[h][1] += (g * ref[k][h][1]) >> 15;
+			}
+		}
+
+		if (++m->count < (m->hz ? m->track_len : m->detect_len)) {
+			continue;
+		}
+		m->count = 0;
+
+		if (!m->hz) {
+			eeg_mains_detect(m);
+		} else {
+			eeg_mains_track(m, &m->bank[m->hz == m->bank[0].hz ? 0 : 1]);
+		}
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEG_MAINS_H_ */
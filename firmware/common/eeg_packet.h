@@ -0,0 +1,363 @@
+/*
+ * ANA EEG sticker - BLE packet format
+ *
+ * Shared between the sticker firmware and host-side tooling, so this header
+ * must stay free of Zephyr includes.
+ */
+
+#ifndef EEG_PACKET_H_
+#define EEG_PACKET_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Packet layout                                                              */
+/* -------------------------------------------------------------------------- */
+/*
+ *  byte 0    : version (high nibble) | packet type (low nibble)
+ *  byte 1    : flags (EEG_PKT_FLAG_*)
+ *  byte 2..3 : sequence number, little endian, wraps at 0xFFFF
+ *  byte 4    : channel mask (bit n set = channel n+1 present)
+ *  byte 5    : number of frames in the payload
+ *  byte 6..  : frames, each one is popcount(mask) x 24-bit big-endian samples
+ *              exactly as clocked out of the ADS1299
+ *
+ * With EEG_PKT_FLAG_SPATIAL the samples are the rows of the spatial filter
+ * matrix (see EEG_CTRL_SET_SPATIAL) instead of electrodes: mask bit n set =
+ * derivation n+1.
+ *
+ * Band power, score and feedback packets (EEG_PKT_TYPE_BANDS,
+ * EEG_PKT_TYPE_SCORES, EEG_PKT_TYPE_FEEDBACK) share the header but each
+ * number their own sequence, the frame count field holds the number of
+ * bands / score records / feedback targets, see below.
+ */
+#define EEG_PKT_VERSION         1
+
+#define EEG_PKT_TYPE_DATA       0x1
+#define EEG_PKT_TYPE_DELTA      0x2   // Delta-compressed block, see eeg_delta.h
+#define EEG_PKT_TYPE_BANDS      0x3   // Band power features
+#define EEG_PKT_TYPE_SCORES     0x4   // Focus and stress scores
+#define EEG_PKT_TYPE_FEEDBACK   0x5   // Neurofeedback target amplitudes
+
+#define EEG_PKT_FLAG_RETX       0x01  // Packet is a retransmission
+#define EEG_PKT_FLAG_FILTERED   0x02  // Samples went through the pre-filter
+#define EEG_PKT_FLAG_SATURATED  0x04  // A channel touched the 24-bit rails
+#define EEG_PKT_FLAG_FLAT       0x08  // A channel stopped changing
+#define EEG_PKT_FLAG_STEP       0x10  // A channel jumped between two samples
+#define EEG_PKT_FLAG_BLINK      0x20  // Large slow deflection, blink or eye movement
+#define EEG_PKT_FLAG_SPATIAL    0x40  // Channels are spatial filter derivations
+#define EEG_PKT_FLAG_ARTIFACTS  (EEG_PKT_FLAG_SATURATED | EEG_PKT_FLAG_FLAT | \
+				 EEG_PKT_FLAG_STEP | EEG_PKT_FLAG_BLINK)
+
+#define EEG_PKT_HDR_LEN         6
+#define EEG_SAMPLE_BYTES        3
+#define EEG_MAX_CHANNELS        8
+
+struct eeg_pkt_hdr {
+	uint8_t ver_type;
+	uint8_t flags;
+	uint8_t seq[2];
+	uint8_t chan_mask;
+	uint8_t n_frames;
+};
+
+static inline uint8_t eeg_pkt_channels(uint8_t chan_mask)
+{
+	uint8_t n = 0;
+
+	for (; chan_mask; chan_mask &= (chan_mask - 1)) {
+		n++;
+	}
+
+	return n;
+}
+
+static inline size_t eeg_pkt_frame_len(uint8_t chan_mask)
+{
+	return (size_t)eeg_pkt_channels(chan_mask) * EEG_SAMPLE_BYTES;
+}
+
+static inline size_t eeg_pkt_len(uint8_t chan_mask, uint8_t n_frames)
+{
+	return EEG_PKT_HDR_LEN + eeg_pkt_frame_len(chan_mask) * n_frames;
+}
+
+static inline void eeg_pkt_hdr_init(struct eeg_pkt_hdr *hdr, uint8_t type,
+				    uint16_t seq, uint8_t chan_mask,
+				    uint8_t n_frames)
+{
+	hdr->ver_type = (uint8_t)((EEG_PKT_VERSION << 4) | (type & 0x0F));
+	hdr->flags = 0;
+	hdr->seq[0] = (uint8_t)(seq & 0xFF);
+	hdr->seq[1] = (uint8_t)(seq >> 8);
+	hdr->chan_mask = chan_mask;
+	hdr->n_frames = n_frames;
+}
+
+static inline uint8_t eeg_pkt_version(const struct eeg_pkt_hdr *hdr)
+{
+	return hdr->ver_type >> 4;
+}
+
+static inline uint8_t eeg_pkt_type(const struct eeg_pkt_hdr *hdr)
+{
+	return hdr->ver_type & 0x0F;
+}
+
+static inline uint16_t eeg_pkt_seq(const struct eeg_pkt_hdr *hdr)
+{
+	return (uint16_t)(hdr->seq[0] | (hdr->seq[1] << 8));
+}
+
+/* Distance from a to b on the 16-bit sequence circle, negative if b is older */
+static inline int16_t eeg_seq_diff(uint16_t a, uint16_t b)
+{
+	return (int16_t)(uint16_t)(b - a);
+}
+
+/*
+ * Band power payload: sample rate (u16 LE), FFT length (u16 LE), segments
+ * averaged (u8), then for every channel in the mask EEG_BANDS_COUNT float32
+ * LE powers in LSB^2 of the 24-bit samples, delta first. Bands as the app's
+ * analyzer: delta 1-4 Hz, theta 4-8, alpha 8-12, beta 12-30, gamma 30-45.
+ */
+#define EEG_BANDS_HDR_LEN       5
+#define EEG_BANDS_COUNT         5
+#define EEG_BANDS_VALUE_LEN     4
+
+#define EEG_BAND_DELTA          0
+#define EEG_BAND_THETA          1
+#define EEG_BAND_ALPHA          2
+#define EEG_BAND_BETA           3
+#define EEG_BAND_GAMMA          4
+
+/* Band edges in Hz, band b covers [edge b, edge b + 1) */
+#define EEG_BANDS_EDGES_HZ      {1, 4, 8, 12, 30, 45}
+
+static inline size_t eeg_bands_pkt_len(uint8_t chan_mask)
+{
+	return EEG_PKT_HDR_LEN + EEG_BANDS_HDR_LEN +
+	       (size_t)eeg_pkt_channels(chan_mask) * EEG_BANDS_COUNT * EEG_BANDS_VALUE_LEN;
+}
+
+/*
+ * Score payload, one record: sequence number of the data packet that closed
+ * the window (u16 LE), seconds of data in the window (u16 LE), seconds
+ * between scores (u8), then u16 LE focus and stress scores (0..1 as
+ * 0..65535), theta/beta ratio (1/1000, saturating) and the median relative
+ * alpha and beta amplitudes (0..1 as 0..65535). The header's channel mask is
+ * the channels scored, those with data free of artifacts in the window.
+ * Computed like the app's MinuteAnalyzer.
+ */
+#define EEG_SCORES_LEN          15
+#define EEG_SCORES_PKT_LEN      (EEG_PKT_HDR_LEN + EEG_SCORES_LEN)
+
+/*
+ * Feedback payload: sequence number of the data packet the newest sample
+ * goes into (u16 LE) and its frame there (u8), sample rate (u16 LE), window
+ * length in samples (u16 LE), the header's frame count of target
+ * frequencies in 1/10 Hz (u16 LE), then for every channel in the mask one
+ * u16 LE peak amplitude per target in LSB of the 24-bit samples, saturating.
+ * The channels are the electrodes as sampled, DC-blocked but neither
+ * pre-filtered nor re-referenced.
+ */
+#define EEG_FEEDBACK_HDR_LEN    7
+#define EEG_FEEDBACK_TARGETS_MAX 4
+#define EEG_FEEDBACK_VALUE_LEN  2
+
+static inline size_t eeg_feedback_pkt_len(uint8_t chan_mask, uint8_t n_targets)
+{
+	return EEG_PKT_HDR_LEN + EEG_FEEDBACK_HDR_LEN + (size_t)n_targets * 2 +
+	       (size_t)eeg_pkt_channels(chan_mask) * n_targets * EEG_FEEDBACK_VALUE_LEN;
+}
+
+/* Sign-extend one 24-bit big-endian ADS1299 sample */
+static inline int32_t eeg_sample_get(const uint8_t *p)
+{
+	int32_t val = ((int32_t)p[0] << 16) | ((int32_t)p[1] << 8) | p[2];
+
+	if (val & 0x800000) {
+		val |= (int32_t)0xFF000000;
+	}
+
+	return val;
+}
+
+static inline void eeg_sample_put(uint8_t *p, int32_t val)
+{
+	p[0] = (uint8_t)((val >> 16) & 0xFF);
+	p[1] = (uint8_t)((val >> 8) & 0xFF);
+	p[2] = (uint8_t)(val & 0xFF);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Control channel (writes to the NUS RX characteristic)                      */
+/* -------------------------------------------------------------------------- */
+/*
+ * Every control message is a TLV: type (1 byte), length (1 byte), value. One
+ * write may carry several TLVs back to back.
+ *
+ * EEG_CTRL_NACK value: one or more (start seq u16 LE, count u16 LE) ranges
+ * the central wants retransmitted. Not acknowledged.
+ *
+ * All other commands are answered on the response characteristic with a TLV
+ * of the same type whose value is a status byte (EEG_CTRL_STATUS_*) followed
+ * by the command specific payload:
+ *
+ *  START      -                              -> -
+ *  STOP       -                              -> -
+ *  SET_RATE   rate in SPS (u16 LE)           -> -
+ *  SET_CHANS  channel mask (u8)              -> -
+ *  SET_GAIN   channel mask (u8), PGA gain (u8) -> -
+ *  COUNTERS   -                              -> struct eeg_ctrl_counters
+ *  LOW_POWER  -                              -> -
+ *  LATENCY    stage (u8), reset (u8)         -> struct eeg_ctrl_latency
+ *  SET_MODE   live outputs (u8, EEG_MODE_*)  -> -
+ *  SET_SPATIAL rows (u8), row (u8), EEG_MAX_CHANNELS coefficients
+ *             (s16 LE, q14, one per electrode) -> -
+ *  SET_FEEDBACK EEG_FEEDBACK_TARGETS_MAX target frequencies (u16 LE,
+ *             1/10 Hz, 0 = unused, used ones first), window ms (u16 LE),
+ *             period ms (u16 LE)  -> -
+ *
+ * A SET_SPATIAL matrix takes effect at the next packet once rows 0..rows-1
+ * have all arrived, rows 0 switches the spatial filter off. A SET_FEEDBACK
+ * window longer than the sticker keeps is shortened to what it keeps.
+ *
+ * For compatibility with early app versions a write of the single byte
+ * EEG_CTRL_LEGACY_START or EEG_CTRL_LEGACY_STOP acts as START / STOP (and
+ * gets no response).
+ */
+#define EEG_CTRL_NACK           0x10
+#define EEG_CTRL_START          0x20
+#define EEG_CTRL_STOP           0x21
+#define EEG_CTRL_SET_RATE       0x22
+#define EEG_CTRL_SET_CHANS      0x23
+#define EEG_CTRL_SET_GAIN       0x24
+#define EEG_CTRL_COUNTERS       0x25
+#define EEG_CTRL_LOW_POWER      0x26
+#define EEG_CTRL_LATENCY        0x27
+#define EEG_CTRL_SET_MODE       0x28
+#define EEG_CTRL_SET_SPATIAL    0x29
+#define EEG_CTRL_SET_FEEDBACK   0x2A
+
+/* What goes out on the live link, any combination the firmware supports */
+#define EEG_MODE_RAW            0x01  // Data packets (default)
+#define EEG_MODE_BANDS          0x02  // Band power packets
+#define EEG_MODE_SCORES         0x04  // Score packets
+#define EEG_MODE_FEEDBACK       0x08  // Feedback packets
+
+#define EEG_CTRL_LEGACY_STOP    0x00
+#define EEG_CTRL_LEGACY_START   0x01
+
+#define EEG_CTRL_STATUS_OK      0
+#define EEG_CTRL_STATUS_LEN     1     // Value length does not match the command
+#define EEG_CTRL_STATUS_VALUE   2     // Value out of range
+#define EEG_CTRL_STATUS_BUSY    3     // Not possible in the current state
+#define EEG_CTRL_STATUS_IO      4     // Talking to the ADS1299 failed
+
+#define EEG_CTRL_TLV_HDR_LEN    2
+#define EEG_CTRL_NACK_RANGE_LEN 4
+#define EEG_CTRL_SPATIAL_LEN    (2 + 2 * EEG_MAX_CHANNELS)
+#define EEG_CTRL_FEEDBACK_LEN   (2 * EEG_FEEDBACK_TARGETS_MAX + 4)
+#define EEG_CTRL_VALUE_MAX      EEG_CTRL_SPATIAL_LEN  // Longest command value
+
+/* COUNTERS response payload, every field u32 LE */
+struct eeg_ctrl_counters {
+	uint32_t packets;               // Data packets produced
+	uint32_t notify_failed;         // Live packets the BT stack refused
+	uint32_t retx_requested;
+	uint32_t retx_sent;
+	uint32_t retx_expired;
+	uint32_t log_written;           // Offline log blocks written to flash
+	uint32_t log_drained;           // Offline log blocks sent on the bulk char
+	uint32_t log_dropped;           // Packets lost because the log fell behind
+	uint32_t ctrl_dropped;          // Commands dropped because the queue was full
+	uint32_t bytes;                 // Live packet bytes handed to the BT stack
+	uint32_t tx_done;               // Live packets confirmed sent
+	uint32_t latency_avg_us;        // Packet complete to sent, since boot
+	uint32_t latency_max_us;
+};
+
+/*
+ * Pipeline latency, measured per stage with the cycle counter and kept as
+ * log2 histograms: bin 0 counts deltas below 1 us, bin n (n >= 1) deltas of
+ * 2^(n-1) up to 2^n us, the last bin everything longer.
+ */
+#define EEG_LAT_DRDY_SPI        0     // DRDY edge to SPI read done, per frame
+#define EEG_LAT_BATCH           1     // First frame read to packet complete
+#define EEG_LAT_QUEUE           2     // Packet complete to notification queued
+#define EEG_LAT_TX              3     // Queued to the controller reporting it sent
+#define EEG_LAT_TOTAL           4     // DRDY of the first frame to sent
+#define EEG_LAT_FEEDBACK        5     // DRDY of the newest frame to feedback sent
+#define EEG_LAT_STAGES          6
+
+#define EEG_LAT_BINS            20
+
+/* LATENCY response payload, every field LE */
+struct eeg_ctrl_latency {
+	uint32_t count;
+	uint32_t max_us;
+	uint16_t bins[EEG_LAT_BINS];    // Saturate at 0xFFFF
+};
+
+/* -------------------------------------------------------------------------- */
+/* Diagnostics (diagnostics characteristic of the EEG service)                */
+/* -------------------------------------------------------------------------- */
+/*
+ * A snapshot, taken once a second while a central is connected, is a sequence
+ * of sections: id (1 byte), length (1 byte), value, all fields little endian.
+ * Reading returns the whole snapshot; notifications carry as many whole
+ * sections as fit and every snapshot starts with EEG_DIAG_SYSTEM. No section
+ * is longer than EEG_DIAG_SECTION_MAX, so the default ATT MTU is enough.
+ *
+ *  SYSTEM  uptime s (u32), state (u8, EEG_STATE_*), CPU load 1/1000 (u16),
+ *          DRDY overruns (u32), acquisition wake-ups (u32)
+ *  LINK    interval 1.25 ms (u16), latency (u16), timeout 10 ms (u16),
+ *          ATT MTU (u16), TX PHY (u8), RX PHY (u8), TX octets (u16);
+ *          absent while disconnected, PHY/octets 0 if not known
+ *  RATES   frames/s (u16), packets/s (u16), live bytes/s (u32),
+ *          live packets refused (u32), live packets sent (u32), the last
+ *          two since boot
+ *  POOL    pool id (u8, EEG_DIAG_POOL_*), used (u16), peak (u16), size (u16),
+ *          times found full (u32)
+ *  THREAD  CPU 1/1000 (u16), stack used (u16), stack size (u16),
+ *          name (rest of the section, not terminated)
+ *  LATENCY stage (u8, EEG_LAT_*), count (u32), 50th, 90th and 99th
+ *          percentile as histogram bin (u8 each), max us (u32)
+ *  POWER   CPU awake per sample avg us (u16), max us (u16), SPIM resumed
+ *          1/1000 (u16), modelled current uA (u32)
+ */
+#define EEG_DIAG_SYSTEM         0x01
+#define EEG_DIAG_LINK           0x02
+#define EEG_DIAG_RATES          0x03
+#define EEG_DIAG_POOL           0x04
+#define EEG_DIAG_THREAD         0x05
+#define EEG_DIAG_LATENCY        0x06
+#define EEG_DIAG_POWER          0x07
+
+#define EEG_DIAG_SYSTEM_LEN     15
+#define EEG_DIAG_LINK_LEN       12
+#define EEG_DIAG_RATES_LEN      16
+#define EEG_DIAG_POOL_LEN       11
+#define EEG_DIAG_THREAD_LEN     6     // Without the name
+#define EEG_DIAG_THREAD_NAME    8
+#define EEG_DIAG_LATENCY_LEN    12
+#define EEG_DIAG_POWER_LEN      10
+#define EEG_DIAG_SECTION_MAX    18    // Including id and length
+
+#define EEG_DIAG_POOL_UART      1     // UART bridge buffers
+#define EEG_DIAG_POOL_LOG       2     // Offline log blocks waiting for flash
+#define EEG_DIAG_POOL_CTRL      3     // Control command queue
+#define EEG_DIAG_POOL_RETX      4     // NACK range queue
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEG_PACKET_H_ */
@@ -0,0 +1,151 @@
+/*
+ * ANA EEG sticker - spatial filter kernel
+ *
+ * Applies a small matrix to every frame: output derivation r is
+ * sum over c of m[r][c] * x[c], with the coefficients in q14 (range +-2) and
+ * EEG_MAX_CHANNELS coefficients per row whatever the number of inputs. Common
+ * average reference, bipolar chains and Laplacians are all such matrices,
+ * see the presets below.
+ *
+ * With the Cortex-M4/M33 DSP extension (__ARM_FEATURE_SIMD32) each 24-bit
+ * sample is split into a signed high and an unsigned low half and two
+ * channels are done per SMLALD / SMLAD. The result is bit-exact with the
+ * portable loop: firmware/host/spatial_check.c defines
+ * EEG_SPATIAL_DSP_EMULATED and its own __pkhbt(), __smlad() and __smlald()
+ * to compare both on the host.
+ *
+ * Header-only and free of Zephyr includes so the host can apply the same
+ * montages.
+ */
+
+#ifndef EEG_SPATIAL_H_
+#define EEG_SPATIAL_H_
+
+#include "eeg_packet.h"
+
+#if defined(__ARM_FEATURE_SIMD32)
+#include <arm_acle.h>
+#define EEG_SPATIAL_HAVE_DSP    1
+#elif defined(EEG_SPATIAL_DSP_EMULATED)
+#define EEG_SPATIAL_HAVE_DSP    1     // The includer defines the intrinsics
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EEG_SPATIAL_FRAC        14
+#define EEG_SPATIAL_ONE         (1 << EEG_SPATIAL_FRAC)
+#define EEG_SPATIAL_COLS        EEG_MAX_CHANNELS        // Row stride
+
+/* Portable loop, the reference */
+static inline void eeg_spatial_apply_scalar(const int16_t *m, uint8_t n_out, uint8_t n_in,
+					    const int32_t *x, int32_t *y, size_t n_frames)
+{
+	for (size_t f = 0; f < n_frames; f++, x += n_in, y += n_out) {
+		for (uint8_t r = 0; r < n_out; r++) {
+			const int16_t *row = &m[r * EEG_SPATIAL_COLS];
+			int64_t acc = 0;
+
+			for (uint8_t c = 0; c < n_in; c++) {
+				acc += (int64_t)row[c] * x[c];
+			}
+
+			y[r] = (int32_t)((acc + (1 << (EEG_SPATIAL_FRAC - 1))) >> EEG_SPATIAL_FRAC);
+		}
+	}
+}
+
+#if defined(EEG_SPATIAL_HAVE_DSP)
+/*
+ * Two channels per instruction. With an odd n_in the last pair's second
+ * sample is 0, so whatever the row holds in that column does not count.
+ */
+static inline void eeg_spatial_apply_dsp(const int16_t *m, uint8_t n_out, uint8_t n_in,
+					 const int32_t *x, int32_t *y, size_t n_frames)
+{
+	for (size_t f = 0; f < n_frames; f++, x += n_in, y += n_out) {
+		/* x = 256 hi + lo, hi signed 16 bits, lo 0..255; channel pairs per word */
+		int32_t hi[EEG_SPATIAL_COLS / 2];
+		int32_t lo[EEG_SPATIAL_COLS / 2];
+
+		for (uint8_t c = 0; c < n_in; c += 2) {
+			int32_t a = x[c];
+			int32_t b = (c + 1 < n_in) ? x[c + 1] : 0;
+
+			hi[c / 2] = (int32_t)__pkhbt(a >> 8, b >> 8, 16);
+			lo[c / 2] = (a & 0xFF) | ((b & 0xFF) << 16);
+		}
+
+		for (uint8_t r = 0; r < n_out; r++) {
+			const int16_t *row = &m[r * EEG_SPATIAL_COLS];
+			int64_t acc_hi = 0;
+			int32_t acc_lo = 0;
+
+			for (uint8_t c = 0; c < n_in; c += 2) {
+				int32_t w;
+
+				memcpy(&w, &row[c], sizeof(w));
+				acc_hi = __smlald(hi[c / 2], w, acc_hi);
+				acc_lo = __smlad(lo[c / 2], w, acc_lo);
+			}
+
+			y[r] = (int32_t)((acc_hi * 256 + acc_lo + (1 << (EEG_SPATIAL_FRAC - 1))) >>
+					 EEG_SPATIAL_FRAC);
+		}
+	}
+}
+#endif /* EEG_SPATIAL_HAVE_DSP */
+
+/*
+ * n_frames frames of n_in samples (24-bit values as int32) to frames of
+ * n_out derivations, both frame-major. The outputs are not clamped; they
+ * stay within 2^27 for 24-bit inputs.
+ */
+static inline void eeg_spatial_apply(const int16_t *m, uint8_t n_out, uint8_t n_in,
+				     const int32_t *x, int32_t *y, size_t n_frames)
+{
+#if defined(EEG_SPATIAL_HAVE_DSP)
+	eeg_spatial_apply_dsp(m, n_out, n_in, x, y, n_frames);
+#else
+	eeg_spatial_apply_scalar(m, n_out, n_in, x, y, n_frames);
+#endif
+}
+
+/* Common average reference over n channels, returns the number of rows */
+static inline uint8_t eeg_spatial_car(int16_t *m, uint8_t n)
+{
+	const int16_t mean = (int16_t)-((EEG_SPATIAL_ONE + n / 2) / n);
+
+	memset(m, 0, (size_t)n * EEG_SPATIAL_COLS * sizeof(*m));
+	for (uint8_t r = 0; r < n; r++) {
+		for (uint8_t c = 0; c < n; c++) {
+			m[r * EEG_SPATIAL_COLS + c] = mean;
+		}
+		m[r * EEG_SPATIAL_COLS + r] += EEG_SPATIAL_ONE;
+	}
+
+	return n;
+}
+
+/* Bipolar chain, channel r minus channel r + 1, returns the number of rows */
+static inline uint8_t eeg_spatial_bipolar(int16_t *m, uint8_t n)
+{
+	if (n < 2) {
+		return 0;
+	}
+
+	memset(m, 0, (size_t)(n - 1) * EEG_SPATIAL_COLS * sizeof(*m));
+	for (uint8_t r = 0; r + 1 < n; r++) {
+		m[r * EEG_SPATIAL_COLS + r] = EEG_SPATIAL_ONE;
+		m[r * EEG_SPATIAL_COLS + r + 1] = -EEG_SPATIAL_ONE;
+	}
+
+	return n - 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEG_SPATIAL_H_ */
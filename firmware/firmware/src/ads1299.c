@@ -3,6 +3,7 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/spi.h>
 #include <zephyr/drivers/gpio.h>
+#include <eeg_codec.h>
 
 
 
@@ -179,17 +180,14 @@ static void ads1299_readout_work_handler(struct k_work *work)
     }
 
     uint8_t eeg_packet[EEG_CHANNELS * 3];
+    int32_t vals[EEG_CHANNELS];
+
+    // status word + sign-extended samples, see common/eeg_codec.h
+    eeg_codec_ads_frame(rx_buf, EEG_CHANNELS, vals);
     for (int ch = 0; ch < EEG_CHANNELS; ch++) {
-        int32_t val = (rx_buf[3 + 3*ch] << 16) |
-                      (rx_buf[3 + 3*ch + 1] << 8) |
-                      rx_buf[3 + 3*ch + 2];
-        if (val & 0x800000) val |= 0xFF000000; // sign extend
-        val -= channel_baseline[ch];
-
-        eeg_packet[ch*3 + 0] = (val >> 16) & 0xFF;
-        eeg_packet[ch*3 + 1] = (val >> 8) & 0xFF;
-        eeg_packet[ch*3 + 2] = val & 0xFF;
+        vals[ch] -= channel_baseline[ch];
     }
+    eeg_codec_pack24(vals, eeg_packet, EEG_CHANNELS);
 
     // store safely under mutex
     printk("Raw bytes: %02X %02X %02X ...\n", rx_buf[3], rx_buf[4], rx_buf[5]);
@@ -0,0 +1,230 @@
+/*
+ * ANA EEG sticker - sample codec benchmark
+ *
+ * Checks every implementation of eeg_codec.h compiled into this build
+ * against the scalar one, on every length up to a few vectors (the tails)
+ * and on a long run, then reports samples/s for unpacking and packing long
+ * runs and for decoding whole data packets as the app receives them.
+ * Exits non-zero on a mismatch.
+ *
+ * Which implementations exist depends on the target: build with
+ * -DEEG_HOST_NATIVE=ON (the default) to let the compiler use everything
+ * this CPU has.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <eeg_codec.h>
+
+#define SAMPLES                 (1 << 14)   // Stays in L2, measures the code
+#define REPS                    20
+#define BATCH                   200         // Runs per timed repetition
+#define TAIL_MAX                64
+#define PKT_CHANNELS            4
+#define PKT_FRAMES              10
+
+typedef void (*unpack_fn)(const uint8_t *src, int32_t *dst, size_t n);
+typedef void (*pack_fn)(const int32_t *src, uint8_t *dst, size_t n);
+
+struct impl {
+	const char *name;
+	unpack_fn unpack;
+	pack_fn pack;           // NULL if it has none of its own
+};
+
+static const struct impl impls[] = {
+	{"scalar", eeg_codec_unpack24_scalar, eeg_codec_pack24_scalar},
+#if defined(EEG_CODEC_HAVE_ARM)
+	{"arm", eeg_codec_unpack24_arm, NULL},
+#endif
+#if defined(EEG_CODEC_HAVE_NEON)
+	{"neon", eeg_codec_unpack24_neon, eeg_codec_pack24_neon},
+#endif
+#if defined(EEG_CODEC_HAVE_SSSE3)
+	{"ssse3", eeg_codec_unpack24_ssse3, eeg_codec_pack24_ssse3},
+#endif
+#if defined(EEG_CODEC_HAVE_AVX2)
+	{"avx2", eeg_codec_unpack24_avx2, NULL},
+#endif
+};
+
+#define IMPLS                   (sizeof(impls) / sizeof(impls[0]))
+
+static volatile int32_t sink;
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* One length; the guard values after the run catch writes past the end */
+static int check_n(const struct impl *im, const uint8_t *bytes, const int32_t *ref, size_t n)
+{
+	static int32_t out[SAMPLES + 1];
+	static uint8_t packed[3 * SAMPLES + 16];
+
+	out[n] = 0x5A5A5A5A;
+	im->unpack(bytes, out, n);
+	if (memcmp(out, ref, n * sizeof(*out)) || (out[n] != 0x5A5A5A5A)) {
+		printf("%s: unpack mismatch at n = %zu\n", im->name, n);
+		return 1;
+	}
+
+	if (im->pack) {
+		memset(&packed[3 * n], 0xA5, 16);
+		im->pack(ref, packed, n);
+		if (memcmp(packed, bytes, 3 * n) || (packed[3 * n] != 0xA5)) {
+			printf("%s: pack mismatch at n = %zu\n", im->name, n);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int check(const struct impl *im, const uint8_t *bytes, const int32_t *ref)
+{
+	for (size_t n = 0; n <= TAIL_MAX; n++) {
+		if (check_n(im, bytes, ref, n)) {
+			return 1;
+		}
+	}
+
+	return check_n(im, bytes, ref, SAMPLES);
+}
+
+static double rate_unpack(unpack_fn fn, const uint8_t *bytes, int32_t *out)
+{
+	double best = 0.0;
+
+	for (int rep = 0; rep < REPS; rep++) {
+		double t0 = now_s();
+		double r;
+
+		for (int b = 0; b < BATCH; b++) {
+			fn(bytes, out, SAMPLES);
+		}
+		r = (double)SAMPLES * BATCH / (now_s() - t0);
+		sink = out[rep];
+		best = (r > best) ? r : best;
+	}
+
+	return best;
+}
+
+static double rate_pack(pack_fn fn, const int32_t *in, uint8_t *bytes)
+{
+	double best = 0.0;
+
+	for (int rep = 0; rep < REPS; rep++) {
+		double t0 = now_s();
+		double r;
+
+		for (int b = 0; b < BATCH; b++) {
+			fn(in, bytes, SAMPLES);
+		}
+		r = (double)SAMPLES * BATCH / (now_s() - t0);
+		sink = bytes[rep];
+		best = (r > best) ? r : best;
+	}
+
+	return best;
+}
+
+/* Back to back data packets of PKT_FRAMES x PKT_CHANNELS, as notified */
+static double rate_packets(const int32_t *ref, int32_t *out)
+{
+	const uint8_t mask = (1 << PKT_CHANNELS) - 1;
+	const size_t len = eeg_pkt_len(mask, PKT_FRAMES);
+	const size_t per_pkt = PKT_FRAMES * PKT_CHANNELS;
+	const size_t n_pkts = SAMPLES / per_pkt;
+	uint8_t *stream = malloc(n_pkts * len);
+	double best = 0.0;
+
+	for (size_t p = 0; p < n_pkts; p++) {
+		uint8_t *pkt = &stream[p * len];
+
+		eeg_pkt_hdr_init((struct eeg_pkt_hdr *)pkt, EEG_PKT_TYPE_DATA, (uint16_t)p,
+				 mask, PKT_FRAMES);
+		eeg_codec_pack24_scalar(&ref[p * per_pkt], &pkt[EEG_PKT_HDR_LEN], per_pkt);
+	}
+
+	for (int rep = 0; rep < REPS; rep++) {
+		double t0 = now_s();
+		double r;
+
+		for (int b = 0; b < BATCH; b++) {
+			for (size_t p = 0; p < n_pkts; p++) {
+				if (eeg_codec_pkt_decode(&stream[p * len], len, &out[p * per_pkt],
+							 per_pkt) != PKT_FRAMES) {
+					printf("packet %zu not decoded\n", p);
+					exit(1);
+				}
+			}
+		}
+		r = (double)n_pkts * per_pkt * BATCH / (now_s() - t0);
+		sink = out[rep];
+		best = (r > best) ? r : best;
+	}
+
+	if (memcmp(out, ref, n_pkts * per_pkt * sizeof(*out))) {
+		printf("packet decode mismatch\n");
+		exit(1);
+	}
+
+	free(stream);
+	return best;
+}
+
+int main(void)
+{
+	uint8_t *bytes = malloc(3 * SAMPLES + 16);
+	int32_t *ref = malloc(SAMPLES * sizeof(*ref));
+	int32_t *out = malloc((SAMPLES + 1) * sizeof(*out));
+	unsigned int seed = 1;
+	int failed = 0;
+
+	/* Full 24-bit range, both rails included */
+	for (size_t i = 0; i < SAMPLES; i++) {
+		seed = seed * 1103515245U + 12345U;
+		ref[i] = (int32_t)(seed << 8) >> 8;
+	}
+	ref[0] = (1 << 23) - 1;
+	ref[1] = -(1 << 23);
+	eeg_codec_pack24_scalar(ref, bytes, SAMPLES);
+
+	printf("default: %s\n", EEG_CODEC_IMPL);
+	printf("%-8s %14s %14s\n", "impl", "unpack Ms/s", "pack Ms/s");
+	for (size_t k = 0; k < IMPLS; k++) {
+		const struct impl *im = &impls[k];
+
+		if (check(im, bytes, ref)) {
+			failed = 1;
+			continue;
+		}
+
+		printf("%-8s %14.0f", im->name, rate_unpack(im->unpack, bytes, out) / 1e6);
+		if (im->pack) {
+			printf(" %14.0f\n", rate_pack(im->pack, ref, bytes) / 1e6);
+		} else {
+			printf(" %14s\n", "-");
+		}
+	}
+
+	printf("packets  %14.0f  (%d ch x %d frames, eeg_codec_pkt_decode)\n",
+	       rate_packets(ref, out) / 1e6, PKT_CHANNELS, PKT_FRAMES);
+
+	free(bytes);
+	free(ref);
+	free(out);
+
+	return failed;
+}
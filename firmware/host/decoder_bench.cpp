@@ -0,0 +1,273 @@
+/*
+ * ANA EEG sticker - streaming decoder benchmark
+ *
+ * Feeds eeg_decoder streams of data packets as a central would see them:
+ * one notification per packet at the largest MTU, several packets per CIS
+ * SDU, single-frame notifications, packets lost for good and packets lost
+ * then retransmitted a few packets later. Every scenario is first checked
+ * sample by sample, with the order, the gaps and the NACKs it must produce,
+ * then timed on one thread, blocks consumed through their channel views.
+ * Reports samples/s and packets/s; the goal is 100 M samples/s for full
+ * notifications. Exits non-zero on a mismatch, not on a missed goal.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#include <eeg_codec.h>
+
+#include "eeg_decoder.hpp"
+
+#define PACKETS                 4096        // Per stream
+#define REPS                    20
+#define BATCH                   20          // Streams per timed repetition
+#define RETX_DELAY              8           // Packets a retransmission comes late
+#define GOAL_MSPS               100.0
+
+struct scenario {
+	const char *name;
+	unsigned channels;
+	unsigned frames;
+	unsigned per_payload;   // Packets back to back in one payload
+	unsigned loss;          // Packets lost per 1000
+	bool retx;              // Lost ones arrive again, late
+	bool goal;
+};
+
+static const scenario scenarios[] = {
+	{"8 ch x 9, MTU 247", 8, 9, 1, 0, false, true},
+	{"4 ch x 19, MTU 247", 4, 19, 1, 0, false, true},
+	{"4 ch x 19, 4 per SDU", 4, 19, 4, 0, false, false},
+	{"8 ch x 9, 2% retx", 8, 9, 1, 20, true, false},
+	{"8 ch x 9, 2% lost", 8, 9, 1, 20, false, false},
+	{"4 ch x 1, MTU 23", 4, 1, 1, 0, false, false},
+};
+
+struct stream {
+	std::vector<uint8_t> bytes;
+	std::vector<size_t> payloads;   // Offsets, one past the last at the end
+	unsigned lost;
+	unsigned retx;
+};
+
+static volatile int64_t sink;
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t hash(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7FEB352DU;
+	x ^= x >> 15;
+	x *= 0x846CA68BU;
+	return x ^ (x >> 16);
+}
+
+/* Full 24-bit range, both rails every so often */
+static int32_t sample(unsigned pkt, unsigned frame, unsigned ch)
+{
+	uint32_t h = hash(pkt * 0x10000U + frame * 0x10U + ch);
+
+	if ((h & 0xFFF) == 0) {
+		return (h & 0x1000) ? (1 << 23) - 1 : -(1 << 23);
+	}
+	return (int32_t)(h << 8) >> 8;
+}
+
+static bool lost(const scenario &sc, unsigned pkt)
+{
+	return (hash(pkt ^ 0xA5A5A5A5U) % 1000) < sc.loss;
+}
+
+static void put_packet(const scenario &sc, std::vector<uint8_t> &out, unsigned pkt, uint8_t flags)
+{
+	const uint8_t mask = (uint8_t)((1u << sc.channels) - 1);
+	size_t at = out.size();
+
+	out.resize(at + eeg_pkt_len(mask, (uint8_t)sc.frames));
+	eeg_pkt_hdr_init((struct eeg_pkt_hdr *)&out[at], EEG_PKT_TYPE_DATA, (uint16_t)pkt, mask,
+			 (uint8_t)sc.frames);
+	out[at + 1] = flags;
+	for (unsigned f = 0; f < sc.frames; f++) {
+		for (unsigned c = 0; c < sc.channels; c++) {
+			eeg_sample_put(&out[at + EEG_PKT_HDR_LEN + (f * sc.channels + c) * 3],
+				       sample(pkt, f, c));
+		}
+	}
+}
+
+/* Packets in arrival order, grouped into payloads */
+static stream build(const scenario &sc)
+{
+	std::vector<unsigned> order;
+	std::vector<uint8_t> flags;
+	stream s;
+
+	s.lost = 0;
+	s.retx = 0;
+	for (unsigned p = 0; p < PACKETS; p++) {
+		if (lost(sc, p)) {
+			s.lost++;
+		} else {
+			order.push_back(p);
+			flags.push_back(0);
+		}
+		if (sc.retx && (p >= RETX_DELAY) && lost(sc, p - RETX_DELAY)) {
+			order.push_back(p - RETX_DELAY);
+			flags.push_back(EEG_PKT_FLAG_RETX);
+			s.retx++;
+		}
+	}
+	if (sc.retx) {
+		s.lost = 0;
+		for (unsigned p = PACKETS - RETX_DELAY; p < PACKETS; p++) {
+			s.lost += lost(sc, p);
+		}
+	}
+
+	for (size_t i = 0; i < order.size(); i++) {
+		if (i % sc.per_payload == 0) {
+			s.payloads.push_back(s.bytes.size());
+		}
+		put_packet(sc, s.bytes, order[i], flags[i]);
+	}
+	s.payloads.push_back(s.bytes.size());
+
+	return s;
+}
+
+/* Every block in order, every sample, the gaps and the NACKs */
+static bool check(const scenario &sc, const stream &s, eeg::decoder &dec)
+{
+	std::vector<uint8_t> nack(64);
+	unsigned expect = 0;
+	unsigned delivered = 0;
+	unsigned gaps = 0;
+	unsigned nacks = 0;
+	bool ok = true;
+
+	auto block = [&](const eeg::block_view &b) {
+		if (!ok) {
+			return;
+		}
+		while ((expect < PACKETS) && lost(sc, expect) &&
+		       (!sc.retx || (expect + RETX_DELAY >= PACKETS))) {
+			expect++;
+			gaps++;
+		}
+		if ((b.seq() != (uint16_t)expect) || (b.lost_before() != gaps) ||
+		    (b.frames() != sc.frames) || (b.channels() != sc.channels)) {
+			printf("%s: block %u seq %u, %u lost before\n", sc.name, expect, b.seq(),
+			       b.lost_before());
+			ok = false;
+			return;
+		}
+		for (unsigned c = 0; c < sc.channels; c++) {
+			eeg::span<const int32_t> x = b.channel(c);
+
+			for (unsigned f = 0; f < sc.frames; f++) {
+				if (x[f] != sample(expect, f, c)) {
+					printf("%s: packet %u frame %u ch %u: %d, not %d\n", sc.name,
+					       expect, f, c, x[f], sample(expect, f, c));
+					ok = false;
+					return;
+				}
+			}
+		}
+		expect++;
+		delivered++;
+		gaps = 0;
+	};
+
+	dec.reset();
+	for (size_t i = 0; i + 1 < s.payloads.size(); i++) {
+		eeg::span<const uint8_t> pl(&s.bytes[s.payloads[i]], s.payloads[i + 1] - s.payloads[i]);
+
+		dec.push(pl, 0, block);
+		nacks += !dec.nack(eeg::span<uint8_t>(nack.data(), nack.size())).empty();
+	}
+	dec.flush();
+	dec.drain(block);
+
+	if (ok && (delivered + s.lost != PACKETS)) {
+		printf("%s: %u packets out\n", sc.name, delivered);
+		ok = false;
+	}
+	if (ok && (sc.loss > 0) && (nacks == 0)) {
+		printf("%s: no NACK\n", sc.name);
+		ok = false;
+	}
+
+	return ok;
+}
+
+static double rate(const stream &s, eeg::decoder &dec, uint64_t *samples)
+{
+	double best = 0.0;
+
+	for (int rep = 0; rep < REPS; rep++) {
+		uint64_t n = 0;
+		int64_t sum = 0;
+		double t0 = now_s();
+		double r;
+
+		for (int b = 0; b < BATCH; b++) {
+			dec.reset();
+			for (size_t i = 0; i + 1 < s.payloads.size(); i++) {
+				dec.push(eeg::span<const uint8_t>(&s.bytes[s.payloads[i]],
+								  s.payloads[i + 1] - s.payloads[i]),
+					 0, [&](const eeg::block_view &v) {
+						 for (size_t c = 0; c < v.channels(); c++) {
+							 sum += v.channel(c)[0];
+						 }
+						 n += v.frames() * v.channels();
+					 });
+			}
+		}
+		r = (double)n / (now_s() - t0);
+		sink = sum;
+		*samples = n / BATCH;
+		best = (r > best) ? r : best;
+	}
+
+	return best;
+}
+
+int main(void)
+{
+	eeg::decoder dec;
+	int failed = 0;
+
+	printf("codec: %s\n", eeg_dec_codec());
+	printf("%-22s %12s %12s\n", "scenario", "Ms/s", "Mpkt/s");
+
+	for (const scenario &sc : scenarios) {
+		stream s = build(sc);
+		uint64_t samples;
+		double r;
+
+		if (!check(sc, s, dec)) {
+			failed = 1;
+			continue;
+		}
+
+		r = rate(s, dec, &samples);
+		printf("%-22s %12.0f %12.1f", sc.name, r / 1e6,
+		       r / ((double)samples / (PACKETS - s.lost)) / 1e6);
+		if (sc.goal) {
+			printf("  %s %.0f Ms/s", (r / 1e6 >= GOAL_MSPS) ? "meets" : "misses", GOAL_MSPS);
+		}
+		printf("\n");
+	}
+
+	return failed;
+}
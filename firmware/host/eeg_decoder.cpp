@@ -0,0 +1,643 @@
+/*
+ * ANA EEG sticker - streaming packet decoder
+ *
+ * Everything is sized in eeg_dec_create(): a pool of slots, each one
+ * packet's planar samples and room for a copy of the packet, a ring of
+ * pending slots indexed by sequence number, and the ready list. A packet is
+ * decoded once, straight into its slot; in order, it is ready at once and
+ * its raw view points into the pushed payload, out of order it is copied
+ * into the slot and waits there. Slots of ready blocks go back to the pool
+ * at the start of the next push.
+ *
+ * The reorder rules are the app's (BLEService._acceptPacket): a hole is
+ * given up once the newest packet is reorder_window ahead of it, and a jump
+ * ahead asks for the packets in between with a NACK unless the packet is
+ * itself a retransmission.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include <eeg_clock.h>
+#include <eeg_codec.h>
+
+#include "eeg_decoder.h"
+
+namespace
+{
+
+struct nack_range {
+	uint16_t start;
+	uint16_t count;
+};
+
+} // namespace
+
+struct eeg_dec {
+	uint16_t window;
+	uint16_t max_frames;
+	uint8_t legacy_ch;
+
+	/* Slot pool */
+	size_t slot_samples;
+	size_t raw_cap;
+	std::vector<int32_t> samples;
+	std::vector<uint8_t> raw;
+	std::vector<eeg_dec_block> meta;
+	std::vector<int32_t> free_slots;
+	std::vector<int32_t> scratch;
+
+	/* Pending ring, slot of sequence number s at s & pend_mask, -1 if none */
+	std::vector<int32_t> pend;
+	uint32_t pend_mask;
+	uint32_t pend_count;
+
+	std::vector<eeg_dec_block> ready;
+	std::vector<int32_t> ready_slot;
+	size_t n_ready;
+	size_t ready_head;
+
+	bool started;
+	uint16_t next;              // Next sequence number to hand out
+	uint16_t highest;           // Newest sequence number seen
+	uint32_t lost_run;          // Given up on since the last data block
+	uint16_t legacy_seq;
+	int64_t last_rx;
+
+	nack_range nack[EEG_DEC_NACK_RANGES];
+	uint8_t n_nack;
+
+	struct eeg_clock clock;
+	uint8_t sync_id;
+	bool sync_pending;
+	int64_t sync_t1;
+	int64_t prev_t4;
+
+	eeg_dec_stats stats;
+};
+
+namespace
+{
+
+uint16_t get_le16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t get_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+	       ((uint32_t)p[3] << 24);
+}
+
+/* Frame-major as decoded to channel-major, the channel count known to the compiler */
+template <unsigned N> void to_planar(const int32_t *in, int32_t *out, unsigned frames)
+{
+	for (unsigned f = 0; f < frames; f++) {
+		for (unsigned c = 0; c < N; c++) {
+			out[c * frames + f] = in[f * N + c];
+		}
+	}
+}
+
+void to_planar(const int32_t *in, int32_t *out, unsigned n_ch, unsigned frames)
+{
+	switch (n_ch) {
+	case 1:
+		std::memcpy(out, in, frames * sizeof(*out));
+		break;
+	case 2:
+		to_planar<2>(in, out, frames);
+		break;
+	case 3:
+		to_planar<3>(in, out, frames);
+		break;
+	case 4:
+		to_planar<4>(in, out, frames);
+		break;
+	case 5:
+		to_planar<5>(in, out, frames);
+		break;
+	case 6:
+		to_planar<6>(in, out, frames);
+		break;
+	case 7:
+		to_planar<7>(in, out, frames);
+		break;
+	default:
+		to_planar<8>(in, out, frames);
+		break;
+	}
+}
+
+int32_t slot_get(eeg_dec *d)
+{
+	int32_t s;
+
+	if (d->free_slots.empty()) {
+		return -1;
+	}
+	s = d->free_slots.back();
+	d->free_slots.pop_back();
+	return s;
+}
+
+void slot_put(eeg_dec *d, int32_t s)
+{
+	d->free_slots.push_back(s);
+}
+
+void release_ready(eeg_dec *d)
+{
+	for (size_t i = 0; i < d->n_ready; i++) {
+		if (d->ready_slot[i] >= 0) {
+			slot_put(d, d->ready_slot[i]);
+		}
+	}
+	d->n_ready = 0;
+	d->ready_head = 0;
+}
+
+bool timed(const eeg_dec *d)
+{
+	return d->clock.valid && d->clock.anchored && (d->clock.period_us > 0.0);
+}
+
+void make_ready(eeg_dec *d, const eeg_dec_block &b, int32_t slot, int64_t rx_us)
+{
+	eeg_dec_block *r = &d->ready[d->n_ready];
+
+	*r = b;
+	r->t_us = rx_us;
+	r->frame_us = 0.0;
+	d->ready_slot[d->n_ready++] = slot;
+
+	if (!(b.status & EEG_DEC_BLOCK_SAMPLES)) {
+		return;
+	}
+
+	r->lost_before = (uint16_t)std::min<uint32_t>(d->lost_run, UINT16_MAX);
+	d->lost_run = 0;
+	d->stats.samples += (uint64_t)b.frames * b.channels;
+
+	/* Live packets only, log blocks number their own sequence */
+	if ((b.type == EEG_PKT_TYPE_DATA) && !(b.status & EEG_DEC_BLOCK_LEGACY) && timed(d)) {
+		int64_t end = eeg_clock_to_central(&d->clock,
+						   eeg_clock_packet_time(&d->clock, b.seq));
+
+		r->frame_us = d->clock.period_us / b.frames;
+		r->t_us = end - std::llround((b.frames - 1) * r->frame_us);
+		r->status |= EEG_DEC_BLOCK_TIMED;
+	}
+}
+
+void give_up(eeg_dec *d, uint32_t n)
+{
+	d->stats.lost += n;
+	d->lost_run += n;
+	d->next = (uint16_t)(d->next + n);
+}
+
+/* Hand out the packet waiting at d->next */
+void emit_pending(eeg_dec *d, int64_t rx_us)
+{
+	uint32_t i = d->next & d->pend_mask;
+	int32_t slot = d->pend[i];
+
+	d->pend[i] = -1;
+	d->pend_count--;
+	make_ready(d, d->meta[slot], slot, rx_us);
+	d->next++;
+}
+
+bool waiting(const eeg_dec *d)
+{
+	return d->pend[d->next & d->pend_mask] >= 0;
+}
+
+void drain(eeg_dec *d, int64_t rx_us)
+{
+	while (d->pend_count > 0) {
+		if (waiting(d)) {
+			emit_pending(d, rx_us);
+		} else if (eeg_seq_diff(d->next, d->highest) >= d->window) {
+			give_up(d, 1);
+		} else {
+			return;
+		}
+	}
+}
+
+void nack_add(eeg_dec *d, uint16_t start, uint16_t count)
+{
+	nack_range *last = d->n_nack ? &d->nack[d->n_nack - 1] : nullptr;
+
+	if (last && ((uint16_t)(last->start + last->count) == start)) {
+		last->count += count;
+	} else if (d->n_nack < EEG_DEC_NACK_RANGES) {
+		d->nack[d->n_nack++] = {start, count};
+	} else {
+		/* Out of ranges: ask for everything since the last one */
+		last->count = (uint16_t)(start + count - last->start);
+	}
+}
+
+/* A data packet or log block, length checked */
+void push_samples(eeg_dec *d, const uint8_t *p, size_t len, int64_t rx_us)
+{
+	const struct eeg_pkt_hdr *hdr = (const struct eeg_pkt_hdr *)p;
+	const uint16_t seq = eeg_pkt_seq(hdr);
+	const unsigned n_ch = eeg_pkt_channels(hdr->chan_mask);
+	const unsigned frames = hdr->n_frames;
+	eeg_dec_block b;
+	int32_t *out;
+	int32_t slot;
+	int32_t at;
+	int16_t ahead;
+
+	if ((n_ch == 0) || (frames == 0) || (frames > d->max_frames)) {
+		d->stats.malformed++;
+		return;
+	}
+
+	if (!d->started) {
+		d->started = true;
+		d->next = seq;
+		d->highest = seq;
+	}
+
+	at = d->pend[seq & d->pend_mask];
+	if ((eeg_seq_diff(d->next, seq) < 0) || ((at >= 0) && (d->meta[at].seq == seq))) {
+		d->stats.duplicates++;
+		return;
+	}
+
+	slot = slot_get(d);
+	if (slot < 0) {
+		d->stats.overflow++;
+		return;
+	}
+
+	out = &d->samples[(size_t)slot * d->slot_samples];
+	if (eeg_pkt_type(hdr) == EEG_PKT_TYPE_DATA) {
+		eeg_codec_unpack24(&p[EEG_PKT_HDR_LEN], d->scratch.data(), (size_t)frames * n_ch);
+	} else if (eeg_delta_decode(p, len, d->scratch.data(), d->scratch.size()) < 0) {
+		slot_put(d, slot);
+		d->stats.malformed++;
+		return;
+	}
+	to_planar(d->scratch.data(), out, n_ch, frames);
+	d->stats.packets++;
+
+	b.samples = out;
+	b.raw = p;
+	b.raw_len = (uint32_t)len;
+	b.seq = seq;
+	b.frames = (uint16_t)frames;
+	b.lost_before = 0;
+	b.type = eeg_pkt_type(hdr);
+	b.version = eeg_pkt_version(hdr);
+	b.flags = hdr->flags;
+	b.chan_mask = hdr->chan_mask;
+	b.channels = (uint8_t)n_ch;
+	b.status = EEG_DEC_BLOCK_SAMPLES;
+
+	ahead = eeg_seq_diff(d->highest, seq);
+	if (ahead > 0) {
+		if ((ahead > 1) && !(hdr->flags & EEG_PKT_FLAG_RETX)) {
+			nack_add(d, (uint16_t)(d->highest + 1), (uint16_t)(ahead - 1));
+		}
+		d->highest = seq;
+	} else if (ahead < 0) {
+		b.status |= EEG_DEC_BLOCK_RECOVERED;
+		d->stats.recovered++;
+	}
+
+	/* Make room in the window for seq, as drain() would once it waits */
+	while (eeg_seq_diff(d->next, seq) >= d->window) {
+		if (d->pend_count == 0) {
+			give_up(d, eeg_seq_diff(d->next, seq) - d->window + 1);
+			break;
+		}
+		if (waiting(d)) {
+			emit_pending(d, rx_us);
+		} else {
+			give_up(d, 1);
+		}
+	}
+
+	if (seq == d->next) {
+		make_ready(d, b, slot, rx_us);
+		d->next++;
+	} else {
+		/* Waits past this push, keep the packet with it */
+		std::memcpy(&d->raw[(size_t)slot * d->raw_cap], p, len);
+		b.raw = &d->raw[(size_t)slot * d->raw_cap];
+		d->meta[slot] = b;
+		d->pend[seq & d->pend_mask] = slot;
+		d->pend_count++;
+	}
+
+	drain(d, rx_us);
+}
+
+/* Headerless frames of legacy_ch channels, in arrival order */
+void push_legacy(eeg_dec *d, const uint8_t *data, size_t len, int64_t rx_us)
+{
+	const size_t frame_len = (size_t)d->legacy_ch * EEG_SAMPLE_BYTES;
+	const size_t frames = len / frame_len;
+	eeg_dec_block b = {};
+	int32_t slot;
+
+	if ((frames == 0) || (frames > d->max_frames) || (len % frame_len)) {
+		d->stats.malformed++;
+		return;
+	}
+
+	slot = slot_get(d);
+	eeg_codec_unpack24(data, d->scratch.data(), frames * d->legacy_ch);
+	to_planar(d->scratch.data(), &d->samples[(size_t)slot * d->slot_samples], d->legacy_ch,
+		  (unsigned)frames);
+	d->stats.packets++;
+
+	b.samples = &d->samples[(size_t)slot * d->slot_samples];
+	b.raw = data;
+	b.raw_len = (uint32_t)len;
+	b.seq = d->legacy_seq++;
+	b.frames = (uint16_t)frames;
+	b.type = EEG_PKT_TYPE_DATA;
+	b.chan_mask = (uint8_t)((1u << d->legacy_ch) - 1);
+	b.channels = d->legacy_ch;
+	b.status = EEG_DEC_BLOCK_SAMPLES | EEG_DEC_BLOCK_LEGACY;
+	make_ready(d, b, slot, rx_us);
+}
+
+/* Length of the packet at p, 0 if the type does not say (it takes the rest) */
+size_t pkt_len(const struct eeg_pkt_hdr *hdr)
+{
+	switch (eeg_pkt_type(hdr)) {
+	case EEG_PKT_TYPE_DATA:
+		return eeg_pkt_len(hdr->chan_mask, hdr->n_frames);
+	case EEG_PKT_TYPE_BANDS:
+		return eeg_bands_pkt_len(hdr->chan_mask);
+	case EEG_PKT_TYPE_SCORES:
+		return EEG_SCORES_PKT_LEN;
+	case EEG_PKT_TYPE_FEEDBACK:
+		return eeg_feedback_pkt_len(hdr->chan_mask, hdr->n_frames);
+	default:
+		return 0;
+	}
+}
+
+void clear(eeg_dec *d)
+{
+	size_t slots = d->meta.size();
+
+	d->free_slots.clear();
+	for (size_t s = slots; s > 0; s--) {
+		d->free_slots.push_back((int32_t)(s - 1));
+	}
+	std::fill(d->pend.begin(), d->pend.end(), -1);
+	d->pend_count = 0;
+	d->n_ready = 0;
+	d->ready_head = 0;
+	d->started = false;
+	d->next = 0;
+	d->highest = 0;
+	d->lost_run = 0;
+	d->legacy_seq = 0;
+	d->last_rx = 0;
+	d->n_nack = 0;
+	eeg_clock_init(&d->clock);
+	d->sync_id = 0;
+	d->sync_pending = false;
+	d->sync_t1 = 0;
+	d->prev_t4 = 0;
+}
+
+} // namespace
+
+uint32_t eeg_dec_abi_version(void)
+{
+	return EEG_DEC_ABI_VERSION;
+}
+
+const char *eeg_dec_codec(void)
+{
+	return EEG_CODEC_IMPL;
+}
+
+struct eeg_dec *eeg_dec_create(const struct eeg_dec_config *cfg)
+{
+	eeg_dec_config c = cfg ? *cfg : eeg_dec_config{};
+	eeg_dec *d;
+	uint32_t pend_size = 1;
+	size_t slots;
+
+	c.reorder_window = c.reorder_window ? c.reorder_window : EEG_DEC_REORDER_DEFAULT;
+	c.max_frames = c.max_frames ? c.max_frames : EEG_DEC_FRAMES_DEFAULT;
+	if ((c.reorder_window > EEG_DEC_REORDER_MAX) || (c.max_frames > UINT8_MAX) ||
+	    (c.legacy_channels > EEG_MAX_CHANNELS)) {
+		return nullptr;
+	}
+
+	while (pend_size < c.reorder_window) {
+		pend_size <<= 1;
+	}
+	slots = pend_size + EEG_DEC_BURST;
+
+	try {
+		d = new eeg_dec();
+	} catch (const std::bad_alloc &) {
+		return nullptr;
+	}
+
+	d->window = c.reorder_window;
+	d->max_frames = c.max_frames;
+	d->legacy_ch = c.legacy_channels;
+	d->slot_samples = (size_t)c.max_frames * EEG_MAX_CHANNELS;
+	/* A log block at its worst */
+	d->raw_cap = EEG_PKT_HDR_LEN + d->slot_samples * EEG_DELTA_SAMPLE_MAX;
+	d->pend_mask = pend_size - 1;
+
+	try {
+		d->samples.resize(slots * d->slot_samples);
+		d->raw.resize(slots * d->raw_cap);
+		d->meta.resize(slots);
+		d->free_slots.reserve(slots);
+		d->scratch.resize(d->slot_samples);
+		d->pend.resize(pend_size);
+		d->ready.resize(slots);
+		d->ready_slot.resize(slots);
+	} catch (const std::bad_alloc &) {
+		delete d;
+		return nullptr;
+	}
+
+	d->stats = eeg_dec_stats{};
+	clear(d);
+
+	return d;
+}
+
+void eeg_dec_destroy(struct eeg_dec *dec)
+{
+	delete dec;
+}
+
+void eeg_dec_reset(struct eeg_dec *dec)
+{
+	clear(dec);
+}
+
+int eeg_dec_push(struct eeg_dec *dec, const uint8_t *data, size_t len, int64_t rx_us)
+{
+	size_t pos = 0;
+	unsigned packets = 0;
+
+	release_ready(dec);
+	dec->stats.payloads++;
+	dec->last_rx = rx_us;
+
+	if (dec->legacy_ch) {
+		push_legacy(dec, data, len, rx_us);
+		return (int)dec->n_ready;
+	}
+
+	while (len - pos >= EEG_PKT_HDR_LEN) {
+		const uint8_t *p = &data[pos];
+		const struct eeg_pkt_hdr *hdr = (const struct eeg_pkt_hdr *)p;
+		size_t n;
+
+		if (eeg_pkt_version(hdr) != EEG_PKT_VERSION) {
+			dec->stats.unsupported++;
+			return (int)dec->n_ready;
+		}
+
+		n = pkt_len(hdr);
+		n = n ? n : len - pos;
+		if (n > len - pos) {
+			dec->stats.malformed++;
+			return (int)dec->n_ready;
+		}
+		if (packets++ == EEG_DEC_BURST) {
+			dec->stats.overflow++;
+			return (int)dec->n_ready;
+		}
+
+		if ((eeg_pkt_type(hdr) == EEG_PKT_TYPE_DATA) ||
+		    (eeg_pkt_type(hdr) == EEG_PKT_TYPE_DELTA)) {
+			push_samples(dec, p, n, rx_us);
+		} else {
+			eeg_dec_block b = {};
+
+			b.raw = p;
+			b.raw_len = (uint32_t)n;
+			b.seq = eeg_pkt_seq(hdr);
+			b.frames = hdr->n_frames;
+			b.type = eeg_pkt_type(hdr);
+			b.version = eeg_pkt_version(hdr);
+			b.flags = hdr->flags;
+			b.chan_mask = hdr->chan_mask;
+			b.channels = eeg_pkt_channels(hdr->chan_mask);
+			dec->stats.passed++;
+			make_ready(dec, b, -1, rx_us);
+		}
+
+		pos += n;
+	}
+
+	if (pos < len) {
+		dec->stats.malformed++;
+	}
+
+	return (int)dec->n_ready;
+}
+
+int eeg_dec_flush(struct eeg_dec *dec)
+{
+	release_ready(dec);
+
+	while (dec->pend_count > 0) {
+		if (waiting(dec)) {
+			emit_pending(dec, dec->last_rx);
+		} else {
+			give_up(dec, 1);
+		}
+	}
+
+	return (int)dec->n_ready;
+}
+
+const struct eeg_dec_block *eeg_dec_next(struct eeg_dec *dec)
+{
+	return (dec->ready_head < dec->n_ready) ? &dec->ready[dec->ready_head++] : nullptr;
+}
+
+size_t eeg_dec_nack(struct eeg_dec *dec, uint8_t *buf, size_t cap)
+{
+	size_t len = EEG_CTRL_TLV_HDR_LEN + (size_t)dec->n_nack * EEG_CTRL_NACK_RANGE_LEN;
+
+	if ((dec->n_nack == 0) || (cap < len)) {
+		return 0;
+	}
+
+	buf[0] = EEG_CTRL_NACK;
+	buf[1] = (uint8_t)(len - EEG_CTRL_TLV_HDR_LEN);
+	for (uint8_t i = 0; i < dec->n_nack; i++) {
+		uint8_t *r = &buf[EEG_CTRL_TLV_HDR_LEN + i * EEG_CTRL_NACK_RANGE_LEN];
+
+		r[0] = (uint8_t)dec->nack[i].start;
+		r[1] = (uint8_t)(dec->nack[i].start >> 8);
+		r[2] = (uint8_t)dec->nack[i].count;
+		r[3] = (uint8_t)(dec->nack[i].count >> 8);
+	}
+	dec->n_nack = 0;
+
+	return len;
+}
+
+size_t eeg_dec_clock_request(struct eeg_dec *dec, uint8_t *buf, size_t cap, int64_t t1_us)
+{
+	if (cap < EEG_CLOCK_REQ_LEN) {
+		return 0;
+	}
+
+	buf[0] = ++dec->sync_id;
+	eeg_clock_put_le64(&buf[1], (uint64_t)t1_us);
+	eeg_clock_put_le64(&buf[9], (uint64_t)dec->prev_t4);
+	dec->sync_t1 = t1_us;
+	dec->sync_pending = true;
+
+	return EEG_CLOCK_REQ_LEN;
+}
+
+int eeg_dec_clock_response(struct eeg_dec *dec, const uint8_t *data, size_t len, int64_t t4_us)
+{
+	int64_t t2;
+	uint32_t age;
+
+	if ((len < EEG_CLOCK_RESP_LEN) || !dec->sync_pending || (data[0] != dec->sync_id)) {
+		return -1;
+	}
+
+	t2 = (int64_t)eeg_clock_get_le64(&data[1]);
+	eeg_clock_exchange(&dec->clock, dec->sync_t1, t2, t2 + get_le16(&data[9]), t4_us);
+	dec->sync_pending = false;
+	dec->prev_t4 = t4_us;
+
+	age = get_le32(&data[13]);
+	if (age != EEG_CLOCK_NO_ANCHOR) {
+		eeg_clock_anchor(&dec->clock, get_le16(&data[11]), t2 - age);
+	}
+
+	return 0;
+}
+
+void eeg_dec_stats_get(const struct eeg_dec *dec, struct eeg_dec_stats *stats)
+{
+	*stats = dec->stats;
+}
@@ -0,0 +1,165 @@
+/*
+ * ANA EEG sticker - streaming packet decoder, C ABI
+ *
+ * Turns what the central receives from the sticker into blocks of int32
+ * samples in sequence order: live notifications, CIS SDUs (several packets
+ * back to back) and bulk log blocks (EEG_PKT_TYPE_DELTA). Data packets that
+ * arrive out of order, e.g. retransmissions after a NACK, are put back in
+ * place within a reorder window; holes the window gives up on are counted
+ * and reported on the block that follows them. Band power, score and
+ * feedback packets are passed through unchanged, in arrival order.
+ *
+ * Each block's samples are decoded once into memory the decoder owns, one
+ * contiguous row per channel, and handed out as views: no copies, and no
+ * allocation after eeg_dec_create(). Views and the raw packets they point to
+ * stay valid until the next eeg_dec_push(), eeg_dec_flush() or
+ * eeg_dec_reset(); a raw view may point into the pushed payload, which must
+ * live that long too.
+ *
+ * Format versions: packets of EEG_PKT_VERSION (eeg_packet.h), several of
+ * them back to back in one payload, a log block taking the rest of its
+ * payload; with eeg_dec_config.legacy_channels set, headerless payloads of
+ * 24-bit frames from firmware that predates the packet header, every
+ * payload taken as such. Packets of another version are counted as
+ * unsupported and skipped, unknown types of this version passed through.
+ *
+ * Block times come from the clock characteristic exchange (eeg_clock.h)
+ * when the caller runs it through eeg_dec_clock_request() and
+ * eeg_dec_clock_response(), else from the receive time given to push.
+ *
+ * A decoder is not thread safe, use one per stream. The C++ API is in
+ * eeg_decoder.hpp, the Dart binding in the app's eeg_decoder_ffi.dart.
+ */
+
+#ifndef EEG_DECODER_H_
+#define EEG_DECODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32) && defined(EEG_DEC_BUILD)
+#define EEG_DEC_API             __declspec(dllexport)
+#elif defined(_WIN32)
+#define EEG_DEC_API             __declspec(dllimport)
+#else
+#define EEG_DEC_API             __attribute__((visibility("default")))
+#endif
+
+/* Bumped when a struct below or a function's meaning changes */
+#define EEG_DEC_ABI_VERSION     1
+
+#define EEG_DEC_REORDER_DEFAULT 256       // As the app waited for retransmissions
+#define EEG_DEC_REORDER_MAX     16384
+#define EEG_DEC_FRAMES_DEFAULT  32        // CONFIG_EEG_FRAMES_PER_PACKET maximum
+#define EEG_DEC_BURST           64        // Packets decoded per payload
+#define EEG_DEC_NACK_RANGES     8         // Holes kept for eeg_dec_nack()
+
+/* eeg_dec_block.status */
+#define EEG_DEC_BLOCK_SAMPLES   0x01      // Data or log block, samples valid
+#define EEG_DEC_BLOCK_RECOVERED 0x02      // Filled a hole, arrived late or retransmitted
+#define EEG_DEC_BLOCK_TIMED     0x04      // t_us and frame_us from the clock exchange
+#define EEG_DEC_BLOCK_LEGACY    0x08      // Headerless payload, sequence made up here
+
+struct eeg_dec;
+
+struct eeg_dec_config {
+	/*
+	 * Newer packets a hole is waited for before it is given up on, up to
+	 * EEG_DEC_REORDER_MAX; 1 gives up at once (bulk download). Default
+	 * EEG_DEC_REORDER_DEFAULT.
+	 */
+	uint16_t reorder_window;
+	/*
+	 * Largest packet accepted, in frames, 1..255: log blocks need 255.
+	 * Default EEG_DEC_FRAMES_DEFAULT.
+	 */
+	uint16_t max_frames;
+	/* Channels in a headerless frame from pre-header firmware, 0 = none */
+	uint8_t legacy_channels;
+};
+
+/* One decoded packet; every pointer is a view, see above */
+struct eeg_dec_block {
+	const int32_t *samples;     // channels rows of frames samples, channel c at c * frames
+	const uint8_t *raw;         // The packet as received
+	int64_t t_us;               // Central time of the first frame
+	double frame_us;            // Time between frames, 0 if not timed
+	uint32_t raw_len;
+	uint16_t seq;
+	uint16_t frames;            // 0 for packets without samples
+	uint16_t lost_before;       // Data packets given up on just before this one
+	uint8_t type;               // EEG_PKT_TYPE_*
+	uint8_t version;
+	uint8_t flags;              // EEG_PKT_FLAG_*, the sticker's status bits
+	uint8_t chan_mask;
+	uint8_t channels;
+	uint8_t status;             // EEG_DEC_BLOCK_*
+};
+
+struct eeg_dec_stats {
+	uint64_t payloads;          // Pushed
+	uint64_t packets;           // Data and log blocks decoded
+	uint64_t samples;           // In the blocks handed out
+	uint64_t lost;              // Data packets given up on
+	uint64_t recovered;         // Holes filled later
+	uint64_t duplicates;        // Already handed out or given up on
+	uint64_t passed;            // Packets without samples passed through
+	uint64_t malformed;         // Too short, too many frames or bad log coding
+	uint64_t unsupported;       // Unknown format version
+	uint64_t overflow;          // Dropped, more than EEG_DEC_BURST packets in one payload
+};
+
+EEG_DEC_API uint32_t eeg_dec_abi_version(void);
+
+/* eeg_codec.h unpacker the library was built with ("avx2", "scalar", ...) */
+EEG_DEC_API const char *eeg_dec_codec(void);
+
+/* cfg NULL or zero fields for the defaults. Returns NULL on a bad config or no memory */
+EEG_DEC_API struct eeg_dec *eeg_dec_create(const struct eeg_dec_config *cfg);
+EEG_DEC_API void eeg_dec_destroy(struct eeg_dec *dec);
+
+/* Forget the stream and the clock, e.g. on a new connection. Keeps the stats */
+EEG_DEC_API void eeg_dec_reset(struct eeg_dec *dec);
+
+/*
+ * Decode one payload received at rx_us (central clock). Returns the number
+ * of blocks now ready for eeg_dec_next(); blocks not taken before the next
+ * push are dropped.
+ */
+EEG_DEC_API int eeg_dec_push(struct eeg_dec *dec, const uint8_t *data, size_t len,
+			     int64_t rx_us);
+
+/* Give up on every hole and make all waiting packets ready, e.g. at the end */
+EEG_DEC_API int eeg_dec_flush(struct eeg_dec *dec);
+
+/* Next ready block in order, NULL when there is none */
+EEG_DEC_API const struct eeg_dec_block *eeg_dec_next(struct eeg_dec *dec);
+
+/*
+ * EEG_CTRL_NACK TLV for the holes seen since the last call, for the NUS RX
+ * characteristic. Returns its length, 0 if there is nothing to ask for or
+ * cap is too small (the holes are then kept).
+ */
+EEG_DEC_API size_t eeg_dec_nack(struct eeg_dec *dec, uint8_t *buf, size_t cap);
+
+/*
+ * Clock characteristic exchange: the request to write, sent at t1_us
+ * (returns its length, 0 if cap is too small), and a response notification
+ * received at t4_us (returns 0, or -1 if it answers no pending request).
+ */
+EEG_DEC_API size_t eeg_dec_clock_request(struct eeg_dec *dec, uint8_t *buf, size_t cap,
+					 int64_t t1_us);
+EEG_DEC_API int eeg_dec_clock_response(struct eeg_dec *dec, const uint8_t *data, size_t len,
+				       int64_t t4_us);
+
+EEG_DEC_API void eeg_dec_stats_get(const struct eeg_dec *dec, struct eeg_dec_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEG_DECODER_H_ */
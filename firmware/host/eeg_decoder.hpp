@@ -0,0 +1,286 @@
+/*
+ * ANA EEG sticker - streaming packet decoder, C++ API
+ *
+ * Header-only C++17 wrapper over the C ABI in eeg_decoder.h, so C++ tools
+ * and the Dart binding share one library and one behaviour:
+ *
+ *   eeg::decoder dec;
+ *
+ *   dec.push(payload, rx_us, [](const eeg::block_view &b) {
+ *           for (size_t c = 0; c < b.channels(); c++) {
+ *                   eeg::span<const int32_t> x = b.channel(c);
+ *                   ...
+ *           }
+ *   });
+ *
+ * eeg::span is std::span where the standard library has it, else a minimal
+ * stand-in with the same members used here.
+ */
+
+#ifndef EEG_DECODER_HPP_
+#define EEG_DECODER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <utility>
+
+#if defined(__has_include)
+#if __has_include(<version>)
+#include <version>
+#endif
+#endif
+#if defined(__cpp_lib_span)
+#include <span>
+#endif
+
+#include "eeg_decoder.h"
+
+namespace eeg
+{
+
+#if defined(__cpp_lib_span)
+
+template <class T> using span = std::span<T>;
+
+#else
+
+template <class T> class span
+{
+public:
+	using element_type = T;
+	using size_type = std::size_t;
+	using iterator = T *;
+
+	constexpr span() noexcept = default;
+	constexpr span(T *data, size_type size) noexcept : data_(data), size_(size)
+	{
+	}
+	template <std::size_t N> constexpr span(T (&arr)[N]) noexcept : data_(arr), size_(N)
+	{
+	}
+
+	constexpr T *data() const noexcept
+	{
+		return data_;
+	}
+	constexpr size_type size() const noexcept
+	{
+		return size_;
+	}
+	constexpr size_type size_bytes() const noexcept
+	{
+		return size_ * sizeof(T);
+	}
+	constexpr bool empty() const noexcept
+	{
+		return size_ == 0;
+	}
+	constexpr T &operator[](size_type i) const noexcept
+	{
+		return data_[i];
+	}
+	constexpr iterator begin() const noexcept
+	{
+		return data_;
+	}
+	constexpr iterator end() const noexcept
+	{
+		return data_ + size_;
+	}
+	constexpr span subspan(size_type offset, size_type count) const noexcept
+	{
+		return span(data_ + offset, count);
+	}
+
+private:
+	T *data_ = nullptr;
+	size_type size_ = 0;
+};
+
+#endif /* __cpp_lib_span */
+
+/* One decoded packet, valid until the decoder's next push, flush or reset */
+class block_view
+{
+public:
+	explicit block_view(const eeg_dec_block &b) noexcept : b_(&b)
+	{
+	}
+
+	std::uint8_t type() const noexcept
+	{
+		return b_->type;
+	}
+	std::uint8_t version() const noexcept
+	{
+		return b_->version;
+	}
+	std::uint16_t seq() const noexcept
+	{
+		return b_->seq;
+	}
+	std::uint8_t flags() const noexcept
+	{
+		return b_->flags;
+	}
+	std::uint8_t chan_mask() const noexcept
+	{
+		return b_->chan_mask;
+	}
+	std::uint8_t status() const noexcept
+	{
+		return b_->status;
+	}
+	bool has_samples() const noexcept
+	{
+		return b_->status & EEG_DEC_BLOCK_SAMPLES;
+	}
+	std::uint16_t lost_before() const noexcept
+	{
+		return b_->lost_before;
+	}
+	std::size_t frames() const noexcept
+	{
+		return b_->frames;
+	}
+	std::size_t channels() const noexcept
+	{
+		return b_->channels;
+	}
+
+	/* Samples of the c-th channel in the mask, one per frame */
+	span<const std::int32_t> channel(std::size_t c) const noexcept
+	{
+		return span<const std::int32_t>(b_->samples + c * b_->frames, b_->frames);
+	}
+
+	/* All channels, channel after channel */
+	span<const std::int32_t> samples() const noexcept
+	{
+		return span<const std::int32_t>(b_->samples, std::size_t(b_->frames) * b_->channels);
+	}
+
+	span<const std::uint8_t> raw() const noexcept
+	{
+		return span<const std::uint8_t>(b_->raw, b_->raw_len);
+	}
+
+	/* Central time of frame f, the receive time if the block is not timed */
+	std::int64_t time_us(std::size_t f) const noexcept
+	{
+		return b_->t_us + static_cast<std::int64_t>(f * b_->frame_us + 0.5);
+	}
+
+	const eeg_dec_block &c_block() const noexcept
+	{
+		return *b_;
+	}
+
+private:
+	const eeg_dec_block *b_;
+};
+
+class decoder
+{
+public:
+	/* Throws std::bad_alloc if the decoder cannot be made */
+	explicit decoder(const eeg_dec_config &cfg = eeg_dec_config{})
+		: dec_(eeg_dec_create(&cfg))
+	{
+		if (!dec_) {
+			throw std::bad_alloc();
+		}
+	}
+	~decoder()
+	{
+		eeg_dec_destroy(dec_);
+	}
+
+	decoder(const decoder &) = delete;
+	decoder &operator=(const decoder &) = delete;
+	decoder(decoder &&other) noexcept : dec_(std::exchange(other.dec_, nullptr))
+	{
+	}
+	decoder &operator=(decoder &&other) noexcept
+	{
+		std::swap(dec_, other.dec_);
+		return *this;
+	}
+
+	/* Returns the number of blocks ready for next() */
+	int push(span<const std::uint8_t> payload, std::int64_t rx_us) noexcept
+	{
+		return eeg_dec_push(dec_, payload.data(), payload.size(), rx_us);
+	}
+
+	/* Pushes and calls f(const block_view &) for every block made ready */
+	template <class F> int push(span<const std::uint8_t> payload, std::int64_t rx_us, F &&f)
+	{
+		int n = push(payload, rx_us);
+
+		drain(f);
+		return n;
+	}
+
+	int flush() noexcept
+	{
+		return eeg_dec_flush(dec_);
+	}
+
+	template <class F> void drain(F &&f)
+	{
+		for (const eeg_dec_block *b; (b = eeg_dec_next(dec_)) != nullptr;) {
+			f(block_view(*b));
+		}
+	}
+
+	std::optional<block_view> next() noexcept
+	{
+		const eeg_dec_block *b = eeg_dec_next(dec_);
+
+		return b ? std::optional<block_view>(block_view(*b)) : std::nullopt;
+	}
+
+	void reset() noexcept
+	{
+		eeg_dec_reset(dec_);
+	}
+
+	/* NACK TLV for the holes seen since the last call, empty if none */
+	span<std::uint8_t> nack(span<std::uint8_t> buf) noexcept
+	{
+		return buf.subspan(0, eeg_dec_nack(dec_, buf.data(), buf.size()));
+	}
+
+	span<std::uint8_t> clock_request(span<std::uint8_t> buf, std::int64_t t1_us) noexcept
+	{
+		return buf.subspan(0, eeg_dec_clock_request(dec_, buf.data(), buf.size(), t1_us));
+	}
+
+	bool clock_response(span<const std::uint8_t> resp, std::int64_t t4_us) noexcept
+	{
+		return eeg_dec_clock_response(dec_, resp.data(), resp.size(), t4_us) == 0;
+	}
+
+	eeg_dec_stats stats() const noexcept
+	{
+		eeg_dec_stats s;
+
+		eeg_dec_stats_get(dec_, &s);
+		return s;
+	}
+
+	eeg_dec *handle() const noexcept
+	{
+		return dec_;
+	}
+
+private:
+	eeg_dec *dec_;
+};
+
+} // namespace eeg
+
+#endif /* EEG_DECODER_HPP_ */
@@ -0,0 +1,194 @@
+/*
+ * ANA EEG sticker - pre-filter cascade check
+ *
+ * Runs CONFIG_EEG_FILTER's cascade as the sticker does (filter.c): q31
+ * biquads from eeg_biquad.h, 1 Hz high-pass and 45 Hz low-pass (Q 0.7071)
+ * and 50 Hz notch (Q 30), 24-bit samples shifted up by 7 bits, in packet
+ * sized blocks, rounded and clamped back to 24 bits. Compares it with the
+ * app's double precision RBJ cascade (analyzer_dart.dart _Biquad) on the
+ * same input: 60 s of electrode offset, 10 Hz alpha, 50 Hz mains and
+ * noise, peaks up to full scale, and an offset step half way through.
+ *
+ * Tolerance: every output sample within TOLERANCE_LSB (2) 24-bit codes of
+ * the rounded double output at 250, 500 and 1000 SPS. Above 1 kSPS the q31
+ * pole resolution near z = 1 moves the 1 Hz corner and the bound no longer
+ * holds (see filter.h), so higher rates are reported but not checked.
+ * Exits non-zero if the bound is exceeded.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <eeg_biquad.h>
+
+#define TOLERANCE_LSB           2
+#define DURATION_S              60
+#define FRAMES                  10          // Samples per packet and channel
+#define STAGES                  3
+#define SHIFT                   7           // As filter.c FILTER_SHIFT
+#define SAMPLE_MAX              ((1 << 23) - 1)
+#define SAMPLE_MIN              (-(1 << 23))
+#define Q_BUTTERWORTH           0.7071
+#define Q_NOTCH                 30.0
+
+struct rate {
+	unsigned int sps;
+	int checked;
+};
+
+static const struct rate rates[] = {
+	{250, 1}, {500, 1}, {1000, 1}, {2000, 0}, {16000, 0},
+};
+
+#define RATES                   (sizeof(rates) / sizeof(rates[0]))
+
+/* The app's _Biquad: direct form I, coefficients normalized on every call */
+struct dbiquad {
+	double b0, b1, b2, a0, a1, a2;
+	double x1, x2, y1, y2;
+};
+
+static void dbiquad_design(struct dbiquad *bq, enum eeg_biquad_type type, double fs,
+			   double f0, double q)
+{
+	const double w0 = 2.0 * EEG_BIQUAD_PI * f0 / fs;
+	const double cw = cos(w0);
+	const double alpha = sin(w0) / (2.0 * q);
+
+	switch (type) {
+	case EEG_BIQUAD_LOWPASS:
+		bq->b0 = (1.0 - cw) / 2.0;
+		bq->b1 = 1.0 - cw;
+		bq->b2 = bq->b0;
+		break;
+	case EEG_BIQUAD_HIGHPASS:
+		bq->b0 = (1.0 + cw) / 2.0;
+		bq->b1 = -(1.0 + cw);
+		bq->b2 = bq->b0;
+		break;
+	case EEG_BIQUAD_NOTCH:
+	default:
+		bq->b0 = 1.0;
+		bq->b1 = -2.0 * cw;
+		bq->b2 = 1.0;
+		break;
+	}
+	bq->a0 = 1.0 + alpha;
+	bq->a1 = -2.0 * cw;
+	bq->a2 = 1.0 - alpha;
+	bq->x1 = bq->x2 = bq->y1 = bq->y2 = 0.0;
+}
+
+static double dbiquad_run(struct dbiquad *bq, double x)
+{
+	double y = (bq->b0 / bq->a0) * x + (bq->b1 / bq->a0) * bq->x1 +
+		   (bq->b2 / bq->a0) * bq->x2 - (bq->a1 / bq->a0) * bq->y1 -
+		   (bq->a2 / bq->a0) * bq->y2;
+
+	bq->x2 = bq->x1;
+	bq->x1 = x;
+	bq->y2 = bq->y1;
+	bq->y1 = y;
+
+	return y;
+}
+
+static double noise(unsigned int *seed)
+{
+	*seed = *seed * 1103515245U + 12345U;
+	return (double)((*seed >> 8) & 0xFFFF) / 32768.0 - 1.0;
+}
+
+/* Peaks at 0.95 of full scale before and after the step */
+static int32_t input(unsigned int i, unsigned int sps, unsigned int *seed)
+{
+	const double t = (double)i / sps;
+	const double fs = (double)SAMPLE_MAX;
+	double offset = (i < DURATION_S * sps / 2) ? 0.5 : -0.4;
+	double v;
+
+	v = offset + 0.2 * sin(2.0 * EEG_BIQUAD_PI * 10.0 * t) +
+	    0.2 * sin(2.0 * EEG_BIQUAD_PI * 50.0 * t) + 0.05 * noise(seed);
+
+	return (int32_t)lround(v * fs);
+}
+
+static int32_t clamp24(int64_t v)
+{
+	return (int32_t)((v > SAMPLE_MAX) ? SAMPLE_MAX : ((v < SAMPLE_MIN) ? SAMPLE_MIN : v));
+}
+
+/* Largest difference in 24-bit codes over the run */
+static long run(unsigned int sps, unsigned int *at)
+{
+	int32_t coeffs[STAGES * EEG_BIQUAD_COEFFS];
+	int64_t state[STAGES * EEG_BIQUAD_STATE];
+	struct eeg_biquad_cas cas;
+	struct dbiquad ref[STAGES];
+	int32_t in[FRAMES], block[FRAMES];
+	unsigned int seed = 1;
+	long worst = 0;
+
+	eeg_biquad_design(&coeffs[0], EEG_BIQUAD_HIGHPASS, sps, 1.0, Q_BUTTERWORTH);
+	eeg_biquad_design(&coeffs[EEG_BIQUAD_COEFFS], EEG_BIQUAD_LOWPASS, sps, 45.0,
+			  Q_BUTTERWORTH);
+	eeg_biquad_design(&coeffs[2 * EEG_BIQUAD_COEFFS], EEG_BIQUAD_NOTCH, sps, 50.0, Q_NOTCH);
+	eeg_biquad_init(&cas, STAGES, coeffs, state);
+
+	dbiquad_design(&ref[0], EEG_BIQUAD_HIGHPASS, sps, 1.0, Q_BUTTERWORTH);
+	dbiquad_design(&ref[1], EEG_BIQUAD_LOWPASS, sps, 45.0, Q_BUTTERWORTH);
+	dbiquad_design(&ref[2], EEG_BIQUAD_NOTCH, sps, 50.0, Q_NOTCH);
+
+	*at = 0;
+	for (unsigned int i = 0; i < DURATION_S * sps; i += FRAMES) {
+		for (unsigned int k = 0; k < FRAMES; k++) {
+			in[k] = input(i + k, sps, &seed);
+			block[k] = (int32_t)((uint32_t)in[k] << SHIFT);
+		}
+
+		eeg_biquad_run(&cas, block, block, FRAMES);
+
+		for (unsigned int k = 0; k < FRAMES; k++) {
+			int32_t got = clamp24(((block[k] >> (SHIFT - 1)) + 1) >> 1);
+			double y = in[k];
+			long d;
+
+			for (unsigned int s = 0; s < STAGES; s++) {
+				y = dbiquad_run(&ref[s], y);
+			}
+
+			d = labs((long)got - (long)clamp24(llround(y)));
+			if (d > worst) {
+				worst = d;
+				*at = i + k;
+			}
+		}
+	}
+
+	return worst;
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	printf("%-8s %12s %10s %s\n", "SPS", "max |diff|", "at s", "");
+	for (size_t r = 0; r < RATES; r++) {
+		unsigned int at;
+		long worst = run(rates[r].sps, &at);
+		const char *verdict = "-";
+
+		if (rates[r].checked) {
+			verdict = (worst <= TOLERANCE_LSB) ? "ok" : "FAIL";
+			failed |= (worst > TOLERANCE_LSB);
+		}
+
+		printf("%-8u %9ld LSB %10.3f %s\n", rates[r].sps, worst,
+		       (double)at / rates[r].sps, verdict);
+	}
+
+	printf("tolerance %d LSB up to 1000 SPS\n", TOLERANCE_LSB);
+
+	return failed;
+}
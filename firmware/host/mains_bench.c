@@ -0,0 +1,406 @@
+/*
+ * ANA EEG sticker - mains canceller benchmark
+ *
+ * Runs the adaptive mains canceller (eeg_mains.h) and the static 50 Hz
+ * notch of the app and CONFIG_EEG_FILTER (eeg_biquad.h, Q 30) over the same
+ * samples, in packet sized blocks as on the sticker, and reports for each:
+ *
+ *  - mains: change of the power within 1 Hz of the mains fundamental and
+ *    its harmonics below Nyquist (Welch estimate, eeg_fft.h)
+ *  - eeg: change of the power in 1-45 Hz outside those bands, how much of
+ *    the EEG the method takes with it
+ *  - residual: for synthetic input, power of (output - clean EEG) relative
+ *    to the injected interference
+ *  - ns and cycles per sample on this machine
+ *
+ * The first SETTLE_S seconds are left out of the power figures so both
+ * methods are measured converged.
+ *
+ * Usage: mains_bench                 synthetic 50 / 60 Hz at 250-1000 SPS
+ *        mains_bench [-r sps] file   a recording saved by the app
+ *                                    (timestamp_utc,ch1,ch2,ch3,ch4 counts)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include <eeg_biquad.h>
+#include <eeg_fft.h>
+#include <eeg_mains.h>
+
+#define SHIFT                   7       // As the sticker's pre-filter
+#define BLOCK                   10      // Frames per packet
+#define SETTLE_S                5
+#define REPS                    5
+#define SYNTH_S                 60
+#define CHANNELS                4
+#define UV_PER_LSB              (4.5e6 / 24 / 8388608.0)
+
+#define NOTCH_HZ                50
+#define NOTCH_Q                 30.0
+#define MAINS_HARMONICS         4
+#define MAINS_TAU_MS            1000
+#define MAINS_DETECT_MS         2000
+
+enum method {
+	METHOD_NOTCH,
+	METHOD_ADAPTIVE,
+	METHODS
+};
+
+static const char *const method_name[METHODS] = {"notch 50 Hz", "adaptive"};
+
+struct result {
+	double mains_db;
+	double eeg_db;
+	double residual_db;     // NAN without a clean reference
+	double ns;
+	double cycles;
+	unsigned int locked_hz;
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long long cycles(void)
+{
+#if defined(HAVE_TSC)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static unsigned int run_notch(const int32_t *x, int32_t *y, size_t n, uint16_t fs)
+{
+	int32_t coeffs[EEG_BIQUAD_COEFFS];
+	int64_t state[EEG_BIQUAD_STATE];
+	struct eeg_biquad_cas cas;
+
+	eeg_biquad_design(coeffs, EEG_BIQUAD_NOTCH, fs, NOTCH_HZ, NOTCH_Q);
+	eeg_biquad_init(&cas, 1, coeffs, state);
+
+	for (size_t i = 0; i < n; i += BLOCK) {
+		eeg_biquad_run(&cas, &x[i], &y[i], (n - i < BLOCK) ? n - i : BLOCK);
+	}
+
+	return NOTCH_HZ;
+}
+
+static unsigned int run_adaptive(const int32_t *x, int32_t *y, size_t n, uint16_t fs)
+{
+	struct eeg_mains mains;
+
+	eeg_mains_init(&mains, fs, 0, MAINS_HARMONICS, MAINS_TAU_MS, MAINS_DETECT_MS);
+
+	for (size_t i = 0; i < n; i += BLOCK) {
+		eeg_mains_run(&mains, &x[i], &y[i], (n - i < BLOCK) ? n - i : BLOCK);
+	}
+
+	return eeg_mains_hz(&mains);
+}
+
+/* One pass of a method over a whole channel, returns the mains it removed */
+static unsigned int run(enum method method, const int32_t *x, int32_t *y, size_t n,
+			uint16_t fs)
+{
+	return (method == METHOD_NOTCH) ? run_notch(x, y, n, fs) : run_adaptive(x, y, n, fs);
+}
+
+/* Welch PSD in counts^2 per bin, Hann, 50 % overlap, 1 Hz bins or finer */
+static uint16_t welch(const int32_t *x, size_t n, uint16_t fs, double *psd)
+{
+	uint16_t len = 1;
+	int32_t *buf, *tw, *seg;
+	int16_t *win;
+	unsigned int segments = 0;
+
+	while (len < fs) {
+		len <<= 1;
+	}
+
+	buf = malloc(2 * len * sizeof(*buf));
+	tw = malloc(len * sizeof(*tw));
+	seg = malloc(len * sizeof(*seg));
+	win = malloc(len * sizeof(*win));
+	eeg_fft_twiddles(tw, len);
+	eeg_fft_hann(win, len);
+	memset(psd, 0, (len / 2) * sizeof(*psd));
+
+	for (size_t start = 0; start + len <= n; start += len / 2) {
+		int shift;
+
+		for (uint16_t i = 0; i < len; i++) {
+			seg[i] = x[start + i] >> SHIFT;
+		}
+		shift = eeg_fft_load(buf, seg, win, len);
+		eeg_fft_q31(buf, tw, len);
+		for (uint16_t k = 0; k < len / 2; k++) {
+			psd[k] += eeg_fft_band_power(buf, k, k + 1, shift);
+		}
+		segments++;
+	}
+
+	for (uint16_t k = 0; k < len / 2 && segments; k++) {
+		psd[k] /= segments;
+	}
+
+	free(buf);
+	free(tw);
+	free(seg);
+	free(win);
+
+	return len;
+}
+
+static bool near_mains(double f, unsigned int mains_hz, uint16_t fs)
+{
+	for (unsigned int h = 1; h * mains_hz < fs / 2.0; h++) {
+		if (fabs(f - h * mains_hz) <= 1.0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Power near the mains harmonics and in the EEG band outside them */
+static void band_powers(const int32_t *x, size_t n, uint16_t fs, unsigned int mains_hz,
+			double *mains, double *eeg)
+{
+	double *psd = malloc((fs + 1) * sizeof(*psd));
+	uint16_t len = welch(x, n, fs, psd);
+
+	*mains = 0.0;
+	*eeg = 0.0;
+	for (uint16_t k = 1; k < len / 2; k++) {
+		double f = (double)k * fs / len;
+
+		if (near_mains(f, mains_hz, fs)) {
+			*mains += psd[k];
+		} else if (f >= 1.0 && f <= 45.0) {
+			*eeg += psd[k];
+		}
+	}
+
+	free(psd);
+}
+
+static void measure(const int32_t *x, const int32_t *clean, const double *interference,
+		    size_t n, uint16_t fs, unsigned int mains_hz, struct result *res)
+{
+	const size_t skip = (size_t)SETTLE_S * fs;
+	int32_t *y = malloc(n * sizeof(*y));
+	double in_mains, in_eeg;
+
+	band_powers(&x[skip], n - skip, fs, mains_hz, &in_mains, &in_eeg);
+
+	for (int m = 0; m < METHODS; m++) {
+		double best_ns = INFINITY, best_cyc = INFINITY;
+		double out_mains, out_eeg;
+
+		for (int rep = 0; rep < REPS; rep++) {
+			double t0 = now_ns();
+			unsigned long long c0 = cycles();
+
+			res[m].locked_hz = run((enum method)m, x, y, n, fs);
+			best_cyc = fmin(best_cyc, (double)(cycles() - c0) / n);
+			best_ns = fmin(best_ns, (now_ns() - t0) / n);
+		}
+
+		band_powers(&y[skip], n - skip, fs, mains_hz, &out_mains, &out_eeg);
+		res[m].ns = best_ns;
+		res[m].cycles = best_cyc;
+		res[m].mains_db = 10.0 * log10(out_mains / in_mains);
+		res[m].eeg_db = 10.0 * log10(out_eeg / in_eeg);
+		res[m].residual_db = NAN;
+
+		if (clean) {
+			double err = 0.0, ref = 0.0;
+
+			for (size_t i = skip; i < n; i++) {
+				double d = (double)(y[i] - clean[i]) / (1 << SHIFT);
+
+				err += d * d;
+				ref += interference[i] * interference[i];
+			}
+			res[m].residual_db = 10.0 * log10(err / ref);
+		}
+	}
+
+	free(y);
+}
+
+static void print_header(const char *what)
+{
+	printf("%-12s %-12s %6s %8s %8s %9s %8s %8s\n", what, "method", "locked",
+	       "mains dB", "eeg dB", "resid dB", "ns/smp", "cyc/smp");
+}
+
+static void print_results(const char *what, const struct result *res)
+{
+	for (int m = 0; m < METHODS; m++) {
+		printf("%-12s %-12s %6u %8.1f %8.2f %9.1f %8.1f %8.0f\n", what,
+		       method_name[m], res[m].locked_hz, res[m].mains_db, res[m].eeg_db,
+		       res[m].residual_db, res[m].ns, res[m].cycles);
+	}
+}
+
+static double gauss(unsigned int *seed)
+{
+	double u = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+
+	return sqrt(-2.0 * log(u)) * cos(2.0 * EEG_FFT_PI * v);
+}
+
+/*
+ * 20 uV alpha plus 1/f-ish background, and mains 0.1 Hz off nominal and
+ * drifting, with harmonics at 20 % and 10 % where the ADS1299's decimation
+ * filter lets them through (below Nyquist).
+ */
+static void synthetic(uint16_t fs, unsigned int mains_hz)
+{
+	const size_t n = (size_t)SYNTH_S * fs;
+	int32_t *x = malloc(n * sizeof(*x));
+	int32_t *clean = malloc(n * sizeof(*clean));
+	double *interference = malloc(n * sizeof(*interference));
+	struct result res[METHODS];
+	unsigned int seed = 1;
+	double brown = 0.0, phase = 0.0;
+	char what[16];
+
+	for (size_t i = 0; i < n; i++) {
+		double t = (double)i / fs;
+		double f = mains_hz + 0.1 + 0.05 * sin(2.0 * EEG_FFT_PI * t / SYNTH_S);
+		double amp = 200.0 * (1.0 + 0.1 * sin(2.0 * EEG_FFT_PI * t / 20.0));
+		double eeg, mains = 0.0;
+
+		brown = 0.995 * brown + gauss(&seed);
+		eeg = 20.0 * sin(2.0 * EEG_FFT_PI * 10.0 * t) + 1.0 * brown + gauss(&seed);
+
+		phase += 2.0 * EEG_FFT_PI * f / fs;
+		for (unsigned int h = 1; h <= 3 && h * f < fs / 2.0; h++) {
+			mains += amp * (h == 1 ? 1.0 : (h == 2 ? 0.2 : 0.1)) * cos(h * phase + h);
+		}
+
+		clean[i] = (int32_t)lround(eeg / UV_PER_LSB) << SHIFT;
+		x[i] = (int32_t)lround((eeg + mains) / UV_PER_LSB) << SHIFT;
+		interference[i] = mains / UV_PER_LSB;
+	}
+
+	snprintf(what, sizeof(what), "%u/%u Hz", fs, mains_hz);
+	measure(x, clean, interference, n, fs, mains_hz, res);
+	print_results(what, res);
+
+	free(x);
+	free(clean);
+	free(interference);
+}
+
+static int recording(const char *path, uint16_t fs)
+{
+	FILE *f = fopen(path, "r");
+	int32_t *ch[CHANNELS] = {0};
+	size_t n = 0, cap = 0;
+	char line[512];
+
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		char *p = strchr(line, ',');
+		double v[CHANNELS];
+		int got = 0;
+
+		/* Header, or anything else that does not parse */
+		while (p && got < CHANNELS) {
+			char *end;
+
+			v[got] = strtod(p + 1, &end);
+			if (end == p + 1) {
+				break;
+			}
+			got++;
+			p = strchr(end, ',');
+		}
+		if (got < CHANNELS) {
+			continue;
+		}
+
+		if (n == cap) {
+			cap = cap ? 2 * cap : 65536;
+			for (int c = 0; c < CHANNELS; c++) {
+				ch[c] = realloc(ch[c], cap * sizeof(*ch[c]));
+			}
+		}
+		for (int c = 0; c < CHANNELS; c++) {
+			ch[c][n] = (int32_t)lround(v[c]) << SHIFT;
+		}
+		n++;
+	}
+	fclose(f);
+
+	if (n < (size_t)(SETTLE_S + 2) * fs) {
+		fprintf(stderr, "%s: %zu samples, need at least %d s\n", path, n, SETTLE_S + 2);
+		return 1;
+	}
+
+	printf("%s: %zu samples at %u SPS\n", path, n, fs);
+	print_header("channel");
+	for (int c = 0; c < CHANNELS; c++) {
+		struct result res[METHODS];
+		int32_t *y = malloc(n * sizeof(*y));
+		unsigned int hz = run(METHOD_ADAPTIVE, ch[c], y, n, fs);
+		char what[16];
+
+		/* Without a reference, judge both at what the canceller locked to */
+		snprintf(what, sizeof(what), "ch%d", c + 1);
+		measure(ch[c], NULL, NULL, n, fs, hz ? hz : NOTCH_HZ, res);
+		print_results(what, res);
+		free(y);
+		free(ch[c]);
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const uint16_t rates[] = {250, 500, 1000};
+	uint16_t fs = 250;
+	int i = 1;
+
+	if (i + 1 < argc && !strcmp(argv[i], "-r")) {
+		fs = (uint16_t)atoi(argv[i + 1]);
+		i += 2;
+	}
+	if (i < argc) {
+		return recording(argv[i], fs);
+	}
+
+	print_header("rate/mains");
+	for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+		synthetic(rates[r], 50);
+		synthetic(rates[r], 60);
+	}
+
+	return 0;
+}
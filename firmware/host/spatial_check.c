@@ -0,0 +1,151 @@
+/*
+ * ANA EEG sticker - spatial filter check
+ *
+ * Runs the Cortex-M DSP path of eeg_spatial_apply() on the host, with
+ * __pkhbt(), __smlad() and __smlald() emulated as the Arm ARM defines them,
+ * and compares it bit for bit with the portable int64 loop: the hi/lo split
+ * of every sample, the 256 hi + lo recombination and rounding, and the zero
+ * padding of the last pair for an odd number of inputs (the row's padding
+ * column is filled with garbage, it must not count). Frames are random
+ * 24-bit samples with both rails every so often; matrices the CAR and
+ * bipolar presets and random ones over the whole q14 range, for every
+ * n_in and n_out up to EEG_MAX_CHANNELS. Exits non-zero on a mismatch.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* ACLE DSP intrinsics, int16x2_t as int32_t */
+static inline uint32_t __pkhbt(int32_t a, int32_t b, unsigned int sh)
+{
+	return ((uint32_t)a & 0xFFFFU) | (((uint32_t)b << sh) & 0xFFFF0000U);
+}
+
+static inline int32_t __smlad(int32_t x, int32_t y, int32_t acc)
+{
+	int32_t p = (int16_t)x * (int16_t)y;
+	int32_t q = (int16_t)(x >> 16) * (int16_t)(y >> 16);
+
+	/* Wraps like the instruction, which only sets Q */
+	return (int32_t)((uint32_t)acc + (uint32_t)p + (uint32_t)q);
+}
+
+static inline int64_t __smlald(int32_t x, int32_t y, int64_t acc)
+{
+	return acc + (int64_t)((int16_t)x * (int16_t)y) +
+	       (int64_t)((int16_t)(x >> 16) * (int16_t)(y >> 16));
+}
+
+#define EEG_SPATIAL_DSP_EMULATED 1
+#include <eeg_spatial.h>
+
+#define FRAMES                  4096        // Per matrix
+#define RANDOM_MATRICES         64          // Per n_in, n_out
+
+#define MATRIX_LEN              (EEG_MAX_CHANNELS * EEG_SPATIAL_COLS)
+
+static uint32_t rng = 1;
+
+static uint32_t next(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+/* Full 24-bit range, both rails every so often */
+static void frames(int32_t *x, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		uint32_t h = next();
+
+		if ((h & 0xFF) == 0) {
+			x[i] = (h & 0x100) ? (1 << 23) - 1 : -(1 << 23);
+		} else {
+			x[i] = (int32_t)(h << 8) >> 8;
+		}
+	}
+}
+
+/* Every coefficient random, the extremes every so often, unused columns too */
+static void random_matrix(int16_t *m)
+{
+	for (size_t i = 0; i < MATRIX_LEN; i++) {
+		uint32_t h = next();
+
+		if ((h & 0xF) == 0) {
+			m[i] = (h & 0x10) ? INT16_MAX : INT16_MIN;
+		} else {
+			m[i] = (int16_t)(h >> 16);
+		}
+	}
+}
+
+/* Garbage beyond n_in, where the DSP path reads the last pair's padding */
+static void poison(int16_t *m, uint8_t n_out, uint8_t n_in)
+{
+	for (uint8_t r = 0; r < n_out; r++) {
+		for (uint8_t c = n_in; c < EEG_SPATIAL_COLS; c++) {
+			m[r * EEG_SPATIAL_COLS + c] = (int16_t)(next() | 1);
+		}
+	}
+}
+
+static int compare(const char *name, const int16_t *m, uint8_t n_out, uint8_t n_in)
+{
+	static int32_t x[FRAMES * EEG_MAX_CHANNELS];
+	static int32_t ref[FRAMES * EEG_MAX_CHANNELS];
+	static int32_t dsp[FRAMES * EEG_MAX_CHANNELS];
+
+	frames(x, (size_t)FRAMES * n_in);
+	eeg_spatial_apply_scalar(m, n_out, n_in, x, ref, FRAMES);
+	eeg_spatial_apply_dsp(m, n_out, n_in, x, dsp, FRAMES);
+
+	for (size_t i = 0; i < (size_t)FRAMES * n_out; i++) {
+		if (dsp[i] != ref[i]) {
+			printf("%s %u in, %u out: frame %zu row %zu: %d, not %d\n", name, n_in, n_out,
+			       i / n_out, i % n_out, dsp[i], ref[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	int16_t m[MATRIX_LEN];
+	unsigned int matrices = 0;
+	int failed = 0;
+
+	for (uint8_t n = 1; n <= EEG_MAX_CHANNELS; n++) {
+		uint8_t rows = eeg_spatial_car(m, n);
+
+		poison(m, rows, n);
+		failed |= compare("car", m, rows, n);
+		matrices++;
+
+		rows = eeg_spatial_bipolar(m, n);
+		if (rows > 0) {
+			poison(m, rows, n);
+			failed |= compare("bipolar", m, rows, n);
+			matrices++;
+		}
+	}
+
+	for (uint8_t n_in = 1; n_in <= EEG_MAX_CHANNELS; n_in++) {
+		for (uint8_t n_out = 1; n_out <= EEG_MAX_CHANNELS; n_out++) {
+			for (int k = 0; k < RANDOM_MATRICES; k++) {
+				random_matrix(m);
+				failed |= compare("random", m, n_out, n_in);
+				matrices++;
+			}
+		}
+	}
+
+	printf("%u matrices x %d frames: %s\n", matrices, FRAMES,
+	       failed ? "MISMATCH" : "DSP path bit-exact with the portable loop");
+
+	return failed;
+}
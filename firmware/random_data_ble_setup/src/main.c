@@ -34,6 +34,9 @@
 #include <zephyr/random/rand32.h>
 #include <zephyr/logging/log.h>
 
+/* No CMakeLists.txt of its own to add ../common with, include it directly */
+#include "../../common/eeg_codec.h"
+
 #define LOG_MODULE_NAME peripheral_uart
 LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 
@@ -95,18 +98,19 @@ fake eeg generator and sender
 --------------------------------------------*/
 static void send_fake_data(void){
 	uint8_t raw_data[EEG_CHANNELS*3];
+	int32_t fake[EEG_CHANNELS];
 	char eeg_str[20];
-	
+
 	for(int ch = 0; ch < EEG_CHANNELS; ch++){
 		//Fake EEG value range of +/- 500000(WHICH SHOULD BE THE SAME AS +/- 0.5mV with ads1299 scaling)
-		int32_t fake_val = (rand() % 1000000) - 500000;
-		//convert to 24-bit signed big edian
-		raw_data[ch*3 + 0] = (fake_val >> 16) & 0xFF;
-		raw_data[ch*3 + 1] = (fake_val >> 8) & 0xFF;
-		raw_data[ch*3 + 2] = fake_val & 0xFF;
-
+		fake[ch] = (rand() % 1000000) - 500000;
+	}
+	//convert to 24-bit signed big edian
+	eeg_codec_pack24(fake, raw_data, EEG_CHANNELS);
+	
+	for(int ch = 0; ch < EEG_CHANNELS; ch++){
 		//this makes it human readable for nrf app
-		snprintf(eeg_str, sizeof(eeg_str), "Channel %d:%ld", ch + 1, (long)fake_val);
+		snprintf(eeg_str, sizeof(eeg_str), "Channel %d:%ld", ch + 1, (long)fake[ch]);
 		if(current_conn) {
 			int err = bt_nus_send(current_conn, eeg_str, strlen(eeg_str));
 			/*if you wanted to send the raw binary data in one packet
@@ -119,6 +119,9 @@ struct eeg_item {
 };
 
 K_FIFO_DEFINE(ads_fifo);
+#define EEG_ITEM_COUNT 16   // frames queued between the SPI and BLE threads
+K_MEM_SLAB_DEFINE_STATIC(ads_slab, sizeof(struct eeg_item), EEG_ITEM_COUNT, 4);
+static atomic_t ads_item_failed;
 
 /* -------------------------------------------------------------------------- */
 /* Driver Data Structure                                                      */
@@ -136,6 +139,8 @@ struct ads1299_data {
 /* Semaphore for SPI thread to wait on DRDY */
 K_SEM_DEFINE(spi_sem, 0, 1);
 K_SEM_DEFINE(spi_start_sem, 0, 1); //sephamore that waits until current connection is true
+static K_EVENT_DEFINE(conn_events); //set by the connection callbacks, main sleeps on it
+#define CONN_EVT_CONNECTED BIT(0)
 const struct device *dev;
 static void drdy_isr(const struct device *dev,
                      struct gpio_callback *cb,
@@ -179,6 +184,58 @@ struct uart_data_t {
 static K_FIFO_DEFINE(fifo_uart_tx_data);
 static K_FIFO_DEFINE(fifo_uart_rx_data);
 
+/* UART payload buffers, fixed at link time instead of coming from the heap */
+K_MEM_SLAB_DEFINE_STATIC(uart_slab, sizeof(struct uart_data_t), CONFIG_BT_NUS_UART_BUFFER_COUNT, 4);
+static atomic_t uart_buf_failed;
+
+static struct uart_data_t *uart_buf_alloc(void)
+{
+	struct uart_data_t *buf;
+
+	if (k_mem_slab_alloc(&uart_slab, (void **)&buf, K_NO_WAIT)) {
+		atomic_inc(&uart_buf_failed);
+		return NULL;
+	}
+
+	return buf;
+}
+
+static void uart_buf_free(struct uart_data_t *buf)
+{
+	k_mem_slab_free(&uart_slab, buf);
+}
+
+#define POOL_REPORT_MS 10000 // failed allocations are logged at most this often
+
+/*
+ * Log both slabs when an allocation failed since the last report. Called from
+ * the threads that free them, so it costs no wakeup of its own.
+ */
+static void pool_report(void)
+{
+	static atomic_val_t ads_seen, uart_seen;
+	static int64_t reported_ms = -POOL_REPORT_MS;
+	atomic_val_t ads_failed = atomic_get(&ads_item_failed);
+	atomic_val_t uart_failed = atomic_get(&uart_buf_failed);
+	int64_t now = k_uptime_get();
+
+	if ((ads_failed == ads_seen && uart_failed == uart_seen) ||
+	    (now - reported_ms < POOL_REPORT_MS)) {
+		return;
+	}
+
+	ads_seen = ads_failed;
+	uart_seen = uart_failed;
+	reported_ms = now;
+
+	LOG_WRN("EEG frames: %ld failed, %u/%u used, peak %u",
+		(long)ads_failed, k_mem_slab_num_used_get(&ads_slab), EEG_ITEM_COUNT,
+		k_mem_slab_max_used_get(&ads_slab));
+	LOG_WRN("UART buffers: %ld failed, %u/%u used, peak %u",
+		(long)uart_failed, k_mem_slab_num_used_get(&uart_slab),
+		CONFIG_BT_NUS_UART_BUFFER_COUNT, k_mem_slab_max_used_get(&uart_slab));
+}
+
 static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
 	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
@@ -221,7 +278,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 					   data[0]);
 		}
 
-		k_free(buf);
+		uart_buf_free(buf);
 
 		buf = k_fifo_get(&fifo_uart_tx_data, K_NO_WAIT);
 		if (!buf) {
@@ -255,7 +312,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		LOG_DBG("UART_RX_DISABLED");
 		disable_req = false;
 
-		buf = k_malloc(sizeof(*buf));
+		buf = uart_buf_alloc();
 		if (buf) {
 			buf->len = 0;
 		} else {
@@ -271,7 +328,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 
 	case UART_RX_BUF_REQUEST:
 		LOG_DBG("UART_RX_BUF_REQUEST");
-		buf = k_malloc(sizeof(*buf));
+		buf = uart_buf_alloc();
 		if (buf) {
 			buf->len = 0;
 			uart_rx_buf_rsp(uart, buf->data, sizeof(buf->data));
@@ -289,7 +346,7 @@ static void uart_cb(const struct device *dev, struct uart_event *evt, void *user
 		if (buf->len > 0) {
 			k_fifo_put(&fifo_uart_rx_data, buf);
 		} else {
-			k_free(buf);
+			uart_buf_free(buf);
 		}
 
 		break;
@@ -318,7 +375,8 @@ static void uart_work_handler(struct k_work *item)
 {
 	struct uart_data_t *buf;
 
-	buf = k_malloc(sizeof(*buf));
+	buf = uart_buf_alloc();
+	pool_report();
 	if (buf) {
 		buf->len = 0;
 	} else {
@@ -357,7 +415,7 @@ static int uart_init(void)
 		}
 	}
 
-	rx = k_malloc(sizeof(*rx));
+	rx = uart_buf_alloc();
 	if (rx) {
 		rx->len = 0;
 	} else {
@@ -375,7 +433,7 @@ static int uart_init(void)
 
 	err = uart_callback_set(uart, uart_cb, NULL);
 	if (err) {
-		k_free(rx);
+		uart_buf_free(rx);
 		LOG_ERR("Cannot initialize UART callback");
 		return err;
 	}
@@ -403,29 +461,29 @@ static int uart_init(void)
 		}
 	}
 
-	tx = k_malloc(sizeof(*tx));
+	tx = uart_buf_alloc();
 
 	if (tx) {
 		pos = snprintf(tx->data, sizeof(tx->data),
 			       "Starting Nordic UART service example\r\n");
 
 		if ((pos < 0) || (pos >= sizeof(tx->data))) {
-			k_free(rx);
-			k_free(tx);
+			uart_buf_free(rx);
+			uart_buf_free(tx);
 			LOG_ERR("snprintf returned %d", pos);
 			return -ENOMEM;
 		}
 
 		tx->len = pos;
 	} else {
-		k_free(rx);
+		uart_buf_free(rx);
 		return -ENOMEM;
 	}
 
 	err = uart_tx(uart, tx->data, tx->len, SYS_FOREVER_MS);
 	if (err) {
-		k_free(rx);
-		k_free(tx);
+		uart_buf_free(rx);
+		uart_buf_free(tx);
 		LOG_ERR("Cannot display welcome message (err: %d)", err);
 		return err;
 	}
@@ -434,7 +492,7 @@ static int uart_init(void)
 	if (err) {
 		LOG_ERR("Cannot enable uart reception (err: %d)", err);
 		/* Free the rx buffer only because the tx buffer will be handled in the callback */
-		k_free(rx);
+		uart_buf_free(rx);
 	}
 
 	return err;
@@ -453,6 +511,7 @@ static void connected(struct bt_conn *conn, uint8_t err)
 	LOG_INF("Connected %s", addr);
 
 	current_conn = bt_conn_ref(conn);
+	k_event_post(&conn_events, CONN_EVT_CONNECTED);
 
 	dk_set_led_on(CON_STATUS_LED);
 }
@@ -473,6 +532,7 @@ static void disconnected(struct bt_conn *conn, uint8_t reason)
 	if (current_conn) {
 		bt_conn_unref(current_conn);
 		current_conn = NULL;
+		k_event_clear(&conn_events, CONN_EVT_CONNECTED);
 		dk_set_led_off(CON_STATUS_LED);
 	}
 }
@@ -581,7 +641,7 @@ static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data,
 	LOG_INF("Received data from: %s", addr);
 
 	for (uint16_t pos = 0; pos != len;) {
-		struct uart_data_t *tx = k_malloc(sizeof(*tx));
+		struct uart_data_t *tx = uart_buf_alloc();
 
 		if (!tx) {
 			LOG_WRN("Not able to allocate UART send data buffer");
@@ -921,14 +981,11 @@ int main(void)
        LOG_INF("Streaming of ADS Data started");
        ads1299_send_command(dev, _RDATAC);
 		printk("RDATAC COMMAND SENT\n");
-	   while(1){
-			if (current_conn) {
-				printk("current connection established\n");
-				
-    			k_sem_give(&spi_start_sem);
-				break;
-			}
-		}
+	//sleep (CPU idle) until the first central connects instead of spinning on current_conn
+	k_event_wait(&conn_events, CONN_EVT_CONNECTED, false, K_FOREVER);
+	printk("current connection established\n");
+	k_sem_give(&spi_start_sem);
+	return 0;
 }
 
 void ble_write_thread(void)
@@ -948,7 +1005,8 @@ void ble_write_thread(void)
         }
 
         /* Free the memory */
-        k_free(item);
+        k_mem_slab_free(&ads_slab, item);
+        pool_report();
     }
 }
 
@@ -982,8 +1040,9 @@ void spi_thread(void *p1, void *p2, void *p3)
 		}
         if (ret) { continue; }
 
-        struct eeg_item *item = k_malloc(sizeof(*item));
-        if (!item) {
+        struct eeg_item *item;
+        if (k_mem_slab_alloc(&ads_slab, (void **)&item, K_NO_WAIT)) {
+		atomic_inc(&ads_item_failed);
 		printk("Failed to allocate EEG item\n");
 		continue;
 	}
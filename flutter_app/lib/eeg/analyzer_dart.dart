@@ -99,10 +99,13 @@ double _meanSq(List<double> v) {
 }
 
 class MinuteAnalyzer {
-  MinuteAnalyzer({required this.fs, required this.channels});
+  MinuteAnalyzer({required this.fs, required this.channels, this.preFiltered = false});
 
   final int fs;
   final int channels;
+  /// Samples come from a sticker built with CONFIG_EEG_FILTER (packet flag
+  /// FILTERED), which runs the same pre-filter as q31 biquads.
+  final bool preFiltered;
 
   /// Analyze a 60s window and return per-minute scores & booleans.
   MinuteScores analyze(MinuteWindow w) {
@@ -122,7 +125,7 @@ class MinuteAnalyzer {
     final hp = _Biquad.highpass(fs.toDouble(), 1.0, 0.7071);
     final lp = _Biquad.lowpass(fs.toDouble(), 45.0, 0.7071);
     final notch50 = _Biquad.notch(fs.toDouble(), 50.0, 30.0); // Q=30 narrow
-    for (int c = 0; c < channels; c++) {
+    for (int c = 0; c < (preFiltered ? 0 : channels); c++) {
       for (int i = 0; i < n; i++) {
         var y = hp.process(x[c][i]);
         y = lp.process(y);
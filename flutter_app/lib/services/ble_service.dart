@@ -3,11 +3,17 @@
 // BLE + EEG minute analyzer (pure Dart), keeping your scanning/connecting/streaming.
 //
 // - Scans & connects to Nordic UART Service (NUS).
-// - Subscribes to TX notifications, parses 4× int16 (LE) per packet.
-// - Emits raw 4-ch samples via eegStream.
+// - Subscribes to TX notifications, parses sequence-numbered packets of
+//   24-bit samples (see docs/ble-protocol.md).
+// - NACKs lost packets and reorders retransmissions before emitting, in the
+//   native decoder (eeg_decoder_ffi.dart) when its library is shipped.
+// - Emits raw 4-ch samples via eegStream, and the same samples stamped on
+//   this phone's monotonic clock via sampleStream (see eeg_clock.dart).
 // - Buffers ~60s of samples, analyzes on-device, and exposes:
 //     focused$, stressed$, focusScore$, stressScore$,
 //     focusSeriesStream, stressSeriesStream.
+// - Reads the sticker's diagnostics on demand or once a second
+//   (readDiagnostics, diagnosticsStream, see eeg_diagnostics.dart).
 //
 // NOTE: Call connectDevice(...) after picking a device from scan(),
 //       and call disconnect() on teardown.
@@ -19,6 +25,11 @@ import 'dart:math' as math;
 import 'dart:typed_data';
 import 'package:flutter_blue_plus/flutter_blue_plus.dart';
 
+import '../eeg/eeg_models.dart';
+import 'eeg_clock.dart';
+import 'eeg_decoder_ffi.dart';
+import 'eeg_diagnostics.dart';
+
 /// ---------- Top-level helpers (must NOT be inside a class) ----------
 
 /// Simple Direct-Form I biquad filter.
@@ -109,6 +120,137 @@ double _meanSq(List<double> v) {
   return acc / v.length;
 }
 
+/// Samples recorded by the sticker while no phone was connected, downloaded
+/// from its flash log after reconnecting.
+class EegBacklogBlock {
+  EegBacklogBlock(this.seq, this.frames);
+  final int seq;                   // sequence number of the first packet
+  final List<List<double>> frames; // [frame][channel] raw counts
+}
+
+/// Sticker counters returned by [BLEService.queryCounters].
+class EegCounters {
+  EegCounters.fromPayload(List<int> p)
+      : packets = _u32(p, 0),
+        notifyFailed = _u32(p, 4),
+        retxRequested = _u32(p, 8),
+        retxSent = _u32(p, 12),
+        retxExpired = _u32(p, 16),
+        logWritten = _u32(p, 20),
+        logDrained = _u32(p, 24),
+        logDropped = _u32(p, 28),
+        ctrlDropped = _u32(p, 32),
+        bytes = _u32(p, 36),
+        txDone = _u32(p, 40),
+        latencyAvgUs = _u32(p, 44),
+        latencyMaxUs = _u32(p, 48);
+
+  final int packets;       // data packets produced
+  final int notifyFailed;  // live packets the sticker's BT stack refused
+  final int retxRequested;
+  final int retxSent;
+  final int retxExpired;
+  final int logWritten;    // offline log blocks written to flash
+  final int logDrained;    // offline log blocks sent on the bulk characteristic
+  final int logDropped;    // packets lost because the log fell behind
+  final int ctrlDropped;   // commands dropped by the sticker
+  final int bytes;         // live bytes handed to the sticker's BT stack
+  final int txDone;        // live packets confirmed sent
+  final int latencyAvgUs;  // packet complete -> sent, since boot
+  final int latencyMaxUs;
+
+  static int _u32(List<int> p, int o) =>
+      o + 4 <= p.length ? p[o] | (p[o + 1] << 8) | (p[o + 2] << 16) | (p[o + 3] << 24) : 0;
+}
+
+/// Band powers computed on the sticker (EEG_PKT_TYPE_BANDS), about once a
+/// second while [BLEService.setStreamMode] includes [BLEService.modeBands].
+class EegBandPowers {
+  EegBandPowers.fromPacket(List<int> raw, int nCh)
+      : seq = raw[2] | (raw[3] << 8),
+        mask = raw[4],
+        samplingHz = raw[6] | (raw[7] << 8),
+        fftLen = raw[8] | (raw[9] << 8),
+        segments = raw[10],
+        powers = List<List<double>>.generate(nCh, (c) {
+          final bd = ByteData.sublistView(Uint8List.fromList(raw));
+          return List<double>.generate(raw[5], (b) =>
+              bd.getFloat32(11 + (c * raw[5] + b) * 4, Endian.little));
+        });
+
+  final int seq;          // numbered apart from the data packets
+  final int mask;
+  final int samplingHz;
+  final int fftLen;       // Welch segment length
+  final int segments;     // segments averaged
+  final List<List<double>> powers; // [channel][delta, theta, alpha, beta, gamma], counts^2
+}
+
+/// Focus and stress scored on the sticker (EEG_PKT_TYPE_SCORES), every few
+/// seconds while [BLEService.setStreamMode] includes [BLEService.modeScores].
+/// Scores from while the phone was away arrive in a burst after reconnecting.
+class EegStickerScores {
+  EegStickerScores.fromPacket(List<int> p)
+      : seq = p[2] | (p[3] << 8),
+        mask = p[4],
+        dataSeq = p[6] | (p[7] << 8),
+        windowSec = p[8] | (p[9] << 8),
+        periodSec = p[10],
+        focusScore = (p[11] | (p[12] << 8)) / 65535,
+        stressScore = (p[13] | (p[14] << 8)) / 65535,
+        thetaBetaRatio = (p[15] | (p[16] << 8)) / 1000,
+        alphaRel = (p[17] | (p[18] << 8)) / 65535,
+        betaRel = (p[19] | (p[20] << 8)) / 65535;
+
+  final int seq;          // numbered apart from the data packets
+  final int mask;         // channels scored
+  final int dataSeq;      // data packet that closed the window
+  final int windowSec;    // seconds of data scored
+  final int periodSec;    // seconds between scores
+  final double focusScore;  // 0..1 (1 = focused)
+  final double stressScore; // 0..1 (1 = stressed)
+  final double thetaBetaRatio; // median across channels
+  final double alphaRel;       // median relative alpha amplitude
+  final double betaRel;        // median relative beta amplitude
+}
+
+/// Target amplitudes from the sticker's neurofeedback trackers
+/// (EEG_PKT_TYPE_FEEDBACK), every 50 ms or so while
+/// [BLEService.setStreamMode] includes [BLEService.modeFeedback].
+class EegFeedback {
+  EegFeedback.fromPacket(List<int> p, int nCh)
+      : seq = p[2] | (p[3] << 8),
+        mask = p[4],
+        dataSeq = p[6] | (p[7] << 8),
+        frame = p[8],
+        samplingHz = p[9] | (p[10] << 8),
+        window = p[11] | (p[12] << 8),
+        targetsHz = List<double>.generate(
+            p[5], (t) => (p[13 + 2 * t] | (p[14 + 2 * t] << 8)) / 10),
+        amplitudes = List<List<int>>.generate(nCh, (c) {
+          final o = 13 + 2 * p[5] + 2 * c * p[5];
+          return List<int>.generate(p[5], (t) => p[o + 2 * t] | (p[o + 2 * t + 1] << 8));
+        });
+
+  final int seq;          // numbered apart from the data packets
+  final int mask;         // electrodes tracked
+  final int dataSeq;      // data packet of the newest sample
+  final int frame;        // its frame in that packet
+  final int samplingHz;
+  final int window;       // samples, lag is about half of it
+  final List<double> targetsHz;
+  final List<List<int>> amplitudes; // [channel][target], peak counts
+}
+
+/// A control command the sticker answered with a non-zero status.
+class EegCommandException implements Exception {
+  EegCommandException(this.command, this.status);
+  final int command;
+  final int status; // 1 bad length, 2 bad value, 3 busy, 4 ADS1299 I/O
+  @override
+  String toString() => 'EEG command 0x${command.toRadixString(16)} failed (status $status)';
+}
+
 class _MinuteScores {
   _MinuteScores(this.focusScore, this.stressScore, this.focused, this.stressed);
   final double focusScore;  // 0..1 (1 = focused)
@@ -124,15 +266,121 @@ class BLEService {
   BluetoothDevice? _device;
   late BluetoothCharacteristic _txChar; // notify
   late BluetoothCharacteristic _rxChar; // write
+  BluetoothCharacteristic? _bulkChar;   // notify, offline log download
+  BluetoothCharacteristic? _respChar;   // notify, control responses
+  BluetoothCharacteristic? _clockChar;  // write + notify, clock sync
+  BluetoothCharacteristic? _diagChar;   // read + notify, diagnostics
 
   final _eegController = StreamController<List<double>>.broadcast();
   Stream<List<double>> get eegStream => _eegController.stream;
 
+  final _backlogController = StreamController<EegBacklogBlock>.broadcast();
+  Stream<EegBacklogBlock> get backlogStream => _backlogController.stream;
+
+  /// Samples with tMicros on [monotonicMicros]' clock: sticker time mapped
+  /// through [clock] once synced, arrival time before that.
+  final _sampleController = StreamController<EegSample>.broadcast();
+  Stream<EegSample> get sampleStream => _sampleController.stream;
+
+  /// Sticker diagnostics once a second while [setDiagnosticsPush] is on.
+  final _diagController = StreamController<EegDiagnostics>.broadcast();
+  Stream<EegDiagnostics> get diagnosticsStream => _diagController.stream;
+
+  /// Band powers from the sticker, see [setStreamMode].
+  final _bandsController = StreamController<EegBandPowers>.broadcast();
+  Stream<EegBandPowers> get bandPowerStream => _bandsController.stream;
+
+  /// Scores from the sticker, see [setStreamMode]. They also drive focused$,
+  /// stressed$, the score streams and the series, instead of the analyzer.
+  final _scoresController = StreamController<EegStickerScores>.broadcast();
+  Stream<EegStickerScores> get stickerScoresStream => _scoresController.stream;
+
+  /// Neurofeedback amplitudes from the sticker, see [setStreamMode].
+  final _feedbackController = StreamController<EegFeedback>.broadcast();
+  Stream<EegFeedback> get feedbackStream => _feedbackController.stream;
+  EegDiagnostics? _diagPending;
+
   // Nordic UART UUIDs
   static final Guid _svcUuid = Guid("6e400001-b5a3-f393-e0a9-e50e24dcca9e");
   static final Guid _txUuid  = Guid("6e400003-b5a3-f393-e0a9-e50e24dcca9e");
   static final Guid _rxUuid  = Guid("6e400002-b5a3-f393-e0a9-e50e24dcca9e");
 
+  // ANA EEG service UUIDs
+  static final Guid _eegSvcUuid = Guid("e1a00001-5ee5-4c0d-9a0e-0a0e0e6ef00d");
+  static final Guid _bulkUuid   = Guid("e1a00002-5ee5-4c0d-9a0e-0a0e0e6ef00d");
+  static final Guid _respUuid   = Guid("e1a00003-5ee5-4c0d-9a0e-0a0e0e6ef00d");
+  static final Guid _clockUuid  = Guid("e1a00004-5ee5-4c0d-9a0e-0a0e0e6ef00d");
+  static final Guid _diagUuid   = Guid("e1a00005-5ee5-4c0d-9a0e-0a0e0e6ef00d");
+
+  // ---------- Packet format (firmware/common/eeg_packet.h) ----------
+  static const int _pktHdrLen = 6;
+  static const int _pktVersion = 1;
+  static const int _pktTypeData = 0x1;
+  static const int _pktTypeDelta = 0x2;
+  static const int _pktTypeBands = 0x3;
+  static const int _pktTypeScores = 0x4;
+  static const int _pktTypeFeedback = 0x5;
+  static const int _scoresPktLen = _pktHdrLen + 15;
+  static const int _pktFlagRetx = 0x01;
+  static const int _pktFlagFiltered = 0x02;
+  static const int _pktFlagArtifacts = 0x3C; // saturated, flat, step, blink
+  static const int _pktFlagSpatial = 0x40;
+  static const int _ctrlNack = 0x10;
+  static const int _ctrlStart = 0x20;
+  static const int _ctrlStop = 0x21;
+  static const int _ctrlSetRate = 0x22;
+  static const int _ctrlSetChans = 0x23;
+  static const int _ctrlSetGain = 0x24;
+  static const int _ctrlCounters = 0x25;
+  static const int _ctrlLowPower = 0x26;
+  static const int _ctrlLatency = 0x27;
+  static const int _ctrlSetMode = 0x28;
+  static const int _ctrlSetSpatial = 0x29;
+  static const int _ctrlSetFeedback = 0x2A;
+  static const int _feedbackTargets = 4; // EEG_FEEDBACK_TARGETS_MAX
+  static const int _spatialCols = 8; // EEG_MAX_CHANNELS
+  static const int _spatialOne = 1 << 14; // q14
+  static const int modeRaw = 0x01;
+  static const int modeBands = 0x02;
+  static const int modeScores = 0x04;
+  static const int modeFeedback = 0x08;
+  static const Duration _ctrlTimeout = Duration(seconds: 2);
+
+  final Map<int, Completer<List<int>>> _pendingCmds = {};
+
+  // ---------- Clock sync (firmware/common/eeg_clock.h) ----------
+  static const int _clockReqLen = 17;
+  static const int _clockNoAnchor = 0xFFFFFFFF;
+  static const Duration _syncTick = Duration(milliseconds: 250);
+  static const int _syncFastTicks = 8;   // first requests back to back
+  static const int _syncSlowTicks = 20;  // then one every 5 s
+
+  final Stopwatch _mono = Stopwatch()..start();
+  int get monotonicMicros => _mono.elapsedMicroseconds;
+
+  final EegClock clock = EegClock();
+  Timer? _syncTimer;
+  int _syncTicks = 0;
+  int _syncId = 0;
+  int? _syncT1;   // t1 of the outstanding request
+  int _prevT4 = 0;
+
+  // A gap still open after this many newer packets is given up on; must stay
+  // below the sticker's retransmit ring depth.
+  static const int _reorderWindow = 256;
+
+  int? _nextSeq;     // next sequence number to emit
+  int? _highestSeq;  // newest sequence number seen
+  final Map<int, List<List<double>>> _pendingPackets = {};
+  int _lostPackets = 0;
+  int get lostPackets => _lostPackets;
+  final Set<int> _pendingArtifacts = {};
+  // Decodes and reorders in native code when libeeg_decoder is available.
+  EegNativeDecoder? _nativeDecoder = EegNativeDecoder.open(reorderWindow: _reorderWindow);
+  int _artifactPackets = 0;
+  /// Packets the sticker flagged as saturated, flat, stepped or blink.
+  int get artifactPackets => _artifactPackets;
+
   // ---------- Analyzer state ----------
   static const int _channels = 4;
   static const int _minFs = 200;
@@ -141,6 +389,13 @@ class BLEService {
   final List<List<double>> _minuteBuf = <List<double>>[];
   int? _minuteStartMicros;
   int _sampleCountThisMinute = 0;
+  // Sticker built with CONFIG_EEG_FILTER already ran the pre-filter
+  bool _stickerFiltered = false;
+  // Sticker built with CONFIG_EEG_SPATIAL sends derivations, not electrodes
+  bool _stickerSpatial = false;
+  // Sticker built with CONFIG_EEG_SCORES sends scores, the analyzer idles
+  bool _stickerScores = false;
+  int _stickerScoreSec = 0;
 
   final _focusedCtrl      = StreamController<bool>.broadcast();
   final _stressedCtrl     = StreamController<bool>.broadcast();
@@ -196,10 +451,42 @@ class BLEService {
       await _txChar.setNotifyValue(true);
       _txChar.value.listen(_handleData);
 
-      // start streaming
-      await _rxChar.write([0x01], withoutResponse: false);
+      // Offline log download, optional on older firmware
+      final eegSvc = svcs.where((s) => s.uuid == _eegSvcUuid);
+      if (eegSvc.isNotEmpty) {
+        _bulkChar = eegSvc.first.characteristics.firstWhere((c) => c.uuid == _bulkUuid);
+        await _bulkChar!.setNotifyValue(true);
+        _bulkChar!.value.listen(_handleBulk);
+
+        // Command responses, missing on firmware that only knows 0x01/0x00
+        final resp = eegSvc.first.characteristics.where((c) => c.uuid == _respUuid);
+        if (resp.isNotEmpty) {
+          _respChar = resp.first;
+          await _respChar!.setNotifyValue(true);
+          _respChar!.value.listen(_handleResponse);
+        }
+
+        final clk = eegSvc.first.characteristics.where((c) => c.uuid == _clockUuid);
+        if (clk.isNotEmpty) {
+          _clockChar = clk.first;
+          await _clockChar!.setNotifyValue(true);
+          _clockChar!.value.listen(_handleClock);
+          _startClockSync();
+        }
+
+        final diag = eegSvc.first.characteristics.where((c) => c.uuid == _diagUuid);
+        if (diag.isNotEmpty) {
+          _diagChar = diag.first;
+          _diagChar!.value.listen(_handleDiag);
+        }
+      }
+
+      await startStreaming();
 
+      _resetSequencing();
       _resetMinute();
+      _stickerScores = false;
+      _stickerScoreSec = 0;
       return true;
     } catch (e) {
       print('BLE connectDevice error: $e');
@@ -209,27 +496,427 @@ class BLEService {
 
   // --------------- Notification handler ---------------
   void _handleData(List<int> raw) {
-    if (raw.length < 8) return;
+    if (_nativeDecoder != null) {
+      _handleDataNative(_nativeDecoder!, raw);
+      return;
+    }
+    if (raw.length < _pktHdrLen) return;
+    if ((raw[0] >> 4) == _pktVersion && (raw[0] & 0x0F) == _pktTypeBands) {
+      _handleBands(raw);
+      return;
+    }
+    if ((raw[0] >> 4) == _pktVersion && (raw[0] & 0x0F) == _pktTypeScores) {
+      _handleScores(raw);
+      return;
+    }
+    if ((raw[0] >> 4) == _pktVersion && (raw[0] & 0x0F) == _pktTypeFeedback) {
+      _handleFeedback(raw);
+      return;
+    }
+    if ((raw[0] >> 4) != _pktVersion || (raw[0] & 0x0F) != _pktTypeData) return;
+
+    final flags = raw[1];
+    final seq = raw[2] | (raw[3] << 8);
+    final mask = raw[4];
+    final nFrames = raw[5];
+
+    int nCh = 0;
+    for (int m = mask; m != 0; m &= m - 1) nCh++;
+    if (raw.length < _pktHdrLen + nFrames * nCh * 3) return;
 
-    final bd = ByteData.sublistView(Uint8List.fromList(raw));
-    final sample = List<double>.generate(4, (i) {
-      return bd.getInt16(i * 2, Endian.little).toDouble();
+    final frames = List<List<double>>.generate(nFrames, (f) {
+      final base = _pktHdrLen + f * nCh * 3;
+      return List<double>.generate(nCh, (c) {
+        final p = base + c * 3;
+        int v = (raw[p] << 16) | (raw[p + 1] << 8) | raw[p + 2];
+        if (v & 0x800000 != 0) v -= 0x1000000;
+        return v.toDouble();
+      });
     });
 
-    // Emit raw stream for existing UI
-    _eegController.add(sample);
+    _stickerFiltered = (flags & _pktFlagFiltered) != 0;
+    _stickerSpatial = (flags & _pktFlagSpatial) != 0;
+    _acceptPacket(seq, frames,
+        isRetx: (flags & _pktFlagRetx) != 0, artifacts: flags & _pktFlagArtifacts);
+  }
+
+  /// Same as the Dart path below, decoded, reordered and NACKed natively.
+  void _handleDataNative(EegNativeDecoder dec, List<int> raw) {
+    dec.push(raw, monotonicMicros);
+    for (var b = dec.next(); b != null; b = dec.next()) {
+      if (!b.hasSamples) {
+        // Views die with the next push, the handlers get their own copy
+        if (b.type == _pktTypeBands) _handleBands(Uint8List.fromList(b.raw));
+        if (b.type == _pktTypeScores) _handleScores(Uint8List.fromList(b.raw));
+        if (b.type == _pktTypeFeedback) _handleFeedback(Uint8List.fromList(b.raw));
+        continue;
+      }
+
+      _lostPackets += b.lostBefore;
+      _stickerFiltered = (b.flags & _pktFlagFiltered) != 0;
+      _stickerSpatial = (b.flags & _pktFlagSpatial) != 0;
+
+      final s = b.samples;
+      final nFrames = b.frames;
+      final nCh = b.channels;
+      final frames = List<List<double>>.generate(nFrames,
+          (f) => List<double>.generate(nCh, (c) => s[c * nFrames + f].toDouble()));
+      _emitPacket(b.seq, frames, artifact: (b.flags & _pktFlagArtifacts) != 0);
+    }
+
+    final nack = dec.nack();
+    if (nack != null) {
+      _rxChar.write(nack, withoutResponse: true).catchError((e) {
+        print('BLE NACK write error: $e');
+      });
+    }
+  }
+
+  void _handleBands(List<int> raw) {
+    int nCh = 0;
+    for (int m = raw[4]; m != 0; m &= m - 1) nCh++;
+    if (raw.length < _pktHdrLen + 5 + nCh * raw[5] * 4) return;
+    _bandsController.add(EegBandPowers.fromPacket(raw, nCh));
+  }
+
+  void _handleFeedback(List<int> raw) {
+    int nCh = 0;
+    for (int m = raw[4]; m != 0; m &= m - 1) nCh++;
+    if (raw.length < _pktHdrLen + 7 + 2 * raw[5] + nCh * raw[5] * 2) return;
+    _feedbackController.add(EegFeedback.fromPacket(raw, nCh));
+  }
+
+  void _handleScores(List<int> raw) {
+    if (raw.length < _scoresPktLen) return;
+    final s = EegStickerScores.fromPacket(raw);
+    _scoresController.add(s);
+
+    // The sticker scores now, stop buffering minutes for the analyzer
+    _stickerScores = true;
+    _resetMinute();
+    _publishScores(_MinuteScores(s.focusScore, s.stressScore,
+        s.focusScore > 0.5, s.stressScore > 0.5), seriesPoint: false);
+
+    // One series point per minute of sticker scores, as the analyzer's
+    _stickerScoreSec += s.periodSec;
+    if (_stickerScoreSec >= 60) {
+      _stickerScoreSec = 0;
+      _addSeriesPoint();
+    }
+  }
+
+  /// Decodes one delta-compressed log block (firmware/common/eeg_delta.h).
+  void _handleBulk(List<int> raw) {
+    if (raw.length < _pktHdrLen) return;
+    if ((raw[0] >> 4) != _pktVersion || (raw[0] & 0x0F) != _pktTypeDelta) return;
+
+    final seq = raw[2] | (raw[3] << 8);
+    int nCh = 0;
+    for (int m = raw[4]; m != 0; m &= m - 1) nCh++;
+    final nFrames = raw[5];
+
+    final prev = List<int>.filled(nCh, 0);
+    final frames = <List<double>>[];
+    int pos = _pktHdrLen;
+    for (int f = 0; f < nFrames; f++) {
+      final frame = List<double>.filled(nCh, 0);
+      for (int c = 0; c < nCh; c++) {
+        int zz = 0, shift = 0, b;
+        do {
+          if (pos >= raw.length) return; // truncated block
+          b = raw[pos++];
+          zz |= (b & 0x7F) << shift;
+          shift += 7;
+        } while (b & 0x80 != 0);
+        prev[c] += (zz >> 1) ^ -(zz & 1);
+        frame[c] = prev[c].toDouble();
+      }
+      frames.add(frame);
+    }
+
+    _backlogController.add(EegBacklogBlock(seq, frames));
+  }
 
-    // Feed minute analyzer
-    _addSampleForMinute(sample);
+  /// Signed distance from [a] to [b] on the 16-bit sequence circle.
+  static int _seqDiff(int a, int b) {
+    final d = (b - a) & 0xFFFF;
+    return d >= 0x8000 ? d - 0x10000 : d;
+  }
+
+  void _acceptPacket(int seq, List<List<double>> frames,
+      {required bool isRetx, int artifacts = 0}) {
+    _nextSeq ??= seq;
+    _highestSeq ??= seq;
+
+    // Already emitted or skipped.
+    if (_seqDiff(_nextSeq!, seq) < 0) return;
+
+    final ahead = _seqDiff(_highestSeq!, seq);
+    if (ahead > 0) {
+      if (ahead > 1 && !isRetx) _sendNack((_highestSeq! + 1) & 0xFFFF, ahead - 1);
+      _highestSeq = seq;
+    }
+
+    _pendingPackets[seq] = frames;
+    if (artifacts != 0) _pendingArtifacts.add(seq);
+    _drainInOrder();
+  }
+
+  void _drainInOrder() {
+    while (true) {
+      final frames = _pendingPackets.remove(_nextSeq);
+      if (frames != null) {
+        _emitPacket(_nextSeq!, frames, artifact: _pendingArtifacts.remove(_nextSeq));
+        _nextSeq = (_nextSeq! + 1) & 0xFFFF;
+        continue;
+      }
+
+      // Hole at _nextSeq: wait for the retransmission unless it is too old.
+      if (_pendingPackets.isEmpty || _seqDiff(_nextSeq!, _highestSeq!) < _reorderWindow) return;
+      _lostPackets++;
+      _nextSeq = (_nextSeq! + 1) & 0xFFFF;
+    }
+  }
+
+  /// Hands one in-order packet to the streams and the minute analyzer.
+  void _emitPacket(int seq, List<List<double>> frames, {required bool artifact}) {
+    final times = _frameTimes(seq, frames.length);
+    if (artifact) _artifactPackets++;
+    for (int f = 0; f < frames.length; f++) {
+      final sample = frames[f];
+      // Emit raw stream for existing UI
+      _eegController.add(sample);
+      _sampleController.add(EegSample(times[f], sample.map((v) => v.toInt()).toList()));
+
+      // Feed minute analyzer, leaving out packets the sticker flagged
+      _addSampleForMinute(sample, artifact: artifact);
+    }
+  }
+
+  void _sendNack(int start, int count) {
+    final msg = Uint8List(6)
+      ..[0] = _ctrlNack
+      ..[1] = 4;
+    ByteData.sublistView(msg)
+      ..setUint16(2, start, Endian.little)
+      ..setUint16(4, count, Endian.little);
+    _rxChar.write(msg, withoutResponse: true).catchError((e) {
+      print('BLE NACK write error: $e');
+    });
+  }
+
+  // --------------- Control commands (eeg_packet.h) ---------------
+  Future<void> startStreaming() => _command(_ctrlStart);
+  Future<void> stopStreaming() => _command(_ctrlStop);
+
+  /// [sps] must be one of 250, 500, 1000, 2000, 4000, 8000, 16000.
+  Future<void> setSampleRate(int sps) => _command(_ctrlSetRate, [sps & 0xFF, sps >> 8]);
+
+  /// Bit n of [mask] selects channel n+1.
+  Future<void> setChannels(int mask) => _command(_ctrlSetChans, [mask]);
+
+  /// [gain] must be one of 1, 2, 4, 6, 8, 12, 24.
+  Future<void> setGain(int mask, int gain) => _command(_ctrlSetGain, [mask, gain]);
+
+  Future<void> enterLowPower() => _command(_ctrlLowPower);
+
+  /// [mode] combines [modeRaw], [modeBands], [modeScores] and
+  /// [modeFeedback]; without [modeRaw] only the features are on the link.
+  /// Firmware built without any of them refuses that bit.
+  Future<void> setStreamMode(int mode) => _command(_ctrlSetMode, [mode]);
+
+  /// True while data packets carry the rows of a spatial filter
+  /// ([setSpatialFilter]) instead of the electrodes.
+  bool get stickerSpatial => _stickerSpatial;
+
+  /// Re-reference on the sticker: each row of [rows] is one output channel,
+  /// the weights of electrodes 1..8 (-2..2). Takes effect once every row
+  /// arrived; firmware without CONFIG_EEG_SPATIAL refuses it.
+  Future<void> setSpatialFilter(List<List<double>> rows) async {
+    if (rows.isEmpty || rows.length > _spatialCols) {
+      throw ArgumentError.value(rows.length, 'rows');
+    }
+    for (int r = 0; r < rows.length; r++) {
+      final value = ByteData(2 + 2 * _spatialCols)
+        ..setUint8(0, rows.length)
+        ..setUint8(1, r);
+      for (int c = 0; c < rows[r].length && c < _spatialCols; c++) {
+        final q = (rows[r][c] * _spatialOne).round().clamp(-32768, 32767).toInt();
+        value.setInt16(2 + 2 * c, q, Endian.little);
+      }
+      await _command(_ctrlSetSpatial, value.buffer.asUint8List());
+    }
+  }
+
+  /// Neurofeedback targets (up to 4, Hz), the trackers' window and the time
+  /// between feedback packets, for [modeFeedback]. A shorter window reacts
+  /// sooner but separates nearby targets less.
+  Future<void> setFeedback(List<double> targetsHz,
+      {int windowMs = 250, int periodMs = 50}) {
+    if (targetsHz.isEmpty || targetsHz.length > _feedbackTargets) {
+      throw ArgumentError.value(targetsHz.length, 'targetsHz');
+    }
+    final value = ByteData(2 * _feedbackTargets + 4);
+    for (int t = 0; t < targetsHz.length; t++) {
+      value.setUint16(2 * t, (targetsHz[t] * 10).round(), Endian.little);
+    }
+    value
+      ..setUint16(2 * _feedbackTargets, windowMs, Endian.little)
+      ..setUint16(2 * _feedbackTargets + 2, periodMs, Endian.little);
+    return _command(_ctrlSetFeedback, value.buffer.asUint8List());
+  }
+
+  /// Back to one channel per electrode.
+  Future<void> clearSpatialFilter() =>
+      _command(_ctrlSetSpatial, List<int>.filled(2 + 2 * _spatialCols, 0));
+
+  /// Common average reference over [n] electrodes, for [setSpatialFilter].
+  static List<List<double>> montageCar(int n) => List.generate(
+      n, (r) => List.generate(n, (c) => (r == c ? 1.0 : 0.0) - 1.0 / n));
+
+  /// Bipolar chain 1-2, 2-3, ... over [n] electrodes, for [setSpatialFilter].
+  static List<List<double>> montageBipolar(int n) => List.generate(
+      n - 1, (r) => List.generate(n, (c) => c == r ? 1.0 : (c == r + 1 ? -1.0 : 0.0)));
+
+  Future<EegCounters> queryCounters() async =>
+      EegCounters.fromPayload(await _command(_ctrlCounters));
+
+  /// Histogram of one [EegLatencyStage]; [reset] clears all stages after it.
+  Future<EegLatencyHistogram> queryLatency(int stage, {bool reset = false}) async =>
+      EegLatencyHistogram.fromPayload(await _command(_ctrlLatency, [stage, reset ? 1 : 0]));
+
+  Future<List<int>> _command(int type, [List<int> value = const []]) async {
+    if (_respChar == null) {
+      // Older firmware: only bare start/stop bytes, no acknowledgement
+      if (type == _ctrlStart || type == _ctrlStop) {
+        await _rxChar.write([type == _ctrlStart ? 0x01 : 0x00], withoutResponse: false);
+        return const [];
+      }
+      throw UnsupportedError('Sticker firmware has no command channel');
+    }
+
+    _pendingCmds.remove(type)?.completeError(TimeoutException('superseded'));
+    final done = Completer<List<int>>();
+    _pendingCmds[type] = done;
+    await _rxChar.write([type, value.length, ...value], withoutResponse: false);
+    return done.future.timeout(_ctrlTimeout, onTimeout: () {
+      _pendingCmds.remove(type);
+      throw TimeoutException('No response to command 0x${type.toRadixString(16)}');
+    });
+  }
+
+  void _handleResponse(List<int> raw) {
+    if (raw.length < 3 || raw.length < 2 + raw[1]) return;
+    final done = _pendingCmds.remove(raw[0]);
+    if (done == null) return;
+    final status = raw[2];
+    if (status != 0) {
+      done.completeError(EegCommandException(raw[0], status));
+    } else {
+      done.complete(raw.sublist(3, 2 + raw[1]));
+    }
+  }
+
+  // --------------- Diagnostics ---------------
+  /// One snapshot on demand, null on firmware without diagnostics.
+  Future<EegDiagnostics?> readDiagnostics() async {
+    if (_diagChar == null) return null;
+    return EegDiagnostics()..parse(await _diagChar!.read());
+  }
+
+  Future<void> setDiagnosticsPush(bool on) async {
+    _diagPending = null;
+    await _diagChar?.setNotifyValue(on);
+  }
+
+  // A pushed snapshot spans notifications and ends where the next begins
+  void _handleDiag(List<int> raw) {
+    if (EegDiagnostics.startsSnapshot(raw)) {
+      if (_diagPending != null) _diagController.add(_diagPending!);
+      _diagPending = EegDiagnostics();
+    }
+    _diagPending?.parse(raw);
+  }
+
+  // --------------- Clock sync ---------------
+  void _startClockSync() {
+    clock.reset();
+    _syncTicks = 0;
+    _syncT1 = null;
+    _prevT4 = 0;
+    _syncTimer?.cancel();
+    _syncTimer = Timer.periodic(_syncTick, (_) {
+      final t = _syncTicks++;
+      if (t < _syncFastTicks || t % _syncSlowTicks == 0) _sendClockRequest();
+    });
+  }
+
+  void _sendClockRequest() {
+    _syncId = (_syncId + 1) & 0xFF;
+    final msg = Uint8List(_clockReqLen)..[0] = _syncId;
+    final t1 = monotonicMicros;
+    ByteData.sublistView(msg)
+      ..setUint64(1, t1, Endian.little)
+      ..setUint64(9, _prevT4, Endian.little);
+    _syncT1 = t1;
+    _clockChar?.write(msg, withoutResponse: true).catchError((e) {
+      print('BLE clock write error: $e');
+    });
+  }
+
+  void _handleClock(List<int> raw) {
+    final t4 = monotonicMicros;
+    if (raw.length < _clockReqLen || raw[0] != _syncId || _syncT1 == null) return;
+
+    final b = ByteData.sublistView(Uint8List.fromList(raw));
+    final t2 = b.getUint64(1, Endian.little);
+    final t3 = t2 + b.getUint16(9, Endian.little);
+    clock.exchange(_syncT1!, t2, t3, t4);
+    _syncT1 = null;
+    _prevT4 = t4;
+
+    final age = b.getUint32(13, Endian.little);
+    if (age != _clockNoAnchor) clock.anchor(b.getUint16(11, Endian.little), t2 - age);
+  }
+
+  /// Central time of each frame of packet [seq], last frame at packet completion.
+  List<int> _frameTimes(int seq, int nFrames) {
+    if (!clock.canTimePackets) return List<int>.filled(nFrames, monotonicMicros);
+    final end = clock.toCentral(clock.packetTime(seq));
+    final step = clock.periodUs / nFrames;
+    return List<int>.generate(nFrames, (f) => end - ((nFrames - 1 - f) * step).round());
+  }
+
+  void _resetSequencing() {
+    _nextSeq = null;
+    _highestSeq = null;
+    _pendingPackets.clear();
+    _pendingArtifacts.clear();
+    _nativeDecoder?.reset();
+    _lostPackets = 0;
+    _artifactPackets = 0;
   }
 
   // --------------- Disconnect / cleanup ---------------
   Future<void> disconnect() async {
+    try { await stopStreaming(); } catch (_) {}
     try { await _txChar.setNotifyValue(false); } catch (_) {}
-    try { await _rxChar.write([0x00], withoutResponse: false); } catch (_) {}
+    try { await _bulkChar?.setNotifyValue(false); } catch (_) {}
+    try { await _respChar?.setNotifyValue(false); } catch (_) {}
+    try { await _clockChar?.setNotifyValue(false); } catch (_) {}
+    try { await _diagChar?.setNotifyValue(false); } catch (_) {}
+    _syncTimer?.cancel();
     try { await _device?.disconnect(); } catch (_) {}
+    _nativeDecoder?.dispose();
+    _nativeDecoder = null;
 
     await _eegController.close();
+    await _backlogController.close();
+    await _sampleController.close();
+    await _diagController.close();
+    await _bandsController.close();
+    await _scoresController.close();
+    await _feedbackController.close();
 
     await _focusedCtrl.close();
     await _stressedCtrl.close();
@@ -248,11 +935,13 @@ class BLEService {
     _sampleCountThisMinute = 0;
   }
 
-  void _addSampleForMinute(List<double> sample) {
+  void _addSampleForMinute(List<double> sample, {bool artifact = false}) {
+    if (_stickerScores) return;
     final nowMicros = DateTime.now().microsecondsSinceEpoch;
     _minuteStartMicros ??= nowMicros;
 
-    _minuteBuf.add(sample);
+    // Flagged samples still count towards the rate estimate
+    if (!artifact) _minuteBuf.add(sample);
     _sampleCountThisMinute++;
 
     final elapsedMicros = nowMicros - (_minuteStartMicros ?? nowMicros);
@@ -278,6 +967,11 @@ class BLEService {
       channels: _channels,
     );
 
+    _publishScores(scores);
+    _resetMinute();
+  }
+
+  void _publishScores(_MinuteScores scores, {bool seriesPoint = true}) {
     _focused = scores.focused;
     _stressed = scores.stressed;
     _focusScore = scores.focusScore;
@@ -288,14 +982,16 @@ class BLEService {
     _focusScoreCtrl.add(_focusScore);
     _stressScoreCtrl.add(_stressScore);
 
+    if (seriesPoint) _addSeriesPoint();
+  }
+
+  void _addSeriesPoint() {
     _focusSeries.add(_focusScore);
     _stressSeries.add(_stressScore);
     if (_focusSeries.length > _maxMinutesHistory) _focusSeries.removeAt(0);
     if (_stressSeries.length > _maxMinutesHistory) _stressSeries.removeAt(0);
     _focusSeriesCtrl.add(List<double>.from(_focusSeries));
     _stressSeriesCtrl.add(List<double>.from(_stressSeries));
-
-    _resetMinute();
   }
 
   // ---------------- Core analysis (pure Dart) ----------------
@@ -318,8 +1014,9 @@ class BLEService {
       for (int i = 0; i < n; i++) x[c][i] -= m;
     }
 
-    // Band-limit 1–45 Hz + 50 Hz notch (per-channel filter states)
-    for (int c = 0; c < channels; c++) {
+    // Band-limit 1–45 Hz + 50 Hz notch (per-channel filter states), unless
+    // the sticker did it already
+    for (int c = 0; c < (_stickerFiltered ? 0 : channels); c++) {
       final hp = _Biquad.highpass(fs.toDouble(), 1.0, 0.7071);
       final lp = _Biquad.lowpass(fs.toDouble(), 45.0, 0.7071);
       final notch50 = _Biquad.notch(fs.toDouble(), 50.0, 30.0);
@@ -0,0 +1,96 @@
+// lib/services/eeg_clock.dart
+//
+// Offset/drift estimate between the sticker's uptime clock and this phone's
+// monotonic clock, from the NTP-style exchange on the clock characteristic.
+// Mirrors firmware/common/eeg_clock.h; see docs/ble-protocol.md.
+
+class _ClockSample {
+  _ClockSample(this.tUs, this.offsetUs, this.delayUs);
+  final int tUs;      // sticker time of the exchange midpoint
+  final int offsetUs; // sticker minus central time
+  final int delayUs;  // round trip minus sticker processing
+}
+
+class EegClock {
+  static const int window = 16;
+  static const int delaySlackUs = 2000;
+  static const int minSpanUs = 10000000;
+
+  final List<_ClockSample> _win = [];
+
+  bool valid = false;
+  int _refUs = 0;
+  int offsetUs = 0;  // sticker minus central, at the window's mean time
+  double drift = 0;  // sticker seconds gained per second
+  int delayUs = 0;   // best round trip in the window
+
+  bool _anchored = false;
+  int _anchorSeq = 0;
+  int _anchorUs = 0;
+  double periodUs = 0; // packet period in sticker time
+
+  void reset() {
+    _win.clear();
+    valid = false;
+    drift = 0;
+    _anchored = false;
+    periodUs = 0;
+  }
+
+  /// Adds one completed exchange, t1/t4 central and t2/t3 sticker time (µs).
+  void exchange(int t1, int t2, int t3, int t4) {
+    var delay = (t4 - t1) - (t3 - t2);
+    if (delay < 0) delay = 0;
+    _win.add(_ClockSample(t2 + (t3 - t2) ~/ 2, ((t2 - t1) + (t3 - t4)) ~/ 2, delay));
+    if (_win.length > window) _win.removeAt(0);
+    _fit();
+  }
+
+  void _fit() {
+    final best = _win.map((s) => s.delayUs).reduce((a, b) => a < b ? a : b);
+    // Long round trips waited for a later connection event, skip them.
+    final used = _win.where((s) => s.delayUs <= best + delaySlackUs).toList();
+
+    _refUs = used.fold<int>(0, (a, s) => a + s.tUs) ~/ used.length;
+    offsetUs = used.fold<int>(0, (a, s) => a + s.offsetUs) ~/ used.length;
+    delayUs = best;
+    valid = true;
+
+    final span = used.last.tUs - used.first.tUs;
+    if (span < minSpanUs) return;
+
+    double tt = 0, to = 0;
+    for (final s in used) {
+      final dt = (s.tUs - _refUs).toDouble();
+      tt += dt * dt;
+      to += dt * (s.offsetUs - offsetUs);
+    }
+    drift = to / tt;
+  }
+
+  int offsetAt(int stickerUs) => offsetUs + (drift * (stickerUs - _refUs)).round();
+
+  /// Sticker time to central time, only meaningful once [valid].
+  int toCentral(int stickerUs) => stickerUs - offsetAt(stickerUs);
+
+  /// Records that packet [seq] was complete at sticker time [tUs].
+  void anchor(int seq, int tUs) {
+    if (_anchored) {
+      final d = _seqDiff(_anchorSeq, seq);
+      if (d > 0) periodUs = (tUs - _anchorUs) / d;
+    }
+    _anchored = true;
+    _anchorSeq = seq;
+    _anchorUs = tUs;
+  }
+
+  bool get canTimePackets => valid && _anchored && periodUs > 0;
+
+  /// Sticker time packet [seq] was complete, extrapolated from the newest anchor.
+  int packetTime(int seq) => _anchorUs + (_seqDiff(_anchorSeq, seq) * periodUs).round();
+
+  static int _seqDiff(int a, int b) {
+    final d = (b - a) & 0xFFFF;
+    return d >= 0x8000 ? d - 0x10000 : d;
+  }
+}
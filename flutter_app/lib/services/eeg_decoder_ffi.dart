@@ -0,0 +1,199 @@
+// lib/services/eeg_decoder_ffi.dart
+//
+// dart:ffi binding of the sticker's streaming packet decoder
+// (firmware/host/eeg_decoder.h, built by firmware/host/CMakeLists.txt as
+// libeeg_decoder). It turns notifications into blocks of int32 samples in
+// sequence order, gives up on holes and asks for retransmissions with the
+// same rules as BLEService's Dart parser, and passes band power, score and
+// feedback packets through.
+//
+// Blocks are views of native memory, valid until the next push: read them
+// before pushing again. EegNativeDecoder.open() returns null when the
+// library is not shipped with this build, callers then keep parsing in Dart.
+
+// ignore_for_file: non_constant_identifier_names, deprecated_member_use
+
+import 'dart:ffi';
+import 'dart:io';
+import 'dart:typed_data';
+
+import 'package:ffi/ffi.dart';
+
+/// struct eeg_dec_block
+class EegDecBlockStruct extends Struct {
+  external Pointer<Int32> samples;
+  external Pointer<Uint8> raw;
+  @Int64()
+  external int t_us;
+  @Double()
+  external double frame_us;
+  @Uint32()
+  external int raw_len;
+  @Uint16()
+  external int seq;
+  @Uint16()
+  external int frames;
+  @Uint16()
+  external int lost_before;
+  @Uint8()
+  external int type;
+  @Uint8()
+  external int version;
+  @Uint8()
+  external int flags;
+  @Uint8()
+  external int chan_mask;
+  @Uint8()
+  external int channels;
+  @Uint8()
+  external int status;
+}
+
+/// struct eeg_dec_config
+class EegDecConfigStruct extends Struct {
+  @Uint16()
+  external int reorder_window;
+  @Uint16()
+  external int max_frames;
+  @Uint8()
+  external int legacy_channels;
+}
+
+typedef _AbiVersionC = Uint32 Function();
+typedef _AbiVersion = int Function();
+typedef _CreateC = Pointer<Void> Function(Pointer<EegDecConfigStruct>);
+typedef _Create = Pointer<Void> Function(Pointer<EegDecConfigStruct>);
+typedef _HandleC = Void Function(Pointer<Void>);
+typedef _Handle = void Function(Pointer<Void>);
+typedef _PushC = Int32 Function(Pointer<Void>, Pointer<Uint8>, Size, Int64);
+typedef _Push = int Function(Pointer<Void>, Pointer<Uint8>, int, int);
+typedef _NextC = Pointer<EegDecBlockStruct> Function(Pointer<Void>);
+typedef _Next = Pointer<EegDecBlockStruct> Function(Pointer<Void>);
+typedef _NackC = Size Function(Pointer<Void>, Pointer<Uint8>, Size);
+typedef _Nack = int Function(Pointer<Void>, Pointer<Uint8>, int);
+
+/// One decoded packet; views, valid until the decoder's next push.
+class EegBlockView {
+  EegBlockView._(this._b);
+  final EegDecBlockStruct _b;
+
+  static const int statusSamples = 0x01;
+  static const int statusRecovered = 0x02;
+  static const int statusTimed = 0x04;
+  static const int statusLegacy = 0x08;
+
+  int get type => _b.type;
+  int get version => _b.version;
+  int get seq => _b.seq;
+  int get flags => _b.flags;
+  int get chanMask => _b.chan_mask;
+  int get status => _b.status;
+  bool get hasSamples => (_b.status & statusSamples) != 0;
+  int get lostBefore => _b.lost_before;
+  int get frames => _b.frames;
+  int get channels => _b.channels;
+
+  /// Central time of the first frame and the time between frames, µs.
+  int get tUs => _b.t_us;
+  double get frameUs => _b.frame_us;
+
+  /// Channel after channel, [frames] samples each.
+  Int32List get samples => _b.samples.asTypedList(_b.frames * _b.channels);
+
+  Int32List channel(int c) =>
+      _b.samples.elementAt(c * _b.frames).asTypedList(_b.frames);
+
+  Uint8List get raw => _b.raw.asTypedList(_b.raw_len);
+}
+
+class EegNativeDecoder {
+  EegNativeDecoder._(DynamicLibrary lib, this._dec)
+      : _push = lib.lookupFunction<_PushC, _Push>('eeg_dec_push'),
+        _next = lib.lookupFunction<_NextC, _Next>('eeg_dec_next'),
+        _nack = lib.lookupFunction<_NackC, _Nack>('eeg_dec_nack'),
+        _reset = lib.lookupFunction<_HandleC, _Handle>('eeg_dec_reset'),
+        _destroy = lib.lookupFunction<_HandleC, _Handle>('eeg_dec_destroy');
+
+  static const int _abiVersion = 1;
+  static const int _nackCap = 64;
+
+  Pointer<Void> _dec;
+  final _Push _push;
+  final _Next _next;
+  final _Nack _nack;
+  final _Handle _reset;
+  final _Handle _destroy;
+
+  Pointer<Uint8> _in = nullptr;
+  int _inCap = 0;
+  final Pointer<Uint8> _nackBuf = malloc<Uint8>(_nackCap);
+
+  static DynamicLibrary? _load() {
+    try {
+      if (Platform.isIOS) return DynamicLibrary.process();
+      if (Platform.isWindows) return DynamicLibrary.open('eeg_decoder.dll');
+      if (Platform.isMacOS) return DynamicLibrary.open('libeeg_decoder.dylib');
+      return DynamicLibrary.open('libeeg_decoder.so');
+    } catch (_) {
+      return null;
+    }
+  }
+
+  /// Null if libeeg_decoder is missing or of another ABI version.
+  /// [reorderWindow] 0 keeps the library's default (256 packets).
+  static EegNativeDecoder? open({int reorderWindow = 0}) {
+    final lib = _load();
+    if (lib == null) return null;
+
+    try {
+      final abi = lib.lookupFunction<_AbiVersionC, _AbiVersion>('eeg_dec_abi_version');
+      if (abi() != _abiVersion) return null;
+
+      final create = lib.lookupFunction<_CreateC, _Create>('eeg_dec_create');
+      final cfg = calloc<EegDecConfigStruct>();
+      cfg.ref.reorder_window = reorderWindow;
+      final dec = create(cfg);
+      calloc.free(cfg);
+      if (dec == nullptr) return null;
+      return EegNativeDecoder._(lib, dec);
+    } on ArgumentError {
+      return null; // symbol missing
+    }
+  }
+
+  /// Decodes one notification received at [rxUs]; returns the blocks ready.
+  int push(List<int> payload, int rxUs) {
+    if (payload.length > _inCap) {
+      if (_in != nullptr) malloc.free(_in);
+      _inCap = payload.length < 512 ? 512 : payload.length;
+      _in = malloc<Uint8>(_inCap);
+    }
+    _in.asTypedList(payload.length).setAll(0, payload);
+    return _push(_dec, _in, payload.length, rxUs);
+  }
+
+  /// Next ready block in order, null when there is none.
+  EegBlockView? next() {
+    final b = _next(_dec);
+    return b == nullptr ? null : EegBlockView._(b.ref);
+  }
+
+  /// NACK TLV for the holes seen since the last call, for the NUS RX
+  /// characteristic; null if there is nothing to ask for.
+  Uint8List? nack() {
+    final n = _nack(_dec, _nackBuf, _nackCap);
+    return n == 0 ? null : Uint8List.fromList(_nackBuf.asTypedList(n));
+  }
+
+  void reset() => _reset(_dec);
+
+  void dispose() {
+    if (_dec == nullptr) return;
+    _destroy(_dec);
+    _dec = nullptr;
+    if (_in != nullptr) malloc.free(_in);
+    _in = nullptr;
+    _inCap = 0;
+    malloc.free(_nackBuf);
+  }
+}
@@ -0,0 +1,184 @@
+// Sticker diagnostics snapshot, read from or pushed on the diagnostics
+// characteristic. Mirrors the EEG_DIAG_* sections in
+// firmware/common/eeg_packet.h.
+
+import 'dart:typed_data';
+
+class EegThreadDiag {
+  EegThreadDiag(this.name, this.cpuPermille, this.stackUsed, this.stackSize);
+  final String name;
+  final int cpuPermille;
+  final int stackUsed;  // high-water mark, bytes
+  final int stackSize;
+}
+
+class EegPoolDiag {
+  EegPoolDiag(this.id, this.used, this.peak, this.size, this.full);
+  static const uart = 1, log = 2, ctrl = 3, retx = 4;
+  final int id;
+  final int used;
+  final int peak;
+  final int size;
+  final int full;       // times an allocation found it full
+}
+
+class EegLinkDiag {
+  EegLinkDiag(this.intervalUs, this.latency, this.timeoutMs, this.mtu,
+      this.txPhy, this.rxPhy, this.txOctets);
+  final int intervalUs;
+  final int latency;
+  final int timeoutMs;
+  final int mtu;
+  final int txPhy;      // 0 when the sticker does not track it
+  final int rxPhy;
+  final int txOctets;
+}
+
+/// Pipeline stages timed by the sticker (EEG_LAT_* in eeg_packet.h).
+class EegLatencyStage {
+  static const drdySpi = 0, batch = 1, queue = 2, tx = 3, total = 4, feedback = 5;
+  static const names = ['drdy-spi', 'batch', 'queue', 'tx', 'total', 'feedback'];
+
+  /// Upper bound in us of log2 histogram bin [bin]; bin 0 is below 1 us.
+  static int binLimitUs(int bin) => 1 << bin;
+}
+
+class EegLatencyDiag {
+  EegLatencyDiag(this.stage, this.count, this.p50Bin, this.p90Bin, this.p99Bin, this.maxUs);
+  final int stage;
+  final int count;
+  final int p50Bin;     // see EegLatencyStage.binLimitUs
+  final int p90Bin;
+  final int p99Bin;
+  final int maxUs;
+
+  String get stageName => stage < EegLatencyStage.names.length ? EegLatencyStage.names[stage] : '?';
+
+  @override
+  String toString() => '$stageName n=$count '
+      'p50<${EegLatencyStage.binLimitUs(p50Bin)} p90<${EegLatencyStage.binLimitUs(p90Bin)} '
+      'p99<${EegLatencyStage.binLimitUs(p99Bin)} max=$maxUs us';
+}
+
+/// Result of the LATENCY command: one stage's full histogram.
+class EegLatencyHistogram {
+  EegLatencyHistogram.fromPayload(List<int> p)
+      : count = _u32(p, 0),
+        maxUs = _u32(p, 4),
+        bins = [
+          for (var o = 8; o + 2 <= p.length; o += 2) p[o] | (p[o + 1] << 8),
+        ];
+
+  final int count;
+  final int maxUs;
+  final List<int> bins; // saturate at 0xFFFF
+
+  static int _u32(List<int> p, int o) =>
+      o + 4 <= p.length ? p[o] | (p[o + 1] << 8) | (p[o + 2] << 16) | (p[o + 3] << 24) : 0;
+}
+
+class EegPowerDiag {
+  EegPowerDiag(this.activeAvgUs, this.activeMaxUs, this.spiPermille, this.modelUa);
+  final int activeAvgUs;  // CPU awake per sample
+  final int activeMaxUs;
+  final int spiPermille;  // SPIM resumed
+  final int modelUa;      // modelled MCU current, no radio or ADS1299
+}
+
+class EegDiagnostics {
+  static const _system = 0x01, _link = 0x02, _rates = 0x03, _pool = 0x04, _thread = 0x05,
+      _latency = 0x06, _power = 0x07;
+  static const states = ['idle', 'advertising', 'connected', 'streaming', 'draining'];
+
+  int uptimeS = 0;
+  int state = 0;
+  int cpuPermille = 0;
+  int drdyOverruns = 0;
+  int wakeups = 0;
+  EegLinkDiag? link;    // null while the sticker sees no connection
+  int framesPerS = 0;
+  int packetsPerS = 0;
+  int bytesPerS = 0;
+  int notifyFailed = 0;
+  int packetsSent = 0;
+  final pools = <EegPoolDiag>[];
+  final threads = <EegThreadDiag>[];
+  final latency = <EegLatencyDiag>[];
+  EegPowerDiag? power;  // null unless built with CONFIG_EEG_PM
+
+  String get stateName => state < states.length ? states[state] : '?';
+
+  /// Whether [raw] begins a new snapshot (pushed snapshots span notifications).
+  static bool startsSnapshot(List<int> raw) => raw.isNotEmpty && raw[0] == _system;
+
+  /// Add the sections in [raw]; unknown sections are skipped.
+  void parse(List<int> raw) {
+    final bytes = Uint8List.fromList(raw);
+    var pos = 0;
+    while (pos + 2 <= bytes.length) {
+      final id = bytes[pos], len = bytes[pos + 1];
+      if (pos + 2 + len > bytes.length) break;
+      final v = ByteData.sublistView(bytes, pos + 2, pos + 2 + len);
+      switch (id) {
+        case _system:
+          if (len < 15) break;
+          uptimeS = v.getUint32(0, Endian.little);
+          state = v.getUint8(4);
+          cpuPermille = v.getUint16(5, Endian.little);
+          drdyOverruns = v.getUint32(7, Endian.little);
+          wakeups = v.getUint32(11, Endian.little);
+          break;
+        case _link:
+          if (len < 12) break;
+          link = EegLinkDiag(
+              v.getUint16(0, Endian.little) * 1250,
+              v.getUint16(2, Endian.little),
+              v.getUint16(4, Endian.little) * 10,
+              v.getUint16(6, Endian.little),
+              v.getUint8(8),
+              v.getUint8(9),
+              v.getUint16(10, Endian.little));
+          break;
+        case _rates:
+          if (len < 16) break;
+          framesPerS = v.getUint16(0, Endian.little);
+          packetsPerS = v.getUint16(2, Endian.little);
+          bytesPerS = v.getUint32(4, Endian.little);
+          notifyFailed = v.getUint32(8, Endian.little);
+          packetsSent = v.getUint32(12, Endian.little);
+          break;
+        case _pool:
+          if (len < 11) break;
+          pools.add(EegPoolDiag(v.getUint8(0), v.getUint16(1, Endian.little),
+              v.getUint16(3, Endian.little), v.getUint16(5, Endian.little),
+              v.getUint32(7, Endian.little)));
+          break;
+        case _thread:
+          if (len < 6) break;
+          threads.add(EegThreadDiag(
+              String.fromCharCodes(bytes.sublist(pos + 8, pos + 2 + len)),
+              v.getUint16(0, Endian.little),
+              v.getUint16(2, Endian.little),
+              v.getUint16(4, Endian.little)));
+          break;
+        case _latency:
+          if (len < 12) break;
+          latency.add(EegLatencyDiag(v.getUint8(0), v.getUint32(1, Endian.little),
+              v.getUint8(5), v.getUint8(6), v.getUint8(7), v.getUint32(8, Endian.little)));
+          break;
+        case _power:
+          if (len < 10) break;
+          power = EegPowerDiag(v.getUint16(0, Endian.little), v.getUint16(2, Endian.little),
+              v.getUint16(4, Endian.little), v.getUint32(6, Endian.little));
+          break;
+      }
+      pos += 2 + len;
+    }
+  }
+
+  @override
+  String toString() =>
+      'up ${uptimeS}s $stateName cpu ${cpuPermille / 10}% '
+      '$framesPerS frames/s $packetsPerS pkt/s $bytesPerS B/s '
+      'refused $notifyFailed drdy overruns $drdyOverruns';
+}